@@ -0,0 +1,870 @@
+// HTTP load generator for the dispenser endpoints. Drives a device or the
+// host simulator with N client threads per run and reports per-route latency
+// percentiles and throughput, so changes to start_webserver() or the handlers
+// can be compared run to run.
+//
+//   ashumitra_bench [-H host] [-p port] [-s slots] [-d duration_ms] [-o prefix] scenario...
+//
+// Each scenario is run once for every combination of its client counts and
+// keep-alive settings. Results go to stdout as a table, and with -o also to
+// <prefix>.csv and <prefix>.json. "idle" counts clients that never got a
+// response, typically because they exceed the server's open session limit.
+// Gauges named in the scenario are read from /metrics before and after each
+// run (e.g. free heap for soak tests); they are printed and go to the JSON.
+// The exit status is 1 if a route marked "strict" saw anything but 2xx/304,
+// 2 on usage or scenario errors.
+//
+// Scenario files are "key = value" lines ('#' starts a comment):
+//   name        = reads                 label used in the results
+//   duration_ms = 5000                  measured window per run
+//   requests    = 0                     also end the run after this many requests
+//   warmup_ms   = 500                   traffic before measuring starts
+//   settle_ms   = 0                     pause after setup (let motion finish)
+//   clients     = 1,2,4,8,16            concurrent connections, one thread each
+//   keepalive   = on,off                reuse connections, or one per request
+//   request     = <weight> <METHOD> <path> [body]      client traffic mix
+//   background  = <interval_ms> <METHOD> <path> [body] one extra paced client
+//   setup       = <METHOD> <path> [body]                sent before each run
+//   strict      = <METHOD> <path>       fail if this route returns non-2xx/304
+//   conditional = <path>                GETs replay the last ETag seen
+//   gauge       = <metric>              /metrics value to compare before/after
+// In paths and bodies, {slot} becomes a random slot; in setup lines {each}
+// repeats the line once per slot.
+
+#define _GNU_SOURCE // memmem
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_REQS        16
+#define MAX_BACKGROUND  4
+#define MAX_SETUP       16
+#define MAX_ROUTES      24
+#define MAX_CLIENTS     64
+#define MAX_CLIENT_SETS 16
+#define MAX_CONDITIONAL 4
+#define MAX_ETAG        64
+#define MAX_GAUGES      4
+#define RX_BUF_SIZE     16384
+
+typedef struct {
+    char method[8];
+    char path[256];
+    char body[512];
+    int weight;      // request lines
+    int interval_ms; // background lines
+    int route;
+} bench_req_t;
+
+typedef struct {
+    char label[96]; // "GET /add_dose", background routes are prefixed "bg "
+    bool strict;
+    bool background;
+} bench_route_t;
+
+typedef struct {
+    char name[64];
+    int duration_ms;
+    long max_requests; // 0: no limit
+    int warmup_ms;
+    int settle_ms;
+    int clients[MAX_CLIENT_SETS];
+    int client_sets;
+    bool keepalive[2];
+    int keepalive_sets;
+    bench_req_t reqs[MAX_REQS];
+    int req_count;
+    int total_weight;
+    bench_req_t background[MAX_BACKGROUND];
+    int background_count;
+    bench_req_t setup[MAX_SETUP];
+    int setup_count;
+    char strict[MAX_ROUTES][96];
+    int strict_count;
+    char conditional[MAX_CONDITIONAL][256];
+    int conditional_count;
+    char gauges[MAX_GAUGES][96];
+    int gauge_count;
+    bench_route_t routes[MAX_ROUTES];
+    int route_count;
+} scenario_t;
+
+// Per-thread, per-route results
+typedef struct {
+    uint32_t *lat_us;
+    size_t count;
+    size_t cap;
+    uint32_t ok;       // 2xx and 304
+    uint32_t http_4xx;
+    uint32_t http_5xx;
+    uint32_t errors;   // Connect, send, receive or parse failures
+} route_stats_t;
+
+typedef struct {
+    int fd;
+    size_t rx_len;
+    char rx[RX_BUF_SIZE];
+    char etag[MAX_ETAG];
+} conn_t;
+
+typedef struct {
+    const scenario_t *sc;
+    const bench_req_t *fixed; // Background client: always this request
+    bool keepalive;
+    unsigned seed;
+    uint32_t completed; // Requests finished inside the measured window
+    route_stats_t stats[MAX_ROUTES];
+    conn_t conn;
+    pthread_t thread;
+} client_t;
+
+static const char *s_host = "127.0.0.1";
+static int s_port = 8080;
+static int s_slots = 11;
+static struct addrinfo *s_addr = NULL;
+static atomic_bool s_stop;
+static atomic_bool s_recording;
+static atomic_long s_recorded; // Requests recorded in the current run
+
+// --- Utilities ---
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static char *trim(char *s)
+{
+    while (*s == ' ' || *s == '\t') s++;
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) end--;
+    *end = '\0';
+    return s;
+}
+
+// Expands {slot} (random slot) and {each} (the given slot) into out
+static void expand(const char *in, char *out, size_t size, unsigned *seed, int each)
+{
+    size_t o = 0;
+    while (*in && o + 1 < size) {
+        if (strncmp(in, "{slot}", 6) == 0) {
+            o += snprintf(out + o, size - o, "%d", (int)(rand_r(seed) % s_slots));
+            in += 6;
+        } else if (strncmp(in, "{each}", 6) == 0) {
+            o += snprintf(out + o, size - o, "%d", each);
+            in += 6;
+        } else {
+            out[o++] = *in++;
+        }
+        if (o >= size) o = size - 1;
+    }
+    out[o] = '\0';
+}
+
+// --- Scenario Parsing ---
+static int route_index(scenario_t *sc, const char *method, const char *path, bool background)
+{
+    char label[96];
+    int path_len = (int)strcspn(path, "?");
+    snprintf(label, sizeof(label), "%s%s %.*s", background ? "bg " : "", method, path_len, path);
+    for (int i = 0; i < sc->route_count; i++) {
+        if (strcmp(sc->routes[i].label, label) == 0) return i;
+    }
+    if (sc->route_count >= MAX_ROUTES) return -1;
+    bench_route_t *r = &sc->routes[sc->route_count];
+    snprintf(r->label, sizeof(r->label), "%s", label);
+    r->background = background;
+    return sc->route_count++;
+}
+
+// Parses "[number] METHOD path [body]" into req
+static bool parse_req(char *value, bench_req_t *req, bool numbered)
+{
+    char *save = NULL;
+    if (numbered) {
+        char *num = strtok_r(value, " \t", &save);
+        if (!num) return false;
+        req->weight = req->interval_ms = atoi(num);
+        value = NULL;
+    }
+    char *method = strtok_r(value, " \t", &save);
+    char *path = strtok_r(NULL, " \t", &save);
+    char *body = strtok_r(NULL, "", &save);
+    if (!method || !path || path[0] != '/') return false;
+    snprintf(req->method, sizeof(req->method), "%s", method);
+    snprintf(req->path, sizeof(req->path), "%s", path);
+    snprintf(req->body, sizeof(req->body), "%s", body ? trim(body) : "");
+    return !numbered || req->weight > 0;
+}
+
+static bool load_scenario(const char *file, scenario_t *sc)
+{
+    FILE *f = fopen(file, "r");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", file, strerror(errno));
+        return false;
+    }
+
+    memset(sc, 0, sizeof(*sc));
+    const char *base = strrchr(file, '/');
+    snprintf(sc->name, sizeof(sc->name), "%s", base ? base + 1 : file);
+    sc->duration_ms = 5000;
+    sc->warmup_ms = 500;
+
+    char line[1024];
+    int lineno = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash && (hash == line || hash[-1] == ' ' || hash[-1] == '\t')) *hash = '\0';
+        char *eq = strchr(line, '=');
+        char *key = trim(line);
+        if (*key == '\0') continue;
+        if (!eq) {
+            ok = false;
+            break;
+        }
+        *eq = '\0';
+        key = trim(key);
+        char *value = trim(eq + 1);
+
+        if (strcmp(key, "name") == 0) {
+            snprintf(sc->name, sizeof(sc->name), "%s", value);
+        } else if (strcmp(key, "duration_ms") == 0) {
+            sc->duration_ms = atoi(value);
+        } else if (strcmp(key, "requests") == 0) {
+            sc->max_requests = atol(value);
+        } else if (strcmp(key, "warmup_ms") == 0) {
+            sc->warmup_ms = atoi(value);
+        } else if (strcmp(key, "settle_ms") == 0) {
+            sc->settle_ms = atoi(value);
+        } else if (strcmp(key, "clients") == 0) {
+            for (char *save = NULL, *tok = strtok_r(value, ", ", &save); tok; tok = strtok_r(NULL, ", ", &save)) {
+                int n = atoi(tok);
+                if (n < 1 || n > MAX_CLIENTS || sc->client_sets >= MAX_CLIENT_SETS) ok = false;
+                else sc->clients[sc->client_sets++] = n;
+            }
+        } else if (strcmp(key, "keepalive") == 0) {
+            for (char *save = NULL, *tok = strtok_r(value, ", ", &save); tok; tok = strtok_r(NULL, ", ", &save)) {
+                if (sc->keepalive_sets >= 2 || (strcmp(tok, "on") != 0 && strcmp(tok, "off") != 0)) ok = false;
+                else sc->keepalive[sc->keepalive_sets++] = strcmp(tok, "on") == 0;
+            }
+        } else if (strcmp(key, "request") == 0 && sc->req_count < MAX_REQS) {
+            bench_req_t *req = &sc->reqs[sc->req_count];
+            ok = parse_req(value, req, true) && (req->route = route_index(sc, req->method, req->path, false)) >= 0;
+            sc->total_weight += req->weight;
+            sc->req_count++;
+        } else if (strcmp(key, "background") == 0 && sc->background_count < MAX_BACKGROUND) {
+            bench_req_t *req = &sc->background[sc->background_count];
+            ok = parse_req(value, req, true) && (req->route = route_index(sc, req->method, req->path, true)) >= 0;
+            sc->background_count++;
+        } else if (strcmp(key, "setup") == 0 && sc->setup_count < MAX_SETUP) {
+            ok = parse_req(value, &sc->setup[sc->setup_count++], false);
+        } else if (strcmp(key, "strict") == 0 && sc->strict_count < MAX_ROUTES) {
+            snprintf(sc->strict[sc->strict_count++], sizeof(sc->strict[0]), "%s", value);
+        } else if (strcmp(key, "conditional") == 0 && sc->conditional_count < MAX_CONDITIONAL) {
+            snprintf(sc->conditional[sc->conditional_count++], sizeof(sc->conditional[0]), "%s", value);
+        } else if (strcmp(key, "gauge") == 0 && sc->gauge_count < MAX_GAUGES) {
+            snprintf(sc->gauges[sc->gauge_count++], sizeof(sc->gauges[0]), "%s", value);
+        } else {
+            ok = false;
+        }
+    }
+    fclose(f);
+
+    if (!ok) {
+        fprintf(stderr, "%s:%d: invalid or unsupported line\n", file, lineno);
+        return false;
+    }
+    if (sc->req_count == 0) {
+        fprintf(stderr, "%s: no request lines\n", file);
+        return false;
+    }
+    if (sc->client_sets == 0) sc->clients[sc->client_sets++] = 1;
+    if (sc->keepalive_sets == 0) sc->keepalive[sc->keepalive_sets++] = true;
+    for (int i = 0; i < sc->strict_count; i++) {
+        for (int r = 0; r < sc->route_count; r++) {
+            if (strcmp(sc->routes[r].label, sc->strict[i]) == 0) sc->routes[r].strict = true;
+        }
+    }
+    return true;
+}
+
+// --- HTTP Client ---
+static void conn_close(conn_t *c)
+{
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    c->rx_len = 0;
+}
+
+static bool conn_open(conn_t *c)
+{
+    c->fd = socket(s_addr->ai_family, SOCK_STREAM, 0);
+    if (c->fd < 0) return false;
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval tv = { .tv_sec = 10 };
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(c->fd, s_addr->ai_addr, s_addr->ai_addrlen) != 0) {
+        conn_close(c);
+        return false;
+    }
+    return true;
+}
+
+// Reads more bytes into the receive buffer. Returns false on EOF or error.
+static bool conn_fill(conn_t *c)
+{
+    if (c->rx_len >= sizeof(c->rx)) return false;
+    ssize_t n = recv(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len, 0);
+    if (n <= 0) return false;
+    c->rx_len += n;
+    return true;
+}
+
+static void conn_consume(conn_t *c, size_t n)
+{
+    memmove(c->rx, c->rx + n, c->rx_len - n);
+    c->rx_len -= n;
+}
+
+static const char *find_hdr(const char *head, const char *field, size_t *len)
+{
+    size_t field_len = strlen(field);
+    for (const char *line = strstr(head, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, field, field_len) == 0 && line[field_len] == ':') {
+            const char *v = line + field_len + 1;
+            while (*v == ' ') v++;
+            *len = strcspn(v, "\r\n");
+            return v;
+        }
+    }
+    return NULL;
+}
+
+// Discards a chunked body. Returns false on a malformed or truncated body.
+static bool read_chunked(conn_t *c)
+{
+    for (;;) {
+        char *eol;
+        while (!(eol = memmem(c->rx, c->rx_len, "\r\n", 2))) {
+            if (!conn_fill(c)) return false;
+        }
+        size_t size = strtoul(c->rx, NULL, 16);
+        conn_consume(c, eol - c->rx + 2);
+        for (size_t left = size + 2; left > 0;) { // Data plus its CRLF
+            if (c->rx_len == 0 && !conn_fill(c)) return false;
+            size_t n = c->rx_len < left ? c->rx_len : left;
+            conn_consume(c, n);
+            left -= n;
+        }
+        if (size == 0) return true;
+    }
+}
+
+// Sends one request and reads the full response. Returns the HTTP status or
+// -1 on a transport error. Reconnects once if a reused connection was closed.
+static int http_request(conn_t *c, const char *method, const char *path, const char *body, bool keepalive, bool conditional)
+{
+    char req[2048];
+    size_t body_len = strlen(body);
+    int len = snprintf(req, sizeof(req), "%s %s HTTP/1.1\r\nHost: %s\r\n%s", method, path, s_host,
+                       keepalive ? "" : "Connection: close\r\n");
+    if (conditional && c->etag[0]) len += snprintf(req + len, sizeof(req) - len, "If-None-Match: %s\r\n", c->etag);
+    if (body_len) len += snprintf(req + len, sizeof(req) - len, "Content-Type: application/json\r\nContent-Length: %zu\r\n", body_len);
+    len += snprintf(req + len, sizeof(req) - len, "\r\n%s", body);
+    if (len >= (int)sizeof(req)) return -1;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = c->fd >= 0;
+        if (!reused && !conn_open(c)) return -1;
+        if (send(c->fd, req, len, MSG_NOSIGNAL) != len) {
+            conn_close(c);
+            if (reused) continue;
+            return -1;
+        }
+
+        char *end;
+        bool dropped = false;
+        while (!(end = memmem(c->rx, c->rx_len, "\r\n\r\n", 4))) {
+            if (!conn_fill(c)) {
+                dropped = reused && c->rx_len == 0; // Server closed the idle connection
+                conn_close(c);
+                break;
+            }
+        }
+        if (!end) {
+            if (dropped) continue;
+            return -1;
+        }
+        *end = '\0';
+        int status = 0;
+        if (sscanf(c->rx, "HTTP/1.%*d %d", &status) != 1) {
+            conn_close(c);
+            return -1;
+        }
+
+        size_t vlen;
+        const char *v;
+        bool chunked = (v = find_hdr(c->rx, "Transfer-Encoding", &vlen)) && strncasecmp(v, "chunked", 7) == 0;
+        bool server_close = (v = find_hdr(c->rx, "Connection", &vlen)) && strncasecmp(v, "close", 5) == 0;
+        size_t content_len = (v = find_hdr(c->rx, "Content-Length", &vlen)) ? strtoul(v, NULL, 10) : 0;
+        if (conditional && (v = find_hdr(c->rx, "ETag", &vlen)) && vlen < MAX_ETAG) {
+            memcpy(c->etag, v, vlen);
+            c->etag[vlen] = '\0';
+        }
+        conn_consume(c, end - c->rx + 4);
+
+        bool body_ok;
+        if (chunked) {
+            body_ok = read_chunked(c);
+        } else {
+            body_ok = true;
+            while (content_len > 0) {
+                if (c->rx_len == 0 && !conn_fill(c)) {
+                    body_ok = false;
+                    break;
+                }
+                size_t n = c->rx_len < content_len ? c->rx_len : content_len;
+                conn_consume(c, n);
+                content_len -= n;
+            }
+        }
+        if (!body_ok) {
+            conn_close(c);
+            return -1;
+        }
+        if (!keepalive || server_close) conn_close(c);
+        return status;
+    }
+    return -1;
+}
+
+// --- Gauges ---
+// Fetches /metrics on a fresh connection and reads each named gauge; values
+// that are missing come back as NAN.
+static void read_gauges(const scenario_t *sc, double *values)
+{
+    for (int g = 0; g < sc->gauge_count; g++) values[g] = NAN;
+    if (sc->gauge_count == 0) return;
+
+    conn_t *c = calloc(1, sizeof(conn_t));
+    size_t cap = 65536, len = 0;
+    char *resp = malloc(cap);
+    char req[256];
+    int req_len = snprintf(req, sizeof(req), "GET /metrics HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", s_host);
+    if (conn_open(c) && send(c->fd, req, req_len, MSG_NOSIGNAL) == req_len) {
+        // Read until the server closes, then undo the chunked framing if any
+        ssize_t n;
+        while ((n = recv(c->fd, resp + len, cap - len - 1, 0)) > 0) {
+            len += n;
+            if (len == cap - 1) resp = realloc(resp, cap *= 2);
+        }
+    }
+    conn_close(c);
+    free(c);
+    resp[len] = '\0';
+
+    char *body = strstr(resp, "\r\n\r\n");
+    if (body) {
+        *body = '\0';
+        size_t vlen;
+        const char *v = find_hdr(resp, "Transfer-Encoding", &vlen);
+        body += 4;
+        if (v && strncasecmp(v, "chunked", 7) == 0) {
+            char *in = body, *out = body;
+            size_t size;
+            while ((size = strtoul(in, &in, 16)) > 0 && (in = strstr(in, "\r\n"))) {
+                memmove(out, in + 2, size);
+                out += size;
+                in += 2 + size + 2;
+            }
+            *out = '\0';
+        }
+        for (int g = 0; g < sc->gauge_count; g++) {
+            size_t name_len = strlen(sc->gauges[g]);
+            for (const char *line = body; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : NULL) {
+                if (strncmp(line, sc->gauges[g], name_len) == 0 && line[name_len] == ' ') {
+                    values[g] = strtod(line + name_len + 1, NULL);
+                    break;
+                }
+            }
+        }
+    }
+    free(resp);
+}
+
+// --- Clients ---
+static void record(route_stats_t *st, int status, uint32_t lat_us)
+{
+    if (status < 0) st->errors++;
+    else if ((status >= 200 && status < 300) || status == 304) st->ok++;
+    else if (status >= 400 && status < 500) st->http_4xx++;
+    else st->http_5xx++;
+
+    if (st->count == st->cap) {
+        st->cap = st->cap ? st->cap * 2 : 4096;
+        st->lat_us = realloc(st->lat_us, st->cap * sizeof(uint32_t));
+    }
+    st->lat_us[st->count++] = lat_us;
+}
+
+static bool is_conditional(const scenario_t *sc, const bench_req_t *req)
+{
+    if (strcmp(req->method, "GET") != 0) return false;
+    for (int i = 0; i < sc->conditional_count; i++) {
+        if (strncmp(req->path, sc->conditional[i], strlen(sc->conditional[i])) == 0) return true;
+    }
+    return false;
+}
+
+static void *client_thread(void *arg)
+{
+    client_t *cl = arg;
+    const scenario_t *sc = cl->sc;
+    char path[256];
+    char body[512];
+
+    while (!atomic_load(&s_stop)) {
+        const bench_req_t *req = cl->fixed;
+        if (!req) {
+            int pick = rand_r(&cl->seed) % sc->total_weight;
+            for (int i = 0; i < sc->req_count; i++) {
+                pick -= sc->reqs[i].weight;
+                if (pick < 0) {
+                    req = &sc->reqs[i];
+                    break;
+                }
+            }
+        }
+        expand(req->path, path, sizeof(path), &cl->seed, 0);
+        expand(req->body, body, sizeof(body), &cl->seed, 0);
+
+        bool recording = atomic_load(&s_recording);
+        uint64_t t0 = now_us();
+        int status = http_request(&cl->conn, req->method, path, body, cl->keepalive, is_conditional(sc, req));
+        uint64_t t1 = now_us();
+        // Only requests that both started and finished inside the window count
+        if (recording && atomic_load(&s_recording)) {
+            record(&cl->stats[req->route], status, (uint32_t)(t1 - t0));
+            cl->completed++;
+            atomic_fetch_add(&s_recorded, 1);
+        }
+
+        if (cl->fixed) {
+            int wait_ms = req->interval_ms - (int)((t1 - t0) / 1000);
+            if (wait_ms > 0) sleep_ms(wait_ms);
+        }
+    }
+    conn_close(&cl->conn);
+    return NULL;
+}
+
+static void run_setup(const scenario_t *sc)
+{
+    conn_t conn = { .fd = -1 };
+    unsigned seed = 1;
+    char path[256];
+    char body[512];
+
+    for (int i = 0; i < sc->setup_count; i++) {
+        const bench_req_t *req = &sc->setup[i];
+        bool each = strstr(req->path, "{each}") || strstr(req->body, "{each}");
+        for (int slot = 0; slot < (each ? s_slots : 1); slot++) {
+            expand(req->path, path, sizeof(path), &seed, slot);
+            expand(req->body, body, sizeof(body), &seed, slot);
+            int status = http_request(&conn, req->method, path, body, true, false);
+            if (status < 200 || status >= 300) {
+                fprintf(stderr, "setup: %s %s -> %d\n", req->method, path, status);
+            }
+        }
+    }
+    conn_close(&conn);
+    if (sc->settle_ms > 0) sleep_ms(sc->settle_ms);
+}
+
+// --- Results ---
+typedef struct {
+    char scenario[64];
+    int clients;
+    bool keepalive;
+    int idle_clients; // Clients that never got a response, e.g. beyond the server's session limit
+    int duration_ms;
+    char route[96];
+    bool strict;
+    size_t count;
+    double rps;
+    double mean_ms, p50_ms, p90_ms, p99_ms, max_ms;
+    uint32_t ok, http_4xx, http_5xx, errors;
+} result_t;
+
+static result_t *s_results = NULL;
+static size_t s_result_count = 0;
+
+typedef struct {
+    char scenario[64];
+    int clients;
+    bool keepalive;
+    char name[96];
+    double before, after;
+} gauge_result_t;
+
+static gauge_result_t *s_gauges = NULL;
+static size_t s_gauge_count = 0;
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_ms(const uint32_t *sorted, size_t n, double p)
+{
+    if (n == 0) return 0;
+    size_t rank = (size_t)ceil(p / 100.0 * n);
+    return sorted[rank ? rank - 1 : 0] / 1000.0;
+}
+
+static void add_result(const scenario_t *sc, int clients, bool keepalive, int idle_clients, uint64_t window_us,
+                       const char *route, bool strict, const route_stats_t *st)
+{
+    result_t r = { .clients = clients, .keepalive = keepalive, .idle_clients = idle_clients,
+                   .duration_ms = (int)(window_us / 1000), .strict = strict,
+                   .count = st->count, .ok = st->ok, .http_4xx = st->http_4xx, .http_5xx = st->http_5xx,
+                   .errors = st->errors };
+    snprintf(r.scenario, sizeof(r.scenario), "%s", sc->name);
+    snprintf(r.route, sizeof(r.route), "%s", route);
+    r.rps = window_us ? st->count * 1e6 / window_us : 0;
+    if (st->count > 0) {
+        qsort(st->lat_us, st->count, sizeof(uint32_t), cmp_u32);
+        double sum = 0;
+        for (size_t i = 0; i < st->count; i++) sum += st->lat_us[i];
+        r.mean_ms = sum / st->count / 1000.0;
+        r.p50_ms = percentile_ms(st->lat_us, st->count, 50);
+        r.p90_ms = percentile_ms(st->lat_us, st->count, 90);
+        r.p99_ms = percentile_ms(st->lat_us, st->count, 99);
+        r.max_ms = st->lat_us[st->count - 1] / 1000.0;
+    }
+    s_results = realloc(s_results, (s_result_count + 1) * sizeof(result_t));
+    s_results[s_result_count++] = r;
+
+    printf("%-16s %3d %-4s %4d %-24s %8zu %9.1f %8.2f %8.2f %8.2f %8.2f %6u %5u %5u %5u%s\n",
+           r.scenario, r.clients, r.keepalive ? "on" : "off", r.idle_clients, r.route, r.count, r.rps, r.p50_ms, r.p90_ms,
+           r.p99_ms, r.max_ms, r.ok, r.http_4xx, r.http_5xx, r.errors,
+           strict && (r.http_4xx || r.http_5xx || r.errors) ? "  FAIL" : "");
+}
+
+static void merge_stats(route_stats_t *into, const route_stats_t *from)
+{
+    if (into->count + from->count > into->cap) {
+        into->cap = into->count + from->count;
+        into->lat_us = realloc(into->lat_us, into->cap * sizeof(uint32_t));
+    }
+    if (from->count) memcpy(into->lat_us + into->count, from->lat_us, from->count * sizeof(uint32_t));
+    into->count += from->count;
+    into->ok += from->ok;
+    into->http_4xx += from->http_4xx;
+    into->http_5xx += from->http_5xx;
+    into->errors += from->errors;
+}
+
+// Runs one scenario at one client count and keep-alive setting.
+// Returns false if a strict route failed.
+static bool run_once(const scenario_t *sc, int clients, bool keepalive)
+{
+    run_setup(sc);
+    double before[MAX_GAUGES];
+    read_gauges(sc, before);
+
+    int total = clients + sc->background_count;
+    client_t *cl = calloc(total, sizeof(client_t));
+    atomic_store(&s_stop, false);
+    atomic_store(&s_recording, false);
+    for (int i = 0; i < total; i++) {
+        cl[i].sc = sc;
+        cl[i].fixed = i < clients ? NULL : &sc->background[i - clients];
+        cl[i].keepalive = keepalive;
+        cl[i].seed = 0x9e3779b9u * (i + 1) ^ (unsigned)now_us();
+        cl[i].conn.fd = -1;
+        pthread_create(&cl[i].thread, NULL, client_thread, &cl[i]);
+    }
+
+    sleep_ms(sc->warmup_ms);
+    atomic_store(&s_recorded, 0);
+    atomic_store(&s_recording, true);
+    uint64_t deadline = now_us() + (uint64_t)sc->duration_ms * 1000;
+    while (now_us() < deadline && (sc->max_requests <= 0 || atomic_load(&s_recorded) < sc->max_requests)) {
+        sleep_ms(10);
+    }
+    atomic_store(&s_recording, false);
+    uint64_t window_us = now_us() - (deadline - (uint64_t)sc->duration_ms * 1000);
+    atomic_store(&s_stop, true);
+    for (int i = 0; i < total; i++) pthread_join(cl[i].thread, NULL);
+
+    int idle = 0;
+    for (int i = 0; i < total; i++) {
+        if (cl[i].completed == 0) idle++;
+    }
+
+    bool passed = true;
+    route_stats_t all = { 0 };
+    for (int r = 0; r < sc->route_count; r++) {
+        route_stats_t merged = { 0 };
+        for (int i = 0; i < total; i++) merge_stats(&merged, &cl[i].stats[r]);
+        if (!sc->routes[r].background) merge_stats(&all, &merged);
+        add_result(sc, clients, keepalive, idle, window_us, sc->routes[r].label, sc->routes[r].strict, &merged);
+        if (sc->routes[r].strict && (merged.http_4xx || merged.http_5xx || merged.errors)) passed = false;
+        free(merged.lat_us);
+    }
+    add_result(sc, clients, keepalive, idle, window_us, "*", false, &all);
+    free(all.lat_us);
+
+    double after[MAX_GAUGES];
+    read_gauges(sc, after);
+    for (int g = 0; g < sc->gauge_count; g++) {
+        gauge_result_t gr = { .clients = clients, .keepalive = keepalive, .before = before[g], .after = after[g] };
+        snprintf(gr.scenario, sizeof(gr.scenario), "%s", sc->name);
+        snprintf(gr.name, sizeof(gr.name), "%s", sc->gauges[g]);
+        s_gauges = realloc(s_gauges, (s_gauge_count + 1) * sizeof(gauge_result_t));
+        s_gauges[s_gauge_count++] = gr;
+        printf("%-16s %3d %-4s      gauge %s: %.0f -> %.0f (%+.0f)\n", sc->name, clients, keepalive ? "on" : "off",
+               gr.name, gr.before, gr.after, gr.after - gr.before);
+    }
+
+    for (int i = 0; i < total; i++) {
+        for (int r = 0; r < sc->route_count; r++) free(cl[i].stats[r].lat_us);
+    }
+    free(cl);
+    return passed;
+}
+
+static bool write_csv(const char *file)
+{
+    FILE *f = fopen(file, "w");
+    if (!f) return false;
+    fprintf(f, "scenario,clients,keepalive,idle_clients,route,duration_ms,count,rps,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,ok,http_4xx,http_5xx,errors\n");
+    for (size_t i = 0; i < s_result_count; i++) {
+        const result_t *r = &s_results[i];
+        fprintf(f, "%s,%d,%s,%d,%s,%d,%zu,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%u,%u,%u,%u\n",
+                r->scenario, r->clients, r->keepalive ? "on" : "off", r->idle_clients, r->route, r->duration_ms, r->count, r->rps,
+                r->mean_ms, r->p50_ms, r->p90_ms, r->p99_ms, r->max_ms, r->ok, r->http_4xx, r->http_5xx, r->errors);
+    }
+    return fclose(f) == 0;
+}
+
+static bool write_json(const char *file)
+{
+    FILE *f = fopen(file, "w");
+    if (!f) return false;
+    fprintf(f, "{\"target\":\"%s:%d\",\"started\":%ld,\"results\":[", s_host, s_port, (long)time(NULL));
+    for (size_t i = 0; i < s_result_count; i++) {
+        const result_t *r = &s_results[i];
+        fprintf(f, "%s\n{\"scenario\":\"%s\",\"clients\":%d,\"keepalive\":%s,\"idle_clients\":%d,\"route\":\"%s\",\"strict\":%s,"
+                   "\"duration_ms\":%d,\"count\":%zu,\"rps\":%.2f,\"mean_ms\":%.3f,\"p50_ms\":%.3f,\"p90_ms\":%.3f,"
+                   "\"p99_ms\":%.3f,\"max_ms\":%.3f,\"ok\":%u,\"http_4xx\":%u,\"http_5xx\":%u,\"errors\":%u}",
+                i ? "," : "", r->scenario, r->clients, r->keepalive ? "true" : "false", r->idle_clients,
+                r->route, r->strict ? "true" : "false", r->duration_ms, r->count, r->rps, r->mean_ms, r->p50_ms, r->p90_ms,
+                r->p99_ms, r->max_ms, r->ok, r->http_4xx, r->http_5xx, r->errors);
+    }
+    fprintf(f, "\n],\"gauges\":[");
+    for (size_t i = 0; i < s_gauge_count; i++) {
+        const gauge_result_t *g = &s_gauges[i];
+        char before[32] = "null", after[32] = "null"; // Gauge missing from /metrics
+        if (!isnan(g->before)) snprintf(before, sizeof(before), "%.0f", g->before);
+        if (!isnan(g->after)) snprintf(after, sizeof(after), "%.0f", g->after);
+        fprintf(f, "%s\n{\"scenario\":\"%s\",\"clients\":%d,\"keepalive\":%s,\"name\":\"%s\",\"before\":%s,\"after\":%s}",
+                i ? "," : "", g->scenario, g->clients, g->keepalive ? "true" : "false", g->name, before, after);
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ashumitra_bench [-H host] [-p port] [-s slots] [-d duration_ms] [-o prefix] scenario...\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = NULL;
+    int duration_override = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:s:d:o:")) != -1) {
+        switch (opt) {
+            case 'H': s_host = optarg; break;
+            case 'p': s_port = atoi(optarg); break;
+            case 's': s_slots = atoi(optarg); break;
+            case 'd': duration_override = atoi(optarg); break;
+            case 'o': out = optarg; break;
+            default: usage(); return 2;
+        }
+    }
+    if (optind >= argc || s_slots < 1) {
+        usage();
+        return 2;
+    }
+
+    char port[8];
+    snprintf(port, sizeof(port), "%d", s_port);
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    int gai = getaddrinfo(s_host, port, &hints, &s_addr);
+    if (gai != 0) {
+        fprintf(stderr, "%s: %s\n", s_host, gai_strerror(gai));
+        return 2;
+    }
+
+    printf("%-16s %3s %-4s %4s %-24s %8s %9s %8s %8s %8s %8s %6s %5s %5s %5s\n", "scenario", "cli", "ka", "idle", "route",
+           "count", "rps", "p50_ms", "p90_ms", "p99_ms", "max_ms", "ok", "4xx", "5xx", "err");
+    bool passed = true;
+    for (int i = optind; i < argc; i++) {
+        scenario_t *sc = malloc(sizeof(scenario_t));
+        if (!load_scenario(argv[i], sc)) {
+            free(sc);
+            return 2;
+        }
+        if (duration_override > 0) sc->duration_ms = duration_override;
+        for (int k = 0; k < sc->keepalive_sets; k++) {
+            for (int c = 0; c < sc->client_sets; c++) {
+                passed &= run_once(sc, sc->clients[c], sc->keepalive[k]);
+                fflush(stdout);
+            }
+        }
+        free(sc);
+    }
+
+    if (out) {
+        char file[512];
+        snprintf(file, sizeof(file), "%s.csv", out);
+        if (!write_csv(file)) fprintf(stderr, "cannot write %s\n", file);
+        snprintf(file, sizeof(file), "%s.json", out);
+        if (!write_json(file)) fprintf(stderr, "cannot write %s\n", file);
+    }
+    freeaddrinfo(s_addr);
+    if (!passed) fprintf(stderr, "FAIL: a strict route returned non-2xx/304 responses\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,938 @@
+// Fleet aggregator: polls many dispensers from one epoll loop and serves the
+// merged view, so a facility dashboard asks one endpoint instead of walking
+// every unit in turn.
+//
+//   ashumitra_fleet [-l port] [-i min_ms] [-I max_ms] [-O offline_ms] [-t timeout_ms]
+//                   [-c max_inflight] [-b seconds] [-f file] host:port[-last_port]...
+//
+// Each unit is polled with GET /get_filled_doses?format=mask and the last
+// ETag, over one kept-alive connection per unit, so an unchanged unit costs a
+// 304 and no new TCP handshake. A poll has -t ms to connect and answer; a
+// unit that misses it is marked offline after two failures in a row and then
+// retried with a doubling delay up to -O ms, so dead units cost little and
+// never hold up the others.
+//
+// Poll intervals adapt per unit: a change brings the unit back to -i ms, each
+// unchanged answer stretches its interval by half, up to -I ms. Intervals are
+// jittered by up to 10% so the polls do not bunch up.
+//
+// The merged view is served on -l (default 9090):
+//   GET /fleet           {"seq":42,"devices":300,"online":297,"units":[{"addr":...,"online":true,
+//                         "epoch":"1a2b3c4d","gen":5,"mask":37,"age_ms":800,"interval_ms":1500,"rtt_ms":0.4},...]}
+//   GET /fleet?since=N   only the units that changed after view sequence N
+//   GET /stats           poll counters and round-trip percentiles
+// /fleet carries the view sequence as its ETag and answers If-None-Match
+// with 304, so dashboards can poll it cheaply as well.
+//
+// With -b the tool runs for that many seconds, prints a summary (time until
+// every unit was first answered or given up on, polls per second, connection
+// reuse and round-trip percentiles) and exits. fleet_sims.sh starts a fleet
+// of simulators to run it against.
+
+#define _GNU_SOURCE // memmem, accept4
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_DEVICES      4096
+#define MAX_VIEW_CONNS   64
+#define DEV_TX_SIZE      256
+#define DEV_RX_SIZE      1024
+#define VIEW_RX_SIZE     2048
+#define MAX_ETAG         48
+#define OFFLINE_AFTER    2      // Failed polls in a row before a unit is shown offline
+#define RTT_BUCKET_US    100    // Round-trip histogram resolution
+#define RTT_BUCKETS      100000 // Up to 10 s
+#define STATUS_EVERY_MS  10000
+
+// epoll_event.data.u64: kind in the high half, index in the low half
+#define SRC_DEVICE   1ULL
+#define SRC_LISTEN   2ULL
+#define SRC_VIEW     3ULL
+#define SRC(kind, i) (((kind) << 32) | (uint32_t)(i))
+
+typedef enum {
+    PHASE_IDLE = 0,   // Waiting for the next poll; the connection may be kept open
+    PHASE_CONNECTING,
+    PHASE_SENDING,
+    PHASE_RECEIVING,
+} poll_phase_t;
+
+typedef struct {
+    char addr_str[64];
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+
+    // Poll in flight
+    int fd;                 // -1 when not connected
+    poll_phase_t phase;
+    bool reused;            // This poll went out on a kept-alive connection
+    char tx[DEV_TX_SIZE];
+    size_t tx_len;
+    size_t tx_off;
+    char rx[DEV_RX_SIZE];
+    size_t rx_len;
+    uint64_t start_us;
+
+    // Scheduling
+    uint64_t due_ms;        // Next poll, or the deadline of the poll in flight
+    int heap_pos;           // -1 when not in the heap
+    uint32_t interval_ms;
+    uint32_t fails;         // Failed polls in a row
+
+    // View
+    bool answered;          // Has answered at least once
+    bool online;
+    bool settled;           // Answered or given up on at least once (for the sweep time)
+    char etag[MAX_ETAG];
+    uint32_t epoch;
+    uint32_t gen;
+    uint32_t mask;
+    uint64_t last_ok_ms;
+    uint64_t view_seq;      // View sequence of the last change to this unit
+    uint32_t rtt_us;
+} device_t;
+
+typedef struct {
+    int fd;                 // -1 when free
+    char rx[VIEW_RX_SIZE];
+    size_t rx_len;
+    char *tx;
+    size_t tx_len;
+    size_t tx_off;
+    bool close_after;
+} view_conn_t;
+
+typedef struct {
+    uint64_t polls;
+    uint64_t changed;       // 200 with a new state
+    uint64_t not_modified;  // 304
+    uint64_t errors;        // Refused, reset, bad status or malformed answers
+    uint64_t timeouts;
+    uint64_t connects;      // New TCP connections
+    uint64_t reused;        // Polls sent on a kept-alive connection
+    uint64_t stale;         // Kept-alive connections found closed and reopened
+    uint64_t view_requests;
+} fleet_stats_t;
+
+static uint32_t s_min_ms = 1000;
+static uint32_t s_max_ms = 10000;
+static uint32_t s_offline_ms = 30000;
+static uint32_t s_timeout_ms = 2000;
+static int s_max_inflight = 256;
+
+static int s_epoll = -1;
+static device_t *s_devices = NULL;
+static int s_device_count = 0;
+static device_t **s_heap = NULL;
+static int s_heap_len = 0;
+static int *s_ready = NULL;   // FIFO of due devices waiting for an in-flight slot
+static int s_ready_head = 0;
+static int s_ready_count = 0;
+static int s_inflight = 0;
+static uint64_t s_view_seq = 0;
+static uint64_t s_start_ms = 0;
+static uint64_t s_sweep_ms = 0; // Time until every unit had settled once, 0 until then
+static int s_settled = 0;
+static fleet_stats_t s_stats;
+static uint32_t *s_rtt_hist = NULL;
+static uint64_t s_rtt_count = 0;
+static uint32_t s_seed = 0x2545f491;
+static int s_listen_fd = -1;
+static view_conn_t s_views[MAX_VIEW_CONNS];
+static volatile sig_atomic_t s_stop = 0;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t now_ms(void)
+{
+    return now_us() / 1000;
+}
+
+static uint32_t rand32(void)
+{
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 17;
+    s_seed ^= s_seed << 5;
+    return s_seed;
+}
+
+// Up to 10% either way
+static uint32_t jitter(uint32_t ms)
+{
+    uint32_t spread = ms / 10;
+    return spread ? ms - spread + rand32() % (2 * spread + 1) : ms;
+}
+
+// --- Growable text buffer for the view responses ---
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} strbuf_t;
+
+static void sb_printf(strbuf_t *sb, const char *fmt, ...)
+{
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(sb->data ? sb->data + sb->len : NULL, sb->data ? sb->cap - sb->len : 0, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if (sb->data && sb->len + n < sb->cap) {
+            sb->len += n;
+            return;
+        }
+        size_t cap = sb->cap ? sb->cap * 2 : 4096;
+        while (cap < sb->len + n + 1) cap *= 2;
+        char *data = realloc(sb->data, cap);
+        if (!data) return;
+        sb->data = data;
+        sb->cap = cap;
+    }
+}
+
+// --- Deadline heap: every device that is due at some point, keyed by due_ms ---
+static void heap_place(int i, device_t *d)
+{
+    s_heap[i] = d;
+    d->heap_pos = i;
+}
+
+static void heap_up(int i)
+{
+    device_t *d = s_heap[i];
+    while (i > 0 && s_heap[(i - 1) / 2]->due_ms > d->due_ms) {
+        heap_place(i, s_heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heap_place(i, d);
+}
+
+static void heap_down(int i)
+{
+    device_t *d = s_heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= s_heap_len) break;
+        if (child + 1 < s_heap_len && s_heap[child + 1]->due_ms < s_heap[child]->due_ms) child++;
+        if (s_heap[child]->due_ms >= d->due_ms) break;
+        heap_place(i, s_heap[child]);
+        i = child;
+    }
+    heap_place(i, d);
+}
+
+static void heap_remove(device_t *d)
+{
+    int i = d->heap_pos;
+    if (i < 0) return;
+    d->heap_pos = -1;
+    device_t *last = s_heap[--s_heap_len];
+    if (i == s_heap_len) return;
+    heap_place(i, last);
+    heap_up(i);
+    heap_down(last->heap_pos);
+}
+
+static void schedule(device_t *d, uint64_t due_ms)
+{
+    d->due_ms = due_ms;
+    if (d->heap_pos < 0) {
+        heap_place(s_heap_len++, d);
+        heap_up(s_heap_len - 1);
+    } else {
+        heap_up(d->heap_pos);
+        heap_down(d->heap_pos);
+    }
+}
+
+// --- Device polling ---
+static void dev_close(device_t *d)
+{
+    if (d->fd >= 0) {
+        epoll_ctl(s_epoll, EPOLL_CTL_DEL, d->fd, NULL);
+        close(d->fd);
+        d->fd = -1;
+    }
+}
+
+static void dev_watch(device_t *d, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.u64 = SRC(SRC_DEVICE, d - s_devices) };
+    if (epoll_ctl(s_epoll, EPOLL_CTL_MOD, d->fd, &ev) != 0) {
+        epoll_ctl(s_epoll, EPOLL_CTL_ADD, d->fd, &ev);
+    }
+}
+
+static void mark_settled(device_t *d)
+{
+    if (!d->settled) {
+        d->settled = true;
+        d->view_seq = ++s_view_seq; // Known for the first time, even if only as offline
+        if (++s_settled == s_device_count) {
+            s_sweep_ms = now_ms() - s_start_ms;
+        }
+    }
+}
+
+static void set_online(device_t *d, bool online)
+{
+    if (d->online != online) {
+        d->online = online;
+        d->view_seq = ++s_view_seq;
+    }
+}
+
+static void poll_done(device_t *d)
+{
+    d->phase = PHASE_IDLE;
+    d->rx_len = 0;
+    s_inflight--;
+}
+
+static void poll_failed(device_t *d, bool timeout)
+{
+    dev_close(d);
+    poll_done(d);
+    if (timeout) {
+        s_stats.timeouts++;
+    } else {
+        s_stats.errors++;
+    }
+    d->fails++;
+    if (d->fails >= OFFLINE_AFTER || !d->answered) {
+        set_online(d, false);
+        mark_settled(d);
+    }
+    // Back off a failing unit: doubling from the minimum interval, capped
+    uint64_t backoff = (uint64_t)s_min_ms << (d->fails < 16 ? d->fails : 16);
+    d->interval_ms = backoff < s_offline_ms ? (uint32_t)backoff : s_offline_ms;
+    schedule(d, now_ms() + jitter(d->interval_ms));
+}
+
+static bool dev_connect(device_t *d)
+{
+    d->fd = socket(d->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (d->fd < 0) return false;
+    int one = 1;
+    setsockopt(d->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    s_stats.connects++;
+    d->reused = false;
+    if (connect(d->fd, (struct sockaddr *)&d->addr, d->addr_len) == 0) {
+        d->phase = PHASE_SENDING;
+        dev_watch(d, EPOLLOUT);
+        return true;
+    }
+    if (errno != EINPROGRESS) return false;
+    d->phase = PHASE_CONNECTING;
+    dev_watch(d, EPOLLOUT);
+    return true;
+}
+
+static void poll_start(device_t *d)
+{
+    d->tx_len = snprintf(d->tx, sizeof(d->tx),
+                         "GET /get_filled_doses?format=mask HTTP/1.1\r\nHost: %s\r\n%s%s%s\r\n", d->addr_str,
+                         d->etag[0] ? "If-None-Match: " : "", d->etag, d->etag[0] ? "\r\n" : "");
+    d->tx_off = 0;
+    d->rx_len = 0;
+    d->start_us = now_us();
+    s_inflight++;
+    s_stats.polls++;
+    schedule(d, now_ms() + s_timeout_ms);
+
+    if (d->fd >= 0) {
+        d->reused = true;
+        d->phase = PHASE_SENDING;
+        s_stats.reused++;
+        dev_watch(d, EPOLLOUT);
+    } else if (!dev_connect(d)) {
+        poll_failed(d, false);
+    }
+}
+
+// Finds a header value in a NUL-terminated header block (case-insensitive name)
+static const char *find_hdr(const char *head, const char *field, size_t *len)
+{
+    size_t field_len = strlen(field);
+    for (const char *line = strstr(head, "\r\n"); line && line[2] != '\r'; line = strstr(line + 2, "\r\n")) {
+        const char *p = line + 2;
+        if (strncasecmp(p, field, field_len) == 0 && p[field_len] == ':') {
+            p += field_len + 1;
+            while (*p == ' ') p++;
+            *len = strcspn(p, "\r");
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Returns 1 when a full answer was handled, 0 when more bytes are needed, -1 on a bad answer
+static int handle_answer(device_t *d)
+{
+    char *end = memmem(d->rx, d->rx_len, "\r\n\r\n", 4);
+    if (!end) return d->rx_len + 1 >= sizeof(d->rx) ? -1 : 0;
+    size_t head_len = end - d->rx + 4;
+    *end = '\0'; // Terminates the header block; the body stays in place
+
+    int status = 0;
+    if (sscanf(d->rx, "HTTP/1.%*d %d", &status) != 1) return -1;
+    size_t len;
+    const char *value = find_hdr(d->rx, "Content-Length", &len);
+    size_t body_len = value ? strtoul(value, NULL, 10) : 0;
+    if (!value && status != 304) return -1; // The units always send a length for this route
+    if (head_len + body_len > d->rx_len) {
+        if (head_len + body_len + 1 > sizeof(d->rx)) return -1;
+        *end = '\r';
+        return 0;
+    }
+    value = find_hdr(d->rx, "Connection", &len);
+    bool keep = !(value && len == 5 && strncasecmp(value, "close", 5) == 0);
+
+    uint64_t now = now_ms();
+    uint32_t rtt = (uint32_t)(now_us() - d->start_us);
+    d->rtt_us = rtt;
+    uint32_t bucket = rtt / RTT_BUCKET_US;
+    s_rtt_hist[bucket < RTT_BUCKETS ? bucket : RTT_BUCKETS - 1]++;
+    s_rtt_count++;
+
+    bool changed = false;
+    if (status == 200) {
+        char body[128];
+        size_t n = body_len < sizeof(body) - 1 ? body_len : sizeof(body) - 1;
+        memcpy(body, d->rx + head_len, n);
+        body[n] = '\0';
+        const char *gen = strstr(body, "\"gen\":");
+        const char *mask = strstr(body, "\"mask\":");
+        if (!gen || !mask) return -1;
+        uint32_t new_gen = strtoul(gen + 6, NULL, 10);
+        uint32_t new_mask = strtoul(mask + 7, NULL, 10);
+        uint32_t new_epoch = d->epoch;
+        value = find_hdr(d->rx, "ETag", &len);
+        if (value && len < sizeof(d->etag)) {
+            memcpy(d->etag, value, len);
+            d->etag[len] = '\0';
+            sscanf(d->etag, "\"%8x", &new_epoch);
+        } else {
+            d->etag[0] = '\0';
+        }
+        changed = !d->answered || new_gen != d->gen || new_epoch != d->epoch || new_mask != d->mask;
+        d->gen = new_gen;
+        d->mask = new_mask;
+        d->epoch = new_epoch;
+        s_stats.changed += changed;
+    } else if (status == 304) {
+        s_stats.not_modified++;
+    } else {
+        return -1;
+    }
+
+    if (changed) {
+        d->view_seq = ++s_view_seq;
+    }
+    d->answered = true;
+    d->last_ok_ms = now;
+    d->fails = 0;
+    set_online(d, true);
+    mark_settled(d);
+
+    if (!keep) dev_close(d);
+    poll_done(d);
+    if (changed || d->interval_ms > s_max_ms || d->interval_ms < s_min_ms) {
+        d->interval_ms = s_min_ms;
+    } else {
+        uint32_t stretched = d->interval_ms + d->interval_ms / 2;
+        d->interval_ms = stretched < s_max_ms ? stretched : s_max_ms;
+    }
+    schedule(d, now + jitter(d->interval_ms));
+    return 1;
+}
+
+static void dev_event(device_t *d, uint32_t events)
+{
+    (void)events; // Errors show up as failed reads and writes
+    if (d->phase == PHASE_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            poll_failed(d, false);
+            return;
+        }
+        d->phase = PHASE_SENDING;
+    }
+    if (d->phase == PHASE_SENDING) {
+        while (d->tx_off < d->tx_len) {
+            ssize_t n = send(d->fd, d->tx + d->tx_off, d->tx_len - d->tx_off, MSG_NOSIGNAL);
+            if (n < 0 && errno == EAGAIN) return;
+            if (n <= 0) {
+                if (d->reused) goto stale;
+                poll_failed(d, false);
+                return;
+            }
+            d->tx_off += n;
+        }
+        d->phase = PHASE_RECEIVING;
+        dev_watch(d, EPOLLIN);
+        return;
+    }
+    if (d->phase != PHASE_RECEIVING) return;
+
+    for (;;) {
+        ssize_t n = recv(d->fd, d->rx + d->rx_len, sizeof(d->rx) - 1 - d->rx_len, 0);
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) {
+            // The unit dropped a kept-alive connection between polls: reopen it once
+            if (d->reused && d->rx_len == 0) goto stale;
+            poll_failed(d, false);
+            return;
+        }
+        d->rx_len += n;
+        d->rx[d->rx_len] = '\0';
+        int done = handle_answer(d);
+        if (done < 0) {
+            poll_failed(d, false);
+            return;
+        }
+        if (done > 0) return;
+    }
+
+stale:
+    s_stats.stale++;
+    dev_close(d);
+    d->tx_off = 0;
+    d->rx_len = 0;
+    if (!dev_connect(d)) poll_failed(d, false);
+}
+
+// Starts the polls that are due, up to the in-flight limit; fails the ones past their deadline
+static void run_timers(void)
+{
+    uint64_t now = now_ms();
+    while (s_heap_len > 0 && s_heap[0]->due_ms <= now) {
+        device_t *d = s_heap[0];
+        heap_remove(d);
+        if (d->phase != PHASE_IDLE) {
+            poll_failed(d, true);
+        } else if (s_inflight < s_max_inflight) {
+            poll_start(d);
+        } else {
+            s_ready[(s_ready_head + s_ready_count++) % s_device_count] = d - s_devices;
+        }
+    }
+    while (s_ready_count > 0 && s_inflight < s_max_inflight) {
+        device_t *d = &s_devices[s_ready[s_ready_head]];
+        s_ready_head = (s_ready_head + 1) % s_device_count;
+        s_ready_count--;
+        poll_start(d);
+    }
+}
+
+// --- Round-trip percentiles ---
+static double rtt_percentile_ms(double p)
+{
+    if (s_rtt_count == 0) return 0;
+    uint64_t rank = (uint64_t)(p * (s_rtt_count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < RTT_BUCKETS; i++) {
+        seen += s_rtt_hist[i];
+        if (seen >= rank) return (i + 0.5) * RTT_BUCKET_US / 1000.0;
+    }
+    return RTT_BUCKETS * RTT_BUCKET_US / 1000.0;
+}
+
+static int online_count(void)
+{
+    int online = 0;
+    for (int i = 0; i < s_device_count; i++) online += s_devices[i].online;
+    return online;
+}
+
+// --- View server ---
+static void render_fleet(strbuf_t *sb, uint64_t since)
+{
+    uint64_t now = now_ms();
+    sb_printf(sb, "{\"seq\":%llu,\"devices\":%d,\"online\":%d,\"units\":[", (unsigned long long)s_view_seq,
+              s_device_count, online_count());
+    bool first = true;
+    for (int i = 0; i < s_device_count; i++) {
+        const device_t *d = &s_devices[i];
+        if (since && d->view_seq <= since) continue;
+        sb_printf(sb, "%s{\"addr\":\"%s\",\"online\":%s", first ? "" : ",", d->addr_str, d->online ? "true" : "false");
+        if (d->answered) {
+            sb_printf(sb, ",\"epoch\":\"%08x\",\"gen\":%u,\"mask\":%u,\"age_ms\":%llu,\"rtt_ms\":%.1f", d->epoch, d->gen,
+                      d->mask, (unsigned long long)(now - d->last_ok_ms), d->rtt_us / 1000.0);
+        }
+        sb_printf(sb, ",\"interval_ms\":%u}", d->interval_ms);
+        first = false;
+    }
+    sb_printf(sb, "]}");
+}
+
+static void render_stats(strbuf_t *sb)
+{
+    sb_printf(sb,
+              "{\"devices\":%d,\"online\":%d,\"inflight\":%d,\"waiting\":%d,\"sweep_ms\":%llu,\"polls\":%llu,"
+              "\"changed\":%llu,\"not_modified\":%llu,\"errors\":%llu,\"timeouts\":%llu,\"connects\":%llu,"
+              "\"reused\":%llu,\"stale\":%llu,\"rtt_p50_ms\":%.1f,\"rtt_p99_ms\":%.1f}",
+              s_device_count, online_count(), s_inflight, s_ready_count, (unsigned long long)s_sweep_ms,
+              (unsigned long long)s_stats.polls, (unsigned long long)s_stats.changed,
+              (unsigned long long)s_stats.not_modified, (unsigned long long)s_stats.errors,
+              (unsigned long long)s_stats.timeouts, (unsigned long long)s_stats.connects,
+              (unsigned long long)s_stats.reused, (unsigned long long)s_stats.stale, rtt_percentile_ms(0.5),
+              rtt_percentile_ms(0.99));
+}
+
+static void view_close(view_conn_t *v)
+{
+    epoll_ctl(s_epoll, EPOLL_CTL_DEL, v->fd, NULL);
+    close(v->fd);
+    free(v->tx);
+    *v = (view_conn_t) { .fd = -1 };
+}
+
+static void view_respond(view_conn_t *v, const char *status, const char *etag, strbuf_t *body)
+{
+    strbuf_t out = { 0 };
+    sb_printf(&out, "HTTP/1.1 %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n", status,
+              body ? body->len : 0);
+    if (etag) sb_printf(&out, "ETag: %s\r\nCache-Control: no-cache\r\n", etag);
+    if (v->close_after) sb_printf(&out, "Connection: close\r\n");
+    sb_printf(&out, "\r\n");
+    if (body && body->len) sb_printf(&out, "%s", body->data);
+    v->tx = out.data;
+    v->tx_len = out.len;
+    v->tx_off = 0;
+}
+
+// Handles one complete request in v->rx; returns false when the header block is not complete yet
+static bool view_request(view_conn_t *v)
+{
+    char *end = memmem(v->rx, v->rx_len, "\r\n\r\n", 4);
+    if (!end) return false;
+    *end = '\0';
+    s_stats.view_requests++;
+
+    char method[8] = "";
+    char path[256] = "";
+    sscanf(v->rx, "%7s %255s", method, path);
+    size_t len;
+    const char *value = find_hdr(v->rx, "Connection", &len);
+    v->close_after = (value && len == 5 && strncasecmp(value, "close", 5) == 0) || strstr(v->rx, "HTTP/1.0");
+
+    strbuf_t body = { 0 };
+    char etag[32];
+    snprintf(etag, sizeof(etag), "\"%llu\"", (unsigned long long)s_view_seq);
+    if (strcmp(method, "GET") != 0) {
+        view_respond(v, "405 Method Not Allowed", NULL, NULL);
+    } else if (strncmp(path, "/fleet", 6) == 0 && (path[6] == '\0' || path[6] == '?')) {
+        const char *since = strstr(path, "since=");
+        value = find_hdr(v->rx, "If-None-Match", &len);
+        if (value && len == strlen(etag) && strncmp(value, etag, len) == 0) {
+            view_respond(v, "304 Not Modified", etag, NULL);
+        } else {
+            render_fleet(&body, since ? strtoull(since + 6, NULL, 10) : 0);
+            view_respond(v, "200 OK", etag, &body);
+        }
+    } else if (strcmp(path, "/stats") == 0) {
+        render_stats(&body);
+        view_respond(v, "200 OK", NULL, &body);
+    } else {
+        view_respond(v, "404 Not Found", NULL, NULL);
+    }
+    free(body.data);
+
+    // Drop the request just answered; pipelined bytes stay for the next one
+    size_t used = end - v->rx + 4;
+    memmove(v->rx, v->rx + used, v->rx_len - used);
+    v->rx_len -= used;
+    return true;
+}
+
+// Sends what is pending; returns false once the connection is closed
+static bool view_flush(view_conn_t *v)
+{
+    while (v->tx_off < v->tx_len) {
+        ssize_t n = send(v->fd, v->tx + v->tx_off, v->tx_len - v->tx_off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EAGAIN) {
+            struct epoll_event ev = { .events = EPOLLOUT, .data.u64 = SRC(SRC_VIEW, v - s_views) };
+            epoll_ctl(s_epoll, EPOLL_CTL_MOD, v->fd, &ev);
+            return true;
+        }
+        if (n <= 0) {
+            view_close(v);
+            return false;
+        }
+        v->tx_off += n;
+    }
+    free(v->tx);
+    v->tx = NULL;
+    v->tx_len = v->tx_off = 0;
+    if (v->close_after) {
+        view_close(v);
+        return false;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = SRC(SRC_VIEW, v - s_views) };
+    epoll_ctl(s_epoll, EPOLL_CTL_MOD, v->fd, &ev);
+    return true;
+}
+
+static void view_event(view_conn_t *v, uint32_t events)
+{
+    (void)events;
+    if (v->tx && !view_flush(v)) return;
+    if (v->tx) return; // Still sending; read the next request afterwards
+
+    for (;;) {
+        if (v->rx_len > 0 && view_request(v)) {
+            if (!view_flush(v) || v->tx) return;
+            continue;
+        }
+        if (v->rx_len + 1 >= sizeof(v->rx)) {
+            view_close(v); // Header block too large
+            return;
+        }
+        ssize_t n = recv(v->fd, v->rx + v->rx_len, sizeof(v->rx) - 1 - v->rx_len, 0);
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) {
+            view_close(v);
+            return;
+        }
+        v->rx_len += n;
+        v->rx[v->rx_len] = '\0';
+    }
+}
+
+static void view_accept(void)
+{
+    for (;;) {
+        int fd = accept4(s_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        view_conn_t *v = NULL;
+        for (int i = 0; i < MAX_VIEW_CONNS && !v; i++) {
+            if (s_views[i].fd < 0) v = &s_views[i];
+        }
+        if (!v) {
+            close(fd);
+            continue;
+        }
+        *v = (view_conn_t) { .fd = fd };
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = SRC(SRC_VIEW, v - s_views) };
+        epoll_ctl(s_epoll, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static bool view_listen(int port)
+{
+    s_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(s_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (s_listen_fd < 0 || bind(s_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(s_listen_fd, 64) != 0) {
+        fprintf(stderr, "cannot listen on port %d: %s\n", port, strerror(errno));
+        return false;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = SRC(SRC_LISTEN, 0) };
+    epoll_ctl(s_epoll, EPOLL_CTL_ADD, s_listen_fd, &ev);
+    for (int i = 0; i < MAX_VIEW_CONNS; i++) s_views[i].fd = -1;
+    return true;
+}
+
+// --- Device list ---
+// "host:port" or "host:first-last" for a range of ports on one host
+static bool add_devices(const char *spec)
+{
+    char host[48];
+    const char *colon = strrchr(spec, ':');
+    if (!colon || (size_t)(colon - spec) >= sizeof(host)) return false;
+    memcpy(host, spec, colon - spec);
+    host[colon - spec] = '\0';
+    char *dash;
+    long first = strtol(colon + 1, &dash, 10);
+    long last = *dash == '-' ? strtol(dash + 1, NULL, 10) : first;
+    if (first <= 0 || last < first || last > 65535) return false;
+
+    for (int port = (int)first; port <= (int)last; port++) {
+        if (s_device_count == MAX_DEVICES) {
+            fprintf(stderr, "more than %d devices\n", MAX_DEVICES);
+            return false;
+        }
+        char port_str[8];
+        snprintf(port_str, sizeof(port_str), "%d", port);
+        struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+        struct addrinfo *res;
+        int gai = getaddrinfo(host, port_str, &hints, &res);
+        if (gai != 0) {
+            fprintf(stderr, "%s: %s\n", host, gai_strerror(gai));
+            return false;
+        }
+        device_t *d = &s_devices[s_device_count++];
+        *d = (device_t) { .fd = -1, .heap_pos = -1, .interval_ms = s_min_ms };
+        snprintf(d->addr_str, sizeof(d->addr_str), "%s:%d", host, port);
+        memcpy(&d->addr, res->ai_addr, res->ai_addrlen);
+        d->addr_len = res->ai_addrlen;
+        freeaddrinfo(res);
+    }
+    return true;
+}
+
+static bool load_devices(const char *file)
+{
+    FILE *f = fopen(file, "r");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", file);
+        return false;
+    }
+    char line[128];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        char spec[96];
+        if (sscanf(line, "%95s", spec) == 1 && spec[0] != '#') ok = add_devices(spec);
+    }
+    fclose(f);
+    return ok;
+}
+
+static void print_summary(uint64_t elapsed_ms)
+{
+    double secs = elapsed_ms / 1000.0;
+    printf("devices %d, online %d, full view after %s%llu ms\n", s_device_count, online_count(),
+           s_sweep_ms ? "" : ">", (unsigned long long)(s_sweep_ms ? s_sweep_ms : elapsed_ms));
+    printf("polls %llu (%.1f/s): %llu changed, %llu not modified, %llu errors, %llu timeouts\n",
+           (unsigned long long)s_stats.polls, s_stats.polls / secs, (unsigned long long)s_stats.changed,
+           (unsigned long long)s_stats.not_modified, (unsigned long long)s_stats.errors,
+           (unsigned long long)s_stats.timeouts);
+    printf("connections %llu new, %llu polls reused one, %llu found closed\n", (unsigned long long)s_stats.connects,
+           (unsigned long long)s_stats.reused, (unsigned long long)s_stats.stale);
+    printf("round trip ms: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n", rtt_percentile_ms(0.5), rtt_percentile_ms(0.9),
+           rtt_percentile_ms(0.99), rtt_percentile_ms(1.0));
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    s_stop = 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ashumitra_fleet [-l port] [-i min_ms] [-I max_ms] [-O offline_ms] [-t timeout_ms]\n"
+                    "                       [-c max_inflight] [-b seconds] [-f file] host:port[-last_port]...\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *file = NULL;
+    int listen_port = 9090;
+    int bench_s = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:i:I:O:t:c:b:f:")) != -1) {
+        switch (opt) {
+            case 'l': listen_port = atoi(optarg); break;
+            case 'i': s_min_ms = atoi(optarg); break;
+            case 'I': s_max_ms = atoi(optarg); break;
+            case 'O': s_offline_ms = atoi(optarg); break;
+            case 't': s_timeout_ms = atoi(optarg); break;
+            case 'c': s_max_inflight = atoi(optarg); break;
+            case 'b': bench_s = atoi(optarg); break;
+            case 'f': file = optarg; break;
+            default: usage(); return 2;
+        }
+    }
+    if ((!file && optind >= argc) || s_min_ms == 0 || s_max_ms < s_min_ms || s_timeout_ms == 0 || s_max_inflight < 1) {
+        usage();
+        return 2;
+    }
+
+    s_devices = calloc(MAX_DEVICES, sizeof(device_t));
+    s_rtt_hist = calloc(RTT_BUCKETS, sizeof(uint32_t));
+    if (!s_devices || !s_rtt_hist) return 2;
+    if (file && !load_devices(file)) return 2;
+    for (int i = optind; i < argc; i++) {
+        if (!add_devices(argv[i])) {
+            fprintf(stderr, "bad device \"%s\"\n", argv[i]);
+            return 2;
+        }
+    }
+    if (s_device_count == 0) {
+        usage();
+        return 2;
+    }
+    s_heap = calloc(s_device_count, sizeof(device_t *));
+    s_ready = calloc(s_device_count, sizeof(int));
+    s_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (!s_heap || !s_ready || s_epoll < 0 || !view_listen(listen_port)) return 2;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Everything is due at once; the in-flight limit spreads out the first sweep
+    s_start_ms = now_ms();
+    s_seed ^= (uint32_t)now_us();
+    for (int i = 0; i < s_device_count; i++) {
+        schedule(&s_devices[i], s_start_ms);
+    }
+    fprintf(stderr, "polling %d devices, view on port %d\n", s_device_count, listen_port);
+
+    uint64_t end_ms = bench_s > 0 ? s_start_ms + (uint64_t)bench_s * 1000 : 0;
+    uint64_t next_status_ms = s_start_ms + STATUS_EVERY_MS;
+    struct epoll_event events[256];
+    while (!s_stop) {
+        run_timers();
+        uint64_t now = now_ms();
+        if (end_ms && now >= end_ms) break;
+        if (!end_ms && now >= next_status_ms) {
+            fprintf(stderr, "online %d/%d, polls %llu, view seq %llu\n", online_count(), s_device_count,
+                    (unsigned long long)s_stats.polls, (unsigned long long)s_view_seq);
+            next_status_ms = now + STATUS_EVERY_MS;
+        }
+
+        int timeout = 1000;
+        if (s_heap_len > 0) {
+            timeout = s_heap[0]->due_ms > now ? (int)(s_heap[0]->due_ms - now) : 0;
+            if (timeout > 1000) timeout = 1000;
+        }
+        int n = epoll_wait(s_epoll, events, 256, timeout);
+        for (int i = 0; i < n; i++) {
+            uint64_t kind = events[i].data.u64 >> 32;
+            uint32_t index = (uint32_t)events[i].data.u64;
+            if (kind == SRC_DEVICE) {
+                device_t *d = &s_devices[index];
+                if (d->fd < 0) continue;
+                if (d->phase == PHASE_IDLE) {
+                    // The unit closed an idle kept-alive connection; reconnect at the next poll
+                    dev_close(d);
+                    continue;
+                }
+                dev_event(d, events[i].events);
+            } else if (kind == SRC_LISTEN) {
+                view_accept();
+            } else if (kind == SRC_VIEW && s_views[index].fd >= 0) {
+                view_event(&s_views[index], events[i].events);
+            }
+        }
+    }
+
+    print_summary(now_ms() - s_start_ms);
+    return 0;
+}
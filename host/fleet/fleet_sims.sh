@@ -0,0 +1,64 @@
+#!/bin/sh
+# Starts a fleet of simulated dispensers on consecutive ports, for running
+# ashumitra_fleet against hundreds of units on one machine.
+#
+#   fleet_sims.sh start <ashumitra_sim> <count> [base_port] [dir]
+#   fleet_sims.sh stop [dir]
+#
+# Each simulator keeps its NVS and flash files in <dir> (default
+# /tmp/ashumitra_fleet). Every 10th unit answers 500 ms late
+# (ASHUMITRA_SIM_HTTP_DELAY_MS), standing in for units on a poor link. For
+# offline units, poll a port range wider than the fleet; to make a unit hang
+# instead, freeze it with kill -STOP.
+#
+#   fleet_sims.sh start host/build/ashumitra_sim 300 19000
+#   host/build/ashumitra_fleet -b 30 127.0.0.1:19000-19309
+#   fleet_sims.sh stop
+set -e
+
+cmd=$1
+case "$cmd" in
+start)
+    sim=$2
+    count=$3
+    base=${4:-19000}
+    dir=${5:-/tmp/ashumitra_fleet}
+    if [ -z "$sim" ] || [ -z "$count" ]; then
+        echo "usage: $0 start <ashumitra_sim> <count> [base_port] [dir]" >&2
+        exit 2
+    fi
+    mkdir -p "$dir"
+    i=0
+    while [ "$i" -lt "$count" ]; do
+        port=$((base + i))
+        delay=0
+        if [ $((i % 10)) -eq 9 ]; then
+            delay=500
+        fi
+        ASHUMITRA_SIM_PORT=$port \
+        ASHUMITRA_SIM_NVS="$dir/nvs_$port.txt" \
+        ASHUMITRA_SIM_FLASH="$dir/flash_$port.bin" \
+        ASHUMITRA_SIM_HTTP_DELAY_MS=$delay \
+        ASHUMITRA_SIM_SCAN_MS=100 \
+        ASHUMITRA_SIM_DHCP_MS=50 \
+        ASHUMITRA_SIM_LOG=1 \
+            "$sim" >"$dir/sim_$port.log" 2>&1 &
+        echo $! >>"$dir/pids"
+        i=$((i + 1))
+    done
+    echo "started $count simulators on ports $base-$((base + count - 1)), logs in $dir"
+    ;;
+stop)
+    dir=${2:-/tmp/ashumitra_fleet}
+    if [ -f "$dir/pids" ]; then
+        # Frozen units need a CONT before they can act on the TERM
+        xargs kill -CONT <"$dir/pids" 2>/dev/null || true
+        xargs kill <"$dir/pids" 2>/dev/null || true
+        rm -f "$dir/pids"
+    fi
+    ;;
+*)
+    echo "usage: $0 start <ashumitra_sim> <count> [base_port] [dir] | stop [dir]" >&2
+    exit 2
+    ;;
+esac
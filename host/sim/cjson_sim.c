@@ -0,0 +1,474 @@
+// Minimal cJSON stand-in covering the subset used by the firmware: parse,
+// build, print unformatted, look up. Numbers print like cJSON does (integers
+// without a fraction).
+
+#include <ctype.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+
+#define CJSON_NESTING_LIMIT 64
+
+// --- Construction ---
+static cJSON *new_item(int type)
+{
+    cJSON *item = calloc(1, sizeof(*item));
+    if (item) item->type = type;
+    return item;
+}
+
+void cJSON_Delete(cJSON *item)
+{
+    while (item) {
+        cJSON *next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+cJSON *cJSON_CreateArray(void)  { return new_item(cJSON_Array); }
+cJSON *cJSON_CreateObject(void) { return new_item(cJSON_Object); }
+
+cJSON *cJSON_CreateBool(cJSON_bool boolean)
+{
+    return new_item(boolean ? cJSON_True : cJSON_False);
+}
+
+cJSON *cJSON_CreateNumber(double num)
+{
+    cJSON *item = new_item(cJSON_Number);
+    if (item) {
+        item->valuedouble = num;
+        item->valueint = num >= 2147483647.0 ? 2147483647 : num <= -2147483648.0 ? (int)-2147483648.0 : (int)num;
+    }
+    return item;
+}
+
+cJSON *cJSON_CreateString(const char *string)
+{
+    cJSON *item = new_item(cJSON_String);
+    if (item) {
+        item->valuestring = strdup(string);
+        if (!item->valuestring) {
+            free(item);
+            return NULL;
+        }
+    }
+    return item;
+}
+
+cJSON_bool cJSON_AddItemToArray(cJSON *array, cJSON *item)
+{
+    if (!array || !item) return 0;
+    if (!array->child) {
+        array->child = item;
+        item->prev = item; // cJSON keeps the tail in child->prev
+    } else {
+        cJSON *tail = array->child->prev;
+        tail->next = item;
+        item->prev = tail;
+        array->child->prev = item;
+    }
+    item->next = NULL;
+    return 1;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item)
+{
+    if (!object || !item || !string) return 0;
+    char *key = strdup(string);
+    if (!key) return 0;
+    free(item->string);
+    item->string = key;
+    return cJSON_AddItemToArray(object, item);
+}
+
+// --- Access ---
+int cJSON_GetArraySize(const cJSON *array)
+{
+    int size = 0;
+    if (!array) return 0;
+    for (const cJSON *c = array->child; c; c = c->next) size++;
+    return size;
+}
+
+cJSON *cJSON_GetArrayItem(const cJSON *array, int index)
+{
+    if (!array || index < 0) return NULL;
+    cJSON *c = array->child;
+    while (c && index-- > 0) c = c->next;
+    return c;
+}
+
+static cJSON *get_object_item(const cJSON *object, const char *string, bool case_sensitive)
+{
+    if (!object || !string) return NULL;
+    for (cJSON *c = object->child; c; c = c->next) {
+        if (c->string && (case_sensitive ? strcmp(c->string, string) : strcasecmp(c->string, string)) == 0) return c;
+    }
+    return NULL;
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string)
+{
+    return get_object_item(object, string, false);
+}
+
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string)
+{
+    return get_object_item(object, string, true);
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON *item) { return item && (item->type & 0xff) == cJSON_Number; }
+cJSON_bool cJSON_IsString(const cJSON *item) { return item && (item->type & 0xff) == cJSON_String; }
+cJSON_bool cJSON_IsArray(const cJSON *item)  { return item && (item->type & 0xff) == cJSON_Array; }
+cJSON_bool cJSON_IsObject(const cJSON *item) { return item && (item->type & 0xff) == cJSON_Object; }
+cJSON_bool cJSON_IsBool(const cJSON *item)   { return item && (item->type & (cJSON_True | cJSON_False)) != 0; }
+cJSON_bool cJSON_IsTrue(const cJSON *item)   { return item && (item->type & 0xff) == cJSON_True; }
+
+char *cJSON_GetStringValue(const cJSON *item)
+{
+    return cJSON_IsString(item) ? item->valuestring : NULL;
+}
+
+// --- Parsing ---
+typedef struct {
+    const char *p;
+    const char *end;
+    int depth;
+} parser_t;
+
+static void skip_ws(parser_t *ps)
+{
+    while (ps->p < ps->end && isspace((unsigned char)*ps->p)) ps->p++;
+}
+
+static bool match(parser_t *ps, const char *literal)
+{
+    size_t len = strlen(literal);
+    if ((size_t)(ps->end - ps->p) < len || strncmp(ps->p, literal, len) != 0) return false;
+    ps->p += len;
+    return true;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Appends a code point as UTF-8; returns the number of bytes written
+static int put_utf8(char *out, unsigned cp)
+{
+    if (cp < 0x80) { out[0] = (char)cp; return 1; }
+    if (cp < 0x800) { out[0] = (char)(0xc0 | (cp >> 6)); out[1] = (char)(0x80 | (cp & 0x3f)); return 2; }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | (cp >> 12)); out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f)); return 3;
+    }
+    out[0] = (char)(0xf0 | (cp >> 18)); out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3f)); out[3] = (char)(0x80 | (cp & 0x3f)); return 4;
+}
+
+static bool parse_hex4(parser_t *ps, unsigned *out)
+{
+    if (ps->end - ps->p < 4) return false;
+    unsigned value = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = hex_digit(ps->p[i]);
+        if (d < 0) return false;
+        value = (value << 4) | (unsigned)d;
+    }
+    ps->p += 4;
+    *out = value;
+    return true;
+}
+
+static char *parse_string_raw(parser_t *ps)
+{
+    if (ps->p >= ps->end || *ps->p != '"') return NULL;
+    ps->p++;
+
+    // Escapes never expand, so the raw length bounds the decoded length
+    const char *start = ps->p;
+    while (ps->p < ps->end && *ps->p != '"') {
+        if (*ps->p == '\\') ps->p++;
+        ps->p++;
+    }
+    if (ps->p >= ps->end) return NULL;
+    char *out = malloc(ps->p - start + 1);
+    if (!out) return NULL;
+    ps->p = start;
+
+    char *w = out;
+    while (*ps->p != '"') {
+        char c = *ps->p++;
+        if ((unsigned char)c < 0x20) goto fail;
+        if (c != '\\') {
+            *w++ = c;
+            continue;
+        }
+        c = *ps->p++;
+        switch (c) {
+            case '"': case '\\': case '/': *w++ = c; break;
+            case 'b': *w++ = '\b'; break;
+            case 'f': *w++ = '\f'; break;
+            case 'n': *w++ = '\n'; break;
+            case 'r': *w++ = '\r'; break;
+            case 't': *w++ = '\t'; break;
+            case 'u': {
+                unsigned cp;
+                if (!parse_hex4(ps, &cp)) goto fail;
+                if (cp >= 0xd800 && cp < 0xdc00) {
+                    unsigned low;
+                    if (!match(ps, "\\u") || !parse_hex4(ps, &low) || low < 0xdc00 || low > 0xdfff) goto fail;
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                }
+                w += put_utf8(w, cp);
+                break;
+            }
+            default: goto fail;
+        }
+    }
+    ps->p++; // Closing quote
+    *w = '\0';
+    return out;
+
+fail:
+    free(out);
+    return NULL;
+}
+
+static cJSON *parse_value(parser_t *ps);
+
+static cJSON *parse_container(parser_t *ps, bool object)
+{
+    cJSON *item = new_item(object ? cJSON_Object : cJSON_Array);
+    if (!item) return NULL;
+    if (++ps->depth > CJSON_NESTING_LIMIT) goto fail;
+    ps->p++; // '[' or '{'
+
+    skip_ws(ps);
+    if (ps->p < ps->end && *ps->p == (object ? '}' : ']')) {
+        ps->p++;
+        ps->depth--;
+        return item;
+    }
+
+    for (;;) {
+        char *key = NULL;
+        skip_ws(ps);
+        if (object) {
+            key = parse_string_raw(ps);
+            if (!key) goto fail;
+            skip_ws(ps);
+            if (ps->p >= ps->end || *ps->p != ':') {
+                free(key);
+                goto fail;
+            }
+            ps->p++;
+        }
+        cJSON *child = parse_value(ps);
+        if (!child) {
+            free(key);
+            goto fail;
+        }
+        child->string = key;
+        cJSON_AddItemToArray(item, child);
+
+        skip_ws(ps);
+        if (ps->p < ps->end && *ps->p == ',') {
+            ps->p++;
+            continue;
+        }
+        if (ps->p < ps->end && *ps->p == (object ? '}' : ']')) {
+            ps->p++;
+            ps->depth--;
+            return item;
+        }
+        goto fail;
+    }
+
+fail:
+    cJSON_Delete(item);
+    return NULL;
+}
+
+static cJSON *parse_number(parser_t *ps)
+{
+    char buf[64];
+    size_t len = 0;
+    while (ps->p + len < ps->end && len < sizeof(buf) - 1 && strchr("+-0123456789.eE", ps->p[len])) {
+        buf[len] = ps->p[len];
+        len++;
+    }
+    buf[len] = '\0';
+    char *endp;
+    double value = strtod(buf, &endp);
+    if (endp == buf) return NULL;
+    ps->p += endp - buf;
+    return cJSON_CreateNumber(value);
+}
+
+static cJSON *parse_value(parser_t *ps)
+{
+    skip_ws(ps);
+    if (ps->p >= ps->end) return NULL;
+
+    switch (*ps->p) {
+        case '{': return parse_container(ps, true);
+        case '[': return parse_container(ps, false);
+        case '"': {
+            char *s = parse_string_raw(ps);
+            if (!s) return NULL;
+            cJSON *item = new_item(cJSON_String);
+            if (!item) {
+                free(s);
+                return NULL;
+            }
+            item->valuestring = s;
+            return item;
+        }
+        case 't': return match(ps, "true") ? new_item(cJSON_True) : NULL;
+        case 'f': return match(ps, "false") ? new_item(cJSON_False) : NULL;
+        case 'n': return match(ps, "null") ? new_item(cJSON_NULL) : NULL;
+        default:  return parse_number(ps);
+    }
+}
+
+cJSON *cJSON_ParseWithLength(const char *value, size_t length)
+{
+    if (!value) return NULL;
+    parser_t ps = { .p = value, .end = value + length, .depth = 0 };
+    cJSON *item = parse_value(&ps);
+    if (!item) return NULL;
+    skip_ws(&ps);
+    if (ps.p < ps.end && *ps.p != '\0') {
+        cJSON_Delete(item); // Trailing garbage
+        return NULL;
+    }
+    return item;
+}
+
+cJSON *cJSON_Parse(const char *value)
+{
+    return value ? cJSON_ParseWithLength(value, strlen(value)) : NULL;
+}
+
+// --- Printing ---
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool failed;
+} printer_t;
+
+static void put(printer_t *pr, const char *s, size_t n)
+{
+    if (pr->failed) return;
+    if (pr->len + n + 1 > pr->cap) {
+        size_t cap = pr->cap ? pr->cap : 64;
+        while (pr->len + n + 1 > cap) cap *= 2;
+        char *buf = realloc(pr->buf, cap);
+        if (!buf) {
+            pr->failed = true;
+            return;
+        }
+        pr->buf = buf;
+        pr->cap = cap;
+    }
+    memcpy(pr->buf + pr->len, s, n);
+    pr->len += n;
+    pr->buf[pr->len] = '\0';
+}
+
+static void put_str(printer_t *pr, const char *s)
+{
+    put(pr, s, strlen(s));
+}
+
+static void print_string(printer_t *pr, const char *s)
+{
+    put(pr, "\"", 1);
+    for (; *s; s++) {
+        char esc[8];
+        switch (*s) {
+            case '"':  put_str(pr, "\\\""); break;
+            case '\\': put_str(pr, "\\\\"); break;
+            case '\b': put_str(pr, "\\b"); break;
+            case '\f': put_str(pr, "\\f"); break;
+            case '\n': put_str(pr, "\\n"); break;
+            case '\r': put_str(pr, "\\r"); break;
+            case '\t': put_str(pr, "\\t"); break;
+            default:
+                if ((unsigned char)*s < 0x20) {
+                    snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)*s);
+                    put_str(pr, esc);
+                } else {
+                    put(pr, s, 1);
+                }
+        }
+    }
+    put(pr, "\"", 1);
+}
+
+static void print_value(printer_t *pr, const cJSON *item)
+{
+    char num[32];
+    switch (item->type & 0xff) {
+        case cJSON_NULL:  put_str(pr, "null"); break;
+        case cJSON_False: put_str(pr, "false"); break;
+        case cJSON_True:  put_str(pr, "true"); break;
+        case cJSON_Number:
+            if (isnan(item->valuedouble) || isinf(item->valuedouble)) {
+                put_str(pr, "null");
+            } else if (item->valuedouble == (double)item->valueint) {
+                snprintf(num, sizeof(num), "%d", item->valueint);
+                put_str(pr, num);
+            } else {
+                snprintf(num, sizeof(num), "%.17g", item->valuedouble);
+                put_str(pr, num);
+            }
+            break;
+        case cJSON_String:
+            print_string(pr, item->valuestring ? item->valuestring : "");
+            break;
+        case cJSON_Array:
+        case cJSON_Object: {
+            bool object = (item->type & 0xff) == cJSON_Object;
+            put(pr, object ? "{" : "[", 1);
+            for (const cJSON *c = item->child; c; c = c->next) {
+                if (object) {
+                    print_string(pr, c->string ? c->string : "");
+                    put(pr, ":", 1);
+                }
+                print_value(pr, c);
+                if (c->next) put(pr, ",", 1);
+            }
+            put(pr, object ? "}" : "]", 1);
+            break;
+        }
+        default:
+            pr->failed = true;
+    }
+}
+
+char *cJSON_PrintUnformatted(const cJSON *item)
+{
+    printer_t pr = { 0 };
+    if (!item) return NULL;
+    print_value(&pr, item);
+    if (pr.failed) {
+        free(pr.buf);
+        return NULL;
+    }
+    return pr.buf;
+}
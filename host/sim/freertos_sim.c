@@ -0,0 +1,540 @@
+// FreeRTOS stand-in on pthreads: tasks, queues, semaphores, event groups,
+// task notifications and critical sections. Priorities and core affinity are
+// recorded (uxTaskPriorityGet(), xTaskGetCoreID()) but not enforced; the host
+// scheduler decides.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "sim.h"
+
+// --- Time ---
+static struct timespec s_start;
+static pthread_once_t s_start_once = PTHREAD_ONCE_INIT;
+
+static void start_clock(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s_start);
+}
+
+int64_t sim_uptime_us(void)
+{
+    struct timespec now;
+    pthread_once(&s_start_once, start_clock);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - s_start.tv_sec) * 1000000 + (now.tv_nsec - s_start.tv_nsec) / 1000;
+}
+
+uint32_t sim_uptime_ms(void)
+{
+    return (uint32_t)(sim_uptime_us() / 1000);
+}
+
+void sim_deadline(struct timespec *ts, uint32_t ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void cond_init_monotonic(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Waits on `cond` until woken or until the deadline; portMAX_DELAY waits forever.
+// Returns false on timeout.
+static bool cond_wait_ticks(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *deadline)
+{
+    if (!deadline) {
+        pthread_cond_wait(cond, mutex);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, mutex, deadline) != ETIMEDOUT;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return pdMS_TO_TICKS(sim_uptime_ms());
+}
+
+static void sleep_ms(uint32_t ms)
+{
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sleep_ms(pdTICKS_TO_MS(ticks));
+}
+
+void vTaskDelayUntil(TickType_t *prev_wake, TickType_t increment)
+{
+    TickType_t wake = *prev_wake + increment;
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(wake - now) > 0) {
+        vTaskDelay(wake - now);
+    }
+    *prev_wake = wake;
+}
+
+// --- Critical Sections ---
+// One process-wide recursive mutex stands in for every spinlock
+static pthread_mutex_t s_critical;
+static pthread_once_t s_critical_once = PTHREAD_ONCE_INIT;
+
+static void critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&s_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_once(&s_critical_once, critical_init);
+    pthread_mutex_lock(&s_critical);
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_mutex_unlock(&s_critical);
+}
+
+// --- Tasks ---
+#define SIM_MAX_TASKS 32
+
+struct sim_task {
+    pthread_t thread;
+    char name[16];
+    TaskFunction_t fn;
+    void *arg;
+    uint32_t stack_depth;
+    UBaseType_t priority;
+    BaseType_t core_id;
+    pthread_mutex_t notify_lock;
+    pthread_cond_t notify_cond;
+    uint32_t notify_count;
+};
+
+static pthread_mutex_t s_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_task *s_tasks[SIM_MAX_TASKS];
+static __thread struct sim_task *s_current_task = NULL;
+
+static struct sim_task *task_new(const char *name, uint32_t stack_depth, UBaseType_t prio, BaseType_t core_id)
+{
+    struct sim_task *task = calloc(1, sizeof(*task));
+    if (!task) return NULL;
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->stack_depth = stack_depth;
+    task->priority = prio;
+    task->core_id = core_id;
+    pthread_mutex_init(&task->notify_lock, NULL);
+    cond_init_monotonic(&task->notify_cond);
+
+    pthread_mutex_lock(&s_tasks_lock);
+    for (int i = 0; i < SIM_MAX_TASKS; i++) {
+        if (!s_tasks[i]) {
+            s_tasks[i] = task;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+    return task;
+}
+
+static void *task_entry(void *arg)
+{
+    struct sim_task *task = arg;
+    s_current_task = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t prio, TaskHandle_t *out, BaseType_t core_id)
+{
+    struct sim_task *task = task_new(name, stack_depth, prio, core_id);
+    if (!task) return pdFAIL;
+    task->fn = fn;
+    task->arg = arg;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) return pdFAIL;
+
+    if (out) *out = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t prio, TaskHandle_t *out)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, prio, out, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (!s_current_task) {
+        // A thread the simulator did not start as a task (main, httpd)
+        s_current_task = task_new("thread", 0, 0, tskNO_AFFINITY);
+        if (s_current_task) s_current_task->thread = pthread_self();
+    }
+    return s_current_task;
+}
+
+void sim_task_adopt(const char *name, uint32_t stack_depth, unsigned prio, int core_id)
+{
+    if (s_current_task) return;
+    s_current_task = task_new(name, stack_depth, prio, core_id);
+    if (s_current_task) s_current_task->thread = pthread_self();
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == s_current_task) {
+        pthread_exit(NULL);
+    }
+    // Deleting another task is not used by the firmware
+}
+
+TaskHandle_t xTaskGetHandle(const char *name)
+{
+    TaskHandle_t found = NULL;
+    pthread_mutex_lock(&s_tasks_lock);
+    for (int i = 0; i < SIM_MAX_TASKS && !found; i++) {
+        if (s_tasks[i] && strcmp(s_tasks[i]->name, name) == 0) found = s_tasks[i];
+    }
+    pthread_mutex_unlock(&s_tasks_lock);
+    return found;
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    return task ? task->name : "?";
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    return task ? task->priority : 0;
+}
+
+BaseType_t xTaskGetCoreID(TaskHandle_t task)
+{
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    return task ? task->core_id : tskNO_AFFINITY;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    // A pinned task reports its core; unpinned ones are counted on core 0
+    BaseType_t core_id = xTaskGetCoreID(NULL);
+    return core_id == tskNO_AFFINITY ? 0 : core_id;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    // Host threads have large stacks that are not instrumented; report the
+    // configured depth as untouched
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    return task ? task->stack_depth : 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->notify_lock);
+    task->notify_count++;
+    pthread_cond_signal(&task->notify_cond);
+    pthread_mutex_unlock(&task->notify_lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken) *woken = pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct sim_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    bool forever = ticks == portMAX_DELAY;
+    if (!forever) sim_deadline(&deadline, pdTICKS_TO_MS(ticks));
+
+    pthread_mutex_lock(&task->notify_lock);
+    while (task->notify_count == 0 && ticks != 0) {
+        if (!cond_wait_ticks(&task->notify_cond, &task->notify_lock, forever ? NULL : &deadline)) break;
+    }
+    uint32_t value = task->notify_count;
+    if (value > 0) {
+        task->notify_count = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->notify_lock);
+    return value;
+}
+
+// --- Queues and Semaphores ---
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct sim_queue *q = calloc(1, sizeof(*q));
+    if (!q) return NULL;
+    q->length = length;
+    q->item_size = item_size;
+    if (item_size > 0) {
+        q->items = calloc(length, item_size);
+        if (!q->items) {
+            free(q);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    cond_init_monotonic(&q->not_empty);
+    cond_init_monotonic(&q->not_full);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    if (!q) return;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->items);
+    free(q);
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    struct timespec deadline;
+    bool forever = ticks == portMAX_DELAY;
+    if (!forever) sim_deadline(&deadline, pdTICKS_TO_MS(ticks));
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->length) {
+        if (ticks == 0 || !cond_wait_ticks(&q->not_full, &q->lock, forever ? NULL : &deadline)) {
+            pthread_mutex_unlock(&q->lock);
+            return errQUEUE_FULL;
+        }
+    }
+    if (q->item_size > 0 && item) {
+        UBaseType_t tail = (q->head + q->count) % q->length;
+        memcpy(q->items + tail * q->item_size, item, q->item_size);
+    }
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    return xQueueSend(q, item, ticks);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken)
+{
+    if (woken) *woken = pdFALSE;
+    return xQueueSend(q, item, 0);
+}
+
+static BaseType_t queue_take(QueueHandle_t q, void *item, TickType_t ticks, bool remove)
+{
+    struct timespec deadline;
+    bool forever = ticks == portMAX_DELAY;
+    if (!forever) sim_deadline(&deadline, pdTICKS_TO_MS(ticks));
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) {
+        if (ticks == 0 || !cond_wait_ticks(&q->not_empty, &q->lock, forever ? NULL : &deadline)) {
+            pthread_mutex_unlock(&q->lock);
+            return pdFALSE;
+        }
+    }
+    if (q->item_size > 0 && item) {
+        memcpy(item, q->items + q->head * q->item_size, q->item_size);
+    }
+    if (remove) {
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    return queue_take(q, item, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    return queue_take(q, item, ticks, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t count = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t spaces = q->length - q->count;
+    pthread_mutex_unlock(&q->lock);
+    return spaces;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->count = 0;
+    q->head = 0;
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+// Semaphores are zero-size queues, as in FreeRTOS itself: a token is an item
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    QueueHandle_t q = xQueueCreate(max, 0);
+    if (q) q->count = initial;
+    return q;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    // No priority inheritance on the host
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks)
+{
+    return xQueueReceive(s, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    return xQueueSend(s, NULL, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t s, BaseType_t *woken)
+{
+    if (woken) *woken = pdFALSE;
+    return xSemaphoreGive(s);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t s)
+{
+    vQueueDelete(s);
+}
+
+// --- Event Groups ---
+struct sim_event_group {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct sim_event_group *g = calloc(1, sizeof(*g));
+    if (!g) return NULL;
+    pthread_mutex_init(&g->lock, NULL);
+    cond_init_monotonic(&g->changed);
+    return g;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t g, EventBits_t bits)
+{
+    pthread_mutex_lock(&g->lock);
+    g->bits |= bits;
+    EventBits_t now = g->bits;
+    pthread_cond_broadcast(&g->changed);
+    pthread_mutex_unlock(&g->lock);
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t g, EventBits_t bits)
+{
+    pthread_mutex_lock(&g->lock);
+    EventBits_t before = g->bits;
+    g->bits &= ~bits;
+    pthread_mutex_unlock(&g->lock);
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t g)
+{
+    pthread_mutex_lock(&g->lock);
+    EventBits_t bits = g->bits;
+    pthread_mutex_unlock(&g->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t g, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks)
+{
+    struct timespec deadline;
+    bool forever = ticks == portMAX_DELAY;
+    if (!forever) sim_deadline(&deadline, pdTICKS_TO_MS(ticks));
+
+    pthread_mutex_lock(&g->lock);
+    for (;;) {
+        bool met = wait_for_all ? (g->bits & bits) == bits : (g->bits & bits) != 0;
+        if (met || ticks == 0) break;
+        if (!cond_wait_ticks(&g->changed, &g->lock, forever ? NULL : &deadline)) break;
+    }
+    EventBits_t result = g->bits;
+    bool met = wait_for_all ? (result & bits) == bits : (result & bits) != 0;
+    if (met && clear_on_exit) g->bits &= ~bits;
+    pthread_mutex_unlock(&g->lock);
+    return result;
+}
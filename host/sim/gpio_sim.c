@@ -0,0 +1,191 @@
+// GPIO stand-in modelling the IR break-beam drop sensors below the chutes.
+// The n-th pin given an ISR handler watches the chute of the servo on LEDC
+// channel n, which is tray n's as long as every tray before it has a sensor.
+// Receivers pull low while the beam is broken (the default
+// CONFIG_ASHUMITRA_DROP_BROKEN_LEVEL).
+//
+// Enabling a pin's interrupt stands for a dispense arming its sensor: the
+// pill falls ASHUMITRA_SIM_DROP_MS (120) +- ASHUMITRA_SIM_DROP_JITTER_MS (60)
+// after the horn reaches the chute and breaks the beam for a few
+// milliseconds. ASHUMITRA_SIM_DROP_EMPTY_PCT (0) of the dispenses find the
+// slot empty and drop nothing; ASHUMITRA_SIM_DROP_JAM_PCT (0) jam the pill
+// across the beam for ASHUMITRA_SIM_JAM_MS (5000).
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "sim.h"
+
+#define SIM_DROP_BREAK_MS 8   // Time a falling pill takes to cross the beam
+
+static const char *TAG = "SIM_GPIO";
+
+typedef struct {
+    bool configured;
+    int level;
+    int channel;          // Servo whose chute the beam crosses, -1 without a handler
+    gpio_isr_t isr;
+    void *arg;
+    bool intr_enabled;
+    uint32_t break_at_ms;   // Pending beam changes, 0 when none is due
+    uint32_t restore_at_ms;
+} sim_pin_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static sim_pin_t s_pins[GPIO_NUM_MAX];
+static int s_sensor_count = 0;
+static bool s_service = false;
+
+// Earliest pending beam change, 0 if none. Caller holds s_lock.
+static uint32_t next_change_locked(void)
+{
+    uint32_t next = 0;
+    for (int i = 0; i < GPIO_NUM_MAX; i++) {
+        const sim_pin_t *pin = &s_pins[i];
+        uint32_t due = pin->break_at_ms ? pin->break_at_ms : pin->restore_at_ms;
+        if (due && (!next || due < next)) next = due;
+    }
+    return next;
+}
+
+// Applies the beam changes that are due, running the handlers outside the
+// lock as an interrupt would, one edge at a time
+static void *beam_thread(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&s_lock);
+    for (;;) {
+        uint32_t next = next_change_locked();
+        uint32_t now = sim_uptime_ms();
+        if (!next) {
+            pthread_cond_wait(&s_cond, &s_lock);
+            continue;
+        }
+        if (next > now) {
+            struct timespec deadline;
+            sim_deadline(&deadline, next - now);
+            pthread_cond_timedwait(&s_cond, &s_lock, &deadline);
+            continue; // Re-evaluate: a pin may have been re-armed
+        }
+
+        for (int i = 0; i < GPIO_NUM_MAX; i++) {
+            sim_pin_t *pin = &s_pins[i];
+            bool edge = false;
+            if (pin->break_at_ms && pin->break_at_ms <= now) {
+                pin->break_at_ms = 0;
+                pin->level = 0;
+                edge = true;
+            } else if (!pin->break_at_ms && pin->restore_at_ms && pin->restore_at_ms <= now) {
+                pin->restore_at_ms = 0;
+                pin->level = 1;
+                edge = true;
+            }
+            if (edge && pin->intr_enabled && pin->isr) {
+                gpio_isr_t isr = pin->isr;
+                void *isr_arg = pin->arg;
+                pthread_mutex_unlock(&s_lock);
+                isr(isr_arg);
+                pthread_mutex_lock(&s_lock);
+            }
+        }
+    }
+    return NULL;
+}
+
+esp_err_t gpio_config(const gpio_config_t *conf)
+{
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < GPIO_NUM_MAX; i++) {
+        if (!(conf->pin_bit_mask & (1ULL << i))) continue;
+        s_pins[i].configured = true;
+        s_pins[i].level = 1; // Beam clear
+        s_pins[i].channel = -1;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    pthread_mutex_lock(&s_lock);
+    bool installed = s_service;
+    if (!installed) {
+        s_service = true;
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&s_cond, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_t thread;
+        pthread_create(&thread, NULL, beam_thread, NULL);
+        pthread_detach(thread);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return installed ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    if (!s_service) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim_pin_t *pin = &s_pins[gpio_num];
+    pin->isr = isr_handler;
+    pin->arg = args;
+    pin->channel = s_sensor_count++;
+    pthread_mutex_unlock(&s_lock);
+    ESP_LOGI(TAG, "GPIO %d: drop sensor below servo channel %d", gpio_num, pin->channel);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    if (!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+    sim_pin_t *pin = &s_pins[gpio_num];
+
+    // Decide what this dispense drops before taking the lock
+    uint32_t roll = esp_random() % 100;
+    int empty_pct = sim_env_int("ASHUMITRA_SIM_DROP_EMPTY_PCT", 0);
+    int jam_pct = sim_env_int("ASHUMITRA_SIM_DROP_JAM_PCT", 0);
+    int jitter = sim_env_int("ASHUMITRA_SIM_DROP_JITTER_MS", 60);
+    int delay = sim_env_int("ASHUMITRA_SIM_DROP_MS", 120);
+    if (jitter > 0) delay += (int)(esp_random() % (2 * jitter + 1)) - jitter;
+    if (delay < 1) delay = 1;
+
+    uint32_t now = sim_uptime_ms();
+    uint32_t arrival = pin->channel >= 0 ? sim_servo_arrival_ms(pin->channel) : now;
+    pthread_mutex_lock(&s_lock);
+    pin->intr_enabled = true;
+    if (pin->channel >= 0 && roll >= (uint32_t)empty_pct) {
+        pin->break_at_ms = (arrival > now ? arrival : now) + (uint32_t)delay;
+        pin->restore_at_ms = pin->break_at_ms +
+            (roll < (uint32_t)(empty_pct + jam_pct) ? (uint32_t)sim_env_int("ASHUMITRA_SIM_JAM_MS", 5000) : SIM_DROP_BREAK_MS);
+        pthread_cond_signal(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    if (!GPIO_IS_VALID_GPIO(gpio_num)) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    s_pins[gpio_num].intr_enabled = false;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (!GPIO_IS_VALID_GPIO(gpio_num)) return 0;
+    pthread_mutex_lock(&s_lock);
+    int level = s_pins[gpio_num].configured ? s_pins[gpio_num].level : 0;
+    pthread_mutex_unlock(&s_lock);
+    return level;
+}
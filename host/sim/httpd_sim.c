@@ -0,0 +1,1040 @@
+// esp_http_server stand-in on real sockets. Like the ESP-IDF server it runs
+// every handler on one thread, multiplexing sessions with select(), keeps
+// connections alive, caps open sessions at max_open_sockets (optionally
+// purging the least recently used one) and supports WebSocket sessions,
+// httpd_queue_work() and a custom close_fn.
+//
+// The listening port comes from ASHUMITRA_SIM_PORT (default 8080) rather than
+// config.server_port, so the simulator runs without privileges.
+// ASHUMITRA_SIM_HTTP_DELAY_MS (0) holds every request that long before its
+// handler runs, to stand in for a unit on a poor link in fleet tests.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "sim.h"
+
+#define SIM_HTTPD_MAX_HDR_LEN  1024 // CONFIG_HTTPD_MAX_REQ_HDR_LEN
+#define SIM_HTTPD_MAX_URI_LEN  512  // CONFIG_HTTPD_MAX_URI_LEN
+#define SIM_HTTPD_RX_BUF       (SIM_HTTPD_MAX_HDR_LEN + 512)
+#define SIM_HTTPD_WORK_QUEUE   32
+
+static const char *TAG = "SIM_HTTPD";
+
+typedef struct {
+    int fd;               // -1 when free
+    bool ws;              // WebSocket handshake done
+    int ws_handler;       // Index of the WebSocket URI handler
+    uint32_t last_used;   // For LRU purging
+    bool close_requested; // httpd_sess_trigger_close() was called
+    size_t rx_len;
+    char rx[SIM_HTTPD_RX_BUF];
+} sim_sess_t;
+
+typedef struct {
+    httpd_work_fn_t fn;
+    void *arg;
+} sim_work_t;
+
+typedef struct {
+    httpd_config_t config;
+    uint16_t port;
+    int delay_ms;       // Added before every handler, see ASHUMITRA_SIM_HTTP_DELAY_MS
+    int listen_fd;
+    int wake_pipe[2];
+    pthread_t thread;
+    bool stop;
+
+    httpd_uri_t *handlers;
+    int handler_count;
+
+    pthread_mutex_t sess_lock; // Guards fd/ws of sessions for lookups from other threads
+    sim_sess_t *sessions;
+
+    pthread_mutex_t work_lock;
+    sim_work_t work[SIM_HTTPD_WORK_QUEUE];
+    int work_count;
+
+    pthread_mutex_t send_lock; // Keeps frames sent from other tasks whole
+} sim_server_t;
+
+typedef struct {
+    const char *field;
+    const char *value;
+} sim_resp_hdr_t;
+
+// Per-request state behind httpd_req_t.aux
+typedef struct {
+    sim_server_t *server;
+    sim_sess_t *sess;
+    char headers[SIM_HTTPD_MAX_HDR_LEN + 1]; // Header lines after the request line
+    size_t body_left;                        // Body bytes not yet read by the handler
+    bool keep_alive;
+
+    const char *status;
+    const char *content_type;
+    sim_resp_hdr_t resp_hdrs[16];
+    int resp_hdr_count;
+    bool chunked_started;
+
+    // WebSocket frame being delivered to the handler
+    bool ws_final;
+    httpd_ws_type_t ws_type;
+    size_t ws_len;
+    bool ws_masked;
+    uint8_t ws_mask[4];
+    bool ws_payload_read;
+} sim_req_t;
+
+// --- Socket I/O ---
+// Reads from the session's buffered input first, then from the socket
+// (blocking, bounded by the receive timeout). Returns bytes read, 0 on close,
+// or a negative HTTPD_SOCK_ERR_* value.
+static int sess_recv(sim_sess_t *sess, void *buf, size_t len)
+{
+    if (sess->rx_len > 0) {
+        size_t n = len < sess->rx_len ? len : sess->rx_len;
+        memcpy(buf, sess->rx, n);
+        memmove(sess->rx, sess->rx + n, sess->rx_len - n);
+        sess->rx_len -= n;
+        return (int)n;
+    }
+    ssize_t n = recv(sess->fd, buf, len, 0);
+    if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    return (int)n;
+}
+
+static bool sess_recv_all(sim_sess_t *sess, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len > 0) {
+        int n = sess_recv(sess, p, len);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool send_all(int fd, const void *buf, size_t len, int flags)
+{
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, flags | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// --- Sessions ---
+static sim_sess_t *find_sess(sim_server_t *server, int fd)
+{
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd == fd) return &server->sessions[i];
+    }
+    return NULL;
+}
+
+static void close_sess(sim_server_t *server, sim_sess_t *sess)
+{
+    int fd = sess->fd;
+    pthread_mutex_lock(&server->sess_lock);
+    sess->fd = -1;
+    sess->ws = false;
+    sess->rx_len = 0;
+    sess->close_requested = false;
+    pthread_mutex_unlock(&server->sess_lock);
+
+    if (server->config.close_fn) {
+        server->config.close_fn(server, fd); // Must close the socket itself
+    } else {
+        close(fd);
+    }
+}
+
+static int open_sess_count(sim_server_t *server)
+{
+    int count = 0;
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd >= 0) count++;
+    }
+    return count;
+}
+
+static void accept_sess(sim_server_t *server)
+{
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    fcntl(fd, F_SETFD, FD_CLOEXEC); // Not inherited by esp_restart()'s exec
+
+    sim_sess_t *free_sess = find_sess(server, -1);
+    if (!free_sess && server->config.lru_purge_enable) {
+        // Purge the least recently used session to make room
+        sim_sess_t *lru = NULL;
+        for (int i = 0; i < server->config.max_open_sockets; i++) {
+            sim_sess_t *s = &server->sessions[i];
+            if (!lru || (int32_t)(s->last_used - lru->last_used) < 0) lru = s;
+        }
+        ESP_LOGW(TAG, "Purging least recently used session %d", lru->fd);
+        close_sess(server, lru);
+        free_sess = lru;
+    }
+    if (!free_sess) {
+        close(fd);
+        return;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval rcv = { .tv_sec = server->config.recv_wait_timeout };
+    struct timeval snd = { .tv_sec = server->config.send_wait_timeout };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &rcv, sizeof(rcv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &snd, sizeof(snd));
+
+    if (server->config.open_fn && server->config.open_fn(server, fd) != ESP_OK) {
+        close(fd);
+        return;
+    }
+
+    pthread_mutex_lock(&server->sess_lock);
+    free_sess->fd = fd;
+    free_sess->ws = false;
+    free_sess->rx_len = 0;
+    free_sess->close_requested = false;
+    free_sess->last_used = sim_uptime_ms();
+    pthread_mutex_unlock(&server->sess_lock);
+}
+
+// --- Request Parsing Helpers ---
+static const char *find_header(const char *headers, const char *field, size_t *value_len)
+{
+    size_t field_len = strlen(field);
+    const char *line = headers;
+    while (*line) {
+        const char *eol = strstr(line, "\r\n");
+        if (!eol) eol = line + strlen(line);
+        if ((size_t)(eol - line) > field_len && strncasecmp(line, field, field_len) == 0 && line[field_len] == ':') {
+            const char *value = line + field_len + 1;
+            while (value < eol && (*value == ' ' || *value == '\t')) value++;
+            const char *end = eol;
+            while (end > value && (end[-1] == ' ' || end[-1] == '\t')) end--;
+            *value_len = end - value;
+            return value;
+        }
+        line = *eol ? eol + 2 : eol;
+    }
+    return NULL;
+}
+
+static bool header_has_token(const char *headers, const char *field, const char *token)
+{
+    size_t len;
+    const char *value = find_header(headers, field, &len);
+    if (!value) return false;
+    size_t token_len = strlen(token);
+    for (size_t i = 0; i + token_len <= len; i++) {
+        if (strncasecmp(value + i, token, token_len) == 0) return true;
+    }
+    return false;
+}
+
+static int parse_method(const char *method, size_t len)
+{
+    static const struct { const char *name; int method; } methods[] = {
+        { "GET", HTTP_GET }, { "POST", HTTP_POST }, { "PUT", HTTP_PUT },
+        { "DELETE", HTTP_DELETE }, { "HEAD", HTTP_HEAD },
+    };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (strlen(methods[i].name) == len && strncmp(methods[i].name, method, len) == 0) return methods[i].method;
+    }
+    return -1;
+}
+
+static bool uri_matches(sim_server_t *server, const char *template, const char *uri, size_t len)
+{
+    if (server->config.uri_match_fn) return server->config.uri_match_fn(template, uri, len);
+    return strlen(template) == len && strncmp(template, uri, len) == 0;
+}
+
+// Sends a minimal error response outside of any handler
+static void send_error(sim_sess_t *sess, const char *status, const char *msg)
+{
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf), "HTTP/1.1 %s\r\nContent-Type: text/html\r\nContent-Length: %d\r\n\r\n%s",
+                       status, (int)strlen(msg), msg);
+    send_all(sess->fd, buf, len, 0);
+}
+
+// --- SHA-1 and Base64 for the WebSocket handshake ---
+typedef struct {
+    uint32_t h[5];
+    uint64_t len;
+    uint8_t block[64];
+    size_t used;
+} sha1_ctx_t;
+
+static uint32_t rol32(uint32_t v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+static void sha1_block(sha1_ctx_t *c, const uint8_t *p)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 80; i++) w[i] = rol32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = c->h[0], b = c->h[1], cc = c->h[2], d = c->h[3], e = c->h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20)      { f = (b & cc) | (~b & d);           k = 0x5a827999; }
+        else if (i < 40) { f = b ^ cc ^ d;                    k = 0x6ed9eba1; }
+        else if (i < 60) { f = (b & cc) | (b & d) | (cc & d); k = 0x8f1bbcdc; }
+        else             { f = b ^ cc ^ d;                    k = 0xca62c1d6; }
+        uint32_t t = rol32(a, 5) + f + e + k + w[i];
+        e = d; d = cc; cc = rol32(b, 30); b = a; a = t;
+    }
+    c->h[0] += a; c->h[1] += b; c->h[2] += cc; c->h[3] += d; c->h[4] += e;
+}
+
+static void sha1(const uint8_t *data, size_t len, uint8_t out[20])
+{
+    sha1_ctx_t c = { .h = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 } };
+    c.len = (uint64_t)len * 8;
+    for (size_t i = 0; i < len; i++) {
+        c.block[c.used++] = data[i];
+        if (c.used == 64) {
+            sha1_block(&c, c.block);
+            c.used = 0;
+        }
+    }
+    c.block[c.used++] = 0x80;
+    if (c.used > 56) {
+        while (c.used < 64) c.block[c.used++] = 0;
+        sha1_block(&c, c.block);
+        c.used = 0;
+    }
+    while (c.used < 56) c.block[c.used++] = 0;
+    for (int i = 7; i >= 0; i--) c.block[c.used++] = (uint8_t)(c.len >> (8 * i));
+    sha1_block(&c, c.block);
+    for (int i = 0; i < 5; i++) {
+        out[4 * i] = c.h[i] >> 24; out[4 * i + 1] = c.h[i] >> 16; out[4 * i + 2] = c.h[i] >> 8; out[4 * i + 3] = c.h[i];
+    }
+}
+
+static void base64(const uint8_t *in, size_t len, char *out)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16 | (i + 1 < len ? (uint32_t)in[i + 1] << 8 : 0) | (i + 2 < len ? in[i + 2] : 0);
+        out[o++] = table[(v >> 18) & 63];
+        out[o++] = table[(v >> 12) & 63];
+        out[o++] = i + 1 < len ? table[(v >> 6) & 63] : '=';
+        out[o++] = i + 2 < len ? table[v & 63] : '=';
+    }
+    out[o] = '\0';
+}
+
+static bool ws_handshake(sim_sess_t *sess, const char *headers)
+{
+    static const char guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    size_t key_len;
+    const char *key = find_header(headers, "Sec-WebSocket-Key", &key_len);
+    if (!key || key_len > 64) return false;
+
+    char concat[128];
+    uint8_t digest[20];
+    char accept[32];
+    int concat_len = snprintf(concat, sizeof(concat), "%.*s%s", (int)key_len, key, guid);
+    sha1((const uint8_t *)concat, concat_len, digest);
+    base64(digest, sizeof(digest), accept);
+
+    char resp[256];
+    int len = snprintf(resp, sizeof(resp),
+                       "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    return send_all(sess->fd, resp, len, 0);
+}
+
+// --- Request Handling ---
+static void init_req(httpd_req_t *req, sim_req_t *ra, sim_server_t *server, sim_sess_t *sess)
+{
+    memset(req, 0, sizeof(*req));
+    memset(ra, 0, sizeof(*ra));
+    req->handle = server;
+    req->aux = ra;
+    ra->server = server;
+    ra->sess = sess;
+    ra->status = "200 OK";
+    ra->content_type = "text/html";
+}
+
+// Handles one complete request whose header block is at the start of rx.
+// Returns false if the session must be closed.
+static bool handle_http(sim_server_t *server, sim_sess_t *sess, size_t hdr_len)
+{
+    httpd_req_t req;
+    sim_req_t ra;
+    init_req(&req, &ra, server, sess);
+
+    // Request line: METHOD SP URI SP VERSION
+    char *line_end = strstr(sess->rx, "\r\n");
+    char *sp1 = memchr(sess->rx, ' ', line_end - sess->rx);
+    char *sp2 = sp1 ? memchr(sp1 + 1, ' ', line_end - sp1 - 1) : NULL;
+    if (!sp1 || !sp2) {
+        send_error(sess, "400 Bad Request", "Bad Request");
+        return false;
+    }
+    int method = parse_method(sess->rx, sp1 - sess->rx);
+    size_t uri_len = sp2 - sp1 - 1;
+    bool http10 = strncmp(sp2 + 1, "HTTP/1.0", 8) == 0;
+    if (uri_len > SIM_HTTPD_MAX_URI_LEN) {
+        send_error(sess, "414 URI Too Long", "URI is too long");
+        return false;
+    }
+    memcpy((char *)req.uri, sp1 + 1, uri_len);
+    ((char *)req.uri)[uri_len] = '\0';
+    req.method = method;
+
+    size_t headers_len = hdr_len - (line_end + 2 - sess->rx);
+    memcpy(ra.headers, line_end + 2, headers_len);
+    ra.headers[headers_len] = '\0';
+
+    size_t cl_len;
+    const char *cl = find_header(ra.headers, "Content-Length", &cl_len);
+    req.content_len = cl ? strtoul(cl, NULL, 10) : 0;
+    ra.body_left = req.content_len;
+    ra.keep_alive = http10 ? header_has_token(ra.headers, "Connection", "keep-alive")
+                           : !header_has_token(ra.headers, "Connection", "close");
+
+    // Drop the header block from rx; body bytes (if any) follow
+    memmove(sess->rx, sess->rx + hdr_len, sess->rx_len - hdr_len);
+    sess->rx_len -= hdr_len;
+
+    // Find the handler, matching the path without the query string
+    const char *query = strchr(req.uri, '?');
+    size_t path_len = query ? (size_t)(query - req.uri) : uri_len;
+    int handler = -1;
+    bool path_known = false;
+    for (int i = 0; i < server->handler_count; i++) {
+        if (uri_matches(server, server->handlers[i].uri, req.uri, path_len)) {
+            path_known = true;
+            if ((int)server->handlers[i].method == method) {
+                handler = i;
+                break;
+            }
+        }
+    }
+
+    bool keep = true;
+    if (method < 0) {
+        send_error(sess, "405 Method Not Allowed", "Request method is not supported by server");
+        keep = false;
+    } else if (handler < 0) {
+        if (path_known) {
+            send_error(sess, "405 Method Not Allowed", "Request method for this URI is not handled by server");
+        } else {
+            send_error(sess, "404 Not Found", "Nothing matches the given URI");
+        }
+    } else {
+        const httpd_uri_t *h = &server->handlers[handler];
+        req.user_ctx = h->user_ctx;
+        if (h->is_websocket) {
+            if (!header_has_token(ra.headers, "Upgrade", "websocket") || !ws_handshake(sess, ra.headers)) {
+                send_error(sess, "400 Bad Request", "Bad Request");
+                return false;
+            }
+            pthread_mutex_lock(&server->sess_lock);
+            sess->ws = true;
+            sess->ws_handler = handler;
+            pthread_mutex_unlock(&server->sess_lock);
+            ra.keep_alive = true;
+        }
+        if (server->delay_ms > 0) {
+            usleep(server->delay_ms * 1000); // Blocks every session, like a slow link in front of the single server task
+        }
+        if (h->handler(&req) != ESP_OK) {
+            keep = false; // As in ESP-IDF, a failing handler closes the session
+        }
+    }
+
+    // Discard any body the handler did not read
+    char discard[256];
+    while (keep && ra.body_left > 0) {
+        int n = sess_recv(sess, discard, ra.body_left < sizeof(discard) ? ra.body_left : sizeof(discard));
+        if (n <= 0) return false;
+        ra.body_left -= n;
+    }
+    return keep && ra.keep_alive;
+}
+
+static bool ws_send(sim_server_t *server, int fd, httpd_ws_type_t type, bool final, const uint8_t *payload, size_t len)
+{
+    uint8_t hdr[10];
+    size_t hdr_len = 2;
+    hdr[0] = (final ? 0x80 : 0) | (type & 0x0f);
+    if (len < 126) {
+        hdr[1] = (uint8_t)len;
+    } else if (len < 65536) {
+        hdr[1] = 126;
+        hdr[2] = len >> 8;
+        hdr[3] = len & 0xff;
+        hdr_len = 4;
+    } else {
+        hdr[1] = 127;
+        for (int i = 0; i < 8; i++) hdr[2 + i] = (uint8_t)((uint64_t)len >> (56 - 8 * i));
+        hdr_len = 10;
+    }
+    pthread_mutex_lock(&server->send_lock);
+    bool ok = send_all(fd, hdr, hdr_len, len ? MSG_MORE : 0) && (len == 0 || send_all(fd, payload, len, 0));
+    pthread_mutex_unlock(&server->send_lock);
+    return ok;
+}
+
+// Reads one frame header from a WebSocket session and dispatches it.
+// Returns false if the session must be closed.
+static bool handle_ws_frame(sim_server_t *server, sim_sess_t *sess)
+{
+    httpd_req_t req;
+    sim_req_t ra;
+    init_req(&req, &ra, server, sess);
+
+    uint8_t hdr[2];
+    if (!sess_recv_all(sess, hdr, 2)) return false;
+    ra.ws_final = hdr[0] & 0x80;
+    ra.ws_type = (httpd_ws_type_t)(hdr[0] & 0x0f);
+    ra.ws_masked = hdr[1] & 0x80;
+    ra.ws_len = hdr[1] & 0x7f;
+    if (ra.ws_len == 126) {
+        uint8_t ext[2];
+        if (!sess_recv_all(sess, ext, 2)) return false;
+        ra.ws_len = (size_t)ext[0] << 8 | ext[1];
+    } else if (ra.ws_len == 127) {
+        uint8_t ext[8];
+        if (!sess_recv_all(sess, ext, 8)) return false;
+        ra.ws_len = 0;
+        for (int i = 0; i < 8; i++) ra.ws_len = (ra.ws_len << 8) | ext[i];
+    }
+    if (ra.ws_masked && !sess_recv_all(sess, ra.ws_mask, 4)) return false;
+
+    const httpd_uri_t *h = &server->handlers[sess->ws_handler];
+    if (!h->handle_ws_control_frames && (ra.ws_type == HTTPD_WS_TYPE_CLOSE || ra.ws_type == HTTPD_WS_TYPE_PING ||
+                                         ra.ws_type == HTTPD_WS_TYPE_PONG)) {
+        uint8_t payload[125];
+        if (ra.ws_len > sizeof(payload) || !sess_recv_all(sess, payload, ra.ws_len)) return false;
+        for (size_t i = 0; ra.ws_masked && i < ra.ws_len; i++) payload[i] ^= ra.ws_mask[i % 4];
+        if (ra.ws_type == HTTPD_WS_TYPE_PING) {
+            return ws_send(server, sess->fd, HTTPD_WS_TYPE_PONG, true, payload, ra.ws_len);
+        }
+        if (ra.ws_type == HTTPD_WS_TYPE_CLOSE) {
+            ws_send(server, sess->fd, HTTPD_WS_TYPE_CLOSE, true, NULL, 0);
+            return false;
+        }
+        return true; // Unsolicited pong
+    }
+
+    req.method = 0; // Only the handshake call is HTTP_GET
+    snprintf((char *)req.uri, sizeof(req.uri), "%s", h->uri);
+    req.user_ctx = h->user_ctx;
+    bool keep = h->handler(&req) == ESP_OK;
+
+    // Discard a payload the handler did not read
+    if (keep && !ra.ws_payload_read) {
+        char discard[256];
+        size_t left = ra.ws_len;
+        while (left > 0) {
+            int n = sess_recv(sess, discard, left < sizeof(discard) ? left : sizeof(discard));
+            if (n <= 0) return false;
+            left -= n;
+        }
+    }
+    return keep;
+}
+
+// Handles everything buffered (or arriving) on a readable session.
+// Returns false if the session must be closed.
+static bool handle_sess(sim_server_t *server, sim_sess_t *sess)
+{
+    ssize_t n = recv(sess->fd, sess->rx + sess->rx_len, sizeof(sess->rx) - sess->rx_len, MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) return false;
+    if (n > 0) sess->rx_len += n;
+    sess->last_used = sim_uptime_ms();
+
+    for (;;) {
+        if (sess->ws) {
+            if (sess->rx_len == 0) return true;
+            if (!handle_ws_frame(server, sess)) return false;
+            continue;
+        }
+
+        // Wait until the whole header block has arrived
+        char *end = NULL;
+        for (size_t i = 0; i + 4 <= sess->rx_len; i++) {
+            if (memcmp(sess->rx + i, "\r\n\r\n", 4) == 0) {
+                end = sess->rx + i;
+                break;
+            }
+        }
+        if (!end) {
+            if (sess->rx_len > SIM_HTTPD_MAX_HDR_LEN) {
+                send_error(sess, "431 Request Header Fields Too Large", "Header fields are too long");
+                return false;
+            }
+            return true;
+        }
+        end[2] = '\0'; // Terminate the header block after its last CRLF for the string helpers
+        if (!handle_http(server, sess, end - sess->rx + 4)) return false;
+        if (sess->rx_len == 0) return true;
+    }
+}
+
+static void run_work(sim_server_t *server)
+{
+    sim_work_t work[SIM_HTTPD_WORK_QUEUE];
+    pthread_mutex_lock(&server->work_lock);
+    int count = server->work_count;
+    memcpy(work, server->work, count * sizeof(work[0]));
+    server->work_count = 0;
+    pthread_mutex_unlock(&server->work_lock);
+
+    for (int i = 0; i < count; i++) work[i].fn(work[i].arg);
+}
+
+static void *server_thread(void *arg)
+{
+    sim_server_t *server = arg;
+    sim_task_adopt("httpd", server->config.stack_size, server->config.task_priority, server->config.core_id);
+
+    while (!server->stop) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(server->wake_pipe[0], &rfds);
+        int maxfd = server->wake_pipe[0];
+        // Without an address nothing reaches the device; check again shortly
+        bool link_up = sim_wifi_link_up();
+        struct timeval link_poll = { .tv_usec = 10000 };
+        if (link_up && (server->config.lru_purge_enable || open_sess_count(server) < server->config.max_open_sockets)) {
+            FD_SET(server->listen_fd, &rfds);
+            if (server->listen_fd > maxfd) maxfd = server->listen_fd;
+        }
+        for (int i = 0; i < server->config.max_open_sockets && link_up; i++) {
+            int fd = server->sessions[i].fd;
+            if (fd >= 0) {
+                FD_SET(fd, &rfds);
+                if (fd > maxfd) maxfd = fd;
+            }
+        }
+
+        if (select(maxfd + 1, &rfds, NULL, NULL, link_up ? NULL : &link_poll) < 0) {
+            if (errno == EINTR) continue;
+            ESP_LOGE(TAG, "select() failed: %s", strerror(errno));
+            break;
+        }
+
+        // Data from the network waits at the AP while the station sleeps
+        bool network_rx = FD_ISSET(server->listen_fd, &rfds);
+        for (int i = 0; i < server->config.max_open_sockets && !network_rx; i++) {
+            network_rx = server->sessions[i].fd >= 0 && FD_ISSET(server->sessions[i].fd, &rfds);
+        }
+        uint32_t rx_delay_ms = network_rx ? sim_wifi_rx_delay_ms() : 0;
+        if (rx_delay_ms > 0) {
+            usleep(rx_delay_ms * 1000);
+        }
+
+        if (FD_ISSET(server->wake_pipe[0], &rfds)) {
+            char drain[64];
+            while (read(server->wake_pipe[0], drain, sizeof(drain)) == sizeof(drain)) {
+            }
+            run_work(server);
+        }
+        for (int i = 0; i < server->config.max_open_sockets; i++) {
+            sim_sess_t *sess = &server->sessions[i];
+            if (sess->fd < 0) continue;
+            if (sess->close_requested || (FD_ISSET(sess->fd, &rfds) && !handle_sess(server, sess))) {
+                close_sess(server, sess);
+            }
+        }
+        if (FD_ISSET(server->listen_fd, &rfds)) {
+            accept_sess(server);
+        }
+    }
+    return NULL;
+}
+
+// --- Public API ---
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    sim_server_t *server = calloc(1, sizeof(*server));
+    if (!server) return ESP_ERR_HTTPD_ALLOC_MEM;
+    server->config = *config;
+    server->port = (uint16_t)sim_env_int("ASHUMITRA_SIM_PORT", 8080);
+    server->delay_ms = sim_env_int("ASHUMITRA_SIM_HTTP_DELAY_MS", 0);
+    server->handlers = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    server->sessions = calloc(config->max_open_sockets, sizeof(sim_sess_t));
+    if (!server->handlers || !server->sessions || pipe(server->wake_pipe) != 0) {
+        free(server->handlers);
+        free(server->sessions);
+        free(server);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    for (int i = 0; i < config->max_open_sockets; i++) server->sessions[i].fd = -1;
+    pthread_mutex_init(&server->sess_lock, NULL);
+    pthread_mutex_init(&server->work_lock, NULL);
+    pthread_mutex_init(&server->send_lock, NULL);
+
+    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0); // Not inherited by esp_restart()'s exec
+    int one = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(server->port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (server->listen_fd < 0 || bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server->listen_fd, config->backlog_conn) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on port %d: %s", server->port, strerror(errno));
+        if (server->listen_fd >= 0) close(server->listen_fd);
+        close(server->wake_pipe[0]);
+        close(server->wake_pipe[1]);
+        free(server->handlers);
+        free(server->sessions);
+        free(server);
+        return ESP_ERR_HTTPD_TASK;
+    }
+
+    if (pthread_create(&server->thread, NULL, server_thread, server) != 0) {
+        close(server->listen_fd);
+        free(server->handlers);
+        free(server->sessions);
+        free(server);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    ESP_LOGI(TAG, "Listening on http://127.0.0.1:%d (max %d sessions%s)", server->port,
+             config->max_open_sockets, config->lru_purge_enable ? ", LRU purge" : "");
+    *handle = server;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    sim_server_t *server = handle;
+    if (!server) return ESP_ERR_INVALID_ARG;
+    server->stop = true;
+    if (write(server->wake_pipe[1], "x", 1) < 0) {
+        // The thread also exits on its next wakeup
+    }
+    pthread_join(server->thread, NULL);
+    for (int i = 0; i < server->config.max_open_sockets; i++) {
+        if (server->sessions[i].fd >= 0) close_sess(server, &server->sessions[i]);
+    }
+    close(server->listen_fd);
+    close(server->wake_pipe[0]);
+    close(server->wake_pipe[1]);
+    free(server->handlers);
+    free(server->sessions);
+    free(server);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    sim_server_t *server = handle;
+    for (int i = 0; i < server->handler_count; i++) {
+        if (server->handlers[i].method == uri_handler->method && strcmp(server->handlers[i].uri, uri_handler->uri) == 0) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (server->handler_count >= server->config.max_uri_handlers) {
+        ESP_LOGW(TAG, "No slot left for registering handler %s", uri_handler->uri);
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    server->handlers[server->handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+// Same rules as ESP-IDF: a trailing '*' matches any suffix, a trailing '?'
+// makes the preceding character optional, and both may be combined.
+bool httpd_uri_match_wildcard(const char *template, const char *uri, size_t len)
+{
+    size_t tpl_len = strlen(template);
+    char last = tpl_len > 0 ? template[tpl_len - 1] : 0;
+    char prevlast = tpl_len > 1 ? template[tpl_len - 2] : 0;
+    bool asterisk = last == '*' || (prevlast == '*' && last == '?');
+    bool quest = last == '?' || (prevlast == '?' && last == '*');
+    size_t special = (asterisk ? 1 : 0) + (quest ? 2 : 0);
+
+    if (tpl_len < special) return false;
+    size_t exact = tpl_len - special;
+    if (len < exact) return false;
+
+    if (!quest) {
+        if (!asterisk && len != exact) return false;
+        return strncmp(template, uri, exact) == 0;
+    }
+    if (len > exact && template[exact] != uri[exact]) return false;
+    if (strncmp(template, uri, exact) != 0) return false;
+    return asterisk || len <= exact + 1;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    const char *query = strchr(r->uri, '?');
+    if (!query) return ESP_ERR_NOT_FOUND;
+    query++;
+    size_t len = strcspn(query, "#");
+    if (buf_len == 0) return ESP_ERR_HTTPD_RESULT_TRUNC;
+    size_t n = len < buf_len - 1 ? len : buf_len - 1;
+    memcpy(buf, query, n);
+    buf[n] = '\0';
+    return n < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    const char *query = strchr(r->uri, '?');
+    return query ? strcspn(query + 1, "#") : 0;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    size_t key_len = strlen(key);
+    const char *p = qry;
+    while (p && *p) {
+        const char *end = strchr(p, '&');
+        size_t pair_len = end ? (size_t)(end - p) : strlen(p);
+        const char *eq = memchr(p, '=', pair_len);
+        size_t name_len = eq ? (size_t)(eq - p) : pair_len;
+        if (name_len == key_len && strncmp(p, key, key_len) == 0) {
+            const char *value = eq ? eq + 1 : p + pair_len;
+            size_t value_len = p + pair_len - value;
+            if (val_size == 0) return ESP_ERR_HTTPD_RESULT_TRUNC;
+            size_t n = value_len < val_size - 1 ? value_len : val_size - 1;
+            memcpy(val, value, n);
+            val[n] = '\0';
+            return n < value_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+        }
+        p = end ? end + 1 : NULL;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    sim_req_t *ra = r->aux;
+    size_t len;
+    return find_header(ra->headers, field, &len) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    sim_req_t *ra = r->aux;
+    size_t len;
+    const char *value = find_header(ra->headers, field, &len);
+    if (!value) return ESP_ERR_NOT_FOUND;
+    if (val_size == 0) return ESP_ERR_HTTPD_RESULT_TRUNC;
+    size_t n = len < val_size - 1 ? len : val_size - 1;
+    memcpy(val, value, n);
+    val[n] = '\0';
+    return n < len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    sim_req_t *ra = r->aux;
+    if (ra->body_left == 0) return 0;
+    if (buf_len > ra->body_left) buf_len = ra->body_left;
+    int n = sess_recv(ra->sess, buf, buf_len);
+    if (n > 0) ra->body_left -= n;
+    return n == 0 ? HTTPD_SOCK_ERR_FAIL : n;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    sim_req_t *ra = r->aux;
+    return ra->sess->fd;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    ((sim_req_t *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    ((sim_req_t *)r->aux)->content_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    sim_req_t *ra = r->aux;
+    if (ra->resp_hdr_count >= ra->server->config.max_resp_headers ||
+        ra->resp_hdr_count >= (int)(sizeof(ra->resp_hdrs) / sizeof(ra->resp_hdrs[0]))) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    // Like ESP-IDF, only the pointers are kept; they must stay valid until the response is sent
+    ra->resp_hdrs[ra->resp_hdr_count++] = (sim_resp_hdr_t) { field, value };
+    return ESP_OK;
+}
+
+// Formats the status line and headers. Returns the length, or -1 if they do not fit.
+static int format_resp_head(sim_req_t *ra, char *buf, size_t size, const char *length_hdr)
+{
+    int len = snprintf(buf, size, "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s\r\n", ra->status, ra->content_type, length_hdr);
+    for (int i = 0; i < ra->resp_hdr_count && len < (int)size; i++) {
+        len += snprintf(buf + len, size - len, "%s: %s\r\n", ra->resp_hdrs[i].field, ra->resp_hdrs[i].value);
+    }
+    if (len < (int)size) len += snprintf(buf + len, size - len, "\r\n");
+    return len < (int)size ? len : -1;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    sim_req_t *ra = r->aux;
+    char head[1024];
+    char length_hdr[48];
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN) buf_len = buf ? (ssize_t)strlen(buf) : 0;
+    snprintf(length_hdr, sizeof(length_hdr), "Content-Length: %d", (int)buf_len);
+    int head_len = format_resp_head(ra, head, sizeof(head), length_hdr);
+    if (head_len < 0) return ESP_ERR_HTTPD_RESP_HDR;
+
+    // Header and body leave in one segment where possible
+    if (!send_all(ra->sess->fd, head, head_len, buf_len > 0 ? MSG_MORE : 0) ||
+        (buf_len > 0 && !send_all(ra->sess->fd, buf, buf_len, 0))) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    sim_req_t *ra = r->aux;
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN) buf_len = buf ? (ssize_t)strlen(buf) : 0;
+    if (!ra->chunked_started) {
+        char head[1024];
+        int head_len = format_resp_head(ra, head, sizeof(head), "Transfer-Encoding: chunked");
+        if (head_len < 0) return ESP_ERR_HTTPD_RESP_HDR;
+        if (!send_all(ra->sess->fd, head, head_len, MSG_MORE)) return ESP_ERR_HTTPD_RESP_SEND;
+        ra->chunked_started = true;
+    }
+
+    char size_line[16];
+    int size_len = snprintf(size_line, sizeof(size_line), "%x\r\n", (unsigned)buf_len);
+    bool ok = send_all(ra->sess->fd, size_line, size_len, MSG_MORE) &&
+              (buf_len == 0 || send_all(ra->sess->fd, buf, buf_len, MSG_MORE)) &&
+              send_all(ra->sess->fd, "\r\n", 2, 0);
+    return ok ? ESP_OK : ESP_ERR_HTTPD_RESP_SEND;
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t *r)
+{
+    httpd_resp_set_status(r, "500 Internal Server Error");
+    httpd_resp_set_type(r, "text/html");
+    return httpd_resp_send(r, "Server has encountered an unexpected error", HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_404(httpd_req_t *r)
+{
+    httpd_resp_set_status(r, "404 Not Found");
+    httpd_resp_set_type(r, "text/html");
+    return httpd_resp_send(r, "This URI does not exist", HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    sim_server_t *server = handle;
+    if (!server) return ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&server->work_lock);
+    bool queued = server->work_count < SIM_HTTPD_WORK_QUEUE;
+    if (queued) server->work[server->work_count++] = (sim_work_t) { work, arg };
+    pthread_mutex_unlock(&server->work_lock);
+
+    if (!queued) return ESP_FAIL;
+    return write(server->wake_pipe[1], "w", 1) == 1 ? ESP_OK : ESP_FAIL;
+}
+
+static void trigger_close_work(void *arg)
+{
+    // The session is closed by the server loop on this wakeup
+    (void)arg;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    sim_server_t *server = handle;
+    pthread_mutex_lock(&server->sess_lock);
+    sim_sess_t *sess = find_sess(server, sockfd);
+    if (sess) sess->close_requested = true;
+    pthread_mutex_unlock(&server->sess_lock);
+    if (!sess) return ESP_ERR_NOT_FOUND;
+    return httpd_queue_work(handle, trigger_close_work, NULL);
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    ssize_t n = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+    return n < 0 ? HTTPD_SOCK_ERR_FAIL : (int)n;
+}
+
+// --- WebSocket API ---
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+    sim_req_t *ra = req->aux;
+    if (!ra->sess->ws) return ESP_ERR_INVALID_STATE;
+
+    pkt->final = ra->ws_final;
+    pkt->fragmented = !ra->ws_final;
+    pkt->type = ra->ws_type;
+    pkt->len = ra->ws_len;
+    if (max_len == 0) return ESP_OK; // Length query only
+
+    if (!pkt->payload || max_len < ra->ws_len || ra->ws_payload_read) return ESP_ERR_INVALID_SIZE;
+    if (!sess_recv_all(ra->sess, pkt->payload, ra->ws_len)) return ESP_FAIL;
+    for (size_t i = 0; ra->ws_masked && i < ra->ws_len; i++) pkt->payload[i] ^= ra->ws_mask[i % 4];
+    ra->ws_payload_read = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt)
+{
+    sim_req_t *ra = req->aux;
+    return httpd_ws_send_frame_async(ra->server, ra->sess->fd, pkt);
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame)
+{
+    sim_server_t *server = hd;
+    if (httpd_ws_get_fd_info(hd, fd) != HTTPD_WS_CLIENT_WEBSOCKET) return ESP_ERR_INVALID_ARG;
+    return ws_send(server, fd, frame->type, frame->final, frame->payload, frame->len) ? ESP_OK : ESP_FAIL;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd)
+{
+    sim_server_t *server = hd;
+    httpd_ws_client_info_t info = HTTPD_WS_CLIENT_INVALID;
+    if (!server || fd < 0) return info;
+
+    pthread_mutex_lock(&server->sess_lock);
+    sim_sess_t *sess = find_sess(server, fd);
+    if (sess) info = sess->ws ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_HTTP;
+    pthread_mutex_unlock(&server->sess_lock);
+    return info;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+// ESP32 pin numbers: 0-39 except 20, 24 and 28-31 exist, 34-39 are input only
+#define GPIO_NUM_MAX 40
+#define GPIO_IS_VALID_GPIO(gpio) ((gpio) >= 0 && (gpio) < GPIO_NUM_MAX && (gpio) != 20 && (gpio) != 24 && \
+                                  ((gpio) < 28 || (gpio) > 31))
+#define GPIO_IS_VALID_OUTPUT_GPIO(gpio) (GPIO_IS_VALID_GPIO(gpio) && (gpio) < 34)
+
+typedef int gpio_num_t;
+typedef enum { GPIO_MODE_DISABLE = 0, GPIO_MODE_INPUT, GPIO_MODE_OUTPUT } gpio_mode_t;
+typedef enum { GPIO_PULLUP_DISABLE = 0, GPIO_PULLUP_ENABLE } gpio_pullup_t;
+typedef enum { GPIO_PULLDOWN_DISABLE = 0, GPIO_PULLDOWN_ENABLE } gpio_pulldown_t;
+typedef enum {
+    GPIO_INTR_DISABLE = 0, GPIO_INTR_POSEDGE, GPIO_INTR_NEGEDGE, GPIO_INTR_ANYEDGE,
+    GPIO_INTR_LOW_LEVEL, GPIO_INTR_HIGH_LEVEL, GPIO_INTR_MAX
+} gpio_int_type_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void *arg);
+
+esp_err_t gpio_config(const gpio_config_t *conf);
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args);
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num);
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num);
+int gpio_get_level(gpio_num_t gpio_num);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef void (*esp_sntp_time_cb_t)(struct timeval *tv);
+
+typedef struct {
+    bool smooth_sync;
+    bool server_from_dhcp;
+    bool wait_for_sync;
+    bool start;
+    esp_sntp_time_cb_t sync_cb;
+    size_t num_of_servers;
+    const char *servers[1];
+} esp_sntp_config_t;
+
+#define ESP_NETIF_SNTP_DEFAULT_CONFIG(server) {  \
+        .smooth_sync = false,                    \
+        .server_from_dhcp = false,               \
+        .wait_for_sync = true,                   \
+        .start = true,                           \
+        .sync_cb = NULL,                         \
+        .num_of_servers = 1,                     \
+        .servers = { server },                   \
+}
+
+// The host clock is already synchronized: the simulator reports a sync
+// ASHUMITRA_SIM_SNTP_MS after init (default 300), then every hour.
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config);
+esp_err_t esp_netif_sntp_start(void);
+esp_err_t esp_netif_sntp_sync_wait(TickType_t tout);
+void esp_netif_sntp_deinit(void);
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Host stand-in for the ESP-IDF FreeRTOS port, implemented on pthreads.
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE  ((BaseType_t)0)
+#define pdTRUE   ((BaseType_t)1)
+#define pdPASS   pdTRUE
+#define pdFAIL   pdFALSE
+#define errQUEUE_FULL ((BaseType_t)0)
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY      ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(t)   ((uint32_t)(((uint64_t)(t) * 1000U) / configTICK_RATE_HZ))
+#define tskIDLE_PRIORITY   0
+#define tskNO_AFFINITY     0x7FFFFFFF
+#define configMAX_PRIORITIES 25
+#define portNUM_PROCESSORS 2
+
+#define BIT0  0x00000001
+#define BIT1  0x00000002
+#define BIT2  0x00000004
+#define BIT3  0x00000008
+#define BIT4  0x00000010
+#define BIT5  0x00000020
+#define BIT6  0x00000040
+#define BIT7  0x00000080
+
+// Spinlocks map to one recursive process-wide mutex on the host
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+#define portENTER_CRITICAL(mux)     vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)      vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)  vPortExitCritical(mux)
+#define taskENTER_CRITICAL(mux)     vPortEnterCritical(mux)
+#define taskEXIT_CRITICAL(mux)      vPortExitCritical(mux)
+#define portYIELD_FROM_ISR()        do { } while (0)
+#define portMEMORY_BARRIER()        __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define IRAM_ATTR
@@ -0,0 +1,177 @@
+// LEDC stand-in with a simulated servo on every configured channel. The
+// duty is decoded back into an angle and a horn model follows it at a finite
+// speed (ASHUMITRA_SIM_SERVO_DPS, default 450 degrees/s), so settle times
+// chosen by the firmware can be checked against where the horn really is.
+
+#include <math.h>
+#include <pthread.h>
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "esp_log.h"
+#include "sim.h"
+
+#define SIM_SERVO_MIN_PULSE_US 500
+#define SIM_SERVO_MAX_PULSE_US 2500
+
+static const char *TAG = "SIM_SERVO";
+
+typedef struct {
+    bool configured;
+    ledc_timer_t timer;
+    uint32_t duty;        // Set by ledc_set_duty, applied by ledc_update_duty
+    bool active;          // Output running (false after ledc_stop)
+    float target_deg;     // Angle commanded by the applied duty
+    float start_deg;      // Horn angle when the target was last changed
+    uint32_t start_ms;    // Time of that change
+} sim_channel_t;
+
+typedef struct {
+    ledc_timer_bit_t resolution;
+    uint32_t freq_hz;
+} sim_timer_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_timer_t s_timers[LEDC_TIMER_MAX];
+static sim_channel_t s_channels[LEDC_CHANNEL_MAX];
+static sim_servo_stats_t s_stats;
+static float s_speed_dps = 0;
+
+static float servo_speed(void)
+{
+    if (s_speed_dps <= 0) s_speed_dps = (float)sim_env_int("ASHUMITRA_SIM_SERVO_DPS", 450);
+    return s_speed_dps;
+}
+
+// Horn angle of a channel at time `now_ms`. Caller holds s_lock.
+static float horn_angle(const sim_channel_t *ch, uint32_t now_ms)
+{
+    float distance = ch->target_deg - ch->start_deg;
+    float moved = servo_speed() * (now_ms - ch->start_ms) / 1000.0f;
+    if (moved >= fabsf(distance)) return ch->target_deg;
+    return ch->start_deg + (distance > 0 ? moved : -moved);
+}
+
+static float duty_to_angle(uint32_t duty, const sim_timer_t *timer)
+{
+    float period_us = 1000000.0f / (timer->freq_hz ? timer->freq_hz : 50);
+    float pulse_us = duty * period_us / ((1u << timer->resolution) - 1);
+    float angle = (pulse_us - SIM_SERVO_MIN_PULSE_US) * 180.0f / (SIM_SERVO_MAX_PULSE_US - SIM_SERVO_MIN_PULSE_US);
+    if (angle < 0) angle = 0;
+    if (angle > 180) angle = 180;
+    return angle;
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *conf)
+{
+    if (conf->timer_num >= LEDC_TIMER_MAX) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    s_timers[conf->timer_num].resolution = conf->duty_resolution;
+    s_timers[conf->timer_num].freq_hz = conf->freq_hz;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *conf)
+{
+    if (conf->channel >= LEDC_CHANNEL_MAX || conf->timer_sel >= LEDC_TIMER_MAX ||
+        !GPIO_IS_VALID_OUTPUT_GPIO(conf->gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    sim_channel_t *ch = &s_channels[conf->channel];
+    ch->configured = true;
+    ch->timer = conf->timer_sel;
+    ch->duty = conf->duty;
+    ch->active = false; // A zero duty produces no pulses, the horn position is unknown
+    ch->start_deg = ch->target_deg = 90.0f;
+    ch->start_ms = sim_uptime_ms();
+    pthread_mutex_unlock(&s_lock);
+    ESP_LOGI(TAG, "Channel %d on GPIO %d", conf->channel, conf->gpio_num);
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty)
+{
+    if (channel >= LEDC_CHANNEL_MAX || !s_channels[channel].configured) return ESP_ERR_INVALID_STATE;
+    pthread_mutex_lock(&s_lock);
+    s_channels[channel].duty = duty;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+    if (channel >= LEDC_CHANNEL_MAX || !s_channels[channel].configured) return ESP_ERR_INVALID_STATE;
+    pthread_mutex_lock(&s_lock);
+    sim_channel_t *ch = &s_channels[channel];
+    uint32_t now = sim_uptime_ms();
+    float target = duty_to_angle(ch->duty, &s_timers[ch->timer]);
+    float current = horn_angle(ch, now);
+    if (fabsf(target - ch->target_deg) >= 0.5f) {
+        s_stats.moves++;
+    }
+    s_stats.duty_updates++;
+    s_stats.travel_deg += fabsf(ch->target_deg - ch->start_deg) - fabsf(ch->target_deg - current);
+    ch->start_deg = current;
+    ch->start_ms = now;
+    ch->target_deg = target;
+    ch->active = true;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t mode, ledc_channel_t channel)
+{
+    if (channel >= LEDC_CHANNEL_MAX) return 0;
+    pthread_mutex_lock(&s_lock);
+    uint32_t duty = s_channels[channel].duty;
+    pthread_mutex_unlock(&s_lock);
+    return duty;
+}
+
+esp_err_t ledc_stop(ledc_mode_t mode, ledc_channel_t channel, uint32_t idle_level)
+{
+    if (channel >= LEDC_CHANNEL_MAX || !s_channels[channel].configured) return ESP_ERR_INVALID_STATE;
+    pthread_mutex_lock(&s_lock);
+    sim_channel_t *ch = &s_channels[channel];
+    // Without pulses the servo stops driving; it stays wherever the horn is
+    uint32_t now = sim_uptime_ms();
+    float current = horn_angle(ch, now);
+    s_stats.travel_deg += fabsf(ch->target_deg - ch->start_deg) - fabsf(ch->target_deg - current);
+    ch->start_deg = ch->target_deg = current;
+    ch->start_ms = now;
+    ch->active = false;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+float sim_servo_angle(void)
+{
+    pthread_mutex_lock(&s_lock);
+    float angle = horn_angle(&s_channels[LEDC_CHANNEL_0], sim_uptime_ms());
+    pthread_mutex_unlock(&s_lock);
+    return angle;
+}
+
+uint32_t sim_servo_arrival_ms(int channel)
+{
+    if (channel < 0 || channel >= LEDC_CHANNEL_MAX) return sim_uptime_ms();
+    pthread_mutex_lock(&s_lock);
+    const sim_channel_t *ch = &s_channels[channel];
+    uint32_t arrival = ch->start_ms + (uint32_t)(fabsf(ch->target_deg - ch->start_deg) * 1000.0f / servo_speed());
+    pthread_mutex_unlock(&s_lock);
+    return arrival;
+}
+
+void sim_servo_get_stats(sim_servo_stats_t *out)
+{
+    pthread_mutex_lock(&s_lock);
+    *out = s_stats;
+    // Include the part of the current move that has already happened
+    for (int i = 0; i < LEDC_CHANNEL_MAX; i++) {
+        const sim_channel_t *ch = &s_channels[i];
+        if (!ch->configured) continue;
+        out->travel_deg += fabsf(ch->target_deg - ch->start_deg) - fabsf(ch->target_deg - horn_angle(ch, sim_uptime_ms()));
+    }
+    pthread_mutex_unlock(&s_lock);
+}
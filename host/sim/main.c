@@ -0,0 +1,14 @@
+// Host simulator entry point: runs the firmware's app_main() on the
+// stand-ins in this directory, then waits for SIGINT/SIGTERM.
+
+#include "sim.h"
+
+void app_main(void);
+
+int main(int argc, char **argv)
+{
+    sim_system_init(argc, argv);
+    app_main();
+    sim_system_run();
+    return 0;
+}
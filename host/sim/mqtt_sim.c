@@ -0,0 +1,487 @@
+// esp-mqtt stand-in: a minimal MQTT 3.1.1 client (QoS 0/1 publish, subscribe,
+// last will, keepalive, automatic reconnect) over a TCP socket, with events
+// delivered on the client's own task as esp-mqtt does. Only mqtt:// URIs are
+// supported. Good enough to run the firmware against a local broker:
+//
+//   mosquitto -p 1883 &
+//   mosquitto_sub -v -t 'ashumitra/#'
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "mqtt_client.h"
+#include "sim.h"
+
+#define SIM_MQTT_DEFAULT_PORT      1883
+#define SIM_MQTT_DEFAULT_KEEPALIVE 120
+#define SIM_MQTT_DEFAULT_RECONNECT 10000
+#define SIM_MQTT_DEFAULT_BUFFER    1024
+
+// Control packet types
+#define MQTT_CONNECT     1
+#define MQTT_CONNACK     2
+#define MQTT_PUBLISH     3
+#define MQTT_PUBACK      4
+#define MQTT_SUBSCRIBE   8
+#define MQTT_SUBACK      9
+#define MQTT_PINGREQ     12
+#define MQTT_PINGRESP    13
+#define MQTT_DISCONNECT  14
+
+static const char *TAG = "SIM_MQTT";
+
+struct esp_mqtt_client {
+    char host[128];
+    int port;
+    char *client_id;
+    char *username;
+    char *password;
+    char *will_topic;
+    char *will_msg;
+    int will_len;
+    int will_qos;
+    bool will_retain;
+    int keepalive_s;
+    int reconnect_ms;
+    int buffer_size;
+
+    esp_event_handler_t handler;
+    void *handler_arg;
+
+    pthread_mutex_t lock; // Serializes writes to the socket
+    int fd;
+    bool connected;
+    volatile bool running;
+    TaskHandle_t task;
+    uint16_t next_msg_id;
+    int64_t last_tx_us;
+};
+
+static char *dup_str(const char *s)
+{
+    return s ? strdup(s) : NULL;
+}
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_t *event)
+{
+    event->client = client;
+    if (client->handler) {
+        client->handler(client->handler_arg, "MQTT_EVENTS", event->event_id, event);
+    }
+}
+
+// --- Encoding ---
+static size_t put_len(uint8_t *out, size_t len)
+{
+    size_t n = 0;
+    do {
+        uint8_t byte = len % 128;
+        len /= 128;
+        out[n++] = byte | (len > 0 ? 0x80 : 0);
+    } while (len > 0);
+    return n;
+}
+
+static size_t put_str(uint8_t *out, const char *s, size_t len)
+{
+    out[0] = (uint8_t)(len >> 8);
+    out[1] = (uint8_t)len;
+    memcpy(out + 2, s, len);
+    return len + 2;
+}
+
+static bool write_all(int fd, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Sends one packet: fixed header byte, remaining length and body. Caller holds client->lock.
+static bool send_packet_locked(esp_mqtt_client_handle_t client, uint8_t header, const uint8_t *body, size_t len)
+{
+    uint8_t head[5];
+    head[0] = header;
+    size_t head_len = 1 + put_len(head + 1, len);
+    if (client->fd < 0 || !write_all(client->fd, head, head_len) || (len && !write_all(client->fd, body, len))) {
+        return false;
+    }
+    client->last_tx_us = sim_uptime_us();
+    return true;
+}
+
+// --- Decoding ---
+static bool read_all(int fd, uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = recv(fd, buf, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Reads one packet into buf. Returns the packet's first byte, or -1 on error;
+// a packet larger than the buffer is read and discarded (*len = 0).
+static int read_packet(esp_mqtt_client_handle_t client, uint8_t *buf, size_t *len)
+{
+    uint8_t header;
+    if (!read_all(client->fd, &header, 1)) return -1;
+    size_t remaining = 0;
+    for (int shift = 0; shift <= 21; shift += 7) {
+        uint8_t byte;
+        if (!read_all(client->fd, &byte, 1)) return -1;
+        remaining |= (size_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    if (remaining > (size_t)client->buffer_size) {
+        ESP_LOGW(TAG, "Dropping a %zu byte packet (buffer %d)", remaining, client->buffer_size);
+        uint8_t skip[256];
+        while (remaining > 0) {
+            size_t n = remaining < sizeof(skip) ? remaining : sizeof(skip);
+            if (!read_all(client->fd, skip, n)) return -1;
+            remaining -= n;
+        }
+        *len = 0;
+        return header;
+    }
+    if (!read_all(client->fd, buf, remaining)) return -1;
+    *len = remaining;
+    return header;
+}
+
+// --- Connection ---
+static int open_socket(const char *host, int port)
+{
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res;
+    if (getaddrinfo(host, port_str, &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+static bool mqtt_connect(esp_mqtt_client_handle_t client, uint8_t *buf)
+{
+    int fd = open_socket(client->host, client->port);
+    if (fd < 0) return false;
+
+    // CONNECT: protocol name and level 4, flags, keepalive, then the payload
+    size_t n = 0;
+    n += put_str(buf + n, "MQTT", 4);
+    buf[n++] = 4;
+    uint8_t flags = 0x02; // Clean session
+    if (client->will_topic) flags |= 0x04 | (client->will_qos << 3) | (client->will_retain ? 0x20 : 0);
+    if (client->username) flags |= 0x80;
+    if (client->password) flags |= 0x40;
+    buf[n++] = flags;
+    buf[n++] = (uint8_t)(client->keepalive_s >> 8);
+    buf[n++] = (uint8_t)client->keepalive_s;
+    n += put_str(buf + n, client->client_id, strlen(client->client_id));
+    if (client->will_topic) {
+        n += put_str(buf + n, client->will_topic, strlen(client->will_topic));
+        n += put_str(buf + n, client->will_msg, client->will_len);
+    }
+    if (client->username) n += put_str(buf + n, client->username, strlen(client->username));
+    if (client->password) n += put_str(buf + n, client->password, strlen(client->password));
+
+    pthread_mutex_lock(&client->lock);
+    client->fd = fd;
+    bool sent = send_packet_locked(client, MQTT_CONNECT << 4, buf, n);
+    pthread_mutex_unlock(&client->lock);
+
+    size_t len = 0;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    bool ok = sent && poll(&pfd, 1, 5000) == 1 && read_packet(client, buf, &len) == (MQTT_CONNACK << 4) &&
+              len == 2 && buf[1] == 0;
+    if (!ok) {
+        ESP_LOGW(TAG, "Broker %s:%d refused the connection", client->host, client->port);
+        pthread_mutex_lock(&client->lock);
+        client->fd = -1;
+        pthread_mutex_unlock(&client->lock);
+        close(fd);
+        return false;
+    }
+    pthread_mutex_lock(&client->lock);
+    client->connected = true;
+    pthread_mutex_unlock(&client->lock);
+    return true;
+}
+
+static void mqtt_close(esp_mqtt_client_handle_t client)
+{
+    pthread_mutex_lock(&client->lock);
+    int fd = client->fd;
+    client->fd = -1;
+    client->connected = false;
+    pthread_mutex_unlock(&client->lock);
+    if (fd >= 0) close(fd);
+}
+
+// Handles one incoming packet. Returns false if the connection should be dropped.
+static bool handle_packet(esp_mqtt_client_handle_t client, int header, uint8_t *buf, size_t len)
+{
+    int type = (header >> 4) & 0x0f;
+    if (type == MQTT_PUBLISH && len >= 2) {
+        int qos = (header >> 1) & 0x03;
+        size_t topic_len = ((size_t)buf[0] << 8) | buf[1];
+        size_t pos = 2 + topic_len;
+        if (pos > len) return false;
+        uint16_t msg_id = 0;
+        if (qos > 0) {
+            if (pos + 2 > len) return false;
+            msg_id = (uint16_t)((buf[pos] << 8) | buf[pos + 1]);
+            pos += 2;
+        }
+        esp_mqtt_event_t event = {
+            .event_id = MQTT_EVENT_DATA,
+            .topic = (char *)buf + 2,
+            .topic_len = (int)topic_len,
+            .data = (char *)buf + pos,
+            .data_len = (int)(len - pos),
+            .total_data_len = (int)(len - pos),
+            .msg_id = msg_id,
+            .retain = header & 0x01,
+            .qos = qos,
+        };
+        dispatch(client, &event);
+        if (qos == 1) {
+            uint8_t ack[2] = { (uint8_t)(msg_id >> 8), (uint8_t)msg_id };
+            pthread_mutex_lock(&client->lock);
+            bool sent = send_packet_locked(client, MQTT_PUBACK << 4, ack, sizeof(ack));
+            pthread_mutex_unlock(&client->lock);
+            return sent;
+        }
+    } else if ((type == MQTT_PUBACK || type == MQTT_SUBACK) && len >= 2) {
+        esp_mqtt_event_t event = {
+            .event_id = type == MQTT_PUBACK ? MQTT_EVENT_PUBLISHED : MQTT_EVENT_SUBSCRIBED,
+            .msg_id = (buf[0] << 8) | buf[1],
+        };
+        dispatch(client, &event);
+    }
+    return true;
+}
+
+static void mqtt_task(void *arg)
+{
+    esp_mqtt_client_handle_t client = arg;
+    uint8_t *buf = malloc(client->buffer_size);
+
+    while (client->running && buf) {
+        esp_mqtt_event_t event = { .event_id = MQTT_EVENT_BEFORE_CONNECT };
+        dispatch(client, &event);
+        if (!mqtt_connect(client, buf)) {
+            event = (esp_mqtt_event_t) { .event_id = MQTT_EVENT_ERROR };
+            dispatch(client, &event);
+            event = (esp_mqtt_event_t) { .event_id = MQTT_EVENT_DISCONNECTED };
+            dispatch(client, &event);
+            for (int waited = 0; waited < client->reconnect_ms && client->running; waited += 50) {
+                vTaskDelay(pdMS_TO_TICKS(50));
+            }
+            continue;
+        }
+        ESP_LOGI(TAG, "Connected to %s:%d", client->host, client->port);
+        event = (esp_mqtt_event_t) { .event_id = MQTT_EVENT_CONNECTED };
+        dispatch(client, &event);
+
+        bool ping_pending = false;
+        int64_t ping_sent_us = 0;
+        while (client->running) {
+            struct pollfd pfd = { .fd = client->fd, .events = POLLIN };
+            int ready = poll(&pfd, 1, 100);
+            if (ready < 0 && errno != EINTR) break;
+            if (ready > 0) {
+                size_t len = 0;
+                int header = read_packet(client, buf, &len);
+                if (header < 0) break;
+                if (((header >> 4) & 0x0f) == MQTT_PINGRESP) ping_pending = false;
+                if (!handle_packet(client, header, buf, len)) break;
+            }
+
+            // Keepalive: ping after half the interval without traffic, give up
+            // when the answer does not come within the other half
+            int64_t now = sim_uptime_us();
+            int64_t half_us = (int64_t)client->keepalive_s * 500000;
+            if (ping_pending && now - ping_sent_us > half_us) break;
+            pthread_mutex_lock(&client->lock);
+            if (!ping_pending && now - client->last_tx_us > half_us) {
+                ping_pending = send_packet_locked(client, MQTT_PINGREQ << 4, NULL, 0);
+                ping_sent_us = now;
+            }
+            pthread_mutex_unlock(&client->lock);
+        }
+
+        if (!client->running) {
+            pthread_mutex_lock(&client->lock);
+            send_packet_locked(client, MQTT_DISCONNECT << 4, NULL, 0); // Clean disconnect: no last will
+            pthread_mutex_unlock(&client->lock);
+        }
+        mqtt_close(client);
+        ESP_LOGI(TAG, "Disconnected from %s:%d", client->host, client->port);
+        event = (esp_mqtt_event_t) { .event_id = MQTT_EVENT_DISCONNECTED };
+        dispatch(client, &event);
+        for (int waited = 0; waited < client->reconnect_ms && client->running; waited += 50) {
+            vTaskDelay(pdMS_TO_TICKS(50));
+        }
+    }
+    free(buf);
+    client->task = NULL;
+    vTaskDelete(NULL);
+}
+
+// --- Public API ---
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    const char *uri = config->broker.address.uri;
+    if (!uri || strncmp(uri, "mqtt://", 7) != 0) {
+        ESP_LOGE(TAG, "Unsupported broker URI %s", uri ? uri : "(null)");
+        return NULL;
+    }
+
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(*client));
+    if (!client) return NULL;
+    const char *host = uri + 7;
+    const char *colon = strrchr(host, ':');
+    size_t host_len = colon ? (size_t)(colon - host) : strcspn(host, "/");
+    if (host_len >= sizeof(client->host)) host_len = sizeof(client->host) - 1;
+    memcpy(client->host, host, host_len);
+    client->port = colon ? atoi(colon + 1) : SIM_MQTT_DEFAULT_PORT;
+
+    client->client_id = dup_str(config->credentials.client_id ? config->credentials.client_id : "ashumitra_sim");
+    client->username = dup_str(config->credentials.username);
+    client->password = dup_str(config->credentials.authentication.password);
+    if (config->session.last_will.topic) {
+        client->will_topic = dup_str(config->session.last_will.topic);
+        client->will_len = config->session.last_will.msg_len ? config->session.last_will.msg_len
+                                                             : (int)strlen(config->session.last_will.msg);
+        client->will_msg = malloc(client->will_len + 1);
+        memcpy(client->will_msg, config->session.last_will.msg, client->will_len);
+        client->will_qos = config->session.last_will.qos;
+        client->will_retain = config->session.last_will.retain;
+    }
+    client->keepalive_s = config->session.keepalive ? config->session.keepalive : SIM_MQTT_DEFAULT_KEEPALIVE;
+    client->reconnect_ms = config->network.reconnect_timeout_ms ? config->network.reconnect_timeout_ms : SIM_MQTT_DEFAULT_RECONNECT;
+    client->buffer_size = config->buffer.size ? config->buffer.size : SIM_MQTT_DEFAULT_BUFFER;
+    client->fd = -1;
+    client->next_msg_id = 1;
+    pthread_mutex_init(&client->lock, NULL);
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    if (!client) return ESP_ERR_INVALID_ARG;
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (!client) return ESP_ERR_INVALID_ARG;
+    if (client->running) return ESP_FAIL;
+    client->running = true;
+    if (xTaskCreate(mqtt_task, "mqtt_task", 6144, client, 5, &client->task) != pdPASS) {
+        client->running = false;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    if (!client || !client->running) return ESP_FAIL;
+    client->running = false;
+    while (client->task) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    if (!client) return ESP_ERR_INVALID_ARG;
+    if (client->running) esp_mqtt_client_stop(client);
+    pthread_mutex_destroy(&client->lock);
+    free(client->client_id);
+    free(client->username);
+    free(client->password);
+    free(client->will_topic);
+    free(client->will_msg);
+    free(client);
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    if (!client) return -1;
+    if (len == 0 && data) len = (int)strlen(data);
+    size_t topic_len = strlen(topic);
+    size_t body_len = 2 + topic_len + (qos > 0 ? 2 : 0) + len;
+    if (body_len > (size_t)client->buffer_size) return -1;
+
+    uint8_t *body = malloc(body_len);
+    if (!body) return -1;
+    size_t n = put_str(body, topic, topic_len);
+
+    pthread_mutex_lock(&client->lock);
+    int msg_id = 0;
+    if (qos > 0) {
+        msg_id = client->next_msg_id++;
+        if (client->next_msg_id == 0) client->next_msg_id = 1;
+        body[n++] = (uint8_t)(msg_id >> 8);
+        body[n++] = (uint8_t)msg_id;
+    }
+    memcpy(body + n, data, len);
+    bool sent = client->connected &&
+                send_packet_locked(client, (MQTT_PUBLISH << 4) | (qos > 0 ? 0x02 : 0) | (retain ? 0x01 : 0), body, body_len);
+    pthread_mutex_unlock(&client->lock);
+    free(body);
+    return sent ? msg_id : -1;
+}
+
+int esp_mqtt_client_subscribe_single(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    if (!client) return -1;
+    uint8_t body[2 + 2 + 256 + 1];
+    size_t topic_len = strlen(topic);
+    if (topic_len > 256) return -1;
+
+    pthread_mutex_lock(&client->lock);
+    int msg_id = client->next_msg_id++;
+    if (client->next_msg_id == 0) client->next_msg_id = 1;
+    body[0] = (uint8_t)(msg_id >> 8);
+    body[1] = (uint8_t)msg_id;
+    size_t n = 2 + put_str(body + 2, topic, topic_len);
+    body[n++] = (uint8_t)qos;
+    bool sent = client->connected && send_packet_locked(client, (MQTT_SUBSCRIBE << 4) | 0x02, body, n);
+    pthread_mutex_unlock(&client->lock);
+    return sent ? msg_id : -1;
+}
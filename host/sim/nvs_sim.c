@@ -0,0 +1,322 @@
+// NVS stand-in: an in-memory key/value table that nvs_commit() writes to a
+// backing file (ASHUMITRA_SIM_NVS, default ashumitra_nvs.txt), so state
+// survives a simulator restart. Every commit is counted, as a proxy for
+// flash wear on the device.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sim.h"
+
+#define SIM_NVS_MAX_ENTRIES 64
+#define SIM_NVS_MAX_HANDLES 16
+#define SIM_NVS_NAME_MAX    16 // Namespace and key limit, including the NUL, as on the device
+#define SIM_NVS_VALUE_MAX   4000
+
+static const char *TAG = "SIM_NVS";
+
+typedef enum { ENTRY_BLOB = 0, ENTRY_U8, ENTRY_U32, ENTRY_STR } entry_type_t;
+
+typedef struct {
+    bool used;
+    char ns[SIM_NVS_NAME_MAX];
+    char key[SIM_NVS_NAME_MAX];
+    entry_type_t type;
+    size_t len;
+    uint8_t *data;
+} nvs_entry_t;
+
+typedef struct {
+    bool used;
+    char ns[SIM_NVS_NAME_MAX];
+    nvs_open_mode_t mode;
+} nvs_open_handle_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool s_initialized = false;
+static nvs_entry_t s_entries[SIM_NVS_MAX_ENTRIES];
+static nvs_open_handle_t s_handles[SIM_NVS_MAX_HANDLES];
+static sim_nvs_stats_t s_stats;
+
+static const char *backing_path(void)
+{
+    return sim_env_str("ASHUMITRA_SIM_NVS", "ashumitra_nvs.txt");
+}
+
+static void clear_entries(void)
+{
+    for (int i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        free(s_entries[i].data);
+        memset(&s_entries[i], 0, sizeof(s_entries[i]));
+    }
+}
+
+static nvs_entry_t *find_entry(const char *ns, const char *key)
+{
+    for (int i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        if (s_entries[i].used && strcmp(s_entries[i].ns, ns) == 0 && strcmp(s_entries[i].key, key) == 0) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t store_entry(const char *ns, const char *key, entry_type_t type, const void *value, size_t len)
+{
+    nvs_entry_t *entry = find_entry(ns, key);
+    if (!entry) {
+        for (int i = 0; i < SIM_NVS_MAX_ENTRIES && !entry; i++) {
+            if (!s_entries[i].used) entry = &s_entries[i];
+        }
+        if (!entry) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        entry->used = true;
+        snprintf(entry->ns, sizeof(entry->ns), "%s", ns);
+        snprintf(entry->key, sizeof(entry->key), "%s", key);
+    }
+    uint8_t *data = malloc(len > 0 ? len : 1);
+    if (!data) return ESP_ERR_NO_MEM;
+    memcpy(data, value, len);
+    free(entry->data);
+    entry->data = data;
+    entry->len = len;
+    entry->type = type;
+    return ESP_OK;
+}
+
+// File format: one entry per line, "<ns> <key> <type> <hex bytes>"
+static void load_file(void)
+{
+    FILE *f = fopen(backing_path(), "r");
+    if (!f) return;
+
+    char line[2 * SIM_NVS_VALUE_MAX + 64];
+    while (fgets(line, sizeof(line), f)) {
+        char ns[SIM_NVS_NAME_MAX], key[SIM_NVS_NAME_MAX], hex[2 * SIM_NVS_VALUE_MAX + 1];
+        int type;
+        hex[0] = '\0';
+        if (sscanf(line, "%15s %15s %d %8000s", ns, key, &type, hex) < 3) continue;
+        size_t len = strlen(hex) / 2;
+        uint8_t value[SIM_NVS_VALUE_MAX];
+        for (size_t i = 0; i < len; i++) {
+            unsigned int byte;
+            sscanf(hex + 2 * i, "%2x", &byte);
+            value[i] = (uint8_t)byte;
+        }
+        store_entry(ns, key, (entry_type_t)type, value, len);
+    }
+    fclose(f);
+}
+
+static esp_err_t save_file(void)
+{
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", backing_path());
+
+    FILE *f = fopen(tmp_path, "w");
+    if (!f) return ESP_FAIL;
+    for (int i = 0; i < SIM_NVS_MAX_ENTRIES; i++) {
+        const nvs_entry_t *entry = &s_entries[i];
+        if (!entry->used) continue;
+        fprintf(f, "%s %s %d ", entry->ns, entry->key, (int)entry->type);
+        for (size_t j = 0; j < entry->len; j++) fprintf(f, "%02x", entry->data[j]);
+        fputc('\n', f);
+    }
+    if (fclose(f) != 0) return ESP_FAIL;
+    return rename(tmp_path, backing_path()) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    pthread_mutex_lock(&s_lock);
+    if (!s_initialized) {
+        load_file();
+        s_initialized = true;
+        ESP_LOGI(TAG, "NVS backed by %s", backing_path());
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    pthread_mutex_lock(&s_lock);
+    clear_entries();
+    remove(backing_path());
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *ns, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    esp_err_t err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    if (strlen(ns) >= SIM_NVS_NAME_MAX) return ESP_ERR_NVS_INVALID_NAME;
+    pthread_mutex_lock(&s_lock);
+    if (!s_initialized) {
+        err = ESP_ERR_NVS_NOT_INITIALIZED;
+    } else {
+        for (int i = 0; i < SIM_NVS_MAX_HANDLES; i++) {
+            if (!s_handles[i].used) {
+                s_handles[i].used = true;
+                s_handles[i].mode = mode;
+                snprintf(s_handles[i].ns, sizeof(s_handles[i].ns), "%s", ns);
+                *out = (nvs_handle_t)(i + 1);
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+// Caller holds s_lock
+static nvs_open_handle_t *get_handle(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > SIM_NVS_MAX_HANDLES || !s_handles[handle - 1].used) return NULL;
+    return &s_handles[handle - 1];
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    if (h) h->used = false;
+    pthread_mutex_unlock(&s_lock);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    esp_err_t err;
+    pthread_mutex_lock(&s_lock);
+    if (!get_handle(handle)) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else {
+        err = save_file();
+        if (err == ESP_OK) s_stats.commits++;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char *key, entry_type_t type, const void *value, size_t len)
+{
+    esp_err_t err;
+
+    if (strlen(key) >= SIM_NVS_NAME_MAX) return ESP_ERR_NVS_INVALID_NAME;
+    if (len > SIM_NVS_VALUE_MAX) return ESP_ERR_NVS_INVALID_LENGTH;
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    if (!h) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (h->mode == NVS_READONLY) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else {
+        err = store_entry(h->ns, key, type, value, len);
+        if (err == ESP_OK) {
+            s_stats.sets++;
+            s_stats.bytes_written += len;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+// Copies a value out; with `exact`, a length mismatch is an error (integer types)
+static esp_err_t get_value(nvs_handle_t handle, const char *key, entry_type_t type, void *out, size_t *len, bool exact)
+{
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    nvs_entry_t *entry = h ? find_entry(h->ns, key) : NULL;
+    if (!h) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!entry) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (entry->type != type || (exact && entry->len != *len)) {
+        err = ESP_ERR_NVS_TYPE_MISMATCH;
+    } else if (out == NULL) {
+        *len = entry->len; // Length query, as with the real nvs_get_blob()
+    } else if (*len < entry->len) {
+        *len = entry->len;
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out, entry->data, entry->len);
+        *len = entry->len;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set_value(handle, key, ENTRY_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length)
+{
+    return get_value(handle, key, ENTRY_BLOB, out, length, false);
+}
+
+// Strings are stored with their NUL, so lengths match the real nvs_get_str()
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return set_value(handle, key, ENTRY_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out, size_t *length)
+{
+    return get_value(handle, key, ENTRY_STR, out, length, false);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return set_value(handle, key, ENTRY_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out)
+{
+    size_t len = sizeof(*out);
+    return get_value(handle, key, ENTRY_U32, out, &len, true);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return set_value(handle, key, ENTRY_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out)
+{
+    size_t len = sizeof(*out);
+    return get_value(handle, key, ENTRY_U8, out, &len, true);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = get_handle(handle);
+    nvs_entry_t *entry = h ? find_entry(h->ns, key) : NULL;
+    if (!h) {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    } else if (!entry) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        free(entry->data);
+        memset(entry, 0, sizeof(*entry));
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+void sim_nvs_get_stats(sim_nvs_stats_t *out)
+{
+    pthread_mutex_lock(&s_lock);
+    *out = s_stats;
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,138 @@
+// esp_partition stand-in for the data partitions of partitions.csv, backed by
+// one file (ASHUMITRA_SIM_FLASH, default ashumitra_flash.bin) that is mapped
+// into memory. Writes follow NOR flash rules: they can only clear bits, so a
+// write over data that was not erased corrupts it as it would on the device.
+// Erases and writes are counted for the exit report.
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "sim.h"
+
+static const char *TAG = "SIM_FLASH";
+
+// Data partitions of partitions.csv, laid out back to back in the file
+static esp_partition_t s_partitions[] = {
+    { .type = ESP_PARTITION_TYPE_DATA, .subtype = 0x40, .address = 0, .size = 64 * 1024,
+      .erase_size = SPI_FLASH_SEC_SIZE, .label = "history" },
+};
+#define SIM_PARTITION_COUNT (sizeof(s_partitions) / sizeof(s_partitions[0]))
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t *s_flash = NULL;
+static sim_flash_stats_t s_stats;
+
+// Maps the backing file, creating it erased on first use
+static bool flash_open(void)
+{
+    if (s_flash) return true;
+
+    size_t size = 0;
+    for (size_t i = 0; i < SIM_PARTITION_COUNT; i++) {
+        size_t end = s_partitions[i].address + s_partitions[i].size;
+        if (end > size) size = end;
+    }
+
+    const char *path = sim_env_str("ASHUMITRA_SIM_FLASH", "ashumitra_flash.bin");
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Cannot open %s", path);
+        return false;
+    }
+    off_t old_size = lseek(fd, 0, SEEK_END);
+    if (old_size < (off_t)size && ftruncate(fd, size) != 0) {
+        close(fd);
+        return false;
+    }
+    uint8_t *flash = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (flash == MAP_FAILED) return false;
+    if (old_size < (off_t)size) {
+        memset(flash + old_size, 0xff, size - old_size); // New flash comes erased
+    }
+    s_flash = flash;
+    ESP_LOGI(TAG, "Flash partitions backed by %s", path);
+    return true;
+}
+
+static bool in_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    return partition && offset <= partition->size && size <= partition->size - offset;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    pthread_mutex_lock(&s_lock);
+    bool ok = flash_open();
+    pthread_mutex_unlock(&s_lock);
+    if (!ok) return NULL;
+
+    for (size_t i = 0; i < SIM_PARTITION_COUNT; i++) {
+        const esp_partition_t *p = &s_partitions[i];
+        if (p->type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || p->subtype == subtype) &&
+            (!label || strcmp(p->label, label) == 0)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (!in_range(partition, src_offset, size)) return ESP_ERR_INVALID_SIZE;
+    pthread_mutex_lock(&s_lock);
+    memcpy(dst, s_flash + partition->address + src_offset, size);
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    if (!in_range(partition, dst_offset, size)) return ESP_ERR_INVALID_SIZE;
+    const uint8_t *in = src;
+    pthread_mutex_lock(&s_lock);
+    uint8_t *out = s_flash + partition->address + dst_offset;
+    for (size_t i = 0; i < size; i++) {
+        out[i] &= in[i];
+    }
+    s_stats.writes++;
+    s_stats.bytes_written += size;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if (!in_range(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+    if (offset % partition->erase_size != 0 || size % partition->erase_size != 0) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    memset(s_flash + partition->address + offset, 0xff, size);
+    s_stats.erases += size / partition->erase_size;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr, esp_partition_mmap_handle_t *out_handle)
+{
+    if (!in_range(partition, offset, size)) return ESP_ERR_INVALID_SIZE;
+    *out_ptr = s_flash + partition->address + offset;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle)
+{
+    (void)handle; // The file stays mapped for the life of the process
+}
+
+void sim_flash_get_stats(sim_flash_stats_t *out)
+{
+    pthread_mutex_lock(&s_lock);
+    *out = s_stats;
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,89 @@
+// Power management stand-in. Locks are counted as in ESP-IDF; the resulting
+// mode (max clock, DFS, light sleep allowed) is only logged.
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_pm.h"
+
+static const char *TAG = "SIM_PM";
+
+struct esp_pm_lock {
+    esp_pm_lock_type_t type;
+    const char *name;
+    int count;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static esp_pm_config_t s_config;
+static bool s_configured = false;
+static int s_held[ESP_PM_NO_LIGHT_SLEEP + 1]; // Acquired locks by type
+
+// Logs the mode the chip would run in. Caller holds s_lock.
+static void log_mode_locked(void)
+{
+    if (!s_configured) return;
+    if (s_held[ESP_PM_CPU_FREQ_MAX] > 0) {
+        ESP_LOGI(TAG, "CPU at %d MHz", s_config.max_freq_mhz);
+    } else if (s_held[ESP_PM_APB_FREQ_MAX] > 0 || s_held[ESP_PM_NO_LIGHT_SLEEP] > 0 || !s_config.light_sleep_enable) {
+        ESP_LOGI(TAG, "DFS down to %d MHz", s_config.min_freq_mhz);
+    } else {
+        ESP_LOGI(TAG, "DFS down to %d MHz, light sleep allowed", s_config.min_freq_mhz);
+    }
+}
+
+esp_err_t esp_pm_configure(const void *config)
+{
+    const esp_pm_config_t *pm = config;
+    if (!pm || pm->min_freq_mhz <= 0 || pm->min_freq_mhz > pm->max_freq_mhz) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    s_config = *pm;
+    s_configured = true;
+    log_mode_locked();
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle)
+{
+    (void)arg;
+    if (lock_type > ESP_PM_NO_LIGHT_SLEEP || !out_handle) return ESP_ERR_INVALID_ARG;
+    struct esp_pm_lock *lock = calloc(1, sizeof(*lock));
+    if (!lock) return ESP_ERR_NO_MEM;
+    lock->type = lock_type;
+    lock->name = name;
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    if (!handle) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    handle->count++;
+    if (s_held[handle->type]++ == 0) log_mode_locked();
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    if (!handle) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    if (handle->count == 0) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->count--;
+    if (--s_held[handle->type] == 0) log_mode_locked();
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle)
+{
+    if (!handle) return ESP_ERR_INVALID_ARG;
+    if (handle->count > 0) return ESP_ERR_INVALID_STATE;
+    free(handle);
+    return ESP_OK;
+}
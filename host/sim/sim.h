@@ -0,0 +1,71 @@
+#pragma once
+
+// Simulator-only hooks, shared by the host stand-ins in host/sim. Nothing in
+// main/ includes this file.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Reads an integer setting from the environment, e.g. ASHUMITRA_SIM_PORT
+int sim_env_int(const char *name, int fallback);
+const char *sim_env_str(const char *name, const char *fallback);
+
+// Time since the simulator started: milliseconds (the FreeRTOS tick count)
+// and microseconds (esp_timer)
+uint32_t sim_uptime_ms(void);
+int64_t sim_uptime_us(void);
+
+// Absolute CLOCK_MONOTONIC deadline `ms` from now, for timed waits
+void sim_deadline(struct timespec *ts, uint32_t ms);
+
+// Saves argv for esp_restart() and blocks SIGINT/SIGTERM in all threads.
+// Call first thing in main().
+void sim_system_init(int argc, char **argv);
+
+// Waits for SIGINT/SIGTERM, runs the shutdown handlers (like esp_restart()
+// does on the device), prints the simulator counters and exits.
+void sim_system_run(void);
+
+// Counters printed on exit
+typedef struct {
+    uint32_t commits;       // nvs_commit() calls that wrote the backing file
+    uint32_t sets;          // nvs_set_*() calls
+    uint32_t bytes_written; // Payload bytes passed to nvs_set_*()
+} sim_nvs_stats_t;
+void sim_nvs_get_stats(sim_nvs_stats_t *out);
+
+typedef struct {
+    uint32_t erases;        // Sectors erased
+    uint32_t writes;        // esp_partition_write() calls
+    uint32_t bytes_written;
+} sim_flash_stats_t;
+void sim_flash_get_stats(sim_flash_stats_t *out);
+
+typedef struct {
+    uint32_t duty_updates;  // ledc_update_duty() calls on the servo channel
+    uint32_t moves;         // Distinct target angles commanded
+    float travel_deg;       // Physical travel of the simulated horn
+} sim_servo_stats_t;
+void sim_servo_get_stats(sim_servo_stats_t *out);
+
+// Physical angle of the simulated servo horn right now
+float sim_servo_angle(void);
+
+// Uptime at which the horn on LEDC `channel` reaches (or reached) its
+// commanded angle
+uint32_t sim_servo_arrival_ms(int channel);
+
+// Time until the station next listens for buffered frames under the current
+// Wi-Fi power save mode, 0 with power save off. The simulated httpd holds
+// back incoming data this long, as the AP would.
+uint32_t sim_wifi_rx_delay_ms(void);
+
+// True while the station has an address. Before that (and after the link is
+// lost) the simulated httpd leaves incoming connections and data untouched.
+bool sim_wifi_link_up(void);
+
+// Registers the calling thread as a FreeRTOS task, for threads the simulator
+// starts itself (e.g. the httpd server loop) so they report a name, stack,
+// priority and core
+void sim_task_adopt(const char *name, uint32_t stack_depth, unsigned prio, int core_id);
@@ -0,0 +1,91 @@
+// SNTP stand-in. The host clock is the time source; "syncs" only exercise the
+// firmware's sync callback and the delay before the first one.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+#define SNTP_RESYNC_MS 3600000 // CONFIG_LWIP_SNTP_UPDATE_DELAY default
+
+static const char *TAG = "SIM_SNTP";
+
+static esp_sntp_time_cb_t s_sync_cb = NULL;
+static atomic_bool s_running;
+static atomic_bool s_synced;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+
+static void cond_init(void)
+{
+    // sim_deadline() deadlines are on CLOCK_MONOTONIC
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void *sntp_thread(void *arg)
+{
+    (void)arg;
+    sim_task_adopt("tiT", 4096, 18, 0); // Sync callbacks run in the lwIP task on the device
+    uint32_t delay_ms = (uint32_t)sim_env_int("ASHUMITRA_SIM_SNTP_MS", 300);
+    while (atomic_load(&s_running)) {
+        vTaskDelay(pdMS_TO_TICKS(delay_ms));
+        if (!atomic_load(&s_running)) break;
+
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        ESP_LOGI(TAG, "Time synchronized from host clock");
+        pthread_mutex_lock(&s_lock);
+        atomic_store(&s_synced, true);
+        pthread_cond_broadcast(&s_cond);
+        pthread_mutex_unlock(&s_lock);
+        if (s_sync_cb) s_sync_cb(&tv);
+        delay_ms = SNTP_RESYNC_MS;
+    }
+    return NULL;
+}
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config)
+{
+    if (!config) return ESP_ERR_INVALID_ARG;
+    pthread_once(&s_once, cond_init);
+    s_sync_cb = config->sync_cb;
+    return config->start ? esp_netif_sntp_start() : ESP_OK;
+}
+
+esp_err_t esp_netif_sntp_start(void)
+{
+    if (atomic_exchange(&s_running, true)) return ESP_OK;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, sntp_thread, NULL) != 0) {
+        atomic_store(&s_running, false);
+        return ESP_FAIL;
+    }
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_sntp_sync_wait(TickType_t tout)
+{
+    pthread_once(&s_once, cond_init);
+    struct timespec deadline;
+    sim_deadline(&deadline, tout == portMAX_DELAY ? UINT32_MAX / 2 : pdTICKS_TO_MS(tout));
+    pthread_mutex_lock(&s_lock);
+    while (!atomic_load(&s_synced)) {
+        if (pthread_cond_timedwait(&s_cond, &s_lock, &deadline) != 0) break;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return atomic_load(&s_synced) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+void esp_netif_sntp_deinit(void)
+{
+    atomic_store(&s_running, false);
+}
@@ -0,0 +1,231 @@
+// esp_system, esp_log, esp_random and esp_err stand-ins, plus the simulator
+// process lifecycle (signals, restart, exit report).
+
+#include <malloc.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <unistd.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "nvs.h"
+#include "sim.h"
+
+#define SIM_MAX_SHUTDOWN_HANDLERS 8
+// Heap size reported to the firmware, roughly the free DRAM of an ESP32 after Wi-Fi init
+#define SIM_HEAP_SIZE (200 * 1024)
+
+static char **s_argv = NULL;
+static shutdown_handler_t s_shutdown_handlers[SIM_MAX_SHUTDOWN_HANDLERS];
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t s_min_free_heap = SIM_HEAP_SIZE;
+static esp_log_level_t s_log_level = ESP_LOG_INFO;
+
+// --- Environment ---
+int sim_env_int(const char *name, int fallback)
+{
+    const char *value = getenv(name);
+    return (value && *value) ? atoi(value) : fallback;
+}
+
+const char *sim_env_str(const char *name, const char *fallback)
+{
+    const char *value = getenv(name);
+    return (value && *value) ? value : fallback;
+}
+
+// --- Errors ---
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:                        return "ESP_OK";
+        case ESP_FAIL:                      return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:                return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:           return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:         return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:          return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:             return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:         return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:               return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:      return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:           return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION:       return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NOT_FINISHED:          return "ESP_ERR_NOT_FINISHED";
+        case ESP_ERR_NOT_ALLOWED:           return "ESP_ERR_NOT_ALLOWED";
+        case ESP_ERR_NVS_NOT_INITIALIZED:   return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND:         return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_TYPE_MISMATCH:     return "ESP_ERR_NVS_TYPE_MISMATCH";
+        case ESP_ERR_NVS_READ_ONLY:         return "ESP_ERR_NVS_READ_ONLY";
+        case ESP_ERR_NVS_NOT_ENOUGH_SPACE:  return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+        case ESP_ERR_NVS_INVALID_NAME:      return "ESP_ERR_NVS_INVALID_NAME";
+        case ESP_ERR_NVS_INVALID_HANDLE:    return "ESP_ERR_NVS_INVALID_HANDLE";
+        case ESP_ERR_NVS_INVALID_LENGTH:    return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_NVS_NO_FREE_PAGES:     return "ESP_ERR_NVS_NO_FREE_PAGES";
+        case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+        case ESP_ERR_HTTPD_HANDLERS_FULL:   return "ESP_ERR_HTTPD_HANDLERS_FULL";
+        case ESP_ERR_HTTPD_HANDLER_EXISTS:  return "ESP_ERR_HTTPD_HANDLER_EXISTS";
+        case ESP_ERR_HTTPD_INVALID_REQ:     return "ESP_ERR_HTTPD_INVALID_REQ";
+        case ESP_ERR_HTTPD_RESULT_TRUNC:    return "ESP_ERR_HTTPD_RESULT_TRUNC";
+        case ESP_ERR_HTTPD_RESP_HDR:        return "ESP_ERR_HTTPD_RESP_HDR";
+        case ESP_ERR_HTTPD_RESP_SEND:       return "ESP_ERR_HTTPD_RESP_SEND";
+        case ESP_ERR_HTTPD_ALLOC_MEM:       return "ESP_ERR_HTTPD_ALLOC_MEM";
+        case ESP_ERR_HTTPD_TASK:            return "ESP_ERR_HTTPD_TASK";
+    }
+    return "UNKNOWN ERROR";
+}
+
+// --- Logging ---
+// Same line format as ESP-IDF ("I (1234) TAG: message"). ASHUMITRA_SIM_LOG
+// selects the level: 0 none, 1 error, 2 warn, 3 info (default), 4 debug.
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    if (level > s_log_level) return;
+
+    char line[512];
+    int len = snprintf(line, sizeof(line), "%c (%u) %s: ", letters[level], sim_uptime_ms(), tag);
+    va_list args;
+    va_start(args, format);
+    if (len < (int)sizeof(line)) vsnprintf(line + len, sizeof(line) - len, format, args);
+    va_end(args);
+    fprintf(stderr, "%s\n", line);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    if (strcmp(tag, "*") == 0) s_log_level = level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return sim_uptime_ms();
+}
+
+// --- Random ---
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *out = buf;
+    while (len > 0) {
+        ssize_t n = getrandom(out, len, 0);
+        if (n <= 0) {
+            for (size_t i = 0; i < len; i++) out[i] = (uint8_t)rand();
+            return;
+        }
+        out += n;
+        len -= n;
+    }
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t value;
+    esp_fill_random(&value, sizeof(value));
+    return value;
+}
+
+// --- System ---
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < SIM_MAX_SHUTDOWN_HANDLERS; i++) {
+        if (!s_shutdown_handlers[i]) {
+            s_shutdown_handlers[i] = handler;
+            err = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+static void run_shutdown_handlers(void)
+{
+    // Reverse registration order, as esp_restart() does
+    for (int i = SIM_MAX_SHUTDOWN_HANDLERS - 1; i >= 0; i--) {
+        if (s_shutdown_handlers[i]) s_shutdown_handlers[i]();
+    }
+}
+
+static void print_report(void)
+{
+    sim_nvs_stats_t nvs;
+    sim_flash_stats_t flash;
+    sim_servo_stats_t servo;
+    sim_nvs_get_stats(&nvs);
+    sim_flash_get_stats(&flash);
+    sim_servo_get_stats(&servo);
+    fprintf(stderr, "sim: uptime %u ms, nvs %u commits / %u sets / %u bytes, flash %u writes / %u erases / %u bytes, "
+            "servo %u moves / %u duty updates / %.0f degrees\n", sim_uptime_ms(), nvs.commits, nvs.sets, nvs.bytes_written,
+            flash.writes, flash.erases, flash.bytes_written, servo.moves, servo.duty_updates, servo.travel_deg);
+}
+
+void esp_restart(void)
+{
+    run_shutdown_handlers();
+    print_report();
+    fflush(NULL);
+    // A device reboot: start the same binary again with a fresh process
+    if (s_argv) execv("/proc/self/exe", s_argv);
+    _exit(0);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    uint32_t used = info.uordblks > SIM_HEAP_SIZE ? SIM_HEAP_SIZE : (uint32_t)info.uordblks;
+    uint32_t free_size = SIM_HEAP_SIZE - used;
+    pthread_mutex_lock(&s_lock);
+    if (free_size < s_min_free_heap) s_min_free_heap = free_size;
+    pthread_mutex_unlock(&s_lock);
+    return free_size;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    esp_get_free_heap_size();
+    pthread_mutex_lock(&s_lock);
+    uint32_t min_free = s_min_free_heap;
+    pthread_mutex_unlock(&s_lock);
+    return min_free;
+}
+
+// --- Lifecycle ---
+void sim_system_init(int argc, char **argv)
+{
+    (void)argc;
+    s_argv = argv;
+    s_log_level = (esp_log_level_t)sim_env_int("ASHUMITRA_SIM_LOG", ESP_LOG_INFO);
+    sim_uptime_ms(); // Start the tick clock
+    signal(SIGPIPE, SIG_IGN); // Peer resets are reported by send()
+
+    // Handled by sigwait() in sim_system_run(); threads inherit the mask
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+void sim_system_run(void)
+{
+    sigset_t set;
+    int sig;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigwait(&set, &sig);
+
+    fprintf(stderr, "sim: %s, shutting down\n", sig == SIGINT ? "SIGINT" : "SIGTERM");
+    run_shutdown_handlers();
+    print_report();
+    fflush(NULL);
+    _exit(0);
+}
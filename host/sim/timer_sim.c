@@ -0,0 +1,181 @@
+// esp_timer stand-in on the simulator's monotonic clock. Callbacks run one at
+// a time on a dispatcher thread, like the esp_timer task on the device.
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "esp_timer.h"
+#include "sim.h"
+
+#define TIMER_TASK_STACK 4096
+#define TIMER_TASK_PRIO  22
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    int64_t alarm_us;  // Next expiry, INT64_MAX while stopped
+    uint64_t period_us; // 0 for one-shot timers
+    struct esp_timer *next;
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static struct esp_timer *s_timers = NULL;
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_uptime_us();
+}
+
+static struct esp_timer *earliest_locked(void)
+{
+    struct esp_timer *best = NULL;
+    for (struct esp_timer *t = s_timers; t; t = t->next) {
+        if (t->alarm_us != INT64_MAX && (!best || t->alarm_us < best->alarm_us)) best = t;
+    }
+    return best;
+}
+
+static void *timer_thread(void *arg)
+{
+    (void)arg;
+    sim_task_adopt("esp_timer", TIMER_TASK_STACK, TIMER_TASK_PRIO, 0);
+
+    pthread_mutex_lock(&s_lock);
+    for (;;) {
+        struct esp_timer *t = earliest_locked();
+        int64_t now = esp_timer_get_time();
+        if (!t) {
+            pthread_cond_wait(&s_cond, &s_lock);
+            continue;
+        }
+        if (t->alarm_us > now) {
+            int64_t wait_us = t->alarm_us - now;
+            struct timespec deadline;
+            sim_deadline(&deadline, (uint32_t)(wait_us > 3600000000LL ? 3600000 : (wait_us + 999) / 1000));
+            pthread_cond_timedwait(&s_cond, &s_lock, &deadline);
+            continue; // Re-evaluate: the timer may have been stopped or re-armed
+        }
+
+        // Due: re-arm periodic timers from the alarm time so they do not drift
+        t->alarm_us = t->period_us ? t->alarm_us + (int64_t)t->period_us : INT64_MAX;
+        if (t->period_us && t->alarm_us < now) t->alarm_us = now + (int64_t)t->period_us;
+        esp_timer_cb_t callback = t->callback;
+        void *cb_arg = t->arg;
+        pthread_mutex_unlock(&s_lock);
+        callback(cb_arg);
+        pthread_mutex_lock(&s_lock);
+    }
+    return NULL;
+}
+
+static void start_dispatcher(void)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, timer_thread, NULL);
+    pthread_detach(thread);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (!create_args || !create_args->callback || !out_handle) return ESP_ERR_INVALID_ARG;
+    pthread_once(&s_once, start_dispatcher);
+
+    struct esp_timer *t = calloc(1, sizeof(*t));
+    if (!t) return ESP_ERR_NO_MEM;
+    t->callback = create_args->callback;
+    t->arg = create_args->arg;
+    t->name = create_args->name;
+    t->alarm_us = INT64_MAX;
+
+    pthread_mutex_lock(&s_lock);
+    t->next = s_timers;
+    s_timers = t;
+    pthread_mutex_unlock(&s_lock);
+    *out_handle = t;
+    return ESP_OK;
+}
+
+static esp_err_t start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    if (timer->alarm_us != INT64_MAX) {
+        err = ESP_ERR_INVALID_STATE; // Already running, as on the device
+    } else {
+        timer->alarm_us = esp_timer_get_time() + (int64_t)timeout_us;
+        timer->period_us = period_us;
+        pthread_cond_signal(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return period_us > 0 ? start(timer, period_us, period_us) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    if (timer->alarm_us == INT64_MAX) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        timer->alarm_us = INT64_MAX;
+        pthread_cond_signal(&s_cond);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&s_lock);
+    if (timer->alarm_us != INT64_MAX) {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (struct esp_timer **p = &s_timers; *p; p = &(*p)->next) {
+        if (*p == timer) {
+            *p = timer->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&s_lock);
+    bool active = timer && timer->alarm_us != INT64_MAX;
+    pthread_mutex_unlock(&s_lock);
+    return active;
+}
+
+int64_t esp_timer_get_next_alarm(void)
+{
+    pthread_mutex_lock(&s_lock);
+    struct esp_timer *t = earliest_locked();
+    int64_t alarm = t ? t->alarm_us : INT64_MAX;
+    pthread_mutex_unlock(&s_lock);
+    return alarm;
+}
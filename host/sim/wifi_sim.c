@@ -0,0 +1,333 @@
+// Wi-Fi, netif and default event loop stand-ins. Events are dispatched on a
+// dedicated "sys_evt" task as on the device. There is one simulated AP on
+// channel ASHUMITRA_SIM_WIFI_CHANNEL (default 6). A connect attempt scans all
+// channels (ASHUMITRA_SIM_SCAN_MS, default 1500 ms) unless the config names a
+// BSSID and channel, associates (ASHUMITRA_SIM_WIFI_MS, default 50 ms) and
+// then waits for DHCP (ASHUMITRA_SIM_DHCP_MS, default 800 ms) unless a static
+// address was set; the address is always 127.0.0.1. Starting DHCP on a link
+// that came up with a static address gets a lease after the DHCP delay. A pinned BSSID or channel
+// that does not match the AP fails like a missing AP.
+// ASHUMITRA_SIM_WIFI_FAIL=1 makes every attempt fail, =N > 1 only the first N.
+// Until the station has an address the simulated httpd sees no traffic (see
+// sim_wifi_link_up()). Power save is modelled as the station only listening
+// every few beacons (see sim_wifi_rx_delay_ms()).
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "sim.h"
+
+#define SIM_EVENT_MAX_HANDLERS 16
+#define SIM_EVENT_QUEUE_LEN    16
+#define SIM_EVENT_DATA_MAX     64
+
+static const char *TAG = "SIM_WIFI";
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} sim_handler_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    size_t size;
+    uint8_t data[SIM_EVENT_DATA_MAX];
+} sim_event_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_handler_t s_handlers[SIM_EVENT_MAX_HANDLERS];
+static QueueHandle_t s_event_queue = NULL;
+static wifi_config_t s_sta_config;
+static bool s_started = false;
+static bool s_link_up = false;
+static bool s_dhcp_running = true;
+static esp_netif_ip_info_t s_static_ip;
+static int s_attempts = 0;
+
+static const uint8_t s_ap_bssid[6] = { 0x24, 0x0a, 0xc4, 0x5a, 0x11, 0x06 };
+
+// --- Event Loop ---
+static void event_task(void *arg)
+{
+    sim_event_t event;
+    for (;;) {
+        if (xQueueReceive(s_event_queue, &event, portMAX_DELAY) != pdTRUE) continue;
+
+        // Snapshot the matching handlers so they can register more handlers
+        sim_handler_t matched[SIM_EVENT_MAX_HANDLERS];
+        int count = 0;
+        pthread_mutex_lock(&s_lock);
+        for (int i = 0; i < SIM_EVENT_MAX_HANDLERS; i++) {
+            const sim_handler_t *h = &s_handlers[i];
+            if (h->handler && strcmp(h->base, event.base) == 0 && (h->id == ESP_EVENT_ANY_ID || h->id == event.id)) {
+                matched[count++] = *h;
+            }
+        }
+        pthread_mutex_unlock(&s_lock);
+
+        for (int i = 0; i < count; i++) {
+            matched[i].handler(matched[i].arg, event.base, event.id, event.size ? event.data : NULL);
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (s_event_queue) return ESP_ERR_INVALID_STATE;
+    s_event_queue = xQueueCreate(SIM_EVENT_QUEUE_LEN, sizeof(sim_event_t));
+    if (!s_event_queue) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(event_task, "sys_evt", 2304, NULL, 20, NULL) != pdPASS) return ESP_FAIL;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void *arg)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < SIM_EVENT_MAX_HANDLERS; i++) {
+        if (!s_handlers[i].handler) {
+            s_handlers[i] = (sim_handler_t) { .base = base, .id = id, .handler = handler, .arg = arg };
+            err = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id,
+                                              esp_event_handler_t handler, void *arg,
+                                              esp_event_handler_instance_t *instance)
+{
+    esp_err_t err = esp_event_handler_register(base, id, handler, arg);
+    if (err == ESP_OK && instance) *instance = (esp_event_handler_instance_t)handler;
+    return err;
+}
+
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void *data, size_t size, uint32_t ticks)
+{
+    if (!s_event_queue) return ESP_ERR_INVALID_STATE;
+    if (size > SIM_EVENT_DATA_MAX) return ESP_ERR_INVALID_ARG;
+
+    sim_event_t event = { .base = base, .id = id, .size = size };
+    if (size) memcpy(event.data, data, size);
+    return xQueueSend(s_event_queue, &event, ticks) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+// --- Netif ---
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    static int s_sta_netif;
+    return (esp_netif_t *)&s_sta_netif;
+}
+
+// DHCP started on a live link: the lease arrives after the DHCP delay
+static void lease_task(void *arg)
+{
+    vTaskDelay(pdMS_TO_TICKS(sim_env_int("ASHUMITRA_SIM_DHCP_MS", 800)));
+    ip_event_got_ip_t got_ip = {
+        .ip_info.ip.addr = 0x0100007f,      // 127.0.0.1
+        .ip_info.netmask.addr = 0x000000ff, // 255.0.0.0
+    };
+    if (sim_wifi_link_up()) {
+        esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *netif)
+{
+    pthread_mutex_lock(&s_lock);
+    bool lease = !s_dhcp_running && s_link_up;
+    s_dhcp_running = true;
+    pthread_mutex_unlock(&s_lock);
+    if (lease && xTaskCreate(lease_task, "sim_dhcp", 2048, NULL, 5, NULL) != pdPASS) return ESP_FAIL;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *netif)
+{
+    pthread_mutex_lock(&s_lock);
+    s_dhcp_running = false;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info)
+{
+    pthread_mutex_lock(&s_lock);
+    s_static_ip = *ip_info;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+// Station MAC: a fixed prefix plus the HTTP port, so simulated units running
+// side by side on one host have distinct identities
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    int port = sim_env_int("ASHUMITRA_SIM_PORT", 8080);
+    const uint8_t sta[6] = { 0x24, 0x0a, 0xc4, 0x00, (uint8_t)(port >> 8), (uint8_t)port };
+    memcpy(mac, sta, sizeof(sta));
+    if (type == ESP_MAC_WIFI_SOFTAP) mac[5]++;
+    return ESP_OK;
+}
+
+// --- Wi-Fi ---
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (interface != WIFI_IF_STA) return ESP_ERR_INVALID_ARG;
+    s_sta_config = *conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (interface != WIFI_IF_STA) return ESP_ERR_INVALID_ARG;
+    *conf = s_sta_config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    s_started = true;
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+}
+
+static void connect_task(void *arg)
+{
+    pthread_mutex_lock(&s_lock);
+    wifi_sta_config_t sta = s_sta_config.sta;
+    bool dhcp = s_dhcp_running;
+    esp_netif_ip_info_t static_ip = s_static_ip;
+    int attempt = ++s_attempts;
+    pthread_mutex_unlock(&s_lock);
+
+    int channel = sim_env_int("ASHUMITRA_SIM_WIFI_CHANNEL", 6);
+    bool pinned = sta.bssid_set && sta.channel != 0;
+    int fail = sim_env_int("ASHUMITRA_SIM_WIFI_FAIL", 0);
+    bool found = (!sta.bssid_set || memcmp(sta.bssid, s_ap_bssid, sizeof(s_ap_bssid)) == 0) &&
+                 (sta.channel == 0 || sta.channel == channel);
+
+    // A known BSSID and channel skip the scan of every channel
+    vTaskDelay(pdMS_TO_TICKS((pinned ? 0 : sim_env_int("ASHUMITRA_SIM_SCAN_MS", 1500)) +
+                             sim_env_int("ASHUMITRA_SIM_WIFI_MS", 50)));
+
+    if (fail == 1 || attempt <= fail || !found) {
+        wifi_event_sta_disconnected_t disc = { .reason = 201 }; // WIFI_REASON_NO_AP_FOUND
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disc, sizeof(disc), portMAX_DELAY);
+    } else {
+        wifi_event_sta_connected_t conn = { .channel = channel, .authmode = WIFI_AUTH_WPA2_PSK };
+        memcpy(conn.ssid, sta.ssid, sizeof(conn.ssid));
+        conn.ssid_len = strnlen((const char *)conn.ssid, sizeof(conn.ssid));
+        memcpy(conn.bssid, s_ap_bssid, sizeof(conn.bssid));
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &conn, sizeof(conn), portMAX_DELAY);
+
+        ip_event_got_ip_t got_ip = {
+            .ip_info.ip.addr = 0x0100007f,      // 127.0.0.1
+            .ip_info.netmask.addr = 0x000000ff, // 255.0.0.0
+        };
+        if (dhcp || static_ip.ip.addr == 0) {
+            vTaskDelay(pdMS_TO_TICKS(sim_env_int("ASHUMITRA_SIM_DHCP_MS", 800)));
+        } else {
+            got_ip.ip_info = static_ip;
+        }
+        pthread_mutex_lock(&s_lock);
+        s_link_up = true;
+        pthread_mutex_unlock(&s_lock);
+        esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+    }
+    vTaskDelete(NULL);
+}
+
+bool sim_wifi_link_up(void)
+{
+    pthread_mutex_lock(&s_lock);
+    bool up = s_link_up;
+    pthread_mutex_unlock(&s_lock);
+    return up;
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+    ESP_LOGI(TAG, "Connecting to \"%s\"", (const char *)s_sta_config.sta.ssid);
+    return xTaskCreate(connect_task, "sim_conn", 2048, NULL, 5, NULL) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    pthread_mutex_lock(&s_lock);
+    s_link_up = false;
+    pthread_mutex_unlock(&s_lock);
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, NULL, 0, portMAX_DELAY);
+}
+
+// --- Power Save ---
+#define SIM_BEACON_US 102400 // 100 TU, the usual AP beacon interval
+#define SIM_PS_AWAKE_US 50000 // Station stays awake this long after traffic before dozing again
+
+static wifi_ps_type_t s_ps_type = WIFI_PS_MIN_MODEM; // The driver's default
+static int64_t s_awake_until_us = 0;
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+    pthread_mutex_lock(&s_lock);
+    if (type != s_ps_type) {
+        ESP_LOGI(TAG, "Power save %s", type == WIFI_PS_NONE ? "off" : type == WIFI_PS_MIN_MODEM ? "min modem" : "max modem");
+    }
+    s_ps_type = type;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+uint32_t sim_wifi_rx_delay_ms(void)
+{
+    if (!s_started) return 0;
+    int64_t now = sim_uptime_us();
+    int64_t wait_us = 0;
+
+    pthread_mutex_lock(&s_lock);
+    if (s_ps_type == WIFI_PS_NONE) {
+        pthread_mutex_unlock(&s_lock);
+        return 0;
+    }
+    if (now >= s_awake_until_us) {
+        // Dozing: min modem listens at every DTIM beacon (DTIM 1 assumed), max modem every listen_interval beacons
+        uint32_t interval = s_sta_config.sta.listen_interval ? s_sta_config.sta.listen_interval : 3;
+        int64_t period_us = SIM_BEACON_US * (s_ps_type == WIFI_PS_MAX_MODEM ? interval : 1);
+        wait_us = period_us - now % period_us;
+    }
+    s_awake_until_us = now + wait_us + SIM_PS_AWAKE_US;
+    pthread_mutex_unlock(&s_lock);
+    return (uint32_t)((wait_us + 999) / 1000);
+}
@@ -0,0 +1,157 @@
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "admission.h"
+#include "tray.h"
+
+static const char *TAG = "ASHUMITRA_ADMISSION";
+
+// Token bucket of one client, keyed by its address (IPv4 as v4-mapped IPv6)
+typedef struct {
+    uint8_t addr[16];
+    bool in_use;
+    uint32_t tokens_milli; // Available commands x 1000
+    uint32_t last_ms;      // Last refill, also used to pick the entry to recycle
+} admission_client_t;
+
+static admission_config_t s_config = ADMISSION_DEFAULT_CONFIG();
+static admission_client_t s_clients[ADMISSION_MAX_CLIENTS];
+static admission_stats_t s_stats;
+static portMUX_TYPE s_admission_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t admission_init(const admission_config_t *config)
+{
+    if (!config || config->max_pending_jobs < 1 || config->max_pending_jobs > MOTION_QUEUE_LEN ||
+        config->client_burst < 1 || config->client_refill_ms < 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    taskENTER_CRITICAL(&s_admission_lock);
+    s_config = *config;
+    memset(s_clients, 0, sizeof(s_clients));
+    taskEXIT_CRITICAL(&s_admission_lock);
+    ESP_LOGI(TAG, "Motion admission: %d pending jobs per tray, burst %" PRIu32 " per client, +1 every %" PRIu32 " ms%s",
+             config->max_pending_jobs, config->client_burst, config->client_refill_ms,
+             config->collapse_duplicates ? ", duplicates collapsed" : "");
+    return ESP_OK;
+}
+
+// Peer address of a socket; false if it cannot be determined
+static bool peer_addr(int sockfd, uint8_t out[16])
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+
+    if (getpeername(sockfd, (struct sockaddr *)&addr, &len) != 0) return false;
+    memset(out, 0, 16);
+    if (addr.ss_family == AF_INET) {
+        out[10] = out[11] = 0xff;
+        memcpy(out + 12, &((struct sockaddr_in *)&addr)->sin_addr, 4);
+        return true;
+    }
+    if (addr.ss_family == AF_INET6) {
+        memcpy(out, &((struct sockaddr_in6 *)&addr)->sin6_addr, 16);
+        return true;
+    }
+    return false;
+}
+
+// Finds the client's bucket, recycling the least recently seen one for a new
+// client. Call with the lock held.
+static admission_client_t *client_locked(const uint8_t addr[16], uint32_t now_ms)
+{
+    admission_client_t *oldest = &s_clients[0];
+
+    for (int i = 0; i < ADMISSION_MAX_CLIENTS; i++) {
+        admission_client_t *client = &s_clients[i];
+        if (client->in_use && memcmp(client->addr, addr, 16) == 0) return client;
+        if (!client->in_use) {
+            oldest = client;
+        } else if (oldest->in_use && (int32_t)(client->last_ms - oldest->last_ms) < 0) {
+            oldest = client;
+        }
+    }
+    memcpy(oldest->addr, addr, 16);
+    oldest->in_use = true;
+    oldest->tokens_milli = s_config.client_burst * 1000;
+    oldest->last_ms = now_ms;
+    return oldest;
+}
+
+static uint32_t ms_to_retry_s(uint32_t ms)
+{
+    uint32_t s = (ms + 999) / 1000;
+    return s > 0 ? s : 1;
+}
+
+admission_result_t admission_check(int sockfd, motion_op_t op, int slot, uint32_t *job_id, uint32_t *retry_after_s)
+{
+    admission_result_t result = ADMISSION_ACCEPT;
+    *retry_after_s = 0;
+
+    // A repeated tap while the first one is still pending is answered with
+    // that job and costs the client nothing
+    if (s_config.collapse_duplicates && slot >= 0 && motion_find_pending(op, slot, job_id)) {
+        taskENTER_CRITICAL(&s_admission_lock);
+        s_stats.decisions[ADMISSION_DUPLICATE]++;
+        taskEXIT_CRITICAL(&s_admission_lock);
+        return ADMISSION_DUPLICATE;
+    }
+
+    // Only the tray the command runs on matters; a program may touch any tray
+    motion_backlog_t backlog;
+    motion_get_backlog(slot >= 0 ? tray_of_slot(slot) : -1, &backlog);
+
+    uint8_t addr[16];
+    bool known = peer_addr(sockfd, addr);
+    uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+
+    taskENTER_CRITICAL(&s_admission_lock);
+    admission_client_t *client = known ? client_locked(addr, now_ms) : NULL;
+    if (client) {
+        uint32_t cap = s_config.client_burst * 1000;
+        uint64_t earned = (uint64_t)(now_ms - client->last_ms) * 1000 / s_config.client_refill_ms;
+        client->tokens_milli = earned >= cap - client->tokens_milli ? cap : client->tokens_milli + (uint32_t)earned;
+        client->last_ms = now_ms;
+    }
+
+    if (client && client->tokens_milli < 1000) {
+        result = ADMISSION_RATE_LIMITED;
+        *retry_after_s = ms_to_retry_s((uint32_t)((uint64_t)(1000 - client->tokens_milli) * s_config.client_refill_ms / 1000));
+    } else if (backlog.pending >= s_config.max_pending_jobs) {
+        result = ADMISSION_BACKLOG_FULL; // Rejected without using up a token
+        *retry_after_s = ms_to_retry_s(backlog.next_free_ms);
+    } else if (client) {
+        client->tokens_milli -= 1000;
+    }
+    s_stats.decisions[result]++;
+    taskEXIT_CRITICAL(&s_admission_lock);
+
+    if (result != ADMISSION_ACCEPT) {
+        ESP_LOGW(TAG, "%s for slot %d %s, retry after %" PRIu32 " s", motion_op_name(op), slot,
+                 admission_result_name(result), *retry_after_s);
+    }
+    return result;
+}
+
+void admission_get_stats(admission_stats_t *out)
+{
+    taskENTER_CRITICAL(&s_admission_lock);
+    *out = s_stats;
+    taskEXIT_CRITICAL(&s_admission_lock);
+}
+
+const char *admission_result_name(admission_result_t result)
+{
+    switch (result) {
+        case ADMISSION_ACCEPT:       return "accepted";
+        case ADMISSION_DUPLICATE:    return "duplicate";
+        case ADMISSION_RATE_LIMITED: return "rate_limited";
+        case ADMISSION_BACKLOG_FULL: return "backlog_full";
+        case ADMISSION_RESULT_COUNT: break;
+    }
+    return "unknown";
+}
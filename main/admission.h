@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "motion.h"
+
+// Clients tracked for rate limiting; the least recently seen is recycled
+#define ADMISSION_MAX_CLIENTS 8
+
+// Admission policy for commands that move the carousel. It keeps a burst of
+// taps from filling the motion queue and tying up the dispenser for minutes.
+typedef struct {
+    int max_pending_jobs;      // Motion jobs queued or running at once per tray (at most MOTION_QUEUE_LEN)
+    uint32_t client_burst;     // Motion commands one client may send back to back
+    uint32_t client_refill_ms; // Time for a client to earn one more command
+    bool collapse_duplicates;  // A repeat of a pending single-slot command returns that job
+} admission_config_t;
+
+#define ADMISSION_DEFAULT_CONFIG() {  \
+        .max_pending_jobs    = 4,     \
+        .client_burst        = 5,     \
+        .client_refill_ms    = 1000,  \
+        .collapse_duplicates = true,  \
+}
+
+typedef enum {
+    ADMISSION_ACCEPT = 0,     // Queue the command
+    ADMISSION_DUPLICATE,      // Same command already pending; *job_id is that job
+    ADMISSION_RATE_LIMITED,   // The client is sending commands too fast
+    ADMISSION_BACKLOG_FULL,   // max_pending_jobs reached
+    ADMISSION_RESULT_COUNT,
+} admission_result_t;
+
+typedef struct {
+    uint32_t decisions[ADMISSION_RESULT_COUNT]; // admission_check() outcomes, by result
+} admission_stats_t;
+
+esp_err_t admission_init(const admission_config_t *config);
+
+// Decides on a motion command from the client connected on `sockfd`. Single
+// slot commands pass their op and slot for duplicate collapsing; programs pass
+// slot -1. On a rejection *retry_after_s is the suggested wait in seconds.
+// An accepted command uses up one of the client's tokens.
+admission_result_t admission_check(int sockfd, motion_op_t op, int slot, uint32_t *job_id, uint32_t *retry_after_s);
+
+void admission_get_stats(admission_stats_t *out);
+
+const char *admission_result_name(admission_result_t result);
@@ -1,65 +1,73 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h> // Required for atoi
+#include <inttypes.h>
 #include <ctype.h>  // Required for toupper
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/event_groups.h"
 #include "freertos/semphr.h" // Required for Mutex
 #include "esp_system.h"
-#include "esp_wifi.h"
-#include "esp_event.h"
+#include "esp_random.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "nvs.h"      // Required for NVS operations
-#include "lwip/err.h"
-#include "lwip/sys.h"
-#include "driver/ledc.h"
 #include "esp_err.h"
 #include "esp_http_server.h"
-#include "cJSON.h"    // Required for JSON handling
+#include "esp_timer.h"
+#include "cJSON.h"    // Request bodies only; responses use json_writer
+#include "admission.h"
+#include "ashumitra.h"
+#include "cbor.h"
+#include "cbor_api.h"
+#include "dedup.h"
+#include "dose_sched.h"
+#include "drop_sensor.h"
+#include "history.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "motion.h"
+#include "mqtt_bridge.h"
+#include "persist.h"
+#include "power.h"
+#include "push.h"
+#include "slot_state.h"
+#include "task_plan.h"
+#include "trace.h"
+#include "tray.h"
+#include "wifi_mgr.h"
+#include "web_ui.h"   // Generated at build time from web/index.html
 
 // WiFi credentials - replace with your own
 #define WIFI_SSID      "Delta_Virus_2.4G" // *** REPLACE WITH YOUR WIFI SSID ***
 #define WIFI_PASS      "66380115" // *** REPLACE WITH YOUR WIFI PASSWORD ***
-#define MAX_RETRY      5
-
-// Servo control parameters (Unchanged)
-#define SERVO_GPIO_PIN 2
-#define SERVO_TIMER LEDC_TIMER_0
-#define SERVO_CHANNEL LEDC_CHANNEL_0
-#define SERVO_RESOLUTION LEDC_TIMER_13_BIT
-#define SERVO_FREQ 50
-#define SERVO_MIN_PULSEWIDTH 500
-#define SERVO_MAX_PULSEWIDTH 2500
-
-// hii
-// Number of slots for servo positions (Monday Dose 1/2 ... Saturday Dose 1)
-#define NUM_SLOTS 11
-
-// Array to store preset servo positions (in degrees) for each slot
-// Slot 0: Mon D1, Slot 1: Mon D2, Slot 2: Tue D1, ..., Slot 10: Sat D1
-int servo_positions[NUM_SLOTS] = {0, 17, 34, 52, 69, 86, 103, 121, 138, 155, 172};
 
 // NVS definitions
 #define NVS_NAMESPACE "pill_disp"
 #define NVS_KEY_FILLED "filled_slots"
 
-// Array to store the filled status of each slot (in RAM, loaded from NVS)
-// 0 = empty, 1 = filled
-uint8_t filled_slots_status[NUM_SLOTS] = {0}; // Initialize all to empty
-
-// Mutex for protecting access to filled_slots_status (good practice if multiple tasks might access)
-static SemaphoreHandle_t nvs_mutex = NULL;
+// Largest accepted POST /schedule body (one add/remove per slot fits comfortably)
+#define SCHEDULE_MAX_BODY 1024
+// Largest accepted POST /program body
+#define PROGRAM_MAX_BODY 256
+// Largest accepted POST /dose_schedule body
+#define DOSE_SCHED_MAX_BODY 128
+// Largest accepted POST /trays body (two trays with explicit angles fit)
+#define TRAYS_MAX_BODY 1024
+// Delay between answering a layout change and restarting into it
+#define TRAYS_RESTART_DELAY_MS 500
+// HTTP server task stack, sized for the HTML page and JSON responses
+#define HTTPD_STACK_SIZE 10240
+// Concurrent HTTP sessions; needs CONFIG_LWIP_MAX_SOCKETS of at least this plus 4
+#define HTTPD_MAX_SOCKETS 12
+
+// The filled status of each slot lives in slot_state.c (loaded from NVS at boot).
+// Its generation together with the per-boot epoch forms the ETag of
+// /get_filled_doses, so a client's cached copy can never match state from a
+// different boot.
+static uint32_t s_boot_epoch = 0;
 
 static const char *TAG = "ASHUMITRA_SERVER";
 
-/* FreeRTOS event group to signal when we are connected */
-static EventGroupHandle_t s_wifi_event_group;
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
-static int s_retry_num = 0;
-
 // --- NVS Functions ---
 esp_err_t nvs_init() {
     esp_err_t ret = nvs_flash_init();
@@ -71,9 +79,13 @@ esp_err_t nvs_init() {
     return ret;
 }
 
-esp_err_t nvs_read_filled_slots() {
+// Loads the slot status into `filled_slots_status` (tray_slot_count() bytes,
+// 0 = empty, 1 = filled). A record saved for another tray layout has a
+// different size and is discarded.
+esp_err_t nvs_read_filled_slots(uint8_t *filled_slots_status) {
     nvs_handle_t nvs_handle;
     esp_err_t err;
+    int num_slots = tray_slot_count();
 
     err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (err != ESP_OK) {
@@ -81,22 +93,25 @@ esp_err_t nvs_read_filled_slots() {
         return err;
     }
 
-    size_t required_size = sizeof(filled_slots_status);
-    err = nvs_get_blob(nvs_handle, NVS_KEY_FILLED, filled_slots_status, &required_size);
+    size_t required_size = 0;
+    err = nvs_get_blob(nvs_handle, NVS_KEY_FILLED, NULL, &required_size); // Size only
+    if (err == ESP_OK && required_size == (size_t)num_slots) {
+        err = nvs_get_blob(nvs_handle, NVS_KEY_FILLED, filled_slots_status, &required_size);
+    }
 
     if (err == ESP_OK) {
-        if (required_size != sizeof(filled_slots_status)) {
-            ESP_LOGW(TAG, "NVS BLOB size mismatch (%d vs %d expected). Resetting.", (int)required_size, (int)sizeof(filled_slots_status));
-            memset(filled_slots_status, 0, sizeof(filled_slots_status)); // Reset to default (all empty)
+        if (required_size != (size_t)num_slots) {
+            ESP_LOGW(TAG, "NVS BLOB size mismatch (%d vs %d expected). Resetting.", (int)required_size, num_slots);
+            memset(filled_slots_status, 0, num_slots); // Reset to default (all empty)
             err = ESP_ERR_NVS_INVALID_LENGTH; // Indicate an issue happened
         } else {
             ESP_LOGI(TAG, "Successfully read filled slots status from NVS.");
         }
     } else if (err == ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGI(TAG, "Filled slots status not found in NVS. Initializing to empty.");
-        memset(filled_slots_status, 0, sizeof(filled_slots_status));
+        memset(filled_slots_status, 0, num_slots);
         // Optionally write the initial empty state back to NVS here
-        err = nvs_set_blob(nvs_handle, NVS_KEY_FILLED, filled_slots_status, sizeof(filled_slots_status));
+        err = nvs_set_blob(nvs_handle, NVS_KEY_FILLED, filled_slots_status, num_slots);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Error (%s) writing initial empty slots to NVS!", esp_err_to_name(err));
         } else {
@@ -111,488 +126,236 @@ esp_err_t nvs_read_filled_slots() {
 
     } else {
         ESP_LOGE(TAG, "Error (%s) reading filled slots status from NVS!", esp_err_to_name(err));
+        memset(filled_slots_status, 0, num_slots);
     }
 
     nvs_close(nvs_handle);
     return err;
 }
 
+// Writes the current slot snapshot to NVS. Called only by the persistence
+// task (which serializes writes); the snapshot read is lock-free, so slot
+// readers and writers never wait on the flash commit.
 esp_err_t nvs_write_filled_slots() {
     nvs_handle_t nvs_handle;
     esp_err_t err;
+    slot_snapshot_t snap;
 
-    if (!nvs_mutex) return ESP_FAIL; // Should not happen if initialized correctly
+    slot_state_read(&snap);
 
-    // Lock mutex before accessing NVS
-    if (xSemaphoreTake(nvs_mutex, portMAX_DELAY) == pdTRUE) {
-        err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Error (%s) opening NVS handle for writing!", esp_err_to_name(err));
-            xSemaphoreGive(nvs_mutex); // Release mutex on error
-            return err;
-        }
+    err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) opening NVS handle for writing!", esp_err_to_name(err));
+        return err;
+    }
 
-        err = nvs_set_blob(nvs_handle, NVS_KEY_FILLED, filled_slots_status, sizeof(filled_slots_status));
+    err = nvs_set_blob(nvs_handle, NVS_KEY_FILLED, snap.filled, tray_slot_count());
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) writing filled slots status to NVS!", esp_err_to_name(err));
+    } else {
+        err = nvs_commit(nvs_handle); // Commit changes
         if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Error (%s) writing filled slots status to NVS!", esp_err_to_name(err));
+            ESP_LOGE(TAG, "Error (%s) committing filled slots status to NVS!", esp_err_to_name(err));
         } else {
-            err = nvs_commit(nvs_handle); // Commit changes
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Error (%s) committing filled slots status to NVS!", esp_err_to_name(err));
-            } else {
-                ESP_LOGI(TAG, "Successfully wrote filled slots status to NVS.");
-            }
+            ESP_LOGI(TAG, "Successfully wrote filled slots status to NVS (generation %" PRIu32 ").", snap.generation);
         }
-
-        nvs_close(nvs_handle);
-        xSemaphoreGive(nvs_mutex); // Release mutex
-    } else {
-        ESP_LOGE(TAG, "Could not obtain NVS mutex for writing.");
-        err = ESP_FAIL;
     }
-    return err;
-}
-
 
-// --- Servo Functions (Unchanged) ---
-void servo_init(void)
-{
-    ledc_timer_config_t timer_conf = {
-        .speed_mode = LEDC_LOW_SPEED_MODE,
-        .duty_resolution = SERVO_RESOLUTION,
-        .timer_num = SERVO_TIMER,
-        .freq_hz = SERVO_FREQ,
-        .clk_cfg = LEDC_AUTO_CLK
-    };
-    ESP_ERROR_CHECK(ledc_timer_config(&timer_conf));
-
-    ledc_channel_config_t channel_conf = {
-        .gpio_num = SERVO_GPIO_PIN,
-        .speed_mode = LEDC_LOW_SPEED_MODE,
-        .channel = SERVO_CHANNEL,
-        .timer_sel = SERVO_TIMER,
-        .duty = 0,
-        .hpoint = 0
-    };
-    ESP_ERROR_CHECK(ledc_channel_config(&channel_conf));
-}
-
-uint32_t servo_angle_to_duty(int angle)
-{
-    if (angle < 0) angle = 0;
-    if (angle > 180) angle = 180;
-    uint32_t pulse_width = SERVO_MIN_PULSEWIDTH + (((SERVO_MAX_PULSEWIDTH - SERVO_MIN_PULSEWIDTH) * angle) / 180);
-    return (pulse_width * ((1 << SERVO_RESOLUTION) - 1)) / (1000000 / SERVO_FREQ);
-}
-
-void servo_set_angle(int angle)
-{
-    uint32_t duty = servo_angle_to_duty(angle);
-    ESP_ERROR_CHECK(ledc_set_duty(LEDC_LOW_SPEED_MODE, SERVO_CHANNEL, duty));
-    ESP_ERROR_CHECK(ledc_update_duty(LEDC_LOW_SPEED_MODE, SERVO_CHANNEL));
-    ESP_LOGI(TAG, "Setting servo to %d degrees (duty: %lu)", angle, duty);
-     // Add a small delay for the servo to physically move
-    vTaskDelay(pdMS_TO_TICKS(300)); // 300ms delay, adjust as needed
+    nvs_close(nvs_handle);
+    return err;
 }
 
-// --- WiFi Functions (Unchanged) ---
-static void event_handler(void* arg, esp_event_base_t event_base,
-                          int32_t event_id, void* event_data)
-{
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < MAX_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-        }
-        ESP_LOGI(TAG,"connect to the AP fail");
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-    }
-}
-
-void wifi_init_sta(void)
-{
-    s_wifi_event_group = xEventGroupCreate();
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL, &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, &instance_got_ip));
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid = WIFI_SSID,
-            .password = WIFI_PASS,
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-        },
-    };
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s", WIFI_SSID);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s", WIFI_SSID);
-    } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
-    }
-}
 
 // --- Helper Function: Slot to Day/Dose String ---
 void slot_to_day_dose_string(int slot, char *out_str, size_t max_len) {
-    if (slot < 0 || slot >= NUM_SLOTS) {
+    if (slot < 0 || slot >= tray_slot_count()) {
         snprintf(out_str, max_len, "Invalid Slot");
         return;
     }
-    const char *days[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
-    int day_index = slot / 2;
-    int dose_num = (slot % 2) + 1;
-    if (day_index < 6) { // Check index bounds
+    const char *days[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+    int day_index = slot / tray_doses_per_day();
+    int dose_num = (slot % tray_doses_per_day()) + 1;
+    if (day_index < 7) { // Check index bounds
          snprintf(out_str, max_len, "%s Dose %d", days[day_index], dose_num);
     } else {
-         snprintf(out_str, max_len, "Error Slot"); // Should not happen with NUM_SLOTS=11
-    }
-
-}
-
-// --- NEW HTML Page with Modes ---
-static const char *html_page = R"rawliteral(
-<!DOCTYPE html>
-<html>
-<head>
-    <title>ASHUMITRA Pill Dispenser</title>
-    <meta name='viewport' content='width=device-width, initial-scale=1'>
-    <style>
-        body { font-family: 'Segoe UI', Tahoma, Geneva, Verdana, sans-serif; background-color: #f4f0f8; color: #333; margin: 0; padding: 20px; display: flex; flex-direction: column; align-items: center; min-height: 100vh; }
-        .container { background-color: #ffffff; padding: 30px; border-radius: 15px; box-shadow: 0 5px 15px rgba(0, 0, 0, 0.1); text-align: center; max-width: 450px; width: 90%; }
-        h1 { color: #6a0dad; margin-bottom: 10px; }
-        p { color: #555; margin-bottom: 25px; }
-        #dateTime { font-size: 1em; color: #8a2be2; margin-bottom: 20px; padding: 10px; background-color: #e6e6fa; border-radius: 8px; }
-        .controls label, .mode-selector label { display: block; margin-bottom: 8px; font-weight: bold; color: #6a0dad; text-align: left; }
-        .controls select, .controls button { width: 100%; padding: 12px; margin-bottom: 15px; border-radius: 8px; border: 1px solid #ccc; font-size: 1em; box-sizing: border-box; }
-        .controls select { background-color: #f8f8f8; }
-        .controls button { background-color: #9370db; color: white; border: none; font-size: 1.1em; font-weight: bold; cursor: pointer; transition: background-color 0.3s ease; box-shadow: 0 4px #6a0dad; position: relative; top: 0; }
-        .controls button:hover { background-color: #8a2be2; }
-        .controls button:active { background-color: #8a2be2; box-shadow: 0 2px #6a0dad; top: 2px; }
-        .controls button.remove-btn { background-color: #dc3545; box-shadow: 0 4px #a71d2a; font-size: 0.9em; padding: 8px; width: auto; margin-left: 10px; }
-        .controls button.remove-btn:hover { background-color: #c82333; }
-        .controls button.remove-btn:active { background-color: #c82333; box-shadow: 0 2px #a71d2a; top: 2px; }
-        .controls button.dispense-btn { background-color: #28a745; box-shadow: 0 4px #1e7e34; margin: 5px; width: calc(50% - 10px); /* Two columns */ display: inline-block; }
-        .controls button.dispense-btn:hover { background-color: #218838; }
-        .controls button.dispense-btn:active { background-color: #218838; box-shadow: 0 2px #1e7e34; top: 2px; }
-
-        #statusMessage { margin-top: 20px; font-size: 1em; color: #6a0dad; font-weight: bold; min-height: 20px; background-color: #e6e6fa; padding: 10px; border-radius: 8px; display: none; }
-        .status-success { color: #155724; background-color: #d4edda; border: 1px solid #c3e6cb; }
-        .status-error { color: #721c24; background-color: #f8d7da; border: 1px solid #f5c6cb; }
-        .mode-selector { margin-bottom: 25px; background-color: #e6e6fa; padding: 15px; border-radius: 8px; text-align: center; }
-        .mode-selector label { display: inline-block; margin: 0 15px; font-weight: normal; color: #333; cursor: pointer; }
-        .mode-selector input[type="radio"] { margin-right: 5px; vertical-align: middle; }
-        #filledDosesDisplay ul { list-style: none; padding: 0; margin-top: 10px; }
-        #filledDosesDisplay li { background-color: #f8f8f8; padding: 8px 12px; margin-bottom: 5px; border-radius: 5px; display: flex; justify-content: space-between; align-items: center; }
-        #dispenseControls { margin-top: 15px; }
-        #dispenseControls h4, #filledDosesDisplay h4 { color: #6a0dad; margin-bottom: 10px; text-align: left; }
-         hr { border: none; border-top: 1px solid #ddd; margin: 25px 0; }
-    </style>
-</head>
-<body>
-    <div class="container">
-        <h1>ASHUMITRA</h1>
-        <p>Smart Pill Dispenser</p>
-        <div id="dateTime">Loading date and time...</div>
-
-        <div class="mode-selector">
-            <label><input type="radio" name="mode" value="fill" checked onchange="switchMode('fill')"> Filling Mode</label>
-            <label><input type="radio" name="mode" value="dispense" onchange="switchMode('dispense')"> Dispense Mode</label>
-        </div>
-
-        <div id="statusMessage"></div>
-
-        <!-- Filling Mode Controls -->
-        <div id="fillControls" class="controls">
-            <label for="daySelect">Select Day:</label>
-            <select id="daySelect">
-                <option value="monday">Monday</option>
-                <option value="tuesday">Tuesday</option>
-                <option value="wednesday">Wednesday</option>
-                <option value="thursday">Thursday</option>
-                <option value="friday">Friday</option>
-                <option value="saturday">Saturday</option>
-            </select>
-
-            <label for="doseSelect">Select Dose:</label>
-            <select id="doseSelect">
-                <option value="1">Dose 1</option>
-                <option value="2">Dose 2</option>
-            </select>
-
-            <button onclick="addDose()">Add Dose to Schedule</button>
-
-            <div id="filledDosesDisplay">
-                <h4>Scheduled Doses:</h4>
-                <ul id="filledList">
-                    <!-- Filled doses will be listed here -->
-                </ul>
-            </div>
-             <hr>
-        </div>
-
-        <!-- Dispense Mode Controls -->
-        <div id="dispenseControls" class="controls" style="display: none;">
-            <h4>Dispense a Scheduled Dose:</h4>
-            <div id="dispenseButtons">
-                <!-- Buttons for filled doses will be added here -->
-            </div>
-            <hr>
-        </div>
-
-
-    </div>
-
-    <script>
-        let currentMode = 'fill'; // Track current mode
-
-        function updateDateTime() {
-            const now = new Date();
-            const options = { weekday: 'long', year: 'numeric', month: 'long', day: 'numeric', hour: '2-digit', minute: '2-digit', second: '2-digit' };
-            document.getElementById('dateTime').textContent = now.toLocaleDateString('en-US', options);
-        }
-
-        function getSlotFromSelection() {
-            const day = document.getElementById('daySelect').value;
-            const dose = parseInt(document.getElementById('doseSelect').value, 10);
-            let slot = -1;
-
-            if (day === 'monday') slot = (dose === 1) ? 0 : 1;
-            else if (day === 'tuesday') slot = (dose === 1) ? 2 : 3;
-            else if (day === 'wednesday') slot = (dose === 1) ? 4 : 5;
-            else if (day === 'thursday') slot = (dose === 1) ? 6 : 7;
-            else if (day === 'friday') slot = (dose === 1) ? 8 : 9;
-            else if (day === 'saturday') slot = (dose === 1) ? 10 : -1; // Dose 2 invalid
-
-            return slot;
-        }
-
-         function slotToDayDoseString(slot) {
-            const days = ["Mon", "Tue", "Wed", "Thu", "Fri", "Sat"];
-            if (slot < 0 || slot >= 11) return "Invalid Slot";
-            const dayIndex = Math.floor(slot / 2);
-            const doseNum = (slot % 2) + 1;
-             if (dayIndex < 6) {
-                 return `${days[dayIndex]} Dose ${doseNum}`;
-             }
-             return "Error Slot";
-        }
-
-
-        function showStatus(message, isError = false) {
-            const statusDiv = document.getElementById('statusMessage');
-            statusDiv.textContent = message;
-            statusDiv.className = isError ? 'status-error' : 'status-success';
-            statusDiv.style.display = 'block';
-            // Optionally hide after a few seconds
-            // setTimeout(() => { statusDiv.style.display = 'none'; }, 5000);
-        }
+         snprintf(out_str, max_len, "Error Slot"); // More slots than a week of doses
+    }
 
-        function clearStatus() {
-             const statusDiv = document.getElementById('statusMessage');
-             statusDiv.textContent = '';
-             statusDiv.style.display = 'none';
-             statusDiv.className = '';
-        }
+}
 
+// --- HTTP Handlers ---
+// --- HTTP Handlers ---
 
-        function switchMode(newMode) {
-            currentMode = newMode;
-            clearStatus();
-            if (newMode === 'fill') {
-                document.getElementById('fillControls').style.display = 'block';
-                document.getElementById('dispenseControls').style.display = 'none';
-                 loadFilledDoses(); // Refresh the list view
-            } else { // dispense mode
-                document.getElementById('fillControls').style.display = 'none';
-                document.getElementById('dispenseControls').style.display = 'block';
-                loadFilledDoses(); // Load buttons for dispensing
-            }
-        }
+// 429 with a Retry-After hint, for motion commands that cannot be taken now
+static void send_retry_later(httpd_req_t *req, const char *reason, uint32_t retry_after_s)
+{
+    char retry_str[12];
+    char resp_str[100];
 
-        function handleDayChange() {
-            const day = document.getElementById('daySelect').value;
-            const doseSelect = document.getElementById('doseSelect');
-            const dose2Option = doseSelect.querySelector('option[value="2"]');
-            dose2Option.disabled = (day === 'saturday');
-            if (day === 'saturday' && doseSelect.value === '2') {
-                doseSelect.value = '1';
-            }
-        }
+    snprintf(retry_str, sizeof(retry_str), "%" PRIu32, retry_after_s);
+    snprintf(resp_str, sizeof(resp_str), "Error: %s, please try again in %" PRIu32 " s.", reason, retry_after_s);
+    httpd_resp_set_status(req, "429 Too Many Requests");
+    httpd_resp_set_hdr(req, "Retry-After", retry_str);
+    httpd_resp_send(req, resp_str, strlen(resp_str));
+}
 
-        function addDose() {
-            const slot = getSlotFromSelection();
-             clearStatus();
+// Response used when the motion queue cannot take another job
+static void send_motion_busy(httpd_req_t *req)
+{
+    motion_backlog_t backlog;
+    motion_get_backlog(-1, &backlog);
+    send_retry_later(req, "Dispenser is busy", backlog.next_free_ms / 1000 + 1);
+    metrics_inc(&metrics_http_busy);
+    ESP_LOGW(TAG, "Motion queue full, request rejected");
+}
 
-            if (slot === -1) {
-                showStatus('Error: Saturday Dose 2 cannot be scheduled.', true);
-                return;
-            }
+// Outcome of admission control for one motion command
+typedef struct {
+    admission_result_t result;
+    uint32_t retry_after_s;
+    uint32_t job_id;        // Pending job a duplicate was collapsed into
+} motion_ticket_t;
+
+// Runs a motion command past admission control (pass slot -1 for programs).
+// Returns true if it may be queued now. Otherwise the ticket tells whether it
+// was collapsed into a pending job or refused (see send_motion_refused()).
+static bool admit_motion(httpd_req_t *req, motion_op_t op, int slot, motion_ticket_t *ticket)
+{
+    *ticket = (motion_ticket_t) { 0 };
+    ticket->result = admission_check(httpd_req_to_sockfd(req), op, slot, &ticket->job_id, &ticket->retry_after_s);
+    return ticket->result == ADMISSION_ACCEPT;
+}
 
-            showStatus('Adding dose to schedule...');
-            fetch(`/add_dose?slot=${slot}`)
-                .then(response => response.text().then(text => ({ ok: response.ok, status: response.status, text })))
-                .then(({ ok, status, text }) => {
-                    if (!ok) {
-                         throw new Error(`HTTP error ${status}: ${text}`);
-                    }
-                    showStatus(text, false); // Show success message from server
-                    loadFilledDoses(); // Refresh the list/buttons
-                })
-                .catch(error => {
-                    console.error('Error adding dose:', error);
-                    showStatus(`Error adding dose: ${error.message}`, true);
-                });
-        }
+static void send_motion_refused(httpd_req_t *req, const motion_ticket_t *ticket)
+{
+    send_retry_later(req, ticket->result == ADMISSION_RATE_LIMITED ? "Too many commands" : "Dispenser is busy",
+                     ticket->retry_after_s);
+}
 
-        function removeDose(slot) {
-             clearStatus();
-             showStatus('Removing dose from schedule...');
-             fetch(`/remove_dose?slot=${slot}`)
-                .then(response => response.text().then(text => ({ ok: response.ok, status: response.status, text })))
-                 .then(({ ok, status, text }) => {
-                     if (!ok) {
-                          throw new Error(`HTTP error ${status}: ${text}`);
-                     }
-                     showStatus(text, false); // Show success message from server
-                     loadFilledDoses(); // Refresh the list/buttons
-                 })
-                 .catch(error => {
-                     console.error('Error removing dose:', error);
-                     showStatus(`Error removing dose: ${error.message}`, true);
-                 });
-        }
+// JSON responses are serialized into a buffer on the handler's stack. A body
+// that fits goes out in one send with a Content-Length; one that outgrows the
+// buffer switches to chunked transfer as it is written.
+static esp_err_t json_resp_chunk(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
 
+static void json_resp_begin(json_writer_t *w, httpd_req_t *req, char *buf, size_t size)
+{
+    httpd_resp_set_type(req, "application/json");
+    json_writer_init(w, buf, size, json_resp_chunk, req);
+}
 
-        function dispensePill(slot) {
-            clearStatus();
-            if (slot < 0 || slot >= 11) {
-                 showStatus('Error: Invalid slot selected.', true);
-                 return;
-            }
-            showStatus(`Dispensing ${slotToDayDoseString(slot)}...`);
+static esp_err_t json_resp_send(json_writer_t *w, httpd_req_t *req)
+{
+    esp_err_t err = json_writer_finish(w);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write JSON response: %s", esp_err_to_name(err));
+        if (!w->flushed) httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    if (w->flushed) {
+        return httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return httpd_resp_send(req, w->buf, w->len);
+}
 
-            fetch(`/dispense?slot=${slot}`)
-                .then(response => response.text().then(text => ({ ok: response.ok, status: response.status, text })))
-                 .then(({ ok, status, text }) => {
-                     if (!ok) {
-                          throw new Error(`HTTP error ${status}: ${text}`);
-                     }
-                     showStatus(text, false); // Show confirmation from ESP32
-                 })
-                 .catch(error => {
-                     console.error('Error dispensing pill:', error);
-                     showStatus(`Error: Could not contact dispenser. ${error.message}`, true);
-                 });
-        }
+// Hands a published slot-state change to everything that follows the state:
+// the write-behind NVS commit, WebSocket subscribers and the MQTT bridge
+static void slots_changed(const slot_snapshot_t *work, uint32_t added_mask, uint32_t removed_mask)
+{
+    persist_mark_dirty();
+    push_slots_changed(work->generation, slot_snapshot_mask(work), added_mask, removed_mask);
+    mqtt_bridge_state_changed();
+}
 
-        function loadFilledDoses() {
-            fetch('/get_filled_doses')
-                .then(response => {
-                     if (!response.ok) {
-                         throw new Error(`HTTP error! Status: ${response.status}`);
-                    }
-                    return response.json(); // Expecting JSON array like [0, 2, 5]
-                })
-                .then(filledSlots => {
-                    const filledList = document.getElementById('filledList');
-                    const dispenseButtonsDiv = document.getElementById('dispenseButtons');
-
-                    // Clear previous entries
-                    filledList.innerHTML = '';
-                    dispenseButtonsDiv.innerHTML = '';
-
-                    if (filledSlots.length === 0) {
-                        filledList.innerHTML = '<li>No doses scheduled yet.</li>';
-                         dispenseButtonsDiv.innerHTML = '<p>No scheduled doses available to dispense.</p>';
-                         return;
-                    }
+// Client request ID of a command, from ?rid= or an X-Request-Id header; ""
+// when there is none. Returns false, after answering 400, if it is malformed
+// or too long for rid (a truncated ID would not match its retries).
+static bool get_request_id(httpd_req_t *req, const char *query, char *rid, size_t size)
+{
+    esp_err_t err = httpd_query_key_value(query, "rid", rid, size);
+    if (err == ESP_ERR_NOT_FOUND) {
+        err = httpd_req_get_hdr_value_str(req, "X-Request-Id", rid, size);
+    }
+    if (err == ESP_ERR_NOT_FOUND) {
+        rid[0] = '\0';
+        return true;
+    }
+    if (err != ESP_OK || !dedup_id_valid(rid)) {
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "Error: Request ID must be 1-40 characters of A-Z a-z 0-9 . _ : -");
+        return false;
+    }
+    return true;
+}
 
-                    filledSlots.sort((a, b) => a - b); // Sort slots numerically
-
-                    filledSlots.forEach(slot => {
-                         const doseText = slotToDayDoseString(slot);
-
-                         // Add to the list in Filling Mode
-                        const listItem = document.createElement('li');
-                        listItem.textContent = doseText;
-                        const removeButton = document.createElement('button');
-                        removeButton.textContent = 'Remove';
-                        removeButton.className = 'remove-btn';
-                        removeButton.onclick = () => removeDose(slot);
-                        listItem.appendChild(removeButton);
-                        filledList.appendChild(listItem);
-
-                        // Add button in Dispense Mode
-                        const dispenseButton = document.createElement('button');
-                        dispenseButton.textContent = doseText;
-                         dispenseButton.className = 'dispense-btn';
-                        dispenseButton.onclick = () => dispensePill(slot);
-                        dispenseButtonsDiv.appendChild(dispenseButton);
-                    });
-                })
-                .catch(error => {
-                    console.error('Error loading filled doses:', error);
-                    showStatus('Error loading scheduled doses: ' + error.message, true);
-                     document.getElementById('filledList').innerHTML = '<li>Error loading schedule.</li>';
-                     document.getElementById('dispenseButtons').innerHTML = '<p>Error loading schedule.</p>';
-                });
+// Answers a retried command from the dedup table. Returns true if the request
+// was answered (with the stored outcome, or 409 if the ID was used for
+// another command), false if the command should run.
+static bool replay_request(httpd_req_t *req, const char *rid, dedup_cmd_t cmd, int slot)
+{
+    dedup_outcome_t outcome;
+    char job_id_str[12];
+
+    if (rid[0] == '\0') return false;
+    switch (dedup_lookup(rid, cmd, slot, &outcome)) {
+    case DEDUP_HIT:
+        if (outcome.job_id != 0) {
+            snprintf(job_id_str, sizeof(job_id_str), "%" PRIu32, outcome.job_id);
+            httpd_resp_set_hdr(req, "X-Job-Id", job_id_str);
         }
+        httpd_resp_set_hdr(req, "X-Request-Replayed", "1");
+        httpd_resp_sendstr(req, outcome.body);
+        return true;
+    case DEDUP_CONFLICT:
+        httpd_resp_set_status(req, "409 Conflict");
+        httpd_resp_sendstr(req, "Error: Request ID already used for a different command.");
+        return true;
+    default:
+        return false;
+    }
+}
 
+// Stores the successful outcome of a command under its request ID, if it had one
+static void remember_request(const char *rid, dedup_cmd_t cmd, int slot, uint32_t job_id, const char *body)
+{
+    if (rid[0] == '\0') return;
+    dedup_outcome_t outcome = { .job_id = job_id };
+    snprintf(outcome.body, sizeof(outcome.body), "%s", body);
+    dedup_store(rid, cmd, slot, &outcome);
+}
 
-        // Initial setup
-        window.onload = () => {
-            updateDateTime();
-            setInterval(updateDateTime, 1000);
-
-            document.getElementById('daySelect').addEventListener('change', handleDayChange);
-             handleDayChange(); // Set initial state for Saturday Dose 2
-
-            switchMode(currentMode); // Set initial mode view and load doses
-        };
-
-    </script>
-</body>
-</html>
-)rawliteral";
+// Handler for root path (serves the pre-gzipped HTML page from web/index.html)
+static esp_err_t root_get_handler(httpd_req_t *req)
+{
+    char if_none_match[48];
 
+    // The ETag is a hash of the packed page, so it only changes with the firmware
+    httpd_resp_set_hdr(req, "ETag", WEB_UI_ETAG);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache"); // Always revalidate, usually answered with 304
 
-// --- HTTP Handlers ---
-// --- HTTP Handlers ---
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strcmp(if_none_match, WEB_UI_ETAG) == 0) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
 
-// Handler for root path (serves the HTML page) - Unchanged
-static esp_err_t root_get_handler(httpd_req_t *req)
-{
     httpd_resp_set_type(req, "text/html");
-    httpd_resp_sendstr_chunk(req, html_page);
-    httpd_resp_sendstr_chunk(req, NULL);
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    httpd_resp_send(req, (const char *)web_ui_gz, web_ui_gz_len);
     return ESP_OK;
 }
 
 // Handler for adding a dose to the schedule
 // Handler for adding a dose to the schedule
+// ?slot=N[&rid=ID]: with a request ID, a retry gets the first answer back (see dedup.h).
 static esp_err_t add_dose_handler(httpd_req_t *req)
 {
-    char buf[50]; // Buffer for query string
+    char buf[96]; // Buffer for query string
     char slot_str[5];
+    char rid[DEDUP_ID_MAX + 1];
     int slot = -1;
     char resp_str[100];
     char day_dose_buf[50]; // Temporary buffer for day/dose string
@@ -602,53 +365,58 @@ static esp_err_t add_dose_handler(httpd_req_t *req)
             slot = atoi(slot_str);
             ESP_LOGI(TAG, "Add dose request for slot: %d", slot);
 
-            if (slot >= 0 && slot < NUM_SLOTS) {
-                 if (!nvs_mutex) {
-                     httpd_resp_send_500(req);
-                     return ESP_FAIL;
+            if (slot >= 0 && slot < tray_slot_count()) {
+                 if (!get_request_id(req, buf, rid, sizeof(rid)) || replay_request(req, rid, DEDUP_CMD_ADD, slot)) {
+                     return ESP_OK;
                  }
-                 // Lock mutex before modifying shared data
-                 if (xSemaphoreTake(nvs_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-                     // Check if already filled first
-                     if (filled_slots_status[slot] == 1) {
-                         xSemaphoreGive(nvs_mutex); // Release mutex
-                         slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
-                         snprintf(resp_str, sizeof(resp_str), "Already Added: %s", day_dose_buf); // Combine prefix and temp buffer
-                         httpd_resp_send(req, resp_str, strlen(resp_str));
-                         ESP_LOGI(TAG, "%s", resp_str);
-                     } else {
-                         // Not filled, proceed to add
-                         filled_slots_status[slot] = 1; // Mark as filled in RAM
-                         xSemaphoreGive(nvs_mutex); // Release mutex *before* NVS write and servo move
-
-                         // --- Move Servo ---
-                         int angle = servo_positions[slot];
-                         ESP_LOGI(TAG, "Moving servo to %d degrees for filling slot %d", angle, slot);
-                         servo_set_angle(angle); // Move servo to the selected slot position
-                         // ------------------
-
-                         // Write changes to NVS
-                         esp_err_t nvs_err = nvs_write_filled_slots();
-
-                         // Prepare and send response
-                         slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
-                         if (nvs_err == ESP_OK) {
-                            snprintf(resp_str, sizeof(resp_str), "Added: %s (Moved to %d°)", day_dose_buf, angle); // Combine prefix and temp buffer
-                            httpd_resp_send(req, resp_str, strlen(resp_str));
-                            ESP_LOGI(TAG, "%s", resp_str);
-                         } else {
-                            // Still inform user it was added (and moved), but mention NVS error
-                            snprintf(resp_str, sizeof(resp_str), "Added: %s (Moved to %d°). NVS Save Error: %s",
-                                     day_dose_buf, angle, esp_err_to_name(nvs_err));
-                            httpd_resp_set_status(req, "200 OK"); // Send 200 OK, but include error info in message
-                            httpd_resp_send(req, resp_str, strlen(resp_str));
-                            ESP_LOGE(TAG, "NVS Error saving schedule (%s) but slot added to RAM and servo moved.", esp_err_to_name(nvs_err));
-                         }
-                     }
+                 // Take the slot writer lock (held only for this read-modify-write)
+                 slot_snapshot_t work;
+                 slot_state_write_begin(&work);
+                 // Check if already filled first
+                 if (work.filled[slot] == 1) {
+                     slot_state_write_end(&work, false);
+                     slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
+                     snprintf(resp_str, sizeof(resp_str), "Already Added: %s", day_dose_buf); // Combine prefix and temp buffer
+                     httpd_resp_send(req, resp_str, strlen(resp_str));
+                     remember_request(rid, DEDUP_CMD_ADD, slot, 0, resp_str);
+                     ESP_LOGI(TAG, "%s", resp_str);
                  } else {
-                     ESP_LOGE(TAG, "Add dose: Could not obtain mutex");
-                     httpd_resp_set_status(req, "503 Service Unavailable");
-                     httpd_resp_sendstr(req, "Error: Server busy, please try again.");
+                     // Not filled, queue the move first so a refused move leaves the slot untouched
+                     motion_ticket_t ticket;
+                     esp_err_t motion_err = ESP_OK;
+                     if (admit_motion(req, MOTION_OP_FILL, slot, &ticket)) {
+                         motion_err = motion_submit(MOTION_OP_FILL, slot, &ticket.job_id);
+                     } else if (ticket.result != ADMISSION_DUPLICATE) {
+                         motion_err = ESP_ERR_NOT_ALLOWED;
+                     }
+                     if (motion_err == ESP_OK) {
+                         work.filled[slot] = 1; // Mark as filled
+                     }
+                     slot_state_write_end(&work, motion_err == ESP_OK); // Publishes the new generation
+
+                     if (motion_err == ESP_ERR_NOT_ALLOWED) {
+                         send_motion_refused(req, &ticket);
+                         return ESP_OK;
+                     } else if (motion_err != ESP_OK) {
+                         send_motion_busy(req);
+                         return ESP_OK;
+                     }
+                     uint32_t job_id = ticket.job_id;
+
+                     // Saved to NVS in the background by the persistence task
+                     slots_changed(&work, 1UL << slot, 0);
+                     history_log(HISTORY_FILL, slot, job_id, 0);
+
+                     // Prepare and send response; the servo keeps moving in the motion task
+                     int angle = tray_slot_angle(slot);
+                     char job_id_str[12];
+                     snprintf(job_id_str, sizeof(job_id_str), "%" PRIu32, job_id);
+                     httpd_resp_set_hdr(req, "X-Job-Id", job_id_str);
+                     slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
+                     snprintf(resp_str, sizeof(resp_str), "Added: %s (Moving to %d°, job %" PRIu32 ")", day_dose_buf, angle, job_id); // Combine prefix and temp buffer
+                     httpd_resp_send(req, resp_str, strlen(resp_str));
+                     remember_request(rid, DEDUP_CMD_ADD, slot, job_id, resp_str);
+                     ESP_LOGI(TAG, "%s", resp_str);
                  }
 
             } else {
@@ -670,11 +438,12 @@ static esp_err_t add_dose_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-// Handler for removing a dose from the schedule
+// Handler for removing a dose from the schedule. ?slot=N[&rid=ID], as /add_dose
 static esp_err_t remove_dose_handler(httpd_req_t *req)
 {
-    char buf[50];
+    char buf[96];
     char slot_str[5];
+    char rid[DEDUP_ID_MAX + 1];
     int slot = -1;
     char resp_str[100];
     char day_dose_buf[50]; // Temporary buffer for day/dose string
@@ -684,41 +453,30 @@ static esp_err_t remove_dose_handler(httpd_req_t *req)
             slot = atoi(slot_str);
             ESP_LOGI(TAG, "Remove dose request for slot: %d", slot);
 
-             if (slot >= 0 && slot < NUM_SLOTS) {
-                  if (!nvs_mutex) {
-                     httpd_resp_send_500(req);
-                     return ESP_FAIL;
+             if (slot >= 0 && slot < tray_slot_count()) {
+                 if (!get_request_id(req, buf, rid, sizeof(rid)) || replay_request(req, rid, DEDUP_CMD_REMOVE, slot)) {
+                     return ESP_OK;
                  }
-                 // Lock mutex
-                 if (xSemaphoreTake(nvs_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-                     if (filled_slots_status[slot] == 1) {
-                         filled_slots_status[slot] = 0; // Mark as empty in RAM
-                         xSemaphoreGive(nvs_mutex); // Release mutex *before* NVS write
-
-                         esp_err_t nvs_err = nvs_write_filled_slots(); // Write changes to NVS
-                         if (nvs_err == ESP_OK) {
-                             slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
-                             snprintf(resp_str, sizeof(resp_str), "Removed: %s", day_dose_buf); // Combine prefix and temp buffer
-                             httpd_resp_send(req, resp_str, strlen(resp_str));
-                             ESP_LOGI(TAG, "%s", resp_str);
-                         } else {
-                            snprintf(resp_str, sizeof(resp_str), "Error saving schedule (NVS Error: %s)", esp_err_to_name(nvs_err));
-                            httpd_resp_set_status(req, "500 Internal Server Error");
-                            httpd_resp_send(req, resp_str, strlen(resp_str));
-                            ESP_LOGE(TAG, "%s", resp_str);
-                         }
-                     } else {
-                         xSemaphoreGive(nvs_mutex); // Release mutex
-                         slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
-                         snprintf(resp_str, sizeof(resp_str), "Not Found: %s", day_dose_buf); // Combine prefix and temp buffer
-                         httpd_resp_set_status(req, "404 Not Found"); // Or just send a normal OK response
-                         httpd_resp_send(req, resp_str, strlen(resp_str));
-                         ESP_LOGI(TAG, "%s", resp_str);
-                     }
+                 slot_snapshot_t work;
+                 slot_state_write_begin(&work);
+                 if (work.filled[slot] == 1) {
+                     work.filled[slot] = 0; // Mark as empty
+                     slot_state_write_end(&work, true);
+
+                     slots_changed(&work, 0, 1UL << slot); // Saved to NVS in the background
+                     history_log(HISTORY_REMOVE, slot, 0, 0);
+                     slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
+                     snprintf(resp_str, sizeof(resp_str), "Removed: %s", day_dose_buf); // Combine prefix and temp buffer
+                     httpd_resp_send(req, resp_str, strlen(resp_str));
+                     remember_request(rid, DEDUP_CMD_REMOVE, slot, 0, resp_str);
+                     ESP_LOGI(TAG, "%s", resp_str);
                  } else {
-                      ESP_LOGE(TAG, "Remove dose: Could not obtain mutex");
-                      httpd_resp_set_status(req, "503 Service Unavailable");
-                      httpd_resp_sendstr(req, "Error: Server busy, please try again.");
+                     slot_state_write_end(&work, false);
+                     slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
+                     snprintf(resp_str, sizeof(resp_str), "Not Found: %s", day_dose_buf); // Combine prefix and temp buffer
+                     httpd_resp_set_status(req, "404 Not Found"); // Or just send a normal OK response
+                     httpd_resp_send(req, resp_str, strlen(resp_str));
+                     ESP_LOGI(TAG, "%s", resp_str);
                  }
              } else {
                  snprintf(resp_str, sizeof(resp_str), "Error: Invalid slot number (%d)", slot);
@@ -740,102 +498,123 @@ static esp_err_t remove_dose_handler(httpd_req_t *req)
 }
 
 
-// Handler to get the list of filled doses - Unchanged (already correct)
+// Formats the ETag for a given state generation. Each representation (list,
+// bitmask, CBOR) gets its own suffix, so their tags never match each other.
+static void format_state_etag(char *out, size_t max_len, uint32_t generation, const char *suffix)
+{
+    snprintf(out, max_len, "\"%08" PRIx32 "-%" PRIu32 "%s\"", s_boot_epoch, generation, suffix);
+}
+
+// Handler to get the list of filled doses.
+// Default: JSON array of filled slots, e.g. [0,2,5].
+// ?format=mask: {"gen":12,"mask":37}, bit i set when slot i is filled, for fleet pollers.
+// Both carry an ETag; a matching If-None-Match gets 304 without building a response.
 static esp_err_t get_filled_doses_handler(httpd_req_t *req)
 {
-    if (!nvs_mutex) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+    char query[32];
+    char format[8];
+    char etag[32];
+    char if_none_match[48];
+
+    bool mask_format = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+                       httpd_query_key_value(query, "format", format, sizeof(format)) == ESP_OK &&
+                       strcmp(format, "mask") == 0;
+
+    // Cheap path: answer a matching ETag from the current generation alone
+    format_state_etag(etag, sizeof(etag), slot_state_generation(), mask_format ? "-m" : "");
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strcmp(if_none_match, etag) == 0) {
+        httpd_resp_set_hdr(req, "ETag", etag);
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
     }
 
-    cJSON *root = cJSON_CreateArray();
-    if (!root) {
-        ESP_LOGE(TAG, "Failed to create JSON array");
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+    // Consistent copy of the slots and their generation; never blocks on writers
+    slot_snapshot_t snap;
+    slot_state_read(&snap);
+
+    format_state_etag(etag, sizeof(etag), snap.generation, mask_format ? "-m" : "");
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    // At most "[0,1,...,31]" or the mask form; small enough for the stack
+    char buf[96];
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+
+    if (mask_format) {
+        json_obj_begin(&w);
+        json_kv_uint(&w, "gen", snap.generation);
+        json_kv_uint(&w, "mask", slot_snapshot_mask(&snap));
+        json_obj_end(&w);
+        return json_resp_send(&w, req);
     }
 
-    esp_err_t err = ESP_OK;
-    // Lock mutex for reading shared data
-    if (xSemaphoreTake(nvs_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        for (int i = 0; i < NUM_SLOTS; i++) {
-            if (filled_slots_status[i] == 1) {
-                cJSON_AddItemToArray(root, cJSON_CreateNumber(i));
-            }
-        }
-        xSemaphoreGive(nvs_mutex); // Release mutex
-
-        char *json_str = cJSON_PrintUnformatted(root);
-        if (json_str) {
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_send(req, json_str, strlen(json_str));
-            ESP_LOGI(TAG, "Sent filled doses: %s", json_str);
-            free(json_str); // Free memory allocated by cJSON_Print
-        } else {
-            ESP_LOGE(TAG, "Failed to print JSON string");
-            httpd_resp_send_500(req);
-            err = ESP_FAIL;
+    json_arr_begin(&w);
+    for (int i = 0; i < tray_slot_count(); i++) {
+        if (snap.filled[i] == 1) {
+            json_int(&w, i);
         }
-    } else {
-        ESP_LOGE(TAG, "Get filled doses: Could not obtain mutex");
-        httpd_resp_set_status(req, "503 Service Unavailable");
-        httpd_resp_sendstr(req, "[]"); // Send empty array on error?
-        err = ESP_FAIL;
     }
+    json_arr_end(&w);
 
-    cJSON_Delete(root); // Delete JSON object
+    esp_err_t err = json_resp_send(&w, req);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Sent filled doses: %s", buf);
+    }
     return err;
 }
 
-
-// Handler for dispensing pills (now uses slot number)
+// Handler for dispensing pills (now uses slot number).
+// ?slot=N[&rid=ID]: a retry with the same request ID reports the first dispense
+// and its job instead of moving the carousel again.
 static esp_err_t dispense_handler(httpd_req_t *req)
 {
-    char buf[50];
+    char buf[96];
     char slot_str[5];
+    char rid[DEDUP_ID_MAX + 1];
     int slot = -1;
     char resp_str[100];
     char day_dose_buf[50]; // Temporary buffer for day/dose string
-    bool is_filled = false;
 
     if (httpd_req_get_url_query_str(req, buf, sizeof(buf)) == ESP_OK) {
         if (httpd_query_key_value(buf, "slot", slot_str, sizeof(slot_str)) == ESP_OK) {
             slot = atoi(slot_str);
             ESP_LOGI(TAG, "Dispense request for slot: %d", slot);
 
-            if (slot >= 0 && slot < NUM_SLOTS) {
-                if (!nvs_mutex) {
-                    httpd_resp_send_500(req);
-                    return ESP_FAIL;
+            if (slot >= 0 && slot < tray_slot_count()) {
+                if (!get_request_id(req, buf, rid, sizeof(rid)) || replay_request(req, rid, DEDUP_CMD_DISPENSE, slot)) {
+                    return ESP_OK;
                 }
-                 // Check if the requested slot is actually filled (read requires mutex)
-                 if (xSemaphoreTake(nvs_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-                    is_filled = (filled_slots_status[slot] == 1);
-                    xSemaphoreGive(nvs_mutex); // Release mutex after reading
-                 } else {
-                      ESP_LOGE(TAG, "Dispense: Could not obtain mutex");
-                      httpd_resp_set_status(req, "503 Service Unavailable");
-                      httpd_resp_sendstr(req, "Error: Server busy, please try again.");
-                      return ESP_OK; // Return OK as response sent
-                 }
-
-
-                if (is_filled) {
-                    int angle = servo_positions[slot];
-                    servo_set_angle(angle); // Move servo
+                // Check if the requested slot is actually filled (lock-free snapshot read)
+                if (slot_state_is_filled(slot)) {
+                    // Queue the move; the motion task also waits for the pill to drop.
+                    // A repeated tap while it is pending gets the same job.
+                    motion_ticket_t ticket;
+                    if (admit_motion(req, MOTION_OP_DISPENSE, slot, &ticket)) {
+                        if (motion_submit(MOTION_OP_DISPENSE, slot, &ticket.job_id) != ESP_OK) {
+                            send_motion_busy(req);
+                            return ESP_OK;
+                        }
+                    } else if (ticket.result != ADMISSION_DUPLICATE) {
+                        send_motion_refused(req, &ticket);
+                        return ESP_OK;
+                    }
+                    uint32_t job_id = ticket.job_id;
 
                     // Prepare response string
+                    int angle = tray_slot_angle(slot);
+                    char job_id_str[12];
+                    snprintf(job_id_str, sizeof(job_id_str), "%" PRIu32, job_id);
+                    httpd_resp_set_hdr(req, "X-Job-Id", job_id_str);
                     slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
-                    snprintf(resp_str, sizeof(resp_str), "Dispensed: %s (Angle: %d°)", day_dose_buf, angle); // Combine
+                    snprintf(resp_str, sizeof(resp_str), "Dispensing: %s (Angle: %d°, job %" PRIu32 "%s)", day_dose_buf, angle, job_id,
+                             ticket.result == ADMISSION_DUPLICATE ? ", already pending" : ""); // Combine
                     httpd_resp_send(req, resp_str, strlen(resp_str));
+                    remember_request(rid, DEDUP_CMD_DISPENSE, slot, job_id, resp_str);
                     ESP_LOGI(TAG, "Response: %s", resp_str);
 
-                    // --- Optional: Move servo back to a neutral position after dispensing ---
-                     vTaskDelay(pdMS_TO_TICKS(1000)); // Wait 1 second for pill to drop
-                     // servo_set_angle(servo_positions[0]); // Example: back to Monday Dose 1 position
-                     // ESP_LOGI(TAG, "Servo returned to neutral position.");
-                    // --- End Optional ---
-
                 } else {
                      slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf)); // Generate string into temp buffer
                      snprintf(resp_str, sizeof(resp_str), "Error: %s is not scheduled/filled.", day_dose_buf); // Combine
@@ -862,35 +641,1280 @@ static esp_err_t dispense_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+// Handler to report the progress of a queued motion job
+static esp_err_t job_status_handler(httpd_req_t *req)
+{
+    char buf[50];
+    char id_str[12];
+    char resp_str[200];
+    motion_job_info_t job;
+
+    if (httpd_req_get_url_query_str(req, buf, sizeof(buf)) != ESP_OK ||
+        httpd_query_key_value(buf, "id", id_str, sizeof(id_str)) != ESP_OK) {
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "Error: Missing 'id' parameter.");
+        return ESP_OK;
+    }
+
+    uint32_t job_id = strtoul(id_str, NULL, 10);
+    if (!motion_get_job(job_id, &job)) {
+        snprintf(resp_str, sizeof(resp_str), "Error: Unknown job (%" PRIu32 ")", job_id);
+        httpd_resp_set_status(req, "404 Not Found");
+        httpd_resp_send(req, resp_str, strlen(resp_str));
+        return ESP_OK;
+    }
+
+    // Remaining time until the job is predicted to settle, 0 once it has
+    uint32_t eta_ms = 0;
+    if (job.state == MOTION_JOB_MOVING) {
+        uint32_t elapsed = pdTICKS_TO_MS(xTaskGetTickCount()) - job.started_ms;
+        eta_ms = elapsed < job.predicted_ms ? job.predicted_ms - elapsed : 0;
+    }
+
+    json_writer_t w;
+    json_resp_begin(&w, req, resp_str, sizeof(resp_str));
+    json_obj_begin(&w);
+    json_kv_uint(&w, "id", job.id);
+    json_kv_str(&w, "op", motion_op_name(job.op));
+    json_kv_int(&w, "tray", job.tray);
+    json_kv_int(&w, "slot", job.slot);
+    json_kv_int(&w, "angle", job.angle);
+    json_kv_int(&w, "stops", job.stops);
+    json_kv_int(&w, "done", job.stops_done);
+    json_kv_str(&w, "state", motion_state_name(job.state));
+    if (job.state == MOTION_JOB_FAILED) json_kv_str(&w, "fault", motion_fault_name(job.fault));
+    json_kv_uint(&w, "predicted_ms", job.predicted_ms);
+    json_kv_uint(&w, "eta_ms", eta_ms);
+    json_kv_uint(&w, "actual_ms", job.actual_ms);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// Receives the first len bytes of the request body into buf. Returns false
+// if the client closed or stalled before sending them all.
+static bool recv_body(httpd_req_t *req, char *buf, size_t len)
+{
+    size_t received = 0;
+    while (received < len) {
+        int ret = httpd_req_recv(req, buf + received, len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue; // Retry on timeout
+        }
+        if (ret <= 0) {
+            ESP_LOGW(TAG, "Failed to receive request body (%d)", ret);
+            return false;
+        }
+        received += ret;
+    }
+    return true;
+}
+
+// Reads the whole request body into buf (NUL-terminated). Returns false and
+// sends an error response if the body is missing, too large or truncated.
+static bool read_request_body(httpd_req_t *req, char *buf, size_t buf_size)
+{
+    if (req->content_len == 0 || req->content_len >= buf_size) {
+        httpd_resp_set_status(req, req->content_len == 0 ? "400 Bad Request" : "413 Payload Too Large");
+        httpd_resp_sendstr(req, req->content_len == 0 ? "Error: Empty request body." : "Error: Request body too large.");
+        return false;
+    }
+
+    if (!recv_body(req, buf, req->content_len)) {
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "Error: Incomplete request body.");
+        return false;
+    }
+    buf[req->content_len] = '\0';
+    return true;
+}
+
+// Handler for batch schedule updates.
+// Body: {"ops":[{"op":"add","slot":0},{"op":"remove","slot":3}],"sweep":true}
+// All operations are validated first and published together as one snapshot,
+// then persisted with a single (write-behind) NVS commit. With "sweep", the newly filled
+// slots are visited in one planned fill sweep instead of one move per slot.
+static esp_err_t schedule_handler(httpd_req_t *req)
+{
+    char body[SCHEDULE_MAX_BODY];
+    char resp_str[100];
+    slot_snapshot_t work;
+    uint8_t old_status[MAX_SLOTS];
+
+    if (!read_request_body(req, body, sizeof(body))) {
+        return ESP_OK;
+    }
+
+    cJSON *root = cJSON_Parse(body);
+    cJSON *ops = root ? cJSON_GetObjectItem(root, "ops") : NULL;
+    if (!cJSON_IsArray(ops)) {
+        cJSON_Delete(root);
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "Error: Expected JSON object with an 'ops' array.");
+        return ESP_OK;
+    }
+    bool sweep = cJSON_IsTrue(cJSON_GetObjectItem(root, "sweep"));
+
+    // Validate every operation before touching any state
+    int op_index = 0;
+    cJSON *op;
+    cJSON_ArrayForEach(op, ops) {
+        cJSON *action = cJSON_GetObjectItem(op, "op");
+        cJSON *slot = cJSON_GetObjectItem(op, "slot");
+        const char *action_str = cJSON_GetStringValue(action);
+        if (!action_str || (strcmp(action_str, "add") != 0 && strcmp(action_str, "remove") != 0) ||
+            !cJSON_IsNumber(slot) || slot->valueint < 0 || slot->valueint >= tray_slot_count()) {
+            cJSON_Delete(root);
+            snprintf(resp_str, sizeof(resp_str), "Error: Invalid operation at index %d", op_index);
+            httpd_resp_set_status(req, "400 Bad Request");
+            httpd_resp_send(req, resp_str, strlen(resp_str));
+            ESP_LOGW(TAG, "Schedule: %s", resp_str);
+            return ESP_OK;
+        }
+        op_index++;
+    }
+
+    // Apply the whole batch to a private copy and publish it at once, so no reader sees a partial update
+    slot_state_write_begin(&work);
+    memcpy(old_status, work.filled, sizeof(old_status));
+    cJSON_ArrayForEach(op, ops) {
+        int slot = cJSON_GetObjectItem(op, "slot")->valueint;
+        work.filled[slot] = (strcmp(cJSON_GetStringValue(cJSON_GetObjectItem(op, "op")), "add") == 0) ? 1 : 0;
+    }
+    slot_state_write_end(&work, true); // One generation step for the whole batch
+    cJSON_Delete(root);
+
+    // Work out the net effect of the batch
+    int added[MAX_SLOTS];
+    int removed[MAX_SLOTS];
+    int num_added = 0;
+    int num_removed = 0;
+    for (int i = 0; i < tray_slot_count(); i++) {
+        if (!old_status[i] && work.filled[i]) added[num_added++] = i;
+        if (old_status[i] && !work.filled[i]) removed[num_removed++] = i;
+    }
+
+    // One commit for the whole batch, written behind by the persistence task
+    if (num_added > 0 || num_removed > 0) {
+        uint32_t added_mask = 0;
+        uint32_t removed_mask = 0;
+        for (int i = 0; i < num_added; i++) added_mask |= 1UL << added[i];
+        for (int i = 0; i < num_removed; i++) removed_mask |= 1UL << removed[i];
+        slots_changed(&work, added_mask, removed_mask);
+        for (int i = 0; i < num_added; i++) history_log(HISTORY_FILL, added[i], 0, 0);
+        for (int i = 0; i < num_removed; i++) history_log(HISTORY_REMOVE, removed[i], 0, 0);
+    }
+
+    // The sweep is optional: the schedule change stands even if it is refused.
+    // It runs as one job per tray involved.
+    uint32_t job_ids[TRAY_MAX_TRAYS];
+    int job_count = 0;
+    motion_ticket_t ticket;
+    if (sweep && num_added > 0) {
+        if (!admit_motion(req, MOTION_OP_FILL_SWEEP, -1, &ticket)) {
+            ESP_LOGW(TAG, "Schedule: fill sweep not queued, %s", admission_result_name(ticket.result));
+        } else if (motion_submit_program(MOTION_OP_FILL_SWEEP, added, num_added, job_ids, &job_count) != ESP_OK) {
+            ESP_LOGW(TAG, "Schedule: fill sweep not fully queued, motion queue full");
+        }
+    }
+    ESP_LOGI(TAG, "Schedule batch: %d ops, %d added, %d removed, %d sweep jobs", op_index, num_added, num_removed, job_count);
+
+    char buf[160];
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_int(&w, "ops", op_index);
+    json_key(&w, "added");
+    json_arr_begin(&w);
+    for (int i = 0; i < num_added; i++) json_int(&w, added[i]);
+    json_arr_end(&w);
+    json_key(&w, "removed");
+    json_arr_begin(&w);
+    for (int i = 0; i < num_removed; i++) json_int(&w, removed[i]);
+    json_arr_end(&w);
+    if (job_count > 0) {
+        json_kv_uint(&w, "job", job_ids[0]);
+        json_key(&w, "jobs");
+        json_arr_begin(&w);
+        for (int i = 0; i < job_count; i++) json_uint(&w, job_ids[i]);
+        json_arr_end(&w);
+    }
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// Handler for multi-slot motion programs.
+// Body: {"action":"dispense","slots":[9,1,5]}  (action is "dispense" or "fill")
+// The slots of each tray are visited as one job in planner order (nearest end
+// first, at most one reversal); the jobs of different trays run in parallel.
+// The response carries the planner's estimate against the requested order;
+// /job_status reports predicted vs actual time once a job runs.
+static esp_err_t program_handler(httpd_req_t *req)
+{
+    char body[PROGRAM_MAX_BODY];
+    char resp_str[100];
+    int slots[MAX_SLOTS];
+    int count = 0;
+
+    if (!read_request_body(req, body, sizeof(body))) {
+        return ESP_OK;
+    }
+
+    cJSON *root = cJSON_Parse(body);
+    const char *action = root ? cJSON_GetStringValue(cJSON_GetObjectItem(root, "action")) : NULL;
+    cJSON *slots_json = root ? cJSON_GetObjectItem(root, "slots") : NULL;
+    motion_op_t op;
+    if (action && strcmp(action, "dispense") == 0) {
+        op = MOTION_OP_DISPENSE_SWEEP;
+    } else if (action && strcmp(action, "fill") == 0) {
+        op = MOTION_OP_FILL_SWEEP;
+    } else {
+        cJSON_Delete(root);
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "Error: Expected \"action\" of \"dispense\" or \"fill\".");
+        return ESP_OK;
+    }
+    if (!cJSON_IsArray(slots_json) || cJSON_GetArraySize(slots_json) == 0 || cJSON_GetArraySize(slots_json) > tray_slot_count()) {
+        cJSON_Delete(root);
+        snprintf(resp_str, sizeof(resp_str), "Error: Expected a 'slots' array of 1 to %d slots.", tray_slot_count());
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_send(req, resp_str, strlen(resp_str));
+        return ESP_OK;
+    }
+
+    // Validate every slot; a dispense program may only visit filled slots
+    slot_snapshot_t snap;
+    slot_state_read(&snap);
+    cJSON *item;
+    cJSON_ArrayForEach(item, slots_json) {
+        int slot = cJSON_IsNumber(item) ? item->valueint : -1;
+        if (slot < 0 || slot >= tray_slot_count() || (op == MOTION_OP_DISPENSE_SWEEP && snap.filled[slot] != 1)) {
+            cJSON_Delete(root);
+            if (slot < 0 || slot >= tray_slot_count()) {
+                snprintf(resp_str, sizeof(resp_str), "Error: Invalid slot at index %d", count);
+            } else {
+                char day_dose_buf[50];
+                slot_to_day_dose_string(slot, day_dose_buf, sizeof(day_dose_buf));
+                snprintf(resp_str, sizeof(resp_str), "Error: %s is not scheduled/filled.", day_dose_buf);
+            }
+            httpd_resp_set_status(req, "400 Bad Request");
+            httpd_resp_send(req, resp_str, strlen(resp_str));
+            ESP_LOGW(TAG, "Program: %s", resp_str);
+            return ESP_OK;
+        }
+        slots[count++] = slot;
+    }
+    cJSON_Delete(root);
+
+    motion_plan_info_t plan;
+    motion_ticket_t ticket;
+    uint32_t job_ids[TRAY_MAX_TRAYS];
+    int job_count = 0;
+    if (!admit_motion(req, op, -1, &ticket)) {
+        send_motion_refused(req, &ticket);
+        return ESP_OK;
+    }
+    motion_estimate_program(op, slots, count, &plan);
+    if (motion_submit_program(op, slots, count, job_ids, &job_count) != ESP_OK && job_count == 0) {
+        send_motion_busy(req);
+        return ESP_OK;
+    }
+    // A tray whose queue was full is left out; the jobs already queued stand
+    ESP_LOGI(TAG, "Program job %" PRIu32 " (%d jobs): %s %d slots, %d deg planned vs %d deg as requested, ~%" PRIu32 " ms",
+             job_ids[0], job_count, action, plan.count, plan.travel_deg, plan.naive_travel_deg, plan.predicted_ms);
+
+    char job_id_str[12];
+    snprintf(job_id_str, sizeof(job_id_str), "%" PRIu32, job_ids[0]);
+    httpd_resp_set_hdr(req, "X-Job-Id", job_id_str);
+
+    char buf[256];
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_uint(&w, "job", job_ids[0]);
+    json_key(&w, "jobs");
+    json_arr_begin(&w);
+    for (int i = 0; i < job_count; i++) json_uint(&w, job_ids[i]);
+    json_arr_end(&w);
+    json_key(&w, "order");
+    json_arr_begin(&w);
+    for (int i = 0; i < plan.count; i++) json_int(&w, plan.order[i]);
+    json_arr_end(&w);
+    json_kv_int(&w, "travel_deg", plan.travel_deg);
+    json_kv_int(&w, "naive_travel_deg", plan.naive_travel_deg);
+    json_kv_int(&w, "reversals", plan.reversals);
+    json_kv_int(&w, "naive_reversals", plan.naive_reversals);
+    json_kv_uint(&w, "estimated_ms", plan.predicted_ms);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// Handler reporting write-behind persistence counters (flash wear)
+static esp_err_t persist_stats_handler(httpd_req_t *req)
+{
+    char buf[200];
+    persist_stats_t stats;
+
+    persist_get_stats(&stats);
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_uint(&w, "marks", stats.marks);
+    json_kv_uint(&w, "commits", stats.commits);
+    json_kv_uint(&w, "commits_avoided", stats.commits_avoided);
+    json_kv_uint(&w, "failures", stats.failures);
+    json_kv_uint(&w, "bytes_written", stats.bytes_written);
+    json_kv_bool(&w, "dirty", stats.dirty);
+    json_kv_int(&w, "debounce_ms", PERSIST_DEBOUNCE_MS);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// Handler reporting the automatic dose schedule and its counters
+static esp_err_t dose_schedule_get_handler(httpd_req_t *req)
+{
+    char buf[256];
+    char time_str[8];
+    dose_sched_status_t status;
+
+    dose_sched_get_status(&status);
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_bool(&w, "synced", status.synced);
+    json_kv_bool(&w, "enabled", status.enabled);
+    json_kv_str(&w, "tz", DOSE_SCHED_TZ);
+    json_kv_int(&w, "next_slot", status.next_slot);
+    json_kv_uint(&w, "next_due", (uint32_t)status.next_due);
+    json_key(&w, "slots");
+    json_arr_begin(&w);
+    for (int i = 0; i < tray_slot_count(); i++) {
+        snprintf(time_str, sizeof(time_str), "%02d:%02d", status.minute[i] / 60, status.minute[i] % 60);
+        json_obj_begin(&w);
+        json_kv_int(&w, "slot", i);
+        json_kv_str(&w, "time", time_str);
+        json_kv_uint(&w, "due", (uint32_t)status.due[i]);
+        json_obj_end(&w);
+    }
+    json_arr_end(&w);
+    json_kv_uint(&w, "dispensed", status.dispensed);
+    json_kv_uint(&w, "skipped_empty", status.skipped_empty);
+    json_kv_uint(&w, "skipped_disabled", status.skipped_disabled);
+    json_kv_uint(&w, "missed", status.missed);
+    json_kv_uint(&w, "retries", status.retries);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// Parses "HH:MM" into minutes after midnight, -1 if malformed
+static int parse_time_of_day(const char *str)
+{
+    int hour, minute;
+    char extra;
+    if (!str || sscanf(str, "%d:%d%c", &hour, &minute, &extra) != 2 ||
+        hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+        return -1;
+    }
+    return hour * 60 + minute;
+}
+
+// Handler for changing the automatic dose schedule.
+// Body: {"enabled":false}, {"dose":1,"time":"08:30"} (dose 1 to doses_per_day, on every day)
+// or {"slot":4,"time":"07:45"}. Replies with the updated schedule.
+static esp_err_t dose_schedule_post_handler(httpd_req_t *req)
+{
+    char body[DOSE_SCHED_MAX_BODY];
+
+    if (!read_request_body(req, body, sizeof(body))) {
+        return ESP_OK;
+    }
+
+    cJSON *root = cJSON_Parse(body);
+    cJSON *enabled = root ? cJSON_GetObjectItem(root, "enabled") : NULL;
+    cJSON *dose = root ? cJSON_GetObjectItem(root, "dose") : NULL;
+    cJSON *slot = root ? cJSON_GetObjectItem(root, "slot") : NULL;
+    int minute = root ? parse_time_of_day(cJSON_GetStringValue(cJSON_GetObjectItem(root, "time"))) : -1;
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (cJSON_IsBool(enabled)) {
+        err = dose_sched_set_enabled(cJSON_IsTrue(enabled));
+    } else if (cJSON_IsNumber(dose) && minute >= 0) {
+        err = dose_sched_set_dose_time(dose->valueint, minute);
+    } else if (cJSON_IsNumber(slot) && minute >= 0) {
+        err = dose_sched_set_slot_time(slot->valueint, minute);
+    }
+    cJSON_Delete(root);
+
+    if (err == ESP_ERR_INVALID_ARG) {
+        char resp_str[128];
+        snprintf(resp_str, sizeof(resp_str), "Error: Expected {\"enabled\":bool}, {\"dose\":1..%d,\"time\":\"HH:MM\"} "
+                 "or {\"slot\":N,\"time\":\"HH:MM\"}.", tray_doses_per_day());
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_send(req, resp_str, strlen(resp_str));
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        // The change is in effect, it just will not survive a reboot
+        ESP_LOGW(TAG, "Dose schedule changed but not saved (%s)", esp_err_to_name(err));
+    }
+    return dose_schedule_get_handler(req);
+}
+
+// Handler reporting the tray layout in effect
+static esp_err_t trays_get_handler(httpd_req_t *req)
+{
+    char buf[256];
+    const tray_layout_t *layout = tray_layout();
+
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_int(&w, "slots", tray_slot_count());
+    json_kv_int(&w, "doses_per_day", layout->doses_per_day);
+    json_key(&w, "trays");
+    json_arr_begin(&w);
+    for (int t = 0; t < layout->count; t++) {
+        json_obj_begin(&w);
+        json_kv_int(&w, "gpio", layout->tray[t].gpio);
+        json_kv_int(&w, "first", tray_first_slot(t));
+        json_kv_int(&w, "slots", layout->tray[t].slots);
+        json_key(&w, "angles");
+        json_arr_begin(&w);
+        for (int i = 0; i < layout->tray[t].slots; i++) json_int(&w, layout->tray[t].angle[i]);
+        json_arr_end(&w);
+        json_obj_end(&w);
+    }
+    json_arr_end(&w);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+static void restart_cb(void *arg)
+{
+    (void)arg;
+    esp_restart(); // The shutdown handlers flush pending state first
+}
+
+// Empties every slot and erases the saved slot record, for a layout change:
+// the fills name compartments of the old layout. The in-memory state is
+// cleared first, so a write-behind commit racing the erase (or the flush on
+// restart) can only save empty slots.
+static void reset_filled_slots(void)
+{
+    slot_snapshot_t work;
+    slot_state_write_begin(&work);
+    uint32_t removed = slot_snapshot_mask(&work);
+    memset(work.filled, 0, sizeof(work.filled));
+    if (slot_state_write_end(&work, true)) {
+        slots_changed(&work, 0, removed);
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        err = nvs_erase_key(nvs_handle, NVS_KEY_FILLED);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = ESP_OK;
+        }
+        nvs_close(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) erasing filled slots status from NVS!", esp_err_to_name(err));
+    }
+}
+
+// Handler for changing the tray layout.
+// Body: {"doses_per_day":4,"trays":[{"gpio":2,"slots":14},{"gpio":4,"slots":14,"angles":[0,13,...]}]}
+// Trays without "angles" get evenly spaced slots. The layout is saved and the
+// device restarts into it with every slot empty. Dose times are kept only if
+// the slot count and doses per day stay the same, as then every slot number
+// still means the same day and dose.
+static esp_err_t trays_post_handler(httpd_req_t *req)
+{
+    char body[TRAYS_MAX_BODY];
+    tray_layout_t layout = { 0 };
+
+    if (!read_request_body(req, body, sizeof(body))) {
+        return ESP_OK;
+    }
+
+    cJSON *root = cJSON_Parse(body);
+    cJSON *doses = root ? cJSON_GetObjectItem(root, "doses_per_day") : NULL;
+    cJSON *trays = root ? cJSON_GetObjectItem(root, "trays") : NULL;
+    bool valid = cJSON_IsNumber(doses) && cJSON_IsArray(trays) &&
+                 cJSON_GetArraySize(trays) >= 1 && cJSON_GetArraySize(trays) <= TRAY_MAX_TRAYS;
+    if (valid) {
+        layout.doses_per_day = (uint8_t)doses->valueint;
+        cJSON *tray;
+        cJSON_ArrayForEach(tray, trays) {
+            tray_config_t *config = &layout.tray[layout.count++];
+            cJSON *gpio = cJSON_GetObjectItem(tray, "gpio");
+            cJSON *slots = cJSON_GetObjectItem(tray, "slots");
+            cJSON *angles = cJSON_GetObjectItem(tray, "angles");
+            if (!cJSON_IsNumber(gpio) || !tray_gpio_usable(gpio->valueint) ||
+                !cJSON_IsNumber(slots) || slots->valueint < 1 || slots->valueint > MAX_SLOTS ||
+                (angles && (!cJSON_IsArray(angles) || cJSON_GetArraySize(angles) != slots->valueint))) {
+                valid = false;
+                break;
+            }
+            config->gpio = (uint8_t)gpio->valueint;
+            config->slots = (uint8_t)slots->valueint;
+            int i = 0;
+            cJSON *angle;
+            cJSON_ArrayForEach(angle, angles) {
+                if (!cJSON_IsNumber(angle) || angle->valueint < 0 || angle->valueint > 180) valid = false;
+                config->angle[i++] = (uint8_t)angle->valueint;
+            }
+        }
+    }
+    cJSON_Delete(root);
+
+    esp_err_t err = valid ? tray_save_layout(&layout) : ESP_ERR_INVALID_ARG;
+    if (err == ESP_ERR_INVALID_ARG) {
+        char resp_str[192];
+        snprintf(resp_str, sizeof(resp_str), "Error: Expected 1 to %d trays on distinct output GPIOs (not 6-11), 1 to %d doses per day, "
+                 "and %d slots in total at most, no more than one week (7 x doses per day).", TRAY_MAX_TRAYS,
+                 TRAY_MAX_DOSES_PER_DAY, MAX_SLOTS);
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_send(req, resp_str, strlen(resp_str));
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_OK;
+    }
+
+    reset_filled_slots();
+
+    // Restart once the response is out
+    const esp_timer_create_args_t timer_args = { .callback = restart_cb, .name = "restart" };
+    esp_timer_handle_t timer;
+    if (esp_timer_create(&timer_args, &timer) == ESP_OK) {
+        esp_timer_start_once(timer, TRAYS_RESTART_DELAY_MS * 1000);
+    }
+    ESP_LOGI(TAG, "Tray layout saved (%d trays), restarting in %d ms", layout.count, TRAYS_RESTART_DELAY_MS);
+
+    char buf[64];
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_bool(&w, "saved", true);
+    json_kv_int(&w, "restart_ms", TRAYS_RESTART_DELAY_MS);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// Handler paging through the dose history: GET /history?since=SEQ&limit=N.
+// Events come oldest first starting at `since` (or the oldest one kept);
+// "next" is the `since` of the following page, equal to "end" once the
+// client has caught up.
+static esp_err_t history_handler(httpd_req_t *req)
+{
+    char query[64];
+    char value[12];
+    uint32_t since = 0;
+    int limit = HISTORY_PAGE_MAX;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+            since = strtoul(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "limit", value, sizeof(value)) == ESP_OK) {
+            limit = atoi(value);
+            if (limit < 1 || limit > HISTORY_PAGE_MAX) limit = HISTORY_PAGE_MAX;
+        }
+    }
+
+    history_record_t events[HISTORY_PAGE_MAX];
+    uint32_t next;
+    int count = history_read(since, events, limit, &next);
+    history_stats_t stats;
+    history_get_stats(&stats);
+
+    char buf[256];
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_uint(&w, "first", stats.first_seq);
+    json_kv_uint(&w, "end", stats.next_seq);
+    json_kv_uint(&w, "next", next);
+    json_key(&w, "events");
+    json_arr_begin(&w);
+    for (int i = 0; i < count; i++) {
+        json_obj_begin(&w);
+        json_kv_uint(&w, "seq", events[i].seq);
+        json_kv_uint(&w, "t", events[i].time);
+        json_kv_str(&w, "type", history_type_name(events[i].type));
+        json_kv_int(&w, "slot", events[i].slot);
+        if (events[i].job) json_kv_uint(&w, "job", events[i].job);
+        if (events[i].type == HISTORY_MISSED || events[i].type == HISTORY_FAULT) json_kv_int(&w, "detail", events[i].detail);
+        json_obj_end(&w);
+    }
+    json_arr_end(&w);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// Commands from the MQTT cmd topic (see mqtt_bridge.h), run on the MQTT
+// client task with the same checks as their HTTP counterparts. The broker has
+// no socket of its own here, so admission control only holds it to the
+// motion backlog, not to a per-client rate.
+static const char *mqtt_command_cb(const mqtt_cmd_item_t *items, int count, uint32_t *job_id)
+{
+    *job_id = 0;
+    if (items[0].op == MQTT_CMD_DISPENSE) {
+        int slot = items[0].slot;
+        if (!slot_state_is_filled(slot)) {
+            return "slot not filled";
+        }
+        uint32_t retry_after_s;
+        admission_result_t result = admission_check(-1, MOTION_OP_DISPENSE, slot, job_id, &retry_after_s);
+        if (result == ADMISSION_DUPLICATE) {
+            return NULL; // Already pending; *job_id is that job
+        } else if (result != ADMISSION_ACCEPT) {
+            return admission_result_name(result);
+        } else if (motion_submit(MOTION_OP_DISPENSE, slot, job_id) != ESP_OK) {
+            return "busy";
+        }
+        ESP_LOGI(TAG, "MQTT dispense for slot %d, job %" PRIu32, slot, *job_id);
+        return NULL;
+    }
+
+    // Schedule edit: the whole batch is one snapshot, as with POST /schedule
+    slot_snapshot_t work;
+    slot_state_write_begin(&work);
+    uint32_t old_mask = slot_snapshot_mask(&work);
+    for (int i = 0; i < count; i++) {
+        work.filled[items[i].slot] = items[i].op == MQTT_CMD_ADD ? 1 : 0;
+    }
+    slot_state_write_end(&work, true);
+
+    uint32_t new_mask = slot_snapshot_mask(&work);
+    uint32_t added_mask = new_mask & ~old_mask;
+    uint32_t removed_mask = old_mask & ~new_mask;
+    if (added_mask || removed_mask) {
+        slots_changed(&work, added_mask, removed_mask);
+        for (int i = 0; i < tray_slot_count(); i++) {
+            if (added_mask & (1UL << i)) history_log(HISTORY_FILL, i, 0, 0);
+            if (removed_mask & (1UL << i)) history_log(HISTORY_REMOVE, i, 0, 0);
+        }
+    }
+    ESP_LOGI(TAG, "MQTT schedule: %d ops, mask %" PRIx32 " -> %" PRIx32, count, old_mask, new_mask);
+    return NULL;
+}
+
+// Handler reporting the MQTT publisher's configuration and counters
+static esp_err_t mqtt_get_handler(httpd_req_t *req)
+{
+    char uri[MQTT_BRIDGE_URI_MAX];
+    mqtt_bridge_stats_t stats;
+    mqtt_bridge_get_uri(uri, sizeof(uri));
+    mqtt_bridge_get_stats(&stats);
+
+    char buf[384];
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_bool(&w, "enabled", stats.enabled);
+    json_kv_bool(&w, "connected", stats.connected);
+    json_kv_str(&w, "uri", uri);
+    json_kv_str(&w, "device", mqtt_bridge_device_id());
+    json_kv_uint(&w, "connects", stats.connects);
+    json_kv_uint(&w, "state_published", stats.state_published);
+    json_kv_uint(&w, "state_coalesced", stats.state_coalesced);
+    json_kv_uint(&w, "events_published", stats.events_published);
+    json_kv_uint(&w, "events_dropped", stats.events_dropped);
+    json_kv_uint(&w, "commands", stats.commands);
+    json_kv_uint(&w, "command_errors", stats.command_errors);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// Handler setting the MQTT broker. Body: {"uri":"mqtt://192.168.1.10:1883"}
+// An empty URI turns MQTT off. Saved to NVS and applied right away.
+static esp_err_t mqtt_post_handler(httpd_req_t *req)
+{
+    char body[MQTT_BRIDGE_URI_MAX + 32];
+
+    if (!read_request_body(req, body, sizeof(body))) {
+        return ESP_OK;
+    }
+    cJSON *root = cJSON_Parse(body);
+    const char *uri = cJSON_GetStringValue(cJSON_GetObjectItem(root, "uri"));
+    esp_err_t err = uri ? mqtt_bridge_set_uri(uri) : ESP_ERR_INVALID_ARG;
+    bool enabled = uri && uri[0] != '\0';
+    cJSON_Delete(root);
+
+    if (err == ESP_ERR_INVALID_ARG || err == ESP_ERR_INVALID_SIZE) {
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "Error: Expected {\"uri\":\"mqtt://host[:port]\"} (empty to disable).");
+        return ESP_OK;
+    } else if (err != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_OK;
+    }
+
+    char buf[48];
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_bool(&w, "saved", true);
+    json_kv_bool(&w, "enabled", enabled);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// --- Binary protocol (see cbor_api.h) ---
+
+// One op of a POST /cbor batch and its outcome
+typedef struct {
+    uint32_t op;
+    uint32_t arg;
+    uint8_t code;        // cbor_result_t
+    uint32_t job;        // Dispense: the job queued or collapsed into
+    motion_job_state_t job_state; // Job query
+    int8_t job_slot;
+    uint8_t job_done;
+    uint8_t job_stops;
+} cbor_op_entry_t;
+
+// Sends a finished CBOR response, or a plain 500 if it did not fit
+static esp_err_t cbor_resp_send(httpd_req_t *req, const cbor_writer_t *w, const char *status)
+{
+    if (cbor_writer_finish(w) != ESP_OK) {
+        ESP_LOGE(TAG, "CBOR response did not fit (%u bytes)", (unsigned)w->size);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/cbor");
+    return httpd_resp_send(req, (const char *)w->buf, w->len);
+}
+
+// Writes the state entries shared by every response map (4 pairs)
+static void cbor_put_state(cbor_writer_t *w, const slot_snapshot_t *snap)
+{
+    cbor_uint(w, CBOR_KEY_EPOCH);
+    cbor_uint(w, s_boot_epoch);
+    cbor_uint(w, CBOR_KEY_GEN);
+    cbor_uint(w, snap->generation);
+    cbor_uint(w, CBOR_KEY_MASK);
+    cbor_uint(w, slot_snapshot_mask(snap));
+    cbor_uint(w, CBOR_KEY_SLOTS);
+    cbor_uint(w, tray_slot_count());
+}
+
+// Answers a request that failed as a whole, with the current state
+static esp_err_t cbor_send_status(httpd_req_t *req, cbor_result_t status, const char *http_status)
+{
+    uint8_t buf[32];
+    cbor_writer_t w;
+    slot_snapshot_t snap;
+
+    slot_state_read(&snap);
+    cbor_writer_init(&w, buf, sizeof(buf));
+    cbor_map(&w, 5);
+    cbor_uint(&w, CBOR_KEY_STATUS);
+    cbor_uint(&w, status);
+    cbor_put_state(&w, &snap);
+    return cbor_resp_send(req, &w, http_status);
+}
+
+// Handler for GET /cbor: the state alone, with the same ETag scheme as /get_filled_doses
+static esp_err_t cbor_get_handler(httpd_req_t *req)
+{
+    char etag[32];
+    char if_none_match[48];
+
+    format_state_etag(etag, sizeof(etag), slot_state_generation(), "-c");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strcmp(if_none_match, etag) == 0) {
+        httpd_resp_set_hdr(req, "ETag", etag);
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+
+    uint8_t buf[32];
+    cbor_writer_t w;
+    slot_snapshot_t snap;
+    slot_state_read(&snap);
+    format_state_etag(etag, sizeof(etag), snap.generation, "-c");
+    httpd_resp_set_hdr(req, "ETag", etag);
+
+    cbor_writer_init(&w, buf, sizeof(buf));
+    cbor_map(&w, 5);
+    cbor_uint(&w, CBOR_KEY_STATUS);
+    cbor_uint(&w, CBOR_RESULT_OK);
+    cbor_put_state(&w, &snap);
+    return cbor_resp_send(req, &w, "200 OK");
+}
+
+// Parses a POST /cbor body into ops. Returns CBOR_RESULT_OK,
+// CBOR_RESULT_BAD_REQUEST for malformed input or CBOR_RESULT_TOO_LARGE.
+static cbor_result_t cbor_parse_request(const uint8_t *body, size_t len, cbor_op_entry_t *ops, int *op_count,
+                                        bool *has_if_gen, uint32_t *if_gen)
+{
+    cbor_reader_t r;
+    uint32_t pairs;
+
+    *op_count = 0;
+    *has_if_gen = false;
+    cbor_reader_init(&r, body, len);
+    if (!cbor_read_map(&r, &pairs)) {
+        return CBOR_RESULT_BAD_REQUEST;
+    }
+    for (uint32_t i = 0; i < pairs; i++) {
+        uint32_t key;
+        if (cbor_peek(&r) != CBOR_TYPE_UINT) {
+            cbor_skip(&r); // Not one of ours; skip the key and its value
+            cbor_skip(&r);
+            continue;
+        }
+        cbor_read_uint(&r, &key);
+        if (key == CBOR_KEY_OPS) {
+            uint32_t count;
+            if (!cbor_read_array(&r, &count)) {
+                return CBOR_RESULT_BAD_REQUEST;
+            }
+            if (count > CBOR_MAX_OPS) {
+                return CBOR_RESULT_TOO_LARGE;
+            }
+            for (uint32_t j = 0; j < count; j++) {
+                uint32_t fields;
+                cbor_op_entry_t *op = &ops[j];
+                *op = (cbor_op_entry_t) { .code = CBOR_RESULT_NOT_RUN };
+                if (!cbor_read_array(&r, &fields) || fields != 2 ||
+                    !cbor_read_uint(&r, &op->op) || !cbor_read_uint(&r, &op->arg)) {
+                    return CBOR_RESULT_BAD_REQUEST;
+                }
+            }
+            *op_count = count;
+        } else if (key == CBOR_KEY_IF_GEN) {
+            if (!cbor_read_uint(&r, if_gen)) {
+                return CBOR_RESULT_BAD_REQUEST;
+            }
+            *has_if_gen = true;
+        } else {
+            cbor_skip(&r);
+        }
+    }
+    return cbor_reader_done(&r) ? CBOR_RESULT_OK : CBOR_RESULT_BAD_REQUEST;
+}
+
+// Handler for POST /cbor: runs a batch of ops and answers the state after it
+static esp_err_t cbor_post_handler(httpd_req_t *req)
+{
+    uint8_t body[CBOR_MAX_BODY];
+    cbor_op_entry_t ops[CBOR_MAX_OPS];
+    int op_count = 0;
+    bool has_if_gen = false;
+    uint32_t if_gen = 0;
+
+    if (req->content_len > CBOR_MAX_BODY) {
+        return cbor_send_status(req, CBOR_RESULT_TOO_LARGE, "413 Payload Too Large");
+    }
+    if (!recv_body(req, (char *)body, req->content_len)) {
+        return cbor_send_status(req, CBOR_RESULT_BAD_REQUEST, "400 Bad Request");
+    }
+    if (req->content_len > 0) {
+        cbor_result_t parsed = cbor_parse_request(body, req->content_len, ops, &op_count, &has_if_gen, &if_gen);
+        if (parsed != CBOR_RESULT_OK) {
+            ESP_LOGW(TAG, "CBOR: rejected %u-byte request (%d)", (unsigned)req->content_len, parsed);
+            return cbor_send_status(req, parsed, parsed == CBOR_RESULT_TOO_LARGE ? "413 Payload Too Large" : "400 Bad Request");
+        }
+    }
+
+    // Validate every op before anything runs
+    cbor_result_t status = CBOR_RESULT_OK;
+    bool has_edits = false;
+    for (int i = 0; i < op_count; i++) {
+        cbor_op_entry_t *op = &ops[i];
+        if (op->op < CBOR_OP_ADD || op->op > CBOR_OP_JOB) {
+            op->code = CBOR_RESULT_BAD_OP;
+        } else if (op->op != CBOR_OP_JOB && op->arg >= (uint32_t)tray_slot_count()) {
+            op->code = CBOR_RESULT_INVALID_SLOT;
+        } else {
+            has_edits |= op->op == CBOR_OP_ADD || op->op == CBOR_OP_REMOVE;
+            continue;
+        }
+        status = CBOR_RESULT_BAD_REQUEST;
+    }
+
+    // Schedule edits, as one generation; the generation guard is checked under the writer lock
+    if (status == CBOR_RESULT_OK && (has_edits || has_if_gen)) {
+        slot_snapshot_t work;
+        slot_state_write_begin(&work);
+        if (has_if_gen && work.generation != if_gen) {
+            slot_state_write_end(&work, false);
+            status = CBOR_RESULT_STALE;
+        } else {
+            uint32_t old_mask = slot_snapshot_mask(&work);
+            for (int i = 0; i < op_count; i++) {
+                cbor_op_entry_t *op = &ops[i];
+                if (op->op != CBOR_OP_ADD && op->op != CBOR_OP_REMOVE) continue;
+                uint8_t filled = op->op == CBOR_OP_ADD ? 1 : 0;
+                op->code = work.filled[op->arg] == filled ? CBOR_RESULT_UNCHANGED : CBOR_RESULT_OK;
+                work.filled[op->arg] = filled;
+            }
+            slot_state_write_end(&work, has_edits);
+
+            uint32_t new_mask = slot_snapshot_mask(&work);
+            uint32_t added_mask = new_mask & ~old_mask;
+            uint32_t removed_mask = old_mask & ~new_mask;
+            if (added_mask || removed_mask) {
+                slots_changed(&work, added_mask, removed_mask);
+                for (int i = 0; i < tray_slot_count(); i++) {
+                    if (added_mask & (1UL << i)) history_log(HISTORY_FILL, i, 0, 0);
+                    if (removed_mask & (1UL << i)) history_log(HISTORY_REMOVE, i, 0, 0);
+                }
+            }
+        }
+    }
+
+    // Dispenses and job queries, after the edits
+    uint32_t retry_after_s = 0;
+    for (int i = 0; status == CBOR_RESULT_OK && i < op_count; i++) {
+        cbor_op_entry_t *op = &ops[i];
+        if (op->op == CBOR_OP_DISPENSE) {
+            uint32_t retry = 0;
+            if (!slot_state_is_filled(op->arg)) {
+                op->code = CBOR_RESULT_NOT_FILLED;
+                continue;
+            }
+            admission_result_t result = admission_check(httpd_req_to_sockfd(req), MOTION_OP_DISPENSE, op->arg,
+                                                        &op->job, &retry);
+            if (result == ADMISSION_DUPLICATE) {
+                op->code = CBOR_RESULT_DUPLICATE;
+            } else if (result == ADMISSION_RATE_LIMITED) {
+                op->code = CBOR_RESULT_RATE_LIMITED;
+            } else if (result != ADMISSION_ACCEPT) {
+                op->code = CBOR_RESULT_BUSY;
+            } else if (motion_submit(MOTION_OP_DISPENSE, op->arg, &op->job) != ESP_OK) {
+                motion_backlog_t backlog;
+                motion_get_backlog(-1, &backlog);
+                retry = backlog.next_free_ms / 1000 + 1;
+                op->code = CBOR_RESULT_BUSY;
+                metrics_inc(&metrics_http_busy);
+            } else {
+                op->code = CBOR_RESULT_OK;
+            }
+            if (retry > retry_after_s) retry_after_s = retry;
+        } else if (op->op == CBOR_OP_JOB) {
+            motion_job_info_t job;
+            if (!motion_get_job(op->arg, &job)) {
+                op->code = CBOR_RESULT_UNKNOWN_JOB;
+                continue;
+            }
+            op->code = CBOR_RESULT_OK;
+            op->job_state = job.state;
+            op->job_slot = job.slot;
+            op->job_done = job.stops_done;
+            op->job_stops = job.stops;
+        }
+    }
+
+    // Response: status, state after the batch, per-op results and the retry hint
+    uint8_t buf[40 + CBOR_MAX_OPS * 10];
+    cbor_writer_t w;
+    slot_snapshot_t snap;
+    slot_state_read(&snap);
+    cbor_writer_init(&w, buf, sizeof(buf));
+    cbor_map(&w, 5 + (op_count > 0) + (retry_after_s > 0));
+    cbor_uint(&w, CBOR_KEY_STATUS);
+    cbor_uint(&w, status);
+    cbor_put_state(&w, &snap);
+    if (op_count > 0) {
+        cbor_uint(&w, CBOR_KEY_RESULTS);
+        cbor_array(&w, op_count);
+        for (int i = 0; i < op_count; i++) {
+            const cbor_op_entry_t *op = &ops[i];
+            if (op->op == CBOR_OP_JOB && op->code == CBOR_RESULT_OK) {
+                cbor_array(&w, 5);
+                cbor_uint(&w, op->code);
+                cbor_uint(&w, op->job_state);
+                cbor_int(&w, op->job_slot);
+                cbor_uint(&w, op->job_done);
+                cbor_uint(&w, op->job_stops);
+            } else if (op->op == CBOR_OP_DISPENSE && (op->code == CBOR_RESULT_OK || op->code == CBOR_RESULT_DUPLICATE)) {
+                cbor_array(&w, 2);
+                cbor_uint(&w, op->code);
+                cbor_uint(&w, op->job);
+            } else {
+                cbor_array(&w, 1);
+                cbor_uint(&w, op->code);
+            }
+        }
+    }
+    if (retry_after_s > 0) {
+        cbor_uint(&w, CBOR_KEY_RETRY);
+        cbor_uint(&w, retry_after_s);
+    }
+    ESP_LOGI(TAG, "CBOR batch: %d ops, status %d, gen %" PRIu32, op_count, status, snap.generation);
+    return cbor_resp_send(req, &w, status == CBOR_RESULT_OK ? "200 OK" :
+                                   status == CBOR_RESULT_STALE ? "409 Conflict" : "400 Bad Request");
+}
+
+// Handler dumping the trace capture (see trace.h): a summary of handler run
+// times and servo step lateness, then every event in the order recorded as
+// [t_us, type, core, name, value]. A handler is recorded when it returns,
+// stamped with its start time.
+static esp_err_t trace_get_handler(httpd_req_t *req)
+{
+    // Summary rows, one per (type, name) of the handler and servo step events
+    typedef struct {
+        uint8_t type;
+        const char *name;
+        uint32_t count;
+        uint32_t max;
+        uint64_t sum;
+    } trace_sum_t;
+    trace_sum_t sums[METRICS_MAX_ROUTES + TRAY_MAX_TRAYS];
+    int sum_count = 0;
+    trace_status_t status;
+    trace_event_t ev;
+
+    trace_get_status(&status);
+    for (uint32_t seq = status.first_seq; seq < status.next_seq; seq++) {
+        if (!trace_get(seq, &ev) || (ev.type != TRACE_HANDLER && ev.type != TRACE_SERVO_STEP)) continue;
+        int i = 0;
+        while (i < sum_count && (sums[i].type != ev.type || sums[i].name != ev.name)) i++;
+        if (i == sum_count) {
+            if (sum_count == (int)(sizeof(sums) / sizeof(sums[0]))) continue;
+            sums[sum_count++] = (trace_sum_t) { .type = ev.type, .name = ev.name };
+        }
+        sums[i].count++;
+        sums[i].sum += ev.value;
+        if (ev.value > sums[i].max) sums[i].max = ev.value;
+    }
+
+    char buf[512];
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_bool(&w, "active", status.active);
+    json_kv_int(&w, "capacity", TRACE_RING_LEN);
+    json_kv_uint(&w, "recorded", status.recorded);
+    json_kv_uint(&w, "overwritten", status.first_seq);
+    json_key(&w, "summary");
+    json_arr_begin(&w);
+    for (int i = 0; i < sum_count; i++) {
+        json_obj_begin(&w);
+        json_kv_str(&w, "type", trace_type_name(sums[i].type));
+        json_kv_str(&w, "name", sums[i].name);
+        json_kv_uint(&w, "count", sums[i].count);
+        json_kv_uint(&w, "avg_us", (uint32_t)(sums[i].sum / sums[i].count));
+        json_kv_uint(&w, "max_us", sums[i].max);
+        json_obj_end(&w);
+    }
+    json_arr_end(&w);
+    json_key(&w, "events");
+    json_arr_begin(&w);
+    for (uint32_t seq = status.first_seq; seq < status.next_seq; seq++) {
+        if (!trace_get(seq, &ev)) continue; // Overwritten by a running capture meanwhile
+        json_arr_begin(&w);
+        json_uint(&w, ev.t_us);
+        json_str(&w, trace_type_name(ev.type));
+        json_int(&w, ev.core);
+        json_str(&w, ev.name);
+        json_uint(&w, ev.value);
+        json_arr_end(&w);
+    }
+    json_arr_end(&w);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+// Handler starting or stopping a trace capture. Body: {"capture":true}
+// Starting clears the ring; stopping keeps it for GET /trace.
+static esp_err_t trace_post_handler(httpd_req_t *req)
+{
+    char body[48];
+
+    if (!read_request_body(req, body, sizeof(body))) {
+        return ESP_OK;
+    }
+    cJSON *root = cJSON_Parse(body);
+    cJSON *capture = cJSON_GetObjectItem(root, "capture");
+    if (!cJSON_IsBool(capture)) {
+        cJSON_Delete(root);
+        httpd_resp_set_status(req, "400 Bad Request");
+        httpd_resp_sendstr(req, "Error: Expected {\"capture\":true|false}.");
+        return ESP_OK;
+    }
+    if (cJSON_IsTrue(capture)) {
+        trace_start();
+    } else {
+        trace_stop();
+    }
+    cJSON_Delete(root);
+
+    trace_status_t status;
+    trace_get_status(&status);
+    char buf[64];
+    json_writer_t w;
+    json_resp_begin(&w, req, buf, sizeof(buf));
+    json_obj_begin(&w);
+    json_kv_bool(&w, "active", status.active);
+    json_kv_uint(&w, "recorded", status.recorded);
+    json_obj_end(&w);
+    return json_resp_send(&w, req);
+}
+
+static esp_err_t metrics_write_chunk(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len);
+}
+
+// Handler for Prometheus scraping (text exposition format, streamed in chunks)
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    // Handlers run on the httpd task, so this is where its stack gets registered
+    metrics_register_task(xTaskGetCurrentTaskHandle(), HTTPD_STACK_SIZE);
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    esp_err_t err = metrics_render(metrics_write_chunk, req);
+    if (err == ESP_OK) {
+        err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return err;
+}
+
+// Handlers registered through register_timed_handler() are counted and timed for /metrics
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    metrics_hist_t *latency;
+    const char *uri;
+} timed_route_t;
+
+static timed_route_t s_timed_routes[METRICS_MAX_ROUTES];
+static int s_timed_route_count = 0;
+
+static esp_err_t timed_handler(httpd_req_t *req)
+{
+    const timed_route_t *route = req->user_ctx;
+    power_note_activity(); // Restarts the idle countdown, or wakes the device from idle
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = route->handler(req);
+    int64_t end = esp_timer_get_time();
+    metrics_hist_observe(route->latency, (uint32_t)(end - start));
+    trace_record_at(TRACE_HANDLER, route->uri, (uint32_t)start, (uint32_t)(end - start));
+
+    uint_fast64_t none = 0;
+    if (atomic_compare_exchange_strong(&metrics_first_request_us, &none, (uint_fast64_t)end)) {
+        ESP_LOGI(TAG, "First request (%s) served %lld ms after power-on", req->uri, (long long)(end / 1000));
+    }
+    return err;
+}
+
+static esp_err_t register_timed_handler(httpd_handle_t server, const char *uri, httpd_method_t method,
+                                        esp_err_t (*handler)(httpd_req_t *req))
+{
+    httpd_uri_t desc = { .uri = uri, .method = method, .handler = handler, .user_ctx = NULL };
+    metrics_hist_t *latency = NULL;
+
+    if (s_timed_route_count < METRICS_MAX_ROUTES) {
+        latency = metrics_route(method == HTTP_POST ? "POST" : "GET", uri);
+    }
+    if (latency) {
+        timed_route_t *route = &s_timed_routes[s_timed_route_count++];
+        route->handler = handler;
+        route->latency = latency;
+        route->uri = uri;
+        desc.handler = timed_handler;
+        desc.user_ctx = route;
+    } else {
+        ESP_LOGW(TAG, "No metrics slot left for %s, serving it untimed", uri);
+    }
+    return httpd_register_uri_handler(server, &desc);
+}
+
 // Start the HTTP server - Unchanged
 static httpd_handle_t start_webserver(void)
 {
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.stack_size = 10240; // Increased stack size further for HTML page and JSON
+    config.stack_size = HTTPD_STACK_SIZE;
+    config.core_id = TASK_PLAN_HTTPD_CORE;
+    config.task_priority = TASK_PLAN_HTTPD_PRIO;
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.max_uri_handlers = 24; // Default of 8 is already used up
+    config.close_fn = push_on_close; // Drops WebSocket subscribers when their socket closes
+    // Socket limits for bursty clients. httpd keeps 3 of CONFIG_LWIP_MAX_SOCKETS
+    // for itself; one more stays free for outbound connections.
+    config.max_open_sockets = HTTPD_MAX_SOCKETS;
+    config.backlog_conn = 8;
+    // When every session is taken, a new connection evicts the least recently
+    // used one instead of being refused. An idle WebSocket subscriber can be the
+    // victim; the page reconnects and resyncs.
+    config.lru_purge_enable = true;
+    // Drop clients that stall mid-request or stop reading sooner than the 5 s default
+    config.recv_wait_timeout = 3;
+    config.send_wait_timeout = 3;
+
+    admission_config_t admission = ADMISSION_DEFAULT_CONFIG();
+    ESP_ERROR_CHECK(admission_init(&admission));
 
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
         // URI handler for the root page
-        httpd_uri_t root_uri = { "/", HTTP_GET, root_get_handler, NULL };
-        httpd_register_uri_handler(server, &root_uri);
+        register_timed_handler(server, "/", HTTP_GET, root_get_handler);
 
         // URI handler for adding a dose
-        httpd_uri_t add_dose_uri = { "/add_dose", HTTP_GET, add_dose_handler, NULL };
-        httpd_register_uri_handler(server, &add_dose_uri);
+        register_timed_handler(server, "/add_dose", HTTP_GET, add_dose_handler);
 
         // URI handler for removing a dose
-        httpd_uri_t remove_dose_uri = { "/remove_dose", HTTP_GET, remove_dose_handler, NULL };
-        httpd_register_uri_handler(server, &remove_dose_uri);
+        register_timed_handler(server, "/remove_dose", HTTP_GET, remove_dose_handler);
 
         // URI handler for getting filled doses
-        httpd_uri_t get_filled_uri = { "/get_filled_doses", HTTP_GET, get_filled_doses_handler, NULL };
-        httpd_register_uri_handler(server, &get_filled_uri);
+        register_timed_handler(server, "/get_filled_doses", HTTP_GET, get_filled_doses_handler);
 
         // URI handler for the dispense action (using slot)
-        httpd_uri_t dispense_uri = { "/dispense", HTTP_GET, dispense_handler, NULL };
-        httpd_register_uri_handler(server, &dispense_uri);
+        register_timed_handler(server, "/dispense", HTTP_GET, dispense_handler);
+
+        // URI handler for polling motion job progress
+        register_timed_handler(server, "/job_status", HTTP_GET, job_status_handler);
+
+        // URI handler for batch schedule updates
+        register_timed_handler(server, "/schedule", HTTP_POST, schedule_handler);
+
+        // URI handler for multi-slot motion programs
+        register_timed_handler(server, "/program", HTTP_POST, program_handler);
+
+        // URI handler for persistence statistics
+        register_timed_handler(server, "/persist_stats", HTTP_GET, persist_stats_handler);
+
+        // URI handler for Prometheus metrics
+        register_timed_handler(server, "/metrics", HTTP_GET, metrics_handler);
+
+        // URI handlers for the automatic dose schedule
+        register_timed_handler(server, "/dose_schedule", HTTP_GET, dose_schedule_get_handler);
+        register_timed_handler(server, "/dose_schedule", HTTP_POST, dose_schedule_post_handler);
+
+        // URI handlers for the tray layout
+        register_timed_handler(server, "/trays", HTTP_GET, trays_get_handler);
+        register_timed_handler(server, "/trays", HTTP_POST, trays_post_handler);
+
+        // URI handler for the dose history log
+        register_timed_handler(server, "/history", HTTP_GET, history_handler);
+
+        // URI handlers for the MQTT publisher
+        register_timed_handler(server, "/mqtt", HTTP_GET, mqtt_get_handler);
+        register_timed_handler(server, "/mqtt", HTTP_POST, mqtt_post_handler);
+
+        // URI handlers for the binary (CBOR) state and command protocol
+        register_timed_handler(server, "/cbor", HTTP_GET, cbor_get_handler);
+        register_timed_handler(server, "/cbor", HTTP_POST, cbor_post_handler);
+
+        // URI handlers for the trace capture
+        register_timed_handler(server, "/trace", HTTP_GET, trace_get_handler);
+        register_timed_handler(server, "/trace", HTTP_POST, trace_post_handler);
+
+        // WebSocket endpoint pushing slot changes and motion progress
+        push_init(server);
+        httpd_uri_t ws_uri = { .uri = "/ws", .method = HTTP_GET, .handler = push_ws_handler, .user_ctx = NULL, .is_websocket = true };
+        httpd_register_uri_handler(server, &ws_uri);
 
         ESP_LOGI(TAG, "Web server started successfully with new handlers.");
         return server;
@@ -899,49 +1923,118 @@ static httpd_handle_t start_webserver(void)
     ESP_LOGE(TAG, "Error starting server!");
     return NULL;
 }
+// Runs on every (re)connection; SNTP and the MQTT client only need starting once
+static void network_up_cb(void)
+{
+    static bool s_sntp_started = false;
+    if (!s_sntp_started) {
+        s_sntp_started = true;
+        dose_sched_start_sntp();
+    }
+    mqtt_bridge_start();
+}
+
+// Motion job progress goes to WebSocket clients, the dose history and MQTT
+static void job_update_cb(const motion_job_info_t *job)
+{
+    push_job_update(job);
+    history_job_update(job);
+    mqtt_bridge_job_update(job);
+}
+
 // --- Main Application ---
 void app_main(void)
 {
     // Initialize NVS first
     ESP_ERROR_CHECK(nvs_init());
 
-    // Create Mutex for shared NVS/RAM data access
-    nvs_mutex = xSemaphoreCreateMutex();
-    if (!nvs_mutex) {
-         ESP_LOGE(TAG, "Failed to create NVS mutex!");
-         // Handle error - perhaps restart?
-         return;
+    // Random per-boot epoch for state ETags (see s_boot_epoch)
+    s_boot_epoch = esp_random();
+
+    // Tray layout: how many slots there are and which servo moves each of them
+    tray_init();
+
+    // Initialize the servos and start a motion task per tray; job progress is pushed and logged.
+    // Done before anything is sized by the slot count, so a layout whose servos cannot be set up
+    // gives way to the stock carousel instead of failing every boot.
+    motion_set_job_callback(job_update_cb);
+    esp_err_t err = motion_init();
+    if (err != ESP_OK && tray_use_stock_layout()) {
+        err = motion_init();
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start motion controller!");
+        return;
     }
 
-    // Load initial filled slots status from NVS into RAM
-    if (nvs_read_filled_slots() != ESP_OK) {
+    // Load initial filled slots status from NVS and publish it as the first snapshot
+    uint8_t initial_slots[MAX_SLOTS] = { 0 };
+    if (nvs_read_filled_slots(initial_slots) != ESP_OK) {
         // If reading failed critically (not just 'not found'), log it.
         // The function already initializes to empty on 'not found' or size mismatch.
         ESP_LOGW(TAG, "Issues reading initial NVS data, proceeding with default (empty).");
     }
+    if (slot_state_init(initial_slots) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize slot state!");
+        return;
+    }
+
+    // Start the write-behind persistence task; handlers only mark the state dirty
+    if (persist_init(nvs_write_filled_slots, tray_slot_count()) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start persistence task!");
+        return;
+    }
 
 
-    // Initialize servo
-    servo_init();
-    ESP_LOGI(TAG, "Servo initialized on GPIO %d", SERVO_GPIO_PIN);
+    // Low-power idle mode; the motion task keeps the device awake while the servo is driven
+    power_config_t power = POWER_DEFAULT_CONFIG();
+    if (power_init(&power) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize power management!");
+        return;
+    }
 
-    // Initialize WiFi
-    ESP_LOGI(TAG, "Initializing WiFi...");
-    wifi_init_sta();
+    // Dose history in its own flash partition; the device works without it
+    if (history_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Dose history unavailable, events will not be recorded.");
+    }
 
-    // Start the web server only if WiFi connected successfully
-    if (xEventGroupGetBits(s_wifi_event_group) & WIFI_CONNECTED_BIT) {
-         ESP_LOGI(TAG, "Starting web server...");
-         start_webserver();
-         // Set servo to initial/home position (optional, e.g., slot 0)
-         // Use a small delay to ensure webserver task is running before potential servo movement
-         vTaskDelay(pdMS_TO_TICKS(500));
-         servo_set_angle(servo_positions[0]);
-         ESP_LOGI(TAG, "Servo set to initial position: %d degrees (Slot 0)", servo_positions[0]);
-    } else {
-         ESP_LOGE(TAG, "WiFi connection failed. Web server not started.");
+    // MQTT publisher; it connects once the network is up if a broker is configured
+    if (mqtt_bridge_init(s_boot_epoch, mqtt_command_cb) != ESP_OK) {
+        ESP_LOGW(TAG, "MQTT publisher unavailable.");
+    }
+
+    // Drop sensors below the chutes; trays without one fall back to a fixed drop wait
+    if (drop_sensor_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Drop sensors unavailable, using the fixed drop wait.");
+    }
+
+    // Automatic dispensing; it stays idle until SNTP provides the wall time
+    if (dose_sched_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize dose scheduler!");
+        return;
+    }
+
+    // Set every servo to its initial/home position (its tray's first slot) through the motion queues
+    for (int t = 0; t < tray_count(); t++) {
+        motion_submit(MOTION_OP_HOME, tray_first_slot(t), NULL);
+        ESP_LOGI(TAG, "Tray %d servo homing to initial position: %d degrees (Slot %d)", t,
+                 tray_slot_angle(tray_first_slot(t)), tray_first_slot(t));
+    }
+
+    // Bring up Wi-Fi without waiting for it. The web server listens on every
+    // interface, so it starts right away and serves as soon as the station
+    // has an address; the manager reconnects on its own whenever the link drops.
+    wifi_mgr_config_t wifi = {
+        .ssid = WIFI_SSID,
+        .password = WIFI_PASS,
+        .listen_interval = POWER_LISTEN_INTERVAL, // Used in modem sleep while idle
+        .cache_ip = false, // The address comes from DHCP; the cached one can clash before the lease
+    };
+    ESP_ERROR_CHECK(wifi_mgr_start(&wifi, network_up_cb));
+    if (start_webserver() == NULL) {
+        ESP_LOGE(TAG, "Web server not started.");
     }
 
     ESP_LOGI(TAG, "ASHUMITRA application started.");
-    // Tasks (WiFi, HTTP server) are running. app_main can exit or loop.
+    // Tasks (Wi-Fi manager, HTTP server) are running. app_main can exit or loop.
 }
\ No newline at end of file
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Upper bound on the slots of all trays together, as slot sets are passed
+// around as 32-bit masks. The slots actually present come from the tray
+// layout (tray.h), see tray_slot_count().
+#define MAX_SLOTS 32
+
+// Formats a slot index as "Mon Dose 1" etc.
+void slot_to_day_dose_string(int slot, char *out_str, size_t max_len);
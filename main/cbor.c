@@ -0,0 +1,244 @@
+#include <string.h>
+#include "cbor.h"
+
+#define MAJOR_UINT   0
+#define MAJOR_NEGINT 1
+#define MAJOR_BYTES  2
+#define MAJOR_TEXT   3
+#define MAJOR_ARRAY  4
+#define MAJOR_MAP    5
+#define MAJOR_TAG    6
+#define MAJOR_SIMPLE 7
+
+#define SIMPLE_FALSE 20
+#define SIMPLE_TRUE  21
+#define SIMPLE_NULL  22
+
+// --- Writer ---
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t size)
+{
+    *w = (cbor_writer_t) { .buf = buf, .size = size, .err = ESP_OK };
+}
+
+static void put(cbor_writer_t *w, const void *data, size_t n)
+{
+    if (w->err != ESP_OK) return;
+    if (w->len + n > w->size) {
+        w->err = ESP_ERR_NO_MEM;
+        return;
+    }
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+}
+
+// Initial byte plus the shortest argument encoding
+static void put_head(cbor_writer_t *w, uint8_t major, uint32_t arg)
+{
+    uint8_t head[5];
+    size_t n;
+    if (arg < 24) {
+        head[0] = (major << 5) | arg;
+        n = 1;
+    } else if (arg <= 0xff) {
+        head[0] = (major << 5) | 24;
+        head[1] = arg;
+        n = 2;
+    } else if (arg <= 0xffff) {
+        head[0] = (major << 5) | 25;
+        head[1] = arg >> 8;
+        head[2] = arg;
+        n = 3;
+    } else {
+        head[0] = (major << 5) | 26;
+        head[1] = arg >> 24;
+        head[2] = arg >> 16;
+        head[3] = arg >> 8;
+        head[4] = arg;
+        n = 5;
+    }
+    put(w, head, n);
+}
+
+void cbor_uint(cbor_writer_t *w, uint32_t value)
+{
+    put_head(w, MAJOR_UINT, value);
+}
+
+void cbor_int(cbor_writer_t *w, int32_t value)
+{
+    if (value >= 0) {
+        put_head(w, MAJOR_UINT, (uint32_t)value);
+    } else {
+        put_head(w, MAJOR_NEGINT, (uint32_t)(-1 - value));
+    }
+}
+
+void cbor_bool(cbor_writer_t *w, bool value)
+{
+    put_head(w, MAJOR_SIMPLE, value ? SIMPLE_TRUE : SIMPLE_FALSE);
+}
+
+void cbor_null(cbor_writer_t *w)
+{
+    put_head(w, MAJOR_SIMPLE, SIMPLE_NULL);
+}
+
+void cbor_text(cbor_writer_t *w, const char *value)
+{
+    size_t len = strlen(value);
+    put_head(w, MAJOR_TEXT, (uint32_t)len);
+    put(w, value, len);
+}
+
+void cbor_bytes(cbor_writer_t *w, const void *data, size_t len)
+{
+    put_head(w, MAJOR_BYTES, (uint32_t)len);
+    put(w, data, len);
+}
+
+void cbor_array(cbor_writer_t *w, uint32_t count)
+{
+    put_head(w, MAJOR_ARRAY, count);
+}
+
+void cbor_map(cbor_writer_t *w, uint32_t pairs)
+{
+    put_head(w, MAJOR_MAP, pairs);
+}
+
+esp_err_t cbor_writer_finish(const cbor_writer_t *w)
+{
+    return w->err;
+}
+
+// --- Reader ---
+void cbor_reader_init(cbor_reader_t *r, const uint8_t *data, size_t len)
+{
+    *r = (cbor_reader_t) { .p = data, .end = data + len, .err = ESP_OK };
+}
+
+cbor_type_t cbor_peek(const cbor_reader_t *r)
+{
+    if (r->err != ESP_OK || r->p >= r->end) return CBOR_TYPE_END;
+    return (cbor_type_t)(*r->p >> 5);
+}
+
+static bool fail(cbor_reader_t *r)
+{
+    r->err = ESP_ERR_INVALID_ARG;
+    return false;
+}
+
+// Reads an item head. Arguments above 32 bits and indefinite lengths are
+// refused; for floats (simple values 25..27) *arg receives the payload size.
+static bool get_head(cbor_reader_t *r, uint8_t *major, uint32_t *arg)
+{
+    if (r->err != ESP_OK || r->p >= r->end) return fail(r);
+    uint8_t initial = *r->p++;
+    uint8_t info = initial & 0x1f;
+    *major = initial >> 5;
+
+    size_t extra = info < 24 ? 0 : info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : 0;
+    if (info > 26) return fail(r); // 64-bit arguments, reserved values and indefinite lengths
+    if ((size_t)(r->end - r->p) < extra) return fail(r);
+    uint32_t value = info < 24 ? info : 0;
+    for (size_t i = 0; i < extra; i++) {
+        value = (value << 8) | *r->p++;
+    }
+    if (*major == MAJOR_SIMPLE && info >= 25) {
+        r->p -= extra; // Float: leave the payload for the caller to skip
+        *arg = (uint32_t)extra;
+        return true;
+    }
+    *arg = value;
+    return true;
+}
+
+bool cbor_read_uint(cbor_reader_t *r, uint32_t *out)
+{
+    uint8_t major;
+    if (!get_head(r, &major, out)) return false;
+    return major == MAJOR_UINT || fail(r);
+}
+
+bool cbor_read_bool(cbor_reader_t *r, bool *out)
+{
+    uint8_t major;
+    uint32_t arg;
+    if (!get_head(r, &major, &arg)) return false;
+    if (major != MAJOR_SIMPLE || (arg != SIMPLE_FALSE && arg != SIMPLE_TRUE)) return fail(r);
+    *out = arg == SIMPLE_TRUE;
+    return true;
+}
+
+bool cbor_read_array(cbor_reader_t *r, uint32_t *count)
+{
+    uint8_t major;
+    if (!get_head(r, &major, count)) return false;
+    return major == MAJOR_ARRAY || fail(r);
+}
+
+bool cbor_read_map(cbor_reader_t *r, uint32_t *pairs)
+{
+    uint8_t major;
+    if (!get_head(r, &major, pairs)) return false;
+    return major == MAJOR_MAP || fail(r);
+}
+
+bool cbor_read_text(cbor_reader_t *r, const char **out, size_t *len)
+{
+    uint8_t major;
+    uint32_t n;
+    if (!get_head(r, &major, &n)) return false;
+    if (major != MAJOR_TEXT || (size_t)(r->end - r->p) < n) return fail(r);
+    *out = (const char *)r->p;
+    *len = n;
+    r->p += n;
+    return true;
+}
+
+static bool skip_item(cbor_reader_t *r, int depth)
+{
+    uint8_t major;
+    uint32_t arg;
+    const uint8_t *head = r->p;
+    if (depth > CBOR_MAX_DEPTH || !get_head(r, &major, &arg)) return fail(r);
+
+    switch (major) {
+    case MAJOR_BYTES:
+    case MAJOR_TEXT:
+        if ((size_t)(r->end - r->p) < arg) return fail(r);
+        r->p += arg;
+        return true;
+    case MAJOR_ARRAY:
+    case MAJOR_MAP: {
+        uint64_t items = major == MAJOR_MAP ? 2 * (uint64_t)arg : arg;
+        if (items > (uint64_t)(r->end - r->p)) return fail(r); // Every item takes a byte at least
+        for (uint64_t i = 0; i < items; i++) {
+            if (!skip_item(r, depth + 1)) return false;
+        }
+        return true;
+    }
+    case MAJOR_TAG:
+        return skip_item(r, depth + 1);
+    case MAJOR_SIMPLE:
+        // arg is the float payload size only for floats; for false, true,
+        // null and the like it is the value, with nothing after the head
+        if ((*head & 0x1f) < 25) return true;
+        if ((size_t)(r->end - r->p) < arg) return fail(r);
+        r->p += arg;
+        return true;
+    default:
+        return true;
+    }
+}
+
+bool cbor_skip(cbor_reader_t *r)
+{
+    return skip_item(r, 0);
+}
+
+bool cbor_reader_done(const cbor_reader_t *r)
+{
+    return r->err == ESP_OK && r->p == r->end;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Minimal CBOR (RFC 8949) encoder and decoder over caller-provided buffers.
+// Nothing is allocated. Only what the binary endpoint needs is covered:
+// unsigned and negative integers up to 32 bits, booleans, null, text and
+// byte strings, and definite-length arrays and maps. Indefinite lengths,
+// tags and floats are rejected by the reader (skipping a float is fine).
+// Errors are sticky, as with json_writer: check once at the end.
+
+// Deepest nesting cbor_skip() follows
+#define CBOR_MAX_DEPTH 8
+
+typedef enum {
+    CBOR_TYPE_UINT = 0,
+    CBOR_TYPE_NEGINT,
+    CBOR_TYPE_BYTES,
+    CBOR_TYPE_TEXT,
+    CBOR_TYPE_ARRAY,
+    CBOR_TYPE_MAP,
+    CBOR_TYPE_TAG,
+    CBOR_TYPE_SIMPLE, // false, true, null, undefined and floats
+    CBOR_TYPE_END,    // Nothing left to read, or a read error
+} cbor_type_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    esp_err_t err;
+} cbor_writer_t;
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t size);
+
+void cbor_uint(cbor_writer_t *w, uint32_t value);
+void cbor_int(cbor_writer_t *w, int32_t value);
+void cbor_bool(cbor_writer_t *w, bool value);
+void cbor_null(cbor_writer_t *w);
+void cbor_text(cbor_writer_t *w, const char *value);
+void cbor_bytes(cbor_writer_t *w, const void *data, size_t len);
+
+// Container headers: the next `count` items (pairs of items for a map) belong to it
+void cbor_array(cbor_writer_t *w, uint32_t count);
+void cbor_map(cbor_writer_t *w, uint32_t pairs);
+
+// ESP_ERR_NO_MEM if the output did not fit the buffer
+esp_err_t cbor_writer_finish(const cbor_writer_t *w);
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    esp_err_t err;
+} cbor_reader_t;
+
+void cbor_reader_init(cbor_reader_t *r, const uint8_t *data, size_t len);
+
+// Type of the next item without consuming it
+cbor_type_t cbor_peek(const cbor_reader_t *r);
+
+// Each reader consumes one item of the expected type and returns true, or
+// sets the sticky error (ESP_ERR_INVALID_ARG) and returns false
+bool cbor_read_uint(cbor_reader_t *r, uint32_t *out);
+bool cbor_read_bool(cbor_reader_t *r, bool *out);
+bool cbor_read_array(cbor_reader_t *r, uint32_t *count);
+bool cbor_read_map(cbor_reader_t *r, uint32_t *pairs);
+// Points *out into the input (not NUL-terminated)
+bool cbor_read_text(cbor_reader_t *r, const char **out, size_t *len);
+
+// Skips one complete item, containers included
+bool cbor_skip(cbor_reader_t *r);
+
+// True once all input was consumed without error
+bool cbor_reader_done(const cbor_reader_t *r);
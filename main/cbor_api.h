@@ -0,0 +1,70 @@
+#pragma once
+
+// Binary state and command protocol: CBOR over HTTP (/cbor), for fleet
+// aggregators and apps that would otherwise string-match the text answers.
+// Maps use small integer keys, so a full state answer is about 20 bytes.
+//
+// GET /cbor answers the state alone, with an ETag (If-None-Match -> 304).
+// POST /cbor (Content-Type: application/cbor) runs a batch of commands and
+// answers the state after it. An empty body reads the state.
+//
+// Request: map, every key optional, unknown keys ignored
+//   CBOR_KEY_OPS    [[op, arg], ...]  at most CBOR_MAX_OPS, see cbor_op_t
+//   CBOR_KEY_IF_GEN gen               run the batch only while the state is
+//                                     at this generation, else CBOR_RESULT_STALE
+//
+// Response: map
+//   CBOR_KEY_STATUS  cbor_result_t for the request as a whole
+//   CBOR_KEY_EPOCH, CBOR_KEY_GEN, CBOR_KEY_MASK, CBOR_KEY_SLOTS
+//                    boot epoch (as in the ETags), generation, filled-slot
+//                    bitmask and slot count
+//   CBOR_KEY_RESULTS one array per op, in request order:
+//                    [code], [code, job] for a dispense, or
+//                    [code, state, slot, done, stops] for a job query
+//   CBOR_KEY_RETRY   seconds to wait, present if an op got BUSY or RATE_LIMITED
+//
+// Ops are validated before anything runs: one bad op fails the request
+// (CBOR_RESULT_BAD_REQUEST, the others get CBOR_RESULT_NOT_RUN). All adds
+// and removes are then applied together as one state generation, as with
+// POST /schedule; dispenses and job queries run after them.
+
+#define CBOR_MAX_BODY 512
+#define CBOR_MAX_OPS  32
+
+typedef enum {
+    CBOR_KEY_STATUS = 0,
+    CBOR_KEY_EPOCH = 1,
+    CBOR_KEY_GEN = 2,
+    CBOR_KEY_MASK = 3,
+    CBOR_KEY_SLOTS = 4,
+    CBOR_KEY_RESULTS = 5,
+    CBOR_KEY_RETRY = 6,
+} cbor_resp_key_t;
+
+typedef enum {
+    CBOR_KEY_OPS = 1,
+    CBOR_KEY_IF_GEN = 2,
+} cbor_req_key_t;
+
+typedef enum {
+    CBOR_OP_ADD = 1,      // arg: slot to mark filled (no motion)
+    CBOR_OP_REMOVE = 2,   // arg: slot to clear
+    CBOR_OP_DISPENSE = 3, // arg: filled slot to dispense
+    CBOR_OP_JOB = 4,      // arg: motion job id to report on
+} cbor_op_t;
+
+typedef enum {
+    CBOR_RESULT_OK = 0,
+    CBOR_RESULT_UNCHANGED = 1,    // Add of a filled slot, remove of an empty one
+    CBOR_RESULT_DUPLICATE = 2,    // Dispense collapsed into the pending job given
+    CBOR_RESULT_BAD_REQUEST = 3,  // Malformed CBOR or a bad op
+    CBOR_RESULT_TOO_LARGE = 4,    // Body over CBOR_MAX_BODY or more than CBOR_MAX_OPS ops
+    CBOR_RESULT_STALE = 5,        // CBOR_KEY_IF_GEN did not match; nothing ran
+    CBOR_RESULT_BAD_OP = 6,
+    CBOR_RESULT_INVALID_SLOT = 7,
+    CBOR_RESULT_NOT_FILLED = 8,
+    CBOR_RESULT_BUSY = 9,         // Motion backlog full
+    CBOR_RESULT_RATE_LIMITED = 10,
+    CBOR_RESULT_UNKNOWN_JOB = 11,
+    CBOR_RESULT_NOT_RUN = 12,     // Skipped because the request failed
+} cbor_result_t;
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "dedup.h"
+
+static const char *TAG = "ASHUMITRA_DEDUP";
+
+typedef struct {
+    char id[DEDUP_ID_MAX + 1]; // Empty when the entry is free
+    uint8_t cmd;
+    int8_t slot;
+    uint32_t stored_ms;
+    dedup_outcome_t outcome;
+} dedup_entry_t;
+
+static dedup_entry_t s_entries[DEDUP_MAX_ENTRIES];
+static dedup_stats_t s_stats;
+static portMUX_TYPE s_dedup_lock = portMUX_INITIALIZER_UNLOCKED;
+
+bool dedup_id_valid(const char *id)
+{
+    size_t len = strlen(id);
+    if (len == 0 || len > DEDUP_ID_MAX) return false;
+    for (size_t i = 0; i < len; i++) {
+        char c = id[i];
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.' && c != ':') return false;
+    }
+    return true;
+}
+
+static bool expired(const dedup_entry_t *entry, uint32_t now_ms)
+{
+    return now_ms - entry->stored_ms >= DEDUP_TTL_MS;
+}
+
+// Live entry for `id`, or NULL. Call with the lock held.
+static dedup_entry_t *find_locked(const char *id, uint32_t now_ms)
+{
+    for (int i = 0; i < DEDUP_MAX_ENTRIES; i++) {
+        dedup_entry_t *entry = &s_entries[i];
+        if (entry->id[0] != '\0' && !expired(entry, now_ms) && strcmp(entry->id, id) == 0) return entry;
+    }
+    return NULL;
+}
+
+dedup_result_t dedup_lookup(const char *id, dedup_cmd_t cmd, int slot, dedup_outcome_t *outcome)
+{
+    dedup_result_t result = DEDUP_MISS;
+    uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+
+    taskENTER_CRITICAL(&s_dedup_lock);
+    dedup_entry_t *entry = find_locked(id, now_ms);
+    if (entry && (entry->cmd != cmd || entry->slot != slot)) {
+        result = DEDUP_CONFLICT;
+        s_stats.conflicts++;
+    } else if (entry) {
+        result = DEDUP_HIT;
+        *outcome = entry->outcome;
+        s_stats.hits++;
+    }
+    taskEXIT_CRITICAL(&s_dedup_lock);
+
+    if (result != DEDUP_MISS) {
+        ESP_LOGI(TAG, "Request %s: %s", id, result == DEDUP_HIT ? "replayed" : "ID reused for another command");
+    }
+    return result;
+}
+
+void dedup_store(const char *id, dedup_cmd_t cmd, int slot, const dedup_outcome_t *outcome)
+{
+    uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+
+    taskENTER_CRITICAL(&s_dedup_lock);
+    // Reuse a free or expired entry, else recycle the oldest
+    dedup_entry_t *target = find_locked(id, now_ms);
+    for (int i = 0; !target && i < DEDUP_MAX_ENTRIES; i++) {
+        if (s_entries[i].id[0] == '\0' || expired(&s_entries[i], now_ms)) target = &s_entries[i];
+    }
+    if (!target) {
+        target = &s_entries[0];
+        for (int i = 1; i < DEDUP_MAX_ENTRIES; i++) {
+            if ((int32_t)(s_entries[i].stored_ms - target->stored_ms) < 0) target = &s_entries[i];
+        }
+        s_stats.evicted++;
+    }
+    snprintf(target->id, sizeof(target->id), "%s", id);
+    target->cmd = cmd;
+    target->slot = slot;
+    target->stored_ms = now_ms;
+    target->outcome = *outcome;
+    s_stats.stored++;
+    taskEXIT_CRITICAL(&s_dedup_lock);
+}
+
+void dedup_get_stats(dedup_stats_t *out)
+{
+    taskENTER_CRITICAL(&s_dedup_lock);
+    *out = s_stats;
+    taskEXIT_CRITICAL(&s_dedup_lock);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Replay cache for client request IDs. A client that tags a command with an
+// ID (?rid= or an X-Request-Id header) can retry it after a timeout: a
+// retry gets the stored outcome back instead of running the command twice.
+// Only successful outcomes are stored. Refusals such as 429 are not, so a
+// retry of those runs the command again.
+
+#define DEDUP_MAX_ENTRIES 16                // Least recently stored entry is recycled when full
+#define DEDUP_ID_MAX      40                // Longest request ID, in characters (a UUID is 36)
+#define DEDUP_BODY_MAX    100               // Longest response body replayed
+#define DEDUP_TTL_MS      (10 * 60 * 1000)  // How long a retry is recognized
+
+typedef enum {
+    DEDUP_CMD_ADD = 0,
+    DEDUP_CMD_REMOVE,
+    DEDUP_CMD_DISPENSE,
+} dedup_cmd_t;
+
+typedef enum {
+    DEDUP_MISS = 0,  // Unknown ID: run the command
+    DEDUP_HIT,       // Retry of a stored command; *outcome holds its answer
+    DEDUP_CONFLICT,  // ID already used for a different command or slot
+} dedup_result_t;
+
+typedef struct {
+    uint32_t job_id;              // Motion job started by the command, 0 if none
+    char body[DEDUP_BODY_MAX];
+} dedup_outcome_t;
+
+typedef struct {
+    uint32_t hits;       // Retries answered from the cache
+    uint32_t stored;
+    uint32_t conflicts;
+    uint32_t evicted;    // Live entries recycled before their TTL ran out
+} dedup_stats_t;
+
+// True if `id` is 1..DEDUP_ID_MAX characters of [A-Za-z0-9._:-]
+bool dedup_id_valid(const char *id);
+
+dedup_result_t dedup_lookup(const char *id, dedup_cmd_t cmd, int slot, dedup_outcome_t *outcome);
+
+void dedup_store(const char *id, dedup_cmd_t cmd, int slot, const dedup_outcome_t *outcome);
+
+void dedup_get_stats(dedup_stats_t *out);
@@ -0,0 +1,368 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_netif_sntp.h"
+#include "nvs.h"
+#include "dose_sched.h"
+#include "history.h"
+#include "motion.h"
+#include "slot_state.h"
+#include "tray.h"
+
+#define NVS_NAMESPACE "pill_disp"
+#define NVS_KEY_TIMES "dose_times"
+
+static const char *TAG = "ASHUMITRA_SCHED";
+
+// Default time of day of each dose, in minutes after midnight, by doses per day
+static const uint16_t s_default_minute[TRAY_MAX_DOSES_PER_DAY][TRAY_MAX_DOSES_PER_DAY] = {
+    { 8 * 60 },
+    { 8 * 60, 20 * 60 },
+    { 8 * 60, 14 * 60, 20 * 60 },
+    { 8 * 60, 12 * 60, 16 * 60, 20 * 60 },
+};
+
+// Saved configuration, valid only for the tray layout it was saved with
+typedef struct {
+    uint8_t enabled;
+    uint8_t slots;          // tray_slot_count() when saved
+    uint8_t doses_per_day;  // tray_doses_per_day() when saved
+    uint16_t minute[MAX_SLOTS];
+} dose_sched_record_t;
+
+// One pending dose. `due` is when the timer should next look at it; it only
+// differs from `dose_time` while a dispense is being retried.
+typedef struct {
+    time_t due;
+    time_t dose_time;
+    uint8_t slot;
+} dose_entry_t;
+
+// Min-heap on `due` with one entry per slot: the next dose is always s_heap[0],
+// and handling it costs one sift-down. A single one-shot timer sleeps until it.
+static dose_entry_t s_heap[MAX_SLOTS];
+static int s_heap_len = 0;
+static time_t s_handled_until[MAX_SLOTS]; // End of the local day of the last dose handled per slot
+static dose_sched_record_t s_config;
+static dose_sched_status_t s_stats;      // Only the counters are kept up to date
+static bool s_synced = false;
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_timer = NULL;
+
+static void heap_swap(int a, int b)
+{
+    dose_entry_t tmp = s_heap[a];
+    s_heap[a] = s_heap[b];
+    s_heap[b] = tmp;
+}
+
+static void heap_sift_down(int i)
+{
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < s_heap_len && s_heap[left].due < s_heap[smallest].due) smallest = left;
+        if (right < s_heap_len && s_heap[right].due < s_heap[smallest].due) smallest = right;
+        if (smallest == i) return;
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+// Slot 0 is Monday dose 1, then the other doses of Monday, then Tuesday ...
+// (tm_wday: Sunday = 0, Monday = 1)
+static int slot_weekday(int slot)
+{
+    return (slot / tray_doses_per_day() + 1) % 7;
+}
+
+// First local time of the slot's dose strictly after `after`
+static time_t next_dose_time(int slot, time_t after)
+{
+    struct tm base;
+    localtime_r(&after, &base);
+    int days_ahead = (slot_weekday(slot) - base.tm_wday + 7) % 7;
+
+    for (int week = 0; week < 2; week++) {
+        struct tm tm = base;
+        tm.tm_mday += days_ahead + 7 * week;
+        tm.tm_hour = s_config.minute[slot] / 60;
+        tm.tm_min = s_config.minute[slot] % 60;
+        tm.tm_sec = 0;
+        tm.tm_isdst = -1; // Let mktime apply the DST rules of that date
+        time_t t = mktime(&tm);
+        if (t > after) return t;
+    }
+    return after + 7 * 24 * 3600; // Not reached with a sane TZ
+}
+
+// Local midnight following `t`
+static time_t end_of_day(time_t t)
+{
+    struct tm tm;
+    localtime_r(&t, &tm);
+    tm.tm_mday += 1;
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+// Sets the timer for the head of the heap. Caller holds s_lock.
+static void arm_timer_locked(void)
+{
+    esp_timer_stop(s_timer); // Fails harmlessly when not running
+    if (!s_synced || s_heap_len == 0) return;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t delay_us = ((int64_t)s_heap[0].due - now.tv_sec) * 1000000 - now.tv_usec;
+    if (delay_us < 1000) delay_us = 1000;
+    esp_timer_start_once(s_timer, (uint64_t)delay_us);
+}
+
+// Recomputes every slot's next dose from now. Doses that fell before `now`
+// (while unsynced, or before a time change) are not caught up.
+static void rebuild_locked(void)
+{
+    time_t now = time(NULL);
+    s_heap_len = 0;
+    for (int slot = 0; slot < tray_slot_count(); slot++) {
+        time_t after = s_handled_until[slot] > now ? s_handled_until[slot] : now;
+        time_t t = next_dose_time(slot, after);
+        s_heap[s_heap_len++] = (dose_entry_t) { .due = t, .dose_time = t, .slot = (uint8_t)slot };
+    }
+    for (int i = s_heap_len / 2 - 1; i >= 0; i--) {
+        heap_sift_down(i);
+    }
+    arm_timer_locked();
+}
+
+// Acts on one due dose. Returns false if it should be retried later.
+static bool handle_dose_locked(const dose_entry_t *e, time_t now)
+{
+    char day_dose_buf[20];
+    slot_to_day_dose_string(e->slot, day_dose_buf, sizeof(day_dose_buf));
+
+    if (!s_config.enabled) {
+        s_stats.skipped_disabled++;
+        history_log(HISTORY_MISSED, e->slot, 0, HISTORY_MISSED_DISABLED);
+        ESP_LOGI(TAG, "%s due, automatic dispensing is off", day_dose_buf);
+        return true;
+    }
+    if (now - e->dose_time > DOSE_SCHED_GIVE_UP_S) {
+        s_stats.missed++;
+        history_log(HISTORY_MISSED, e->slot, 0, HISTORY_MISSED_LATE);
+        ESP_LOGW(TAG, "%s missed, not queued within %d s", day_dose_buf, DOSE_SCHED_GIVE_UP_S);
+        return true;
+    }
+    if (!slot_state_is_filled(e->slot)) {
+        s_stats.skipped_empty++;
+        history_log(HISTORY_MISSED, e->slot, 0, HISTORY_MISSED_EMPTY);
+        ESP_LOGW(TAG, "%s due but the slot is not filled", day_dose_buf);
+        return true;
+    }
+
+    // A dispense of this slot already on its way (e.g. tapped a moment ago) counts as this dose
+    uint32_t job_id;
+    if (!motion_find_pending(MOTION_OP_DISPENSE, e->slot, &job_id) &&
+        motion_submit(MOTION_OP_DISPENSE, e->slot, &job_id) != ESP_OK) {
+        s_stats.retries++;
+        ESP_LOGW(TAG, "%s due, motion queue full, retrying in %d s", day_dose_buf, DOSE_SCHED_RETRY_S);
+        return false;
+    }
+    s_stats.dispensed++;
+    ESP_LOGI(TAG, "%s due, dispensing (job %" PRIu32 ")", day_dose_buf, job_id);
+    return true;
+}
+
+// Runs in the esp_timer task; motion_submit() never blocks, so this stays short
+static void dose_timer_cb(void *arg)
+{
+    (void)arg;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    time_t now = time(NULL);
+    while (s_heap_len > 0 && s_heap[0].due <= now) {
+        dose_entry_t *e = &s_heap[0];
+        if (handle_dose_locked(e, now)) {
+            s_handled_until[e->slot] = end_of_day(e->dose_time);
+            e->dose_time = next_dose_time(e->slot, e->dose_time);
+            e->due = e->dose_time;
+        } else {
+            e->due = now + DOSE_SCHED_RETRY_S;
+        }
+        heap_sift_down(0);
+    }
+    arm_timer_locked();
+    xSemaphoreGive(s_lock);
+}
+
+// Runs on every SNTP sync. Small corrections keep the heap and only re-arm
+// the timer against the corrected clock.
+static void time_sync_cb(struct timeval *tv)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_synced) {
+        s_synced = true;
+        ESP_LOGI(TAG, "Wall time set (%lld), dose schedule armed", (long long)tv->tv_sec);
+        rebuild_locked();
+    } else {
+        arm_timer_locked();
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static esp_err_t save_config_locked(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+        return err;
+    }
+    err = nvs_set_blob(nvs_handle, NVS_KEY_TIMES, &s_config, sizeof(s_config));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) saving dose times!", esp_err_to_name(err));
+    }
+    nvs_close(nvs_handle);
+    return err;
+}
+
+static void load_config(void)
+{
+    int doses_per_day = tray_doses_per_day();
+    s_config = (dose_sched_record_t) {
+        .enabled = 1,
+        .slots = tray_slot_count(),
+        .doses_per_day = doses_per_day,
+    };
+    for (int slot = 0; slot < s_config.slots; slot++) {
+        s_config.minute[slot] = s_default_minute[doses_per_day - 1][slot % doses_per_day];
+    }
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) return;
+    dose_sched_record_t record;
+    size_t size = sizeof(record);
+    esp_err_t err = nvs_get_blob(nvs_handle, NVS_KEY_TIMES, &record, &size);
+    nvs_close(nvs_handle);
+    if (err != ESP_OK || size != sizeof(record)) {
+        ESP_LOGI(TAG, "No saved dose times, using defaults");
+        return;
+    }
+    if (record.slots != s_config.slots || record.doses_per_day != s_config.doses_per_day) {
+        ESP_LOGI(TAG, "Saved dose times are for another tray layout, using defaults");
+        return;
+    }
+    for (int slot = 0; slot < s_config.slots; slot++) {
+        if (record.minute[slot] >= 24 * 60) return; // Corrupt record, keep the defaults
+    }
+    s_config = record;
+}
+
+esp_err_t dose_sched_init(void)
+{
+    // Dose times are local; newlib needs the zone before the first localtime_r()
+    setenv("TZ", DOSE_SCHED_TZ, 1);
+    tzset();
+
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        ESP_LOGE(TAG, "Failed to create scheduler mutex!");
+        return ESP_ERR_NO_MEM;
+    }
+    load_config();
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = dose_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "dose_sched",
+        .skip_unhandled_events = true,
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &s_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) creating scheduler timer!", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Dose scheduler ready (%s), waiting for wall time", s_config.enabled ? "enabled" : "disabled");
+    return ESP_OK;
+}
+
+void dose_sched_start_sntp(void)
+{
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(DOSE_SCHED_NTP_SERVER);
+    config.sync_cb = time_sync_cb;
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) starting SNTP, doses will not be dispensed automatically", esp_err_to_name(err));
+    }
+}
+
+// Saves a configuration change and reschedules. Caller holds s_lock.
+static esp_err_t apply_config_locked(void)
+{
+    esp_err_t err = save_config_locked();
+    if (s_synced) {
+        rebuild_locked();
+    }
+    return err;
+}
+
+esp_err_t dose_sched_set_slot_time(int slot, int minute)
+{
+    if (slot < 0 || slot >= tray_slot_count() || minute < 0 || minute >= 24 * 60) return ESP_ERR_INVALID_ARG;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_config.minute[slot] = (uint16_t)minute;
+    esp_err_t err = apply_config_locked();
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t dose_sched_set_dose_time(int dose, int minute)
+{
+    int doses_per_day = tray_doses_per_day();
+    if (dose < 1 || dose > doses_per_day || minute < 0 || minute >= 24 * 60) return ESP_ERR_INVALID_ARG;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int slot = dose - 1; slot < tray_slot_count(); slot += doses_per_day) {
+        s_config.minute[slot] = (uint16_t)minute;
+    }
+    esp_err_t err = apply_config_locked();
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+esp_err_t dose_sched_set_enabled(bool enabled)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_config.enabled = enabled;
+    esp_err_t err = apply_config_locked();
+    xSemaphoreGive(s_lock);
+    return err;
+}
+
+void dose_sched_get_status(dose_sched_status_t *out)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    out->synced = s_synced;
+    out->enabled = s_config.enabled;
+    memcpy(out->minute, s_config.minute, sizeof(out->minute));
+    memset(out->due, 0, sizeof(out->due));
+    for (int i = 0; i < s_heap_len; i++) {
+        out->due[s_heap[i].slot] = s_heap[i].due;
+    }
+    out->next_slot = s_heap_len > 0 ? s_heap[0].slot : -1;
+    out->next_due = s_heap_len > 0 ? s_heap[0].due : 0;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "esp_err.h"
+#include "ashumitra.h"
+
+// POSIX TZ of the installation; dose times are local wall-clock times
+#define DOSE_SCHED_TZ          "IST-5:30"
+#define DOSE_SCHED_NTP_SERVER  "pool.ntp.org"
+// A due dose the motion queue cannot take is retried at this interval, and
+// given up as missed once it is this late
+#define DOSE_SCHED_RETRY_S     5
+#define DOSE_SCHED_GIVE_UP_S   600
+
+typedef struct {
+    bool synced;                  // Wall time is known (first SNTP sync done)
+    bool enabled;                 // Automatic dispensing is on
+    uint16_t minute[MAX_SLOTS];   // Time of day of each slot's dose
+    time_t due[MAX_SLOTS];        // Next dispense of each slot, 0 until synced
+    int next_slot;                // Slot due first, -1 if none
+    time_t next_due;
+    uint32_t dispensed;           // Doses handed to the motion queue
+    uint32_t skipped_empty;       // Due while the slot was not filled
+    uint32_t skipped_disabled;    // Due while automatic dispensing was off
+    uint32_t missed;              // Not queued within DOSE_SCHED_GIVE_UP_S
+    uint32_t retries;             // Attempts repeated because the motion queue was full
+} dose_sched_status_t;
+
+// Loads the dose times from NVS and prepares the wake-up timer. Nothing is
+// scheduled until wall time is known. Call after tray_init(); times saved
+// for a different tray layout are replaced by the defaults.
+esp_err_t dose_sched_init(void);
+
+// Starts SNTP. Call once the network is up; the first sync arms the schedule.
+void dose_sched_start_sntp(void);
+
+// Changes the time of one slot, or of one dose (1 .. doses per day) on
+// every day, and saves it. Doses already dispensed today are not repeated.
+esp_err_t dose_sched_set_slot_time(int slot, int minute);
+esp_err_t dose_sched_set_dose_time(int dose, int minute);
+esp_err_t dose_sched_set_enabled(bool enabled);
+
+void dose_sched_get_status(dose_sched_status_t *out);
@@ -0,0 +1,179 @@
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "drop_sensor.h"
+#include "metrics.h"
+#include "tray.h"
+
+static const char *TAG = "ASHUMITRA_DROP";
+
+static const int s_config_gpio[TRAY_MAX_TRAYS] = {
+    CONFIG_ASHUMITRA_DROP_GPIO_TRAY0,
+    CONFIG_ASHUMITRA_DROP_GPIO_TRAY1,
+    CONFIG_ASHUMITRA_DROP_GPIO_TRAY2,
+    CONFIG_ASHUMITRA_DROP_GPIO_TRAY3,
+};
+
+typedef struct {
+    int gpio;                   // -1: no sensor
+    SemaphoreHandle_t dropped;  // Given by the ISR once a pill has crossed the beam
+    volatile bool broken;       // Beam broken since arming and not restored yet
+    int64_t armed_us;
+    uint32_t expected_ms;       // Moving average of the arm-to-drop time, written by the tray's motion task
+} drop_tray_t;
+
+static drop_tray_t s_trays[TRAY_MAX_TRAYS];
+static drop_sensor_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Runs on both edges while a dispense waits. A pill breaks the beam and then
+// restores it; only the restore counts, so a pill stuck across the beam is
+// reported as a jam rather than a drop.
+static void drop_isr(void *arg)
+{
+    drop_tray_t *tray = arg;
+    BaseType_t woken = pdFALSE;
+
+    if (gpio_get_level(tray->gpio) == CONFIG_ASHUMITRA_DROP_BROKEN_LEVEL) {
+        tray->broken = true;
+    } else if (tray->broken) {
+        tray->broken = false;
+        xSemaphoreGiveFromISR(tray->dropped, &woken);
+    }
+    if (woken) portYIELD_FROM_ISR();
+}
+
+static esp_err_t sensor_init(int t, drop_tray_t *tray)
+{
+    gpio_config_t conf = {
+        .pin_bit_mask = 1ULL << tray->gpio,
+        .mode = GPIO_MODE_INPUT,
+        // Input-only pins have no pull-up; the receiver board brings its own
+        .pull_up_en = GPIO_IS_VALID_OUTPUT_GPIO(tray->gpio) ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_ANYEDGE,
+    };
+    esp_err_t err = gpio_config(&conf);
+    if (err == ESP_OK) {
+        // Only armed while a dispense waits for its pill
+        err = gpio_intr_disable(tray->gpio);
+    }
+    if (err == ESP_OK) {
+        err = gpio_isr_handler_add(tray->gpio, drop_isr, tray);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Tray %d: failed to set up the drop sensor on GPIO %d (%s)", t, tray->gpio, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t drop_sensor_init(void)
+{
+    const tray_layout_t *layout = tray_layout();
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) { // Already installed is fine
+        ESP_LOGE(TAG, "Failed to install the GPIO ISR service (%s)", esp_err_to_name(err));
+        return err;
+    }
+
+    for (int t = 0; t < TRAY_MAX_TRAYS; t++) {
+        drop_tray_t *tray = &s_trays[t];
+        *tray = (drop_tray_t) { .gpio = -1, .expected_ms = DROP_SENSOR_EXPECTED_MS };
+        if (t >= layout->count || s_config_gpio[t] < 0) continue;
+
+        int gpio = s_config_gpio[t];
+        bool taken = false;
+        for (int i = 0; i < layout->count; i++) {
+            if (layout->tray[i].gpio == gpio) taken = true;
+        }
+        if (taken || !GPIO_IS_VALID_GPIO(gpio)) {
+            ESP_LOGE(TAG, "Tray %d: GPIO %d cannot be a drop sensor (%s), using the fixed drop wait", t, gpio,
+                     taken ? "drives a servo" : "invalid pin");
+            continue;
+        }
+
+        tray->dropped = xSemaphoreCreateBinary();
+        if (!tray->dropped) return ESP_ERR_NO_MEM;
+        tray->gpio = gpio;
+        if (sensor_init(t, tray) != ESP_OK) {
+            tray->gpio = -1;
+            continue;
+        }
+        ESP_LOGI(TAG, "Tray %d drop sensor on GPIO %d, timeout %d ms", t, gpio, DROP_SENSOR_TIMEOUT_MS);
+    }
+    return ESP_OK;
+}
+
+bool drop_sensor_present(int tray)
+{
+    return tray >= 0 && tray < TRAY_MAX_TRAYS && s_trays[tray].gpio >= 0;
+}
+
+void drop_sensor_arm(int t)
+{
+    if (!drop_sensor_present(t)) return;
+    drop_tray_t *tray = &s_trays[t];
+
+    // The interrupt is off between dispenses, so nothing races these
+    xSemaphoreTake(tray->dropped, 0);
+    tray->broken = false;
+    tray->armed_us = esp_timer_get_time();
+    gpio_intr_enable(tray->gpio);
+}
+
+drop_result_t drop_sensor_wait(int t, uint32_t timeout_ms, uint32_t *waited_ms)
+{
+    if (!drop_sensor_present(t)) {
+        *waited_ms = 0;
+        return DROP_EMPTY;
+    }
+    drop_tray_t *tray = &s_trays[t];
+
+    bool seen = xSemaphoreTake(tray->dropped, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+    gpio_intr_disable(tray->gpio);
+    uint32_t waited_us = (uint32_t)(esp_timer_get_time() - tray->armed_us);
+    *waited_ms = waited_us / 1000;
+
+    drop_result_t result = DROP_SEEN;
+    if (!seen) {
+        result = gpio_get_level(tray->gpio) == CONFIG_ASHUMITRA_DROP_BROKEN_LEVEL ? DROP_JAM : DROP_EMPTY;
+    } else {
+        metrics_hist_observe(&metrics_drop_wait, waited_us);
+        tray->expected_ms = (3 * tray->expected_ms + *waited_ms) / 4;
+    }
+
+    taskENTER_CRITICAL(&s_stats_lock);
+    switch (result) {
+        case DROP_SEEN:  s_stats.seen++; break;
+        case DROP_JAM:   s_stats.jams++; break;
+        case DROP_EMPTY: s_stats.empties++; break;
+    }
+    taskEXIT_CRITICAL(&s_stats_lock);
+    return result;
+}
+
+uint32_t drop_sensor_expected_ms(int tray)
+{
+    return drop_sensor_present(tray) ? s_trays[tray].expected_ms : DROP_SENSOR_EXPECTED_MS;
+}
+
+void drop_sensor_get_stats(drop_sensor_stats_t *out)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+const char *drop_result_name(drop_result_t result)
+{
+    switch (result) {
+        case DROP_SEEN:  return "seen";
+        case DROP_JAM:   return "jam";
+        case DROP_EMPTY: return "empty";
+    }
+    return "unknown";
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// IR break-beam drop sensors, one below each tray's chute. A dispense stop
+// ends as soon as the pill crosses the beam instead of after a fixed wait,
+// and a stop that sees no pill within DROP_SENSOR_TIMEOUT_MS fails with a
+// jam fault (something still blocks the beam) or an empty fault.
+//
+// The receiver output is watched by a GPIO edge interrupt, enabled only
+// while a dispense waits, so a hand in the chute at other times does no
+// harm. Pins, polarity and the timeout are set in menuconfig ("Ashumitra
+// drop sensors", see Kconfig.projbuild). A tray whose pin is -1, the
+// default, has no sensor and keeps the fixed MOTION_DROP_WAIT_MS.
+
+#ifndef CONFIG_ASHUMITRA_DROP_GPIO_TRAY0
+#define CONFIG_ASHUMITRA_DROP_GPIO_TRAY0 -1
+#endif
+#ifndef CONFIG_ASHUMITRA_DROP_GPIO_TRAY1
+#define CONFIG_ASHUMITRA_DROP_GPIO_TRAY1 -1
+#endif
+#ifndef CONFIG_ASHUMITRA_DROP_GPIO_TRAY2
+#define CONFIG_ASHUMITRA_DROP_GPIO_TRAY2 -1
+#endif
+#ifndef CONFIG_ASHUMITRA_DROP_GPIO_TRAY3
+#define CONFIG_ASHUMITRA_DROP_GPIO_TRAY3 -1
+#endif
+#ifndef CONFIG_ASHUMITRA_DROP_BROKEN_LEVEL
+#define CONFIG_ASHUMITRA_DROP_BROKEN_LEVEL 0
+#endif
+#ifndef CONFIG_ASHUMITRA_DROP_TIMEOUT_MS
+#define CONFIG_ASHUMITRA_DROP_TIMEOUT_MS 1500
+#endif
+
+#define DROP_SENSOR_TIMEOUT_MS CONFIG_ASHUMITRA_DROP_TIMEOUT_MS
+// Drop time assumed for predictions until a tray has seen some drops
+#define DROP_SENSOR_EXPECTED_MS 250
+
+typedef enum {
+    DROP_SEEN = 0,   // The pill crossed the beam
+    DROP_JAM,        // Timed out with the beam blocked
+    DROP_EMPTY,      // Timed out with the beam clear: nothing fell
+} drop_result_t;
+
+typedef struct {
+    uint32_t seen;
+    uint32_t jams;
+    uint32_t empties;
+} drop_sensor_stats_t;
+
+// Configures the sensor pin of every tray in the layout. Call after tray_init().
+esp_err_t drop_sensor_init(void);
+
+bool drop_sensor_present(int tray);
+
+// Starts watching a tray's beam, forgetting earlier breaks. Call once the
+// dispense move has been commanded, before its settle time runs.
+void drop_sensor_arm(int tray);
+
+// Waits up to timeout_ms for the pill to cross the beam since
+// drop_sensor_arm(), then stops watching. *waited_ms receives the wait.
+drop_result_t drop_sensor_wait(int tray, uint32_t timeout_ms, uint32_t *waited_ms);
+
+// Typical time from arming to the drop on a tray, for job time predictions
+uint32_t drop_sensor_expected_ms(int tray);
+
+void drop_sensor_get_stats(drop_sensor_stats_t *out);
+
+const char *drop_result_name(drop_result_t result);
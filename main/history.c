@@ -0,0 +1,410 @@
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "metrics.h"
+#include "history.h"
+#include "task_plan.h"
+#include "trace.h"
+
+#define HISTORY_TASK_STACK 3072
+// Largest partition indexed; a bigger one is only used up to this many sectors
+#define HISTORY_MAX_SECTORS 64
+#define HISTORY_SECTOR_SIZE (HISTORY_RECORDS_PER_SECTOR * HISTORY_RECORD_SIZE)
+#define HISTORY_SEQ_NONE    UINT32_MAX
+// Times before this (2020-01-01) mean SNTP has not set the clock yet
+#define HISTORY_MIN_TIME    1577836800
+
+_Static_assert(sizeof(history_record_t) == HISTORY_RECORD_SIZE, "history record must stay 16 bytes");
+
+static const char *TAG = "ASHUMITRA_HISTORY";
+
+static const esp_partition_t *s_partition = NULL;
+static const uint8_t *s_flash = NULL; // Whole partition, memory-mapped for reads
+static esp_partition_mmap_handle_t s_mmap_handle;
+static int s_sectors = 0;
+static TaskHandle_t s_history_task = NULL;
+static SemaphoreHandle_t s_write_lock = NULL; // Serializes the task and the shutdown flush
+
+// Write cursor, only touched with s_write_lock held
+static int s_write_sector = 0;
+static int s_write_index = 0;
+
+// Sequence counter, sector index and the batch of events not written yet,
+// guarded by a spinlock so logging never blocks. Every record in sector k
+// sits at index seq - s_sector_base[k], which makes a lookup by seq one
+// subtraction instead of a search.
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_sector_base[HISTORY_MAX_SECTORS];
+static uint32_t s_next_seq = 1;
+static history_record_t s_pending[HISTORY_PENDING_MAX];
+static int s_pending_head = 0;
+static int s_pending_count = 0;
+static history_stats_t s_stats;
+
+static uint8_t record_check(const history_record_t *rec)
+{
+    const uint8_t *bytes = (const uint8_t *)rec;
+    uint8_t check = 0x5a; // Erased flash (all 0xff) never passes
+    for (size_t i = 0; i < offsetof(history_record_t, check); i++) {
+        check ^= bytes[i];
+    }
+    return check;
+}
+
+static bool record_valid(const history_record_t *rec)
+{
+    return rec->seq != HISTORY_SEQ_NONE && rec->check == record_check(rec);
+}
+
+static bool record_blank(const history_record_t *rec)
+{
+    const uint8_t *bytes = (const uint8_t *)rec;
+    for (size_t i = 0; i < sizeof(*rec); i++) {
+        if (bytes[i] != 0xff) return false;
+    }
+    return true;
+}
+
+static const history_record_t *flash_record(int sector, int index)
+{
+    return (const history_record_t *)(s_flash + sector * HISTORY_SECTOR_SIZE + index * HISTORY_RECORD_SIZE);
+}
+
+// Rebuilds the sector index from the first record of every sector and finds
+// where the newest sector ends
+static esp_err_t history_scan(void)
+{
+    int head = -1;
+    for (int k = 0; k < s_sectors; k++) {
+        const history_record_t *first = flash_record(k, 0);
+        s_sector_base[k] = record_valid(first) ? first->seq : HISTORY_SEQ_NONE;
+        if (s_sector_base[k] != HISTORY_SEQ_NONE && (head < 0 || s_sector_base[k] > s_sector_base[head])) {
+            head = k;
+        }
+    }
+
+    if (head < 0) {
+        // Empty (or never formatted) partition: start at sector 0
+        esp_err_t err = esp_partition_erase_range(s_partition, 0, HISTORY_SECTOR_SIZE);
+        if (err != ESP_OK) return err;
+        s_write_sector = 0;
+        s_write_index = 0;
+        s_sector_base[0] = s_next_seq;
+        return ESP_OK;
+    }
+
+    int count = 0;
+    while (count < HISTORY_RECORDS_PER_SECTOR) {
+        const history_record_t *rec = flash_record(head, count);
+        if (!record_valid(rec) || rec->seq != s_sector_base[head] + count) break;
+        count++;
+    }
+    s_write_sector = head;
+    s_write_index = count;
+    s_next_seq = s_sector_base[head] + count;
+    if (count < HISTORY_RECORDS_PER_SECTOR && !record_blank(flash_record(head, count))) {
+        // A write cut short by a reset: writing over it would corrupt the next
+        // record, so this sector is closed and logging goes on in the next one
+        ESP_LOGW(TAG, "Torn record at seq %" PRIu32 ", closing its sector", s_next_seq);
+        s_write_index = HISTORY_RECORDS_PER_SECTOR;
+    }
+    return ESP_OK;
+}
+
+// Oldest seq still in flash according to `bases`, or `fallback` if the log is empty
+static uint32_t oldest_seq(const uint32_t *bases, uint32_t fallback)
+{
+    uint32_t first = fallback;
+    for (int k = 0; k < s_sectors; k++) {
+        if (bases[k] != HISTORY_SEQ_NONE && bases[k] < first) first = bases[k];
+    }
+    return first;
+}
+
+// Writes the pending events. Caller must hold s_write_lock.
+static void history_write_locked(void)
+{
+    history_record_t batch[HISTORY_PENDING_MAX];
+
+    taskENTER_CRITICAL(&s_lock);
+    int n = s_pending_count;
+    for (int i = 0; i < n; i++) {
+        batch[i] = s_pending[(s_pending_head + i) % HISTORY_PENDING_MAX];
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    int written = 0;
+    while (written < n) {
+        if (s_write_index == HISTORY_RECORDS_PER_SECTOR) {
+            // Sector full: erase the next one, dropping the oldest events
+            int next = (s_write_sector + 1) % s_sectors;
+            taskENTER_CRITICAL(&s_lock);
+            s_sector_base[next] = HISTORY_SEQ_NONE;
+            taskEXIT_CRITICAL(&s_lock);
+            esp_err_t err = esp_partition_erase_range(s_partition, next * HISTORY_SECTOR_SIZE, HISTORY_SECTOR_SIZE);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Error (%s) erasing sector %d", esp_err_to_name(err), next);
+                taskENTER_CRITICAL(&s_lock);
+                s_stats.write_errors++;
+                taskEXIT_CRITICAL(&s_lock);
+                break;
+            }
+            s_write_sector = next;
+            s_write_index = 0;
+            taskENTER_CRITICAL(&s_lock);
+            s_sector_base[next] = batch[written].seq;
+            s_stats.erases++;
+            taskEXIT_CRITICAL(&s_lock);
+        }
+
+        // One write per run of records that fits in the current sector
+        int run = n - written;
+        if (run > HISTORY_RECORDS_PER_SECTOR - s_write_index) run = HISTORY_RECORDS_PER_SECTOR - s_write_index;
+        size_t offset = s_write_sector * HISTORY_SECTOR_SIZE + s_write_index * HISTORY_RECORD_SIZE;
+        esp_err_t err = esp_partition_write(s_partition, offset, &batch[written], run * HISTORY_RECORD_SIZE);
+        if (err != ESP_OK) {
+            // The run may be partly written; start over in a fresh sector
+            ESP_LOGE(TAG, "Error (%s) writing %d events", esp_err_to_name(err), run);
+            s_write_index = HISTORY_RECORDS_PER_SECTOR;
+            taskENTER_CRITICAL(&s_lock);
+            s_stats.write_errors++;
+            taskEXIT_CRITICAL(&s_lock);
+            break;
+        }
+        s_write_index += run;
+        written += run;
+    }
+
+    // Readers find the written events in flash from now on
+    taskENTER_CRITICAL(&s_lock);
+    s_pending_head = (s_pending_head + written) % HISTORY_PENDING_MAX;
+    s_pending_count -= written;
+    if (written > 0) s_stats.flushes++;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (written > 0) {
+        ESP_LOGD(TAG, "Wrote %d events", written);
+    }
+}
+
+static int pending_count(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    int count = s_pending_count;
+    taskEXIT_CRITICAL(&s_lock);
+    return count;
+}
+
+static void history_task(void *arg)
+{
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // First event
+    for (;;) {
+        // Let the batch grow for a while; a half-full batch cuts the wait short
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HISTORY_FLUSH_MS));
+
+        xSemaphoreTake(s_write_lock, portMAX_DELAY);
+        history_write_locked();
+        xSemaphoreGive(s_write_lock);
+
+        if (pending_count() == 0) {
+            uint32_t wait_started_us = trace_task_wait();
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            trace_task_run(wait_started_us);
+        }
+    }
+}
+
+// Runs from esp_restart() so the last batch is not lost on a software reset
+static void history_shutdown_handler(void)
+{
+    if (s_write_lock && xSemaphoreTake(s_write_lock, pdMS_TO_TICKS(500)) == pdTRUE) {
+        history_write_locked();
+        xSemaphoreGive(s_write_lock);
+    }
+}
+
+esp_err_t history_init(void)
+{
+    s_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)HISTORY_PARTITION_SUBTYPE,
+                                           HISTORY_PARTITION_LABEL);
+    if (!s_partition) {
+        ESP_LOGW(TAG, "No '%s' partition, dose history disabled", HISTORY_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_sectors = s_partition->size / HISTORY_SECTOR_SIZE;
+    if (s_sectors > HISTORY_MAX_SECTORS) s_sectors = HISTORY_MAX_SECTORS;
+    if (s_sectors < 2) {
+        ESP_LOGE(TAG, "History partition too small (%" PRIu32 " bytes)", s_partition->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const void *map;
+    esp_err_t err = esp_partition_mmap(s_partition, 0, s_sectors * HISTORY_SECTOR_SIZE, ESP_PARTITION_MMAP_DATA,
+                                       &map, &s_mmap_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) mapping the history partition", esp_err_to_name(err));
+        return err;
+    }
+    s_flash = map;
+
+    err = history_scan();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) preparing the history partition", esp_err_to_name(err));
+        return err;
+    }
+    s_stats.capacity = s_sectors * HISTORY_RECORDS_PER_SECTOR;
+
+    s_write_lock = xSemaphoreCreateMutex();
+    if (!s_write_lock) {
+        ESP_LOGE(TAG, "Failed to create history mutex!");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreatePinnedToCore(history_task, "history", HISTORY_TASK_STACK, NULL, TASK_PLAN_STORAGE_PRIO, &s_history_task,
+                                TASK_PLAN_STORAGE_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create history task!");
+        return ESP_FAIL;
+    }
+    metrics_register_task(s_history_task, HISTORY_TASK_STACK);
+
+    err = esp_register_shutdown_handler(history_shutdown_handler);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error (%s) registering shutdown flush", esp_err_to_name(err));
+    }
+    ESP_LOGI(TAG, "Dose history: %d sectors, events %" PRIu32 "..%" PRIu32, s_sectors,
+             oldest_seq(s_sector_base, s_next_seq), s_next_seq - 1);
+    return ESP_OK;
+}
+
+void history_log(history_type_t type, int slot, uint32_t job, uint8_t detail)
+{
+    if (!s_history_task) return;
+
+    time_t now = time(NULL);
+    history_record_t rec = {
+        .time = now >= HISTORY_MIN_TIME ? (uint32_t)now : 0,
+        .job = job,
+        .type = (uint8_t)type,
+        .slot = (uint8_t)slot,
+        .detail = detail,
+    };
+
+    bool notify = false;
+    taskENTER_CRITICAL(&s_lock);
+    if (s_pending_count == HISTORY_PENDING_MAX) {
+        // The numbering has no gaps, so an event that cannot be kept gets no seq
+        s_stats.dropped++;
+    } else {
+        rec.seq = s_next_seq++;
+        rec.check = record_check(&rec);
+        s_pending[(s_pending_head + s_pending_count) % HISTORY_PENDING_MAX] = rec;
+        s_pending_count++;
+        s_stats.logged++;
+        notify = s_pending_count == 1 || s_pending_count == HISTORY_PENDING_MAX / 2;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (notify) {
+        xTaskNotifyGive(s_history_task);
+    }
+}
+
+void history_job_update(const motion_job_info_t *job)
+{
+    if ((job->op == MOTION_OP_DISPENSE || job->op == MOTION_OP_DISPENSE_SWEEP) &&
+        job->state == MOTION_JOB_MOVING && job->arrived) {
+        history_log(HISTORY_DISPENSE, job->slot, job->id, 0);
+    } else if (job->state == MOTION_JOB_FAILED) {
+        history_fault_t detail = job->fault == MOTION_FAULT_JAM   ? HISTORY_FAULT_JAM :
+                                 job->fault == MOTION_FAULT_EMPTY ? HISTORY_FAULT_EMPTY : HISTORY_FAULT_MOTION;
+        history_log(HISTORY_FAULT, job->slot, job->id, detail);
+    }
+}
+
+int history_read(uint32_t since, history_record_t *out, int max, uint32_t *next)
+{
+    uint32_t bases[HISTORY_MAX_SECTORS];
+    history_record_t pending[HISTORY_PENDING_MAX];
+
+    if (!s_history_task) {
+        *next = since;
+        return 0;
+    }
+
+    // Index and batch are copied together, so every event up to end_seq is
+    // either in the copy of the batch or already in flash
+    taskENTER_CRITICAL(&s_lock);
+    memcpy(bases, s_sector_base, s_sectors * sizeof(bases[0]));
+    int pending_n = s_pending_count;
+    for (int i = 0; i < pending_n; i++) {
+        pending[i] = s_pending[(s_pending_head + i) % HISTORY_PENDING_MAX];
+    }
+    uint32_t end_seq = s_next_seq;
+    taskEXIT_CRITICAL(&s_lock);
+    uint32_t pending_seq = end_seq - pending_n;
+
+    uint32_t first = oldest_seq(bases, pending_seq);
+    uint32_t seq = since < first ? first : since;
+    int n = 0;
+    while (n < max && seq < end_seq) {
+        if (seq >= pending_seq) {
+            out[n++] = pending[seq - pending_seq];
+            seq++;
+            continue;
+        }
+
+        bool found = false;
+        for (int k = 0; k < s_sectors && !found; k++) {
+            if (bases[k] == HISTORY_SEQ_NONE || seq < bases[k] || seq - bases[k] >= HISTORY_RECORDS_PER_SECTOR) continue;
+            // Copied before checking, the writer may be erasing this sector
+            history_record_t rec;
+            memcpy(&rec, flash_record(k, seq - bases[k]), sizeof(rec));
+            if (record_valid(&rec) && rec.seq == seq) {
+                out[n++] = rec;
+                found = true;
+            }
+        }
+        if (found) {
+            seq++;
+            continue;
+        }
+
+        // Lost to an erase or a closed sector: go on with the next sector after it
+        uint32_t skip_to = pending_seq;
+        for (int k = 0; k < s_sectors; k++) {
+            if (bases[k] != HISTORY_SEQ_NONE && bases[k] > seq && bases[k] < skip_to) skip_to = bases[k];
+        }
+        seq = skip_to;
+    }
+    *next = seq;
+    return n;
+}
+
+void history_get_stats(history_stats_t *out)
+{
+    taskENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    out->next_seq = s_next_seq;
+    out->pending = s_pending_count;
+    out->first_seq = oldest_seq(s_sector_base, s_next_seq - s_pending_count);
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+const char *history_type_name(uint8_t type)
+{
+    switch (type) {
+        case HISTORY_FILL:     return "fill";
+        case HISTORY_REMOVE:   return "remove";
+        case HISTORY_DISPENSE: return "dispense";
+        case HISTORY_MISSED:   return "missed";
+        case HISTORY_FAULT:    return "fault";
+        default:               return "unknown";
+    }
+}
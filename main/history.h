@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "motion.h"
+
+// Append-only dose history in its own flash partition (see partitions.csv).
+// Events are fixed-size records numbered by a sequence counter that keeps
+// counting across reboots. The partition is used as a ring of erase sectors:
+// when the last sector fills up, the oldest one is erased and reused, so the
+// log always holds the most recent (sectors - 1) x HISTORY_RECORDS_PER_SECTOR
+// events or more.
+#define HISTORY_PARTITION_LABEL   "history"
+#define HISTORY_PARTITION_SUBTYPE 0x40
+// Events are batched in RAM and written this long after the first one, or
+// as soon as half of HISTORY_PENDING_MAX are waiting
+#define HISTORY_FLUSH_MS          2000
+#define HISTORY_PENDING_MAX       32
+// Most events returned by one history_read() / GET /history page
+#define HISTORY_PAGE_MAX          50
+
+typedef enum {
+    HISTORY_FILL = 1,   // Slot marked filled
+    HISTORY_REMOVE,     // Slot cleared without dispensing
+    HISTORY_DISPENSE,   // Pill dropped from a slot (job = the motion job)
+    HISTORY_MISSED,     // Scheduled dose not dispensed, see history_missed_t
+    HISTORY_FAULT,      // Motion job failed (job = the motion job), see history_fault_t
+} history_type_t;
+
+// Detail of a HISTORY_MISSED event
+typedef enum {
+    HISTORY_MISSED_LATE = 0,  // Not queued within DOSE_SCHED_GIVE_UP_S
+    HISTORY_MISSED_EMPTY,     // Slot was not filled
+    HISTORY_MISSED_DISABLED,  // Automatic dispensing was off
+} history_missed_t;
+
+// Detail of a HISTORY_FAULT event
+typedef enum {
+    HISTORY_FAULT_MOTION = 0, // The servo could not be driven
+    HISTORY_FAULT_JAM,        // No pill passed the drop sensor, its beam stayed blocked
+    HISTORY_FAULT_EMPTY,      // No pill passed the drop sensor
+} history_fault_t;
+
+// One event as stored in flash. The check byte lets a reader tell a complete
+// record from erased flash or a write cut short by a reset.
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint32_t time;   // Unix time, 0 if the wall time was not known yet
+    uint32_t job;
+    uint8_t type;    // history_type_t
+    uint8_t slot;
+    uint8_t detail;
+    uint8_t check;
+} history_record_t;
+
+#define HISTORY_RECORD_SIZE 16
+#define HISTORY_RECORDS_PER_SECTOR (4096 / HISTORY_RECORD_SIZE)
+
+typedef struct {
+    uint32_t first_seq;     // Oldest event still available
+    uint32_t next_seq;      // Sequence number the next event gets
+    uint32_t capacity;      // Records the partition holds
+    uint32_t logged;        // Events logged since boot
+    uint32_t dropped;       // Events lost because the RAM batch was full
+    uint32_t pending;       // Events waiting to be written
+    uint32_t flushes;       // Batches written to flash
+    uint32_t erases;        // Sectors erased (each drops the oldest events)
+    uint32_t write_errors;
+} history_stats_t;
+
+// Finds the partition, rebuilds the sector index and starts the writer task.
+// Without the partition the log stays disabled and history_log() is a no-op.
+esp_err_t history_init(void);
+
+// Appends an event. Never blocks and never touches flash, so it is safe from
+// handlers, the motion task callback and timer callbacks.
+void history_log(history_type_t type, int slot, uint32_t job, uint8_t detail);
+
+// Logs the dispense and fault events of a motion job update (chain it into
+// the motion job callback)
+void history_job_update(const motion_job_info_t *job);
+
+// Copies up to `max` events with seq >= since, oldest first, including those
+// not yet written. *next receives the seq to ask for next. Returns the count.
+int history_read(uint32_t since, history_record_t *out, int max, uint32_t *next);
+
+void history_get_stats(history_stats_t *out);
+
+const char *history_type_name(uint8_t type);
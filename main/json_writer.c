@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "json_writer.h"
+
+void json_writer_init(json_writer_t *w, char *buf, size_t size, json_flush_fn_t flush, void *ctx)
+{
+    *w = (json_writer_t) { .buf = buf, .size = size, .flush = flush, .ctx = ctx, .err = ESP_OK };
+    if (size == 0) {
+        w->err = ESP_ERR_INVALID_SIZE;
+    } else {
+        buf[0] = '\0';
+    }
+}
+
+esp_err_t json_writer_flush(json_writer_t *w)
+{
+    if (w->err == ESP_OK && w->len > 0 && w->flush) {
+        w->err = w->flush(w->ctx, w->buf, w->len);
+        w->flushed = true;
+        w->len = 0;
+    }
+    return w->err;
+}
+
+// One byte of the buffer is always kept for the terminating NUL
+static void put(json_writer_t *w, const char *data, size_t n)
+{
+    if (w->err != ESP_OK) return;
+    if (w->len + n >= w->size) {
+        if (!w->flush) {
+            w->err = ESP_ERR_NO_MEM;
+            return;
+        }
+        json_writer_flush(w);
+        if (w->err == ESP_OK && n >= w->size) {
+            // Larger than the whole buffer: pass it straight through
+            w->err = w->flush(w->ctx, data, n);
+            w->flushed = true;
+            return;
+        }
+        if (w->err != ESP_OK) return;
+    }
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+    w->buf[w->len] = '\0';
+}
+
+// Emits the separator owed before an item at the current level
+static void begin_item(json_writer_t *w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    uint8_t bit = 1u << w->depth;
+    if (w->has_items & bit) put(w, ",", 1);
+    w->has_items |= bit;
+}
+
+static void open_level(json_writer_t *w, char bracket)
+{
+    begin_item(w);
+    if (w->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    put(w, &bracket, 1);
+    w->depth++;
+    w->has_items &= ~(1u << w->depth);
+}
+
+static void close_level(json_writer_t *w, char bracket)
+{
+    if (w->depth == 0) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    put(w, &bracket, 1);
+    w->depth--;
+}
+
+void json_obj_begin(json_writer_t *w) { open_level(w, '{'); }
+void json_obj_end(json_writer_t *w)   { close_level(w, '}'); }
+void json_arr_begin(json_writer_t *w) { open_level(w, '['); }
+void json_arr_end(json_writer_t *w)   { close_level(w, ']'); }
+
+static void put_string(json_writer_t *w, const char *s)
+{
+    put(w, "\"", 1);
+    // Copy runs of plain characters in one go, escape the rest
+    const char *run = s;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        put(w, run, s - run);
+        char esc[8];
+        switch (c) {
+            case '"':  put(w, "\\\"", 2); break;
+            case '\\': put(w, "\\\\", 2); break;
+            case '\n': put(w, "\\n", 2); break;
+            case '\r': put(w, "\\r", 2); break;
+            case '\t': put(w, "\\t", 2); break;
+            default:
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                put(w, esc, 6);
+        }
+        run = s + 1;
+    }
+    put(w, run, s - run);
+    put(w, "\"", 1);
+}
+
+void json_key(json_writer_t *w, const char *key)
+{
+    begin_item(w);
+    put_string(w, key);
+    put(w, ":", 1);
+    w->after_key = true;
+}
+
+void json_int(json_writer_t *w, int32_t value)
+{
+    char num[12];
+    int len = snprintf(num, sizeof(num), "%" PRId32, value);
+    begin_item(w);
+    put(w, num, len);
+}
+
+void json_uint(json_writer_t *w, uint32_t value)
+{
+    char num[12];
+    int len = snprintf(num, sizeof(num), "%" PRIu32, value);
+    begin_item(w);
+    put(w, num, len);
+}
+
+void json_bool(json_writer_t *w, bool value)
+{
+    begin_item(w);
+    put(w, value ? "true" : "false", value ? 4 : 5);
+}
+
+void json_str(json_writer_t *w, const char *value)
+{
+    begin_item(w);
+    put_string(w, value ? value : "");
+}
+
+esp_err_t json_writer_finish(json_writer_t *w)
+{
+    if (w->err == ESP_OK && (w->depth != 0 || w->after_key)) {
+        w->err = ESP_ERR_INVALID_STATE; // Unbalanced document
+    }
+    if (w->flushed) {
+        json_writer_flush(w);
+    }
+    return w->err;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Deepest object/array nesting a writer tracks
+#define JSON_WRITER_MAX_DEPTH 8
+
+// Receives the buffered output when it fills up and on json_writer_finish()
+typedef esp_err_t (*json_flush_fn_t)(void *ctx, const char *data, size_t len);
+
+// Streaming JSON serializer over a caller-provided buffer (usually on the
+// stack). Nothing is allocated: without a flush callback the document must
+// fit the buffer, with one the buffer is handed over whenever it fills.
+// Errors are sticky and reported once by json_writer_finish().
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    json_flush_fn_t flush;
+    void *ctx;
+    esp_err_t err;
+    bool flushed;          // Part of the output has already gone to flush
+    bool after_key;        // The next value belongs to the key just written
+    uint8_t depth;
+    uint8_t has_items;     // Bit per nesting level: a comma is due before the next item
+} json_writer_t;
+
+void json_writer_init(json_writer_t *w, char *buf, size_t size, json_flush_fn_t flush, void *ctx);
+
+void json_obj_begin(json_writer_t *w);
+void json_obj_end(json_writer_t *w);
+void json_arr_begin(json_writer_t *w);
+void json_arr_end(json_writer_t *w);
+
+// Object member name; the next value call supplies its value
+void json_key(json_writer_t *w, const char *key);
+
+void json_int(json_writer_t *w, int32_t value);
+void json_uint(json_writer_t *w, uint32_t value);
+void json_bool(json_writer_t *w, bool value);
+void json_str(json_writer_t *w, const char *value);
+
+// Key and value in one call
+static inline void json_kv_int(json_writer_t *w, const char *key, int32_t value)
+{
+    json_key(w, key);
+    json_int(w, value);
+}
+
+static inline void json_kv_uint(json_writer_t *w, const char *key, uint32_t value)
+{
+    json_key(w, key);
+    json_uint(w, value);
+}
+
+static inline void json_kv_bool(json_writer_t *w, const char *key, bool value)
+{
+    json_key(w, key);
+    json_bool(w, value);
+}
+
+static inline void json_kv_str(json_writer_t *w, const char *key, const char *value)
+{
+    json_key(w, key);
+    json_str(w, value);
+}
+
+// Completes the document. Without a flush callback the buffer is left
+// NUL-terminated and w->len holds the length; ESP_ERR_NO_MEM means it did not
+// fit. With one, output still buffered is passed on only if something was
+// flushed earlier (w->flushed), so a small document can still be sent whole.
+esp_err_t json_writer_finish(json_writer_t *w);
+
+// Passes whatever is buffered to the flush callback
+esp_err_t json_writer_flush(json_writer_t *w);
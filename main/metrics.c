@@ -0,0 +1,337 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_err.h"
+#include "admission.h"
+#include "dedup.h"
+#include "dose_sched.h"
+#include "drop_sensor.h"
+#include "history.h"
+#include "mqtt_bridge.h"
+#include "metrics.h"
+#include "motion.h"
+#include "persist.h"
+#include "power.h"
+#include "slot_state.h"
+#include "wifi_mgr.h"
+
+// Upper bounds of the histogram buckets, in microseconds
+static const uint32_t s_bucket_bounds_us[METRICS_HIST_BUCKETS] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000,
+};
+
+metrics_hist_t metrics_writer_lock_wait;
+metrics_hist_t metrics_nvs_commit;
+metrics_hist_t metrics_motion_job;
+metrics_hist_t metrics_servo_step_late;
+metrics_hist_t metrics_drop_wait;
+metrics_counter_t metrics_http_busy;
+atomic_uint_fast64_t metrics_servo_busy_us;
+atomic_uint_fast64_t metrics_first_request_us;
+
+typedef struct {
+    const char *method;
+    const char *uri;
+    metrics_hist_t latency;
+} metrics_route_t;
+
+typedef struct {
+    TaskHandle_t task;
+    uint32_t stack_size;
+} metrics_task_t;
+
+// Registries are append-only, so a render only needs the count under the lock
+static portMUX_TYPE s_registry_lock = portMUX_INITIALIZER_UNLOCKED;
+static metrics_route_t s_routes[METRICS_MAX_ROUTES];
+static int s_route_count = 0;
+static metrics_task_t s_tasks[METRICS_MAX_TASKS];
+static int s_task_count = 0;
+
+void metrics_hist_observe(metrics_hist_t *hist, uint32_t us)
+{
+    int bucket = 0;
+    while (bucket < METRICS_HIST_BUCKETS && us > s_bucket_bounds_us[bucket]) {
+        bucket++;
+    }
+    atomic_fetch_add_explicit(&hist->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum_us, us, memory_order_relaxed);
+}
+
+metrics_hist_t *metrics_route(const char *method, const char *uri)
+{
+    metrics_hist_t *hist = NULL;
+
+    taskENTER_CRITICAL(&s_registry_lock);
+    for (int i = 0; i < s_route_count && !hist; i++) {
+        if (strcmp(s_routes[i].method, method) == 0 && strcmp(s_routes[i].uri, uri) == 0) {
+            hist = &s_routes[i].latency;
+        }
+    }
+    if (!hist && s_route_count < METRICS_MAX_ROUTES) {
+        s_routes[s_route_count].method = method;
+        s_routes[s_route_count].uri = uri;
+        hist = &s_routes[s_route_count].latency;
+        s_route_count++;
+    }
+    taskEXIT_CRITICAL(&s_registry_lock);
+    return hist;
+}
+
+void metrics_register_task(TaskHandle_t task, uint32_t stack_size)
+{
+    taskENTER_CRITICAL(&s_registry_lock);
+    for (int i = 0; i < s_task_count; i++) {
+        if (s_tasks[i].task == task) {
+            taskEXIT_CRITICAL(&s_registry_lock);
+            return;
+        }
+    }
+    if (s_task_count < METRICS_MAX_TASKS) {
+        s_tasks[s_task_count++] = (metrics_task_t) { task, stack_size };
+    }
+    taskEXIT_CRITICAL(&s_registry_lock);
+}
+
+// --- Rendering ---
+// Lines are collected in a small buffer and handed to the writer in chunks
+typedef struct {
+    metrics_write_fn_t write;
+    void *ctx;
+    esp_err_t err;
+    size_t len;
+    char buf[1024];
+} metrics_out_t;
+
+static void out_flush(metrics_out_t *out)
+{
+    if (out->len > 0 && out->err == ESP_OK) {
+        out->err = out->write(out->ctx, out->buf, out->len);
+    }
+    out->len = 0;
+}
+
+static void out_printf(metrics_out_t *out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out_printf(metrics_out_t *out, const char *fmt, ...)
+{
+    char line[192];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len < 0) return;
+    if ((size_t)len >= sizeof(line)) len = sizeof(line) - 1;
+
+    if (out->len + len > sizeof(out->buf)) {
+        out_flush(out);
+    }
+    memcpy(out->buf + out->len, line, len);
+    out->len += len;
+}
+
+static void out_header(metrics_out_t *out, const char *name, const char *type, const char *help)
+{
+    out_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Writes the series of one histogram. `labels` is empty or "key=\"value\",".
+static void out_hist(metrics_out_t *out, const char *name, const char *labels, const metrics_hist_t *hist)
+{
+    // Label set for _sum and _count: the same labels without "le"
+    char set[112] = "";
+    size_t labels_len = strlen(labels);
+    if (labels_len > 0) snprintf(set, sizeof(set), "{%.*s}", (int)labels_len - 1, labels);
+
+    uint32_t cumulative = 0;
+    for (int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        cumulative += atomic_load_explicit(&hist->buckets[i], memory_order_relaxed);
+        out_printf(out, "%s_bucket{%sle=\"%g\"} %" PRIu32 "\n", name, labels, s_bucket_bounds_us[i] / 1e6, cumulative);
+    }
+    cumulative += atomic_load_explicit(&hist->buckets[METRICS_HIST_BUCKETS], memory_order_relaxed);
+    out_printf(out, "%s_bucket{%sle=\"+Inf\"} %" PRIu32 "\n", name, labels, cumulative);
+    uint64_t sum_us = atomic_load_explicit(&hist->sum_us, memory_order_relaxed);
+    out_printf(out, "%s_sum%s %" PRIu64 ".%06" PRIu64 "\n", name, set, sum_us / 1000000, sum_us % 1000000);
+    // Buckets and count are read separately; use the bucket total so they agree
+    out_printf(out, "%s_count%s %" PRIu32 "\n", name, set, cumulative);
+}
+
+static void out_value(metrics_out_t *out, const char *name, const char *type, const char *help, uint64_t value)
+{
+    out_header(out, name, type, help);
+    out_printf(out, "%s %" PRIu64 "\n", name, value);
+}
+
+esp_err_t metrics_render(metrics_write_fn_t write, void *ctx)
+{
+    // Kept off the httpd stack; the single httpd task renders one request at a time
+    static metrics_out_t out;
+    out = (metrics_out_t) { .write = write, .ctx = ctx, .err = ESP_OK };
+
+    taskENTER_CRITICAL(&s_registry_lock);
+    int route_count = s_route_count;
+    int task_count = s_task_count;
+    taskEXIT_CRITICAL(&s_registry_lock);
+
+    // Per-route request latency
+    out_header(&out, "ashumitra_http_request_duration_seconds", "histogram", "Time spent in HTTP handlers by route.");
+    for (int i = 0; i < route_count; i++) {
+        char labels[96];
+        snprintf(labels, sizeof(labels), "method=\"%s\",uri=\"%s\",", s_routes[i].method, s_routes[i].uri);
+        out_hist(&out, "ashumitra_http_request_duration_seconds", labels, &s_routes[i].latency);
+    }
+    out_value(&out, "ashumitra_http_busy_responses_total", "counter", "Motion commands refused because the motion queue was full.",
+              atomic_load_explicit(&metrics_http_busy, memory_order_relaxed));
+
+    uint64_t first_us = atomic_load_explicit(&metrics_first_request_us, memory_order_relaxed);
+    out_header(&out, "ashumitra_first_request_seconds", "gauge", "Time from power-on until the first HTTP request was served.");
+    out_printf(&out, "ashumitra_first_request_seconds %" PRIu64 ".%06" PRIu64 "\n", first_us / 1000000, first_us % 1000000);
+
+    // Wi-Fi
+    wifi_mgr_stats_t wifi;
+    wifi_mgr_get_stats(&wifi);
+    out_value(&out, "ashumitra_wifi_connected", "gauge", "1 while the station is associated and has an address.", wifi.connected);
+    out_value(&out, "ashumitra_wifi_fast_connect", "gauge", "1 if the current connection joined the cached AP without a scan.", wifi.fast_connect);
+    out_value(&out, "ashumitra_wifi_connect_attempts_total", "counter", "Connection attempts started.", wifi.attempts);
+    out_value(&out, "ashumitra_wifi_connects_total", "counter", "Addresses obtained.", wifi.connects);
+    out_value(&out, "ashumitra_wifi_disconnects_total", "counter", "Links lost and attempts failed.", wifi.disconnects);
+    out_header(&out, "ashumitra_wifi_first_ip_seconds", "gauge", "Time from power-on until the station first had an address.");
+    out_printf(&out, "ashumitra_wifi_first_ip_seconds %" PRIu32 ".%03" PRIu32 "\n", wifi.first_ip_ms / 1000, wifi.first_ip_ms % 1000);
+
+    // MQTT publisher
+    mqtt_bridge_stats_t mqtt;
+    mqtt_bridge_get_stats(&mqtt);
+    out_value(&out, "ashumitra_mqtt_connected", "gauge", "1 while connected to the MQTT broker.", mqtt.connected);
+    out_value(&out, "ashumitra_mqtt_connects_total", "counter", "Connections made to the MQTT broker.", mqtt.connects);
+    out_value(&out, "ashumitra_mqtt_state_published_total", "counter", "Retained slot-state messages published.", mqtt.state_published);
+    out_value(&out, "ashumitra_mqtt_state_coalesced_total", "counter", "State generations folded into a later publish.", mqtt.state_coalesced);
+    out_value(&out, "ashumitra_mqtt_events_published_total", "counter", "Dispense and fault events published.", mqtt.events_published);
+    out_value(&out, "ashumitra_mqtt_events_dropped_total", "counter", "Events lost because the queue was full or the publish failed.", mqtt.events_dropped);
+    out_value(&out, "ashumitra_mqtt_commands_total", "counter", "Commands received over MQTT.", mqtt.commands);
+    out_value(&out, "ashumitra_mqtt_command_errors_total", "counter", "MQTT commands refused or malformed.", mqtt.command_errors);
+    out_value(&out, "ashumitra_mqtt_publish_errors_total", "counter", "MQTT publishes that could not be sent.", mqtt.publish_errors);
+
+    // Motion admission control
+    admission_stats_t admission;
+    admission_get_stats(&admission);
+    out_header(&out, "ashumitra_admission_decisions_total", "counter", "Motion commands by admission decision.");
+    for (int i = 0; i < ADMISSION_RESULT_COUNT; i++) {
+        out_printf(&out, "ashumitra_admission_decisions_total{result=\"%s\"} %" PRIu32 "\n", admission_result_name(i),
+                   admission.decisions[i]);
+    }
+
+    // Request ID replay cache
+    dedup_stats_t dedup;
+    dedup_get_stats(&dedup);
+    out_value(&out, "ashumitra_dedup_hits_total", "counter", "Retried commands answered from the request ID cache.", dedup.hits);
+    out_value(&out, "ashumitra_dedup_stored_total", "counter", "Command outcomes stored under a request ID.", dedup.stored);
+    out_value(&out, "ashumitra_dedup_conflicts_total", "counter", "Request IDs reused for a different command.", dedup.conflicts);
+    out_value(&out, "ashumitra_dedup_evicted_total", "counter", "Request IDs dropped from the full cache before they expired.", dedup.evicted);
+
+    // Slot state
+    slot_state_stats_t slots;
+    slot_state_get_stats(&slots);
+    out_header(&out, "ashumitra_slot_writer_lock_wait_seconds", "histogram", "Time writers waited for the slot state lock.");
+    out_hist(&out, "ashumitra_slot_writer_lock_wait_seconds", "", &metrics_writer_lock_wait);
+    out_value(&out, "ashumitra_slot_reads_total", "counter", "Lock-free slot snapshot reads.", slots.reads);
+    out_value(&out, "ashumitra_slot_read_retries_total", "counter", "Snapshot reads repeated because a publish overlapped.", slots.read_retries);
+    out_value(&out, "ashumitra_slot_writes_total", "counter", "Published slot state changes.", slots.writes);
+    out_value(&out, "ashumitra_slot_generation", "gauge", "Current slot state generation.", slot_state_generation());
+
+    // Persistence
+    persist_stats_t persist;
+    persist_get_stats(&persist);
+    out_header(&out, "ashumitra_nvs_commit_duration_seconds", "histogram", "Time to write and commit the slot record to NVS.");
+    out_hist(&out, "ashumitra_nvs_commit_duration_seconds", "", &metrics_nvs_commit);
+    out_value(&out, "ashumitra_nvs_commits_total", "counter", "Successful NVS commits.", persist.commits);
+    out_value(&out, "ashumitra_nvs_commit_failures_total", "counter", "Failed NVS write attempts.", persist.failures);
+    out_value(&out, "ashumitra_nvs_commits_avoided_total", "counter", "Changes folded into another commit.", persist.commits_avoided);
+    out_value(&out, "ashumitra_nvs_dirty", "gauge", "1 while a change is waiting to be committed.", persist.dirty);
+
+    // Motion
+    out_header(&out, "ashumitra_motion_job_duration_seconds", "histogram", "Run time of motion jobs, excluding queue wait.");
+    out_hist(&out, "ashumitra_motion_job_duration_seconds", "", &metrics_motion_job);
+    out_header(&out, "ashumitra_servo_step_late_seconds", "histogram", "Delay of servo ramp steps past their due time.");
+    out_hist(&out, "ashumitra_servo_step_late_seconds", "", &metrics_servo_step_late);
+    uint64_t busy_us = atomic_load_explicit(&metrics_servo_busy_us, memory_order_relaxed);
+    out_header(&out, "ashumitra_servo_busy_seconds_total", "counter", "Time the servo spent executing jobs.");
+    out_printf(&out, "ashumitra_servo_busy_seconds_total %" PRIu64 ".%06" PRIu64 "\n", busy_us / 1000000, busy_us % 1000000);
+    out_value(&out, "ashumitra_motion_queue_depth", "gauge", "Jobs waiting in the motion queues of all trays.", motion_queue_depth());
+    out_value(&out, "ashumitra_motion_queue_capacity", "gauge", "Size of the motion queues of all trays.", MOTION_QUEUE_LEN * tray_count());
+
+    // Drop sensors
+    drop_sensor_stats_t drops;
+    drop_sensor_get_stats(&drops);
+    out_header(&out, "ashumitra_drop_wait_seconds", "histogram", "Time from reaching the chute to the pill crossing the drop sensor.");
+    out_hist(&out, "ashumitra_drop_wait_seconds", "", &metrics_drop_wait);
+    out_header(&out, "ashumitra_drop_results_total", "counter", "Sensed dispense stops by outcome.");
+    out_printf(&out, "ashumitra_drop_results_total{result=\"%s\"} %" PRIu32 "\n", drop_result_name(DROP_SEEN), drops.seen);
+    out_printf(&out, "ashumitra_drop_results_total{result=\"%s\"} %" PRIu32 "\n", drop_result_name(DROP_JAM), drops.jams);
+    out_printf(&out, "ashumitra_drop_results_total{result=\"%s\"} %" PRIu32 "\n", drop_result_name(DROP_EMPTY), drops.empties);
+
+    // Automatic dispensing
+    dose_sched_status_t sched;
+    dose_sched_get_status(&sched);
+    out_header(&out, "ashumitra_scheduled_doses_total", "counter", "Scheduled doses by outcome.");
+    out_printf(&out, "ashumitra_scheduled_doses_total{outcome=\"dispensed\"} %" PRIu32 "\n", sched.dispensed);
+    out_printf(&out, "ashumitra_scheduled_doses_total{outcome=\"skipped_empty\"} %" PRIu32 "\n", sched.skipped_empty);
+    out_printf(&out, "ashumitra_scheduled_doses_total{outcome=\"skipped_disabled\"} %" PRIu32 "\n", sched.skipped_disabled);
+    out_printf(&out, "ashumitra_scheduled_doses_total{outcome=\"missed\"} %" PRIu32 "\n", sched.missed);
+    out_value(&out, "ashumitra_scheduled_dose_retries_total", "counter", "Scheduled dispenses retried because the motion queue was full.", sched.retries);
+    out_value(&out, "ashumitra_time_synced", "gauge", "1 once SNTP has set the wall time.", sched.synced);
+    out_value(&out, "ashumitra_next_dose_timestamp_seconds", "gauge", "Unix time of the next scheduled dose, 0 if none.", (uint64_t)sched.next_due);
+
+    // Dose history log
+    history_stats_t history;
+    history_get_stats(&history);
+    out_value(&out, "ashumitra_history_events_total", "counter", "Events added to the dose history.", history.logged);
+    out_value(&out, "ashumitra_history_dropped_total", "counter", "Events lost because the write batch was full.", history.dropped);
+    out_value(&out, "ashumitra_history_pending", "gauge", "Events waiting to be written to flash.", history.pending);
+    out_value(&out, "ashumitra_history_flushes_total", "counter", "Event batches written to flash.", history.flushes);
+    out_value(&out, "ashumitra_history_sector_erases_total", "counter", "History sectors erased.", history.erases);
+    out_value(&out, "ashumitra_history_write_errors_total", "counter", "Failed history erases and writes.", history.write_errors);
+    out_value(&out, "ashumitra_history_stored_events", "gauge", "Events currently kept in the history partition.", history.next_seq - history.first_seq);
+
+    // Power
+    power_stats_t power;
+    power_get_stats(&power);
+    out_value(&out, "ashumitra_power_idle", "gauge", "1 while in the low-power idle mode.", power.idle);
+    out_value(&out, "ashumitra_power_holds", "gauge", "Components keeping the device active (e.g. a powered servo).", power.holds);
+    out_value(&out, "ashumitra_power_idle_entries_total", "counter", "Transitions to the idle mode.", power.idle_entries);
+    out_value(&out, "ashumitra_power_wakeups_total", "counter", "Transitions from idle back to active.", power.wakeups);
+    out_header(&out, "ashumitra_power_idle_seconds_total", "counter", "Time spent in the idle mode.");
+    out_printf(&out, "ashumitra_power_idle_seconds_total %" PRIu64 ".%06" PRIu64 "\n", power.idle_us / 1000000, power.idle_us % 1000000);
+
+    // Memory
+    out_value(&out, "ashumitra_heap_free_bytes", "gauge", "Current free heap.", esp_get_free_heap_size());
+    out_value(&out, "ashumitra_heap_min_free_bytes", "gauge", "Lowest free heap since boot.", esp_get_minimum_free_heap_size());
+
+    out_header(&out, "ashumitra_task_stack_size_bytes", "gauge", "Configured task stack size.");
+    for (int i = 0; i < task_count; i++) {
+        out_printf(&out, "ashumitra_task_stack_size_bytes{task=\"%s\"} %" PRIu32 "\n", pcTaskGetName(s_tasks[i].task),
+                   s_tasks[i].stack_size);
+    }
+    out_header(&out, "ashumitra_task_stack_free_min_bytes", "gauge", "Stack high-water mark: least free stack seen.");
+    for (int i = 0; i < task_count; i++) {
+        // ESP-IDF reports the high-water mark in bytes
+        out_printf(&out, "ashumitra_task_stack_free_min_bytes{task=\"%s\"} %" PRIu32 "\n", pcTaskGetName(s_tasks[i].task),
+                   (uint32_t)uxTaskGetStackHighWaterMark(s_tasks[i].task));
+    }
+    out_header(&out, "ashumitra_task_priority", "gauge", "FreeRTOS priority of the task.");
+    for (int i = 0; i < task_count; i++) {
+        out_printf(&out, "ashumitra_task_priority{task=\"%s\"} %u\n", pcTaskGetName(s_tasks[i].task),
+                   (unsigned)uxTaskPriorityGet(s_tasks[i].task));
+    }
+    out_header(&out, "ashumitra_task_core", "gauge", "Core the task is pinned to, -1 if unpinned.");
+    for (int i = 0; i < task_count; i++) {
+        BaseType_t core = xTaskGetCoreID(s_tasks[i].task);
+        out_printf(&out, "ashumitra_task_core{task=\"%s\"} %d\n", pcTaskGetName(s_tasks[i].task),
+                   core == tskNO_AFFINITY ? -1 : (int)core);
+    }
+
+    out_flush(&out);
+    return out.err;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Fixed histogram buckets shared by every latency histogram, in microseconds
+// (100 us .. 2.5 s). Observations above the last bound land in +Inf.
+#define METRICS_HIST_BUCKETS 14
+#define METRICS_MAX_ROUTES   24
+#define METRICS_MAX_TASKS    8
+
+// Latency histogram. Observing is a handful of relaxed atomic adds and never
+// blocks, so instrumentation can stay enabled in production builds.
+typedef struct {
+    atomic_uint_fast32_t buckets[METRICS_HIST_BUCKETS + 1]; // Per bucket (not cumulative), last is +Inf; they sum to the count
+    atomic_uint_fast64_t sum_us;
+} metrics_hist_t;
+
+typedef atomic_uint_fast32_t metrics_counter_t;
+
+// Subsystem metrics, updated directly by the owning modules
+extern metrics_hist_t metrics_writer_lock_wait; // slot_state_write_begin() lock wait
+extern metrics_hist_t metrics_nvs_commit;       // Write and commit of the slot record
+extern metrics_hist_t metrics_motion_job;       // Motion job run time, queue wait excluded
+extern metrics_hist_t metrics_servo_step_late;  // How late each servo ramp step ran
+extern metrics_hist_t metrics_drop_wait;        // Dispense stop from arming the drop sensor to the drop
+extern metrics_counter_t metrics_http_busy;     // Motion commands refused because the motion queue was full
+extern atomic_uint_fast64_t metrics_servo_busy_us;
+extern atomic_uint_fast64_t metrics_first_request_us; // Uptime when the first HTTP request was served, 0 until then
+
+void metrics_hist_observe(metrics_hist_t *hist, uint32_t us);
+
+static inline void metrics_inc(metrics_counter_t *counter)
+{
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+// Returns the histogram for one HTTP route, creating it on first use, or NULL
+// when METRICS_MAX_ROUTES are already in use. Call during startup.
+metrics_hist_t *metrics_route(const char *method, const char *uri);
+
+// Adds a task to the stack high-water mark report
+void metrics_register_task(TaskHandle_t task, uint32_t stack_size);
+
+// Callback receiving the rendered text piece by piece
+typedef esp_err_t (*metrics_write_fn_t)(void *ctx, const char *data, size_t len);
+
+// Renders all metrics in the Prometheus text exposition format (0.0.4),
+// including the slot state, persistence, motion queue and heap figures.
+esp_err_t metrics_render(metrics_write_fn_t write, void *ctx);
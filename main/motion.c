@@ -0,0 +1,705 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "driver/ledc.h"
+#include "ashumitra.h"
+#include "drop_sensor.h"
+#include "motion.h"
+#include "motion_profile.h"
+#include "motion_plan.h"
+#include "metrics.h"
+#include "power.h"
+#include "task_plan.h"
+#include "trace.h"
+
+// Servo control parameters. All servos share one 50 Hz timer; tray N drives
+// its servo on channel SERVO_FIRST_CHANNEL + N, on the GPIO from the layout.
+#define SERVO_TIMER LEDC_TIMER_0
+#define SERVO_FIRST_CHANNEL LEDC_CHANNEL_0
+#define SERVO_RESOLUTION LEDC_TIMER_13_BIT
+#define SERVO_FREQ 50
+#define SERVO_MIN_PULSEWIDTH 500
+#define SERVO_MAX_PULSEWIDTH 2500
+
+// Servo kinematics used for settle times and ramping (see motion_profile.h)
+#define SERVO_MODEL (&SERVO_MODEL_SG90)
+// Ramp the commanded angle along the velocity profile instead of jumping to
+// the target, so the carousel starts and stops gently and pills do not jam
+#define SERVO_RAMP_ENABLED 1
+#define SERVO_RAMP_STEP_MS 20 // One PWM period
+
+#define MOTION_TASK_STACK 4096
+
+static const char *TAG = "ASHUMITRA_MOTION";
+
+// Command passed through a tray's queue to its motion task
+typedef struct {
+    uint32_t id;
+    motion_op_t op;
+    uint8_t count;             // Number of valid entries in slots[]
+    uint8_t slots[MAX_SLOTS];  // Slots to visit, all on the same tray; a single entry for plain moves
+} motion_cmd_t;
+
+// One tray's servo and the task driving it
+typedef struct {
+    int tray;
+    ledc_channel_t channel;
+    QueueHandle_t queue;
+    int current_angle;   // Last commanded angle, -1 until the first move. Only touched by the task.
+    bool powered;        // PWM output running (holding torque). Only touched by the task.
+    char task_name[12];
+} motion_servo_t;
+
+static motion_servo_t s_servos[TRAY_MAX_TRAYS];
+static int s_servo_count = 0;
+
+// Recent jobs, indexed by id % MOTION_JOB_HISTORY. Guarded by a spinlock so
+// status reads never wait on the servo. Ids whose entry still holds a live
+// job are skipped, so a job waiting behind a long one on its tray keeps its
+// entry however many jobs other trays run meanwhile.
+static motion_job_info_t s_jobs[MOTION_JOB_HISTORY];
+static uint32_t s_next_job_id = 1;
+static portMUX_TYPE s_jobs_lock = portMUX_INITIALIZER_UNLOCKED;
+static motion_job_cb_t s_job_cb = NULL;
+
+// --- Servo Functions ---
+static esp_err_t servo_timer_init(void)
+{
+    ledc_timer_config_t timer_conf = {
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .duty_resolution = SERVO_RESOLUTION,
+        .timer_num = SERVO_TIMER,
+        .freq_hz = SERVO_FREQ,
+        .clk_cfg = LEDC_AUTO_CLK
+    };
+    return ledc_timer_config(&timer_conf);
+}
+
+static esp_err_t servo_init(motion_servo_t *servo, int gpio)
+{
+    ledc_channel_config_t channel_conf = {
+        .gpio_num = gpio,
+        .speed_mode = LEDC_LOW_SPEED_MODE,
+        .channel = servo->channel,
+        .timer_sel = SERVO_TIMER,
+        .duty = 0,
+        .hpoint = 0
+    };
+    esp_err_t err = ledc_channel_config(&channel_conf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Tray %d: error (%s) setting up the servo on GPIO %d", servo->tray, esp_err_to_name(err), gpio);
+    }
+    return err;
+}
+
+static uint32_t servo_angle_to_duty(float angle)
+{
+    if (angle < 0) angle = 0;
+    if (angle > 180) angle = 180;
+    uint32_t pulse_width = SERVO_MIN_PULSEWIDTH + (uint32_t)(((SERVO_MAX_PULSEWIDTH - SERVO_MIN_PULSEWIDTH) * angle) / 180.0f + 0.5f);
+    return (pulse_width * ((1 << SERVO_RESOLUTION) - 1)) / (1000000 / SERVO_FREQ);
+}
+
+// Keeps the device awake while pulses are generated: LEDC runs from the APB
+// clock, which DFS would lower and light sleep would stop
+static void servo_power_on(motion_servo_t *servo)
+{
+    if (!servo->powered) {
+        power_hold();
+        servo->powered = true;
+    }
+}
+
+// Stops the PWM output; the next servo_write_angle() restarts it
+static void servo_power_off(motion_servo_t *servo)
+{
+    if (!servo->powered) return;
+    esp_err_t err = ledc_stop(LEDC_LOW_SPEED_MODE, servo->channel, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Tray %d: error (%s) stopping servo PWM", servo->tray, esp_err_to_name(err));
+        return;
+    }
+    servo->powered = false;
+    power_release();
+    ESP_LOGI(TAG, "Tray %d: servo released at %d degrees", servo->tray, servo->current_angle);
+}
+
+// Commands an angle without waiting for the servo to get there
+static esp_err_t servo_write_angle(motion_servo_t *servo, float angle)
+{
+    servo_power_on(servo);
+    esp_err_t err = ledc_set_duty(LEDC_LOW_SPEED_MODE, servo->channel, servo_angle_to_duty(angle));
+    if (err == ESP_OK) {
+        err = ledc_update_duty(LEDC_LOW_SPEED_MODE, servo->channel);
+    }
+    return err;
+}
+
+// Distance of a move from the current position; the full range when the
+// position is not known yet
+static int move_distance(int from_angle, int to_angle)
+{
+    return from_angle < 0 ? MOTION_PROFILE_FULL_RANGE : abs(to_angle - from_angle);
+}
+
+// Commands the move to `angle`, ramping along the profile, and returns the
+// time the servo still needs to settle there. The wait is derived from the
+// distance travelled rather than a fixed delay.
+static esp_err_t servo_move(motion_servo_t *servo, int angle, uint32_t *settle_ms)
+{
+    int start = servo->current_angle;
+    int distance = move_distance(start, angle);
+    uint32_t travel_ms = motion_profile_travel_ms(SERVO_MODEL, distance);
+    esp_err_t err = ESP_OK;
+
+    if (SERVO_RAMP_ENABLED && start >= 0 && distance > 0) {
+        // Step the commanded angle along the trapezoidal profile
+        // Each step is due SERVO_RAMP_STEP_MS after the previous one; how late
+        // it actually runs is the servo timing jitter
+        int dir = angle > start ? 1 : -1;
+        TickType_t last_wake = xTaskGetTickCount();
+        int64_t ramp_start_us = esp_timer_get_time();
+        for (uint32_t t = SERVO_RAMP_STEP_MS; t < travel_ms && err == ESP_OK; t += SERVO_RAMP_STEP_MS) {
+            int64_t late_us = esp_timer_get_time() - ramp_start_us - (int64_t)(t - SERVO_RAMP_STEP_MS) * 1000;
+            metrics_hist_observe(&metrics_servo_step_late, late_us > 0 ? (uint32_t)late_us : 0);
+            trace_record(TRACE_SERVO_STEP, servo->task_name, late_us > 0 ? (uint32_t)late_us : 0);
+            err = servo_write_angle(servo, start + dir * motion_profile_position(SERVO_MODEL, distance, t));
+            vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(SERVO_RAMP_STEP_MS));
+        }
+        travel_ms = 0; // The ramp itself took the travel time
+    }
+    if (err == ESP_OK) {
+        err = servo_write_angle(servo, angle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Tray %d: error (%s) setting servo to %d degrees", servo->tray, esp_err_to_name(err), angle);
+        servo->current_angle = -1; // Position unknown after a partial move
+        return err;
+    }
+
+    *settle_ms = travel_ms + SERVO_MODEL->settle_ms;
+    ESP_LOGI(TAG, "Tray %d: setting servo to %d degrees (%d degree move, settle %" PRIu32 " ms)", servo->tray, angle,
+             distance, *settle_ms);
+    return ESP_OK;
+}
+
+// Moves to `angle` and returns once the servo has settled
+static esp_err_t servo_set_angle(motion_servo_t *servo, int angle)
+{
+    uint32_t settle_ms;
+    esp_err_t err = servo_move(servo, angle, &settle_ms);
+    if (err != ESP_OK) return err;
+    vTaskDelay(pdMS_TO_TICKS(settle_ms));
+    servo->current_angle = angle;
+    return ESP_OK;
+}
+
+// Moves `angle` over the chute and waits for the pill. With a drop sensor
+// the stop ends as soon as the pill has passed the beam, and fails with
+// *fault set if none passes within DROP_SENSOR_TIMEOUT_MS of settling;
+// without one it waits the fixed MOTION_DROP_WAIT_MS.
+static esp_err_t servo_dispense_at(motion_servo_t *servo, int angle, motion_fault_t *fault)
+{
+    if (!drop_sensor_present(servo->tray)) {
+        esp_err_t err = servo_set_angle(servo, angle);
+        if (err == ESP_OK) {
+            vTaskDelay(pdMS_TO_TICKS(MOTION_DROP_WAIT_MS)); // Wait for pill to drop
+        }
+        return err;
+    }
+
+    uint32_t settle_ms, waited_ms;
+    esp_err_t err = servo_move(servo, angle, &settle_ms);
+    if (err != ESP_OK) return err;
+    // The pill can fall while the horn is still settling
+    drop_sensor_arm(servo->tray);
+    drop_result_t result = drop_sensor_wait(servo->tray, settle_ms + DROP_SENSOR_TIMEOUT_MS, &waited_ms);
+    servo->current_angle = angle;
+    if (result != DROP_SEEN) {
+        ESP_LOGW(TAG, "Tray %d: no pill dropped within %" PRIu32 " ms (%s)", servo->tray, waited_ms, drop_result_name(result));
+        *fault = result == DROP_JAM ? MOTION_FAULT_JAM : MOTION_FAULT_EMPTY;
+        return ESP_ERR_TIMEOUT;
+    }
+    ESP_LOGI(TAG, "Tray %d: pill dropped after %" PRIu32 " ms", servo->tray, waited_ms);
+    return ESP_OK;
+}
+
+// --- Job Table ---
+// Reports a job change to the listener, outside the spinlock
+static void job_notify(const motion_job_info_t *job)
+{
+    if (s_job_cb) {
+        s_job_cb(job);
+    }
+}
+
+// fault_slot, if not -1, becomes the job's slot: where a failed job's fault happened
+static void job_set_state(uint32_t id, motion_job_state_t state, motion_fault_t fault, int fault_slot)
+{
+    motion_job_info_t snapshot;
+    bool found = false;
+
+    taskENTER_CRITICAL(&s_jobs_lock);
+    motion_job_info_t *job = &s_jobs[id % MOTION_JOB_HISTORY];
+    if (job->id == id) {
+        job->state = state;
+        job->fault = fault;
+        if (fault_slot >= 0) {
+            job->slot = fault_slot;
+            job->angle = tray_slot_angle(fault_slot);
+        }
+        if (state == MOTION_JOB_SETTLED || state == MOTION_JOB_FAILED) {
+            job->actual_ms = pdTICKS_TO_MS(xTaskGetTickCount()) - job->started_ms;
+        }
+        snapshot = *job;
+        found = true;
+    }
+    taskEXIT_CRITICAL(&s_jobs_lock);
+
+    if (found) job_notify(&snapshot);
+}
+
+// Marks a job as moving and records when it is predicted to settle
+static void job_set_moving(uint32_t id, uint32_t predicted_ms)
+{
+    motion_job_info_t snapshot;
+    bool found = false;
+
+    taskENTER_CRITICAL(&s_jobs_lock);
+    motion_job_info_t *job = &s_jobs[id % MOTION_JOB_HISTORY];
+    if (job->id == id) {
+        job->state = MOTION_JOB_MOVING;
+        job->started_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+        job->predicted_ms = predicted_ms;
+        snapshot = *job;
+        found = true;
+    }
+    taskEXIT_CRITICAL(&s_jobs_lock);
+
+    if (found) job_notify(&snapshot);
+}
+
+// Records that a job is now heading for (or, with `arrived`, has finished at) a given slot
+static void job_set_stop(uint32_t id, int slot, int stops_done, bool arrived)
+{
+    motion_job_info_t snapshot;
+    bool found = false;
+
+    taskENTER_CRITICAL(&s_jobs_lock);
+    motion_job_info_t *job = &s_jobs[id % MOTION_JOB_HISTORY];
+    if (job->id == id) {
+        job->slot = slot;
+        job->angle = tray_slot_angle(slot);
+        job->stops_done = stops_done;
+        job->arrived = arrived;
+        snapshot = *job;
+        found = true;
+    }
+    taskEXIT_CRITICAL(&s_jobs_lock);
+
+    if (found) job_notify(&snapshot);
+}
+
+void motion_set_job_callback(motion_job_cb_t cb)
+{
+    s_job_cb = cb;
+}
+
+const char *motion_op_name(motion_op_t op)
+{
+    switch (op) {
+        case MOTION_OP_HOME:     return "home";
+        case MOTION_OP_FILL:     return "fill";
+        case MOTION_OP_DISPENSE: return "dispense";
+        case MOTION_OP_FILL_SWEEP: return "fill_sweep";
+        case MOTION_OP_DISPENSE_SWEEP: return "dispense_sweep";
+    }
+    return "unknown";
+}
+
+const char *motion_state_name(motion_job_state_t state)
+{
+    switch (state) {
+        case MOTION_JOB_QUEUED:  return "queued";
+        case MOTION_JOB_MOVING:  return "moving";
+        case MOTION_JOB_SETTLED: return "settled";
+        case MOTION_JOB_FAILED:  return "failed";
+    }
+    return "unknown";
+}
+
+const char *motion_fault_name(motion_fault_t fault)
+{
+    switch (fault) {
+        case MOTION_FAULT_NONE:  return "none";
+        case MOTION_FAULT_SERVO: return "servo";
+        case MOTION_FAULT_JAM:   return "jam";
+        case MOTION_FAULT_EMPTY: return "empty";
+    }
+    return "unknown";
+}
+
+static bool op_is_dispense(motion_op_t op)
+{
+    return op == MOTION_OP_DISPENSE || op == MOTION_OP_DISPENSE_SWEEP;
+}
+
+static bool op_is_program(motion_op_t op)
+{
+    return op == MOTION_OP_FILL_SWEEP || op == MOTION_OP_DISPENSE_SWEEP;
+}
+
+// Predicted duration of visiting `slots` in order from `angle`: the settle
+// time of every leg plus the drop wait of dispense stops. With a drop sensor
+// a dispense stop takes the travel and then the tray's typical drop time.
+static uint32_t predict_visits_ms(motion_op_t op, int angle, const uint8_t *slots, int count)
+{
+    uint32_t total = 0;
+    int tray = count > 0 ? tray_of_slot(slots[0]) : -1;
+    bool sensed = op_is_dispense(op) && drop_sensor_present(tray);
+
+    for (int i = 0; i < count; i++) {
+        int target = tray_slot_angle(slots[i]);
+        int distance = move_distance(angle, target);
+        if (sensed) {
+            total += motion_profile_travel_ms(SERVO_MODEL, distance) + drop_sensor_expected_ms(tray);
+        } else {
+            total += motion_profile_settle_ms(SERVO_MODEL, distance);
+            if (op_is_dispense(op)) total += MOTION_DROP_WAIT_MS;
+        }
+        angle = target;
+    }
+    return total;
+}
+
+// --- Motion Task ---
+// One per tray, so a long job on one tray never holds up another tray
+static void motion_task(void *arg)
+{
+    motion_servo_t *servo = arg;
+    motion_cmd_t cmd;
+
+    for (;;) {
+        // Release the servo once no job has come for MOTION_SERVO_HOLD_MS
+        TickType_t wait = servo->powered ? pdMS_TO_TICKS(MOTION_SERVO_HOLD_MS) : portMAX_DELAY;
+        uint32_t wait_started_us = trace_task_wait();
+        if (xQueueReceive(servo->queue, &cmd, wait) != pdTRUE) {
+            servo_power_off(servo);
+            continue;
+        }
+        trace_task_run(wait_started_us);
+
+        if (op_is_program(cmd.op)) {
+            int travel = motion_plan_order(servo->current_angle, cmd.slots, cmd.count);
+            ESP_LOGI(TAG, "Job %" PRIu32 ": planned %d stops, %d degrees of travel", cmd.id, cmd.count, travel);
+        }
+        uint32_t predicted_ms = predict_visits_ms(cmd.op, servo->current_angle, cmd.slots, cmd.count);
+        job_set_moving(cmd.id, predicted_ms);
+        TickType_t started = xTaskGetTickCount();
+        int64_t started_us = esp_timer_get_time();
+
+        // The first failed stop decides the job's fault
+        esp_err_t err = ESP_OK;
+        motion_fault_t fault = MOTION_FAULT_NONE;
+        int fault_slot = -1;
+        int done = 0;
+        for (int i = 0; i < cmd.count; i++) {
+            int slot = cmd.slots[i];
+            int angle = tray_slot_angle(slot);
+            job_set_stop(cmd.id, slot, done, false);
+            ESP_LOGI(TAG, "Job %" PRIu32 ": %s slot %d -> tray %d at %d degrees (%d/%d)", cmd.id, motion_op_name(cmd.op),
+                     slot, servo->tray, angle, i + 1, cmd.count);
+
+            esp_err_t stop_err;
+            motion_fault_t stop_fault = MOTION_FAULT_NONE;
+            if (op_is_dispense(cmd.op)) {
+                stop_err = servo_dispense_at(servo, angle, &stop_fault);
+            } else {
+                stop_err = servo_set_angle(servo, angle);
+            }
+            if (stop_err == ESP_OK) {
+                job_set_stop(cmd.id, slot, ++done, true);
+                continue;
+            }
+            if (stop_fault == MOTION_FAULT_NONE) {
+                stop_fault = MOTION_FAULT_SERVO;
+            }
+            if (err == ESP_OK) {
+                err = stop_err;
+                fault = stop_fault;
+                fault_slot = slot;
+            }
+            // An empty slot does not hold up the rest of the sweep. A jam blocks
+            // the chute for every pill after it, and a servo fault the tray.
+            if (stop_fault != MOTION_FAULT_EMPTY) {
+                break;
+            }
+        }
+
+        uint32_t busy_us = (uint32_t)(esp_timer_get_time() - started_us);
+        metrics_hist_observe(&metrics_motion_job, busy_us);
+        atomic_fetch_add_explicit(&metrics_servo_busy_us, busy_us, memory_order_relaxed);
+        job_set_state(cmd.id, err == ESP_OK ? MOTION_JOB_SETTLED : MOTION_JOB_FAILED, fault, fault_slot);
+        ESP_LOGI(TAG, "Job %" PRIu32 " %s (predicted %" PRIu32 " ms, actual %" PRIu32 " ms)", cmd.id,
+                 err == ESP_OK ? "settled" : "failed", predicted_ms, (uint32_t)pdTICKS_TO_MS(xTaskGetTickCount() - started));
+    }
+}
+
+esp_err_t motion_init(void)
+{
+    const tray_layout_t *layout = tray_layout();
+
+    // Every servo is set up before any task starts, so a failure leaves
+    // nothing running and the caller can retry with another layout
+    esp_err_t err = servo_timer_init();
+    for (int t = 0; err == ESP_OK && t < layout->count; t++) {
+        motion_servo_t *servo = &s_servos[t];
+        *servo = (motion_servo_t) {
+            .tray = t,
+            .channel = SERVO_FIRST_CHANNEL + t,
+            .current_angle = -1,
+        };
+        err = servo_init(servo, layout->tray[t].gpio);
+        if (err == ESP_OK) {
+            ESP_LOGI(TAG, "Tray %d servo initialized on GPIO %d", t, layout->tray[t].gpio);
+        }
+    }
+    if (err != ESP_OK) return err;
+
+    for (int t = 0; t < layout->count; t++) {
+        motion_servo_t *servo = &s_servos[t];
+        servo->queue = xQueueCreate(MOTION_QUEUE_LEN, sizeof(motion_cmd_t));
+        if (!servo->queue) {
+            ESP_LOGE(TAG, "Failed to create motion queue for tray %d!", t);
+            return ESP_ERR_NO_MEM;
+        }
+
+        TaskHandle_t task;
+        snprintf(servo->task_name, sizeof(servo->task_name), "motion%d", t);
+        if (xTaskCreatePinnedToCore(motion_task, servo->task_name, MOTION_TASK_STACK, servo, TASK_PLAN_MOTION_PRIO, &task,
+                                    TASK_PLAN_MOTION_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create motion task for tray %d!", t);
+            return ESP_FAIL;
+        }
+        metrics_register_task(task, MOTION_TASK_STACK);
+        s_servo_count = t + 1;
+    }
+    return ESP_OK;
+}
+
+// Queued or running, i.e. its entry must not be reused. Caller holds s_jobs_lock.
+static bool job_is_live(const motion_job_info_t *job)
+{
+    return job->id != 0 && (job->state == MOTION_JOB_QUEUED || job->state == MOTION_JOB_MOVING);
+}
+
+// Reserves a job id, publishes the job as queued and hands it to the task of
+// the tray its slots are on
+static esp_err_t motion_enqueue(motion_cmd_t *cmd, uint32_t *job_id)
+{
+    int tray = tray_of_slot(cmd->slots[0]);
+    if (tray < 0 || tray >= s_servo_count) return ESP_ERR_INVALID_STATE;
+    motion_servo_t *servo = &s_servos[tray];
+
+    taskENTER_CRITICAL(&s_jobs_lock);
+    // At most TRAY_MAX_TRAYS * (MOTION_QUEUE_LEN + 1) jobs are live, so a free entry is always near
+    for (int tries = 0; tries < MOTION_JOB_HISTORY; tries++) {
+        cmd->id = s_next_job_id++;
+        if (s_next_job_id == 0) s_next_job_id = 1; // 0 is never a valid job id
+        if (!job_is_live(&s_jobs[cmd->id % MOTION_JOB_HISTORY])) break;
+    }
+    s_jobs[cmd->id % MOTION_JOB_HISTORY] = (motion_job_info_t) {
+        .id = cmd->id,
+        .op = cmd->op,
+        .tray = tray,
+        .slot = cmd->slots[0],
+        .angle = tray_slot_angle(cmd->slots[0]),
+        .stops = cmd->count,
+        .stops_done = 0,
+        .state = MOTION_JOB_QUEUED,
+    };
+    taskEXIT_CRITICAL(&s_jobs_lock);
+
+    if (xQueueSend(servo->queue, cmd, 0) != pdTRUE) {
+        // Queue full: forget the job so it is not reported as queued
+        taskENTER_CRITICAL(&s_jobs_lock);
+        if (s_jobs[cmd->id % MOTION_JOB_HISTORY].id == cmd->id) {
+            s_jobs[cmd->id % MOTION_JOB_HISTORY].id = 0;
+        }
+        taskEXIT_CRITICAL(&s_jobs_lock);
+        ESP_LOGW(TAG, "Tray %d motion queue full, rejecting %s for slot %d", tray, motion_op_name(cmd->op), cmd->slots[0]);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (job_id) *job_id = cmd->id;
+    return ESP_OK;
+}
+
+esp_err_t motion_submit(motion_op_t op, int slot, uint32_t *job_id)
+{
+    if (slot < 0 || slot >= tray_slot_count() || op_is_program(op)) return ESP_ERR_INVALID_ARG;
+
+    motion_cmd_t cmd = {
+        .op = op,
+        .count = 1,
+        .slots = { slot },
+    };
+    return motion_enqueue(&cmd, job_id);
+}
+
+// Copies the distinct, valid slots of a program, grouped by tray in tray
+// order. Returns the count, or -1 if any slot is invalid.
+static int program_slots(const int *slots, int count, uint8_t *out)
+{
+    int distinct = 0;
+    uint32_t seen = 0;
+
+    if (count <= 0) return -1;
+    for (int i = 0; i < count; i++) {
+        if (slots[i] < 0 || slots[i] >= tray_slot_count()) return -1;
+        seen |= 1UL << slots[i];
+    }
+    for (int t = 0; t < s_servo_count; t++) {
+        for (int i = 0; i < count; i++) {
+            if (tray_of_slot(slots[i]) != t || !(seen & (1UL << slots[i]))) continue;
+            seen &= ~(1UL << slots[i]);
+            out[distinct++] = slots[i];
+        }
+    }
+    return distinct;
+}
+
+// Length of the run of slots at the start of `slots` that are on the same tray
+static int tray_run(const uint8_t *slots, int count)
+{
+    int n = 1;
+    while (n < count && tray_of_slot(slots[n]) == tray_of_slot(slots[0])) n++;
+    return n;
+}
+
+esp_err_t motion_submit_program(motion_op_t op, const int *slots, int count, uint32_t *job_ids, int *job_count)
+{
+    uint8_t ordered[MAX_SLOTS];
+
+    *job_count = 0;
+    if (!op_is_program(op)) return ESP_ERR_INVALID_ARG;
+    int distinct = program_slots(slots, count, ordered);
+    if (distinct <= 0) return ESP_ERR_INVALID_ARG;
+
+    for (int start = 0; start < distinct; ) {
+        motion_cmd_t cmd = { .op = op };
+        cmd.count = tray_run(ordered + start, distinct - start);
+        memcpy(cmd.slots, ordered + start, cmd.count);
+        esp_err_t err = motion_enqueue(&cmd, &job_ids[*job_count]);
+        if (err != ESP_OK) return err;
+        (*job_count)++;
+        start += cmd.count;
+    }
+    return ESP_OK;
+}
+
+esp_err_t motion_estimate_program(motion_op_t op, const int *slots, int count, motion_plan_info_t *out)
+{
+    if (!op_is_program(op)) return ESP_ERR_INVALID_ARG;
+
+    uint8_t ordered[MAX_SLOTS];
+    int distinct = program_slots(slots, count, ordered);
+    if (distinct <= 0) return ESP_ERR_INVALID_ARG;
+
+    *out = (motion_plan_info_t) { .count = distinct };
+    memcpy(out->order, ordered, distinct);
+    for (int start = 0; start < distinct; ) {
+        uint8_t *run = out->order + start;
+        int n = tray_run(run, distinct - start);
+        // Single aligned word, a stale value only skews the estimate
+        int angle = s_servos[tray_of_slot(run[0])].current_angle;
+        out->naive_travel_deg += motion_plan_travel(angle, run, n);
+        out->naive_reversals += motion_plan_reversals(angle, run, n);
+        out->travel_deg += motion_plan_order(angle, run, n);
+        out->reversals += motion_plan_reversals(angle, run, n);
+        uint32_t predicted_ms = predict_visits_ms(op, angle, run, n);
+        if (predicted_ms > out->predicted_ms) out->predicted_ms = predicted_ms; // Trays move in parallel
+        start += n;
+    }
+    return ESP_OK;
+}
+
+bool motion_get_job(uint32_t job_id, motion_job_info_t *out)
+{
+    bool found = false;
+    if (job_id == 0) return false;
+
+    taskENTER_CRITICAL(&s_jobs_lock);
+    const motion_job_info_t *job = &s_jobs[job_id % MOTION_JOB_HISTORY];
+    if (job->id == job_id) {
+        *out = *job;
+        found = true;
+    }
+    taskEXIT_CRITICAL(&s_jobs_lock);
+    return found;
+}
+
+int motion_queue_depth(void)
+{
+    int depth = 0;
+    for (int t = 0; t < s_servo_count; t++) {
+        depth += (int)uxQueueMessagesWaiting(s_servos[t].queue);
+    }
+    return depth;
+}
+
+void motion_get_backlog(int tray, motion_backlog_t *out)
+{
+    uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+    motion_backlog_t trays[TRAY_MAX_TRAYS] = { 0 };
+
+    taskENTER_CRITICAL(&s_jobs_lock);
+    for (int i = 0; i < MOTION_JOB_HISTORY; i++) {
+        const motion_job_info_t *job = &s_jobs[i];
+        if (job->id == 0 || job->tray < 0 || job->tray >= TRAY_MAX_TRAYS) continue;
+        motion_backlog_t *backlog = &trays[job->tray];
+        if (job->state == MOTION_JOB_QUEUED) {
+            backlog->pending++;
+        } else if (job->state == MOTION_JOB_MOVING) {
+            backlog->pending++;
+            uint32_t elapsed = now_ms - job->started_ms;
+            backlog->next_free_ms = elapsed < job->predicted_ms ? job->predicted_ms - elapsed : 0;
+        }
+    }
+    taskEXIT_CRITICAL(&s_jobs_lock);
+
+    if (tray >= 0 && tray < TRAY_MAX_TRAYS) {
+        *out = trays[tray];
+        return;
+    }
+    *out = trays[0];
+    for (int t = 1; t < TRAY_MAX_TRAYS; t++) {
+        if (trays[t].pending > out->pending) *out = trays[t];
+    }
+}
+
+bool motion_find_pending(motion_op_t op, int slot, uint32_t *job_id)
+{
+    bool found = false;
+    if (op_is_program(op)) return false;
+
+    taskENTER_CRITICAL(&s_jobs_lock);
+    for (int i = 0; i < MOTION_JOB_HISTORY && !found; i++) {
+        const motion_job_info_t *job = &s_jobs[i];
+        if (job->id == 0 || job->op != op || job->slot != slot) continue;
+        // Once the stop is done (the pill has dropped) a repeat is a new request
+        if (job->state == MOTION_JOB_QUEUED || (job->state == MOTION_JOB_MOVING && !job->arrived)) {
+            *job_id = job->id;
+            found = true;
+        }
+    }
+    taskEXIT_CRITICAL(&s_jobs_lock);
+    return found;
+}
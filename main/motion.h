@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "ashumitra.h"
+#include "tray.h"
+
+// Every tray has its own servo, motion task and command queue, so jobs on
+// different trays run at the same time; jobs on one tray run in order.
+
+// Depth of each tray's motion command queue. Requests beyond this are
+// rejected instead of stalling the HTTP server.
+#define MOTION_QUEUE_LEN   8
+// Number of jobs kept for /job_status lookups: room for every job that can
+// be queued or running on all trays at once, plus the most recent finished
+// ones. Queued and running jobs are never evicted.
+#define MOTION_JOB_HISTORY (TRAY_MAX_TRAYS * (MOTION_QUEUE_LEN + 1) + 16)
+// Time to wait at the chute for the pill to drop after a dispense move, on
+// trays without a drop sensor (see drop_sensor.h)
+#define MOTION_DROP_WAIT_MS 1000
+// A servo keeps holding its position this long after the last job, then
+// its PWM output is stopped so it stops drawing holding current. Unpowered,
+// the gear train keeps the carousel in place; the next move starts from the
+// last commanded angle.
+#define MOTION_SERVO_HOLD_MS 2000
+
+typedef enum {
+    MOTION_OP_HOME = 0,  // Return a tray to its home position (its first slot)
+    MOTION_OP_FILL,      // Move a slot under the filling opening
+    MOTION_OP_DISPENSE,  // Move a slot over the chute and wait for the drop
+    MOTION_OP_FILL_SWEEP, // Visit several slots for filling in one pass
+    MOTION_OP_DISPENSE_SWEEP, // Dispense from several slots in one pass; an empty slot is
+                              // skipped over, a jam or servo fault ends the pass
+} motion_op_t;
+
+typedef enum {
+    MOTION_JOB_QUEUED = 0,
+    MOTION_JOB_MOVING,
+    MOTION_JOB_SETTLED,
+    MOTION_JOB_FAILED,
+} motion_job_state_t;
+
+// Why a job failed
+typedef enum {
+    MOTION_FAULT_NONE = 0,
+    MOTION_FAULT_SERVO,  // The servo PWM could not be set
+    MOTION_FAULT_JAM,    // No drop in time and the drop sensor beam stayed blocked
+    MOTION_FAULT_EMPTY,  // No drop in time with the beam clear: the slot was empty
+} motion_fault_t;
+
+typedef struct {
+    uint32_t id;
+    motion_op_t op;
+    int tray;       // Tray whose servo runs the job
+    int slot;       // Current (or only) slot of the job
+    int angle;
+    int stops;      // Number of slots the job visits
+    int stops_done; // Stops completed so far; failed stops are not counted
+    bool arrived;   // Set when the job has just finished its stop at `slot`
+    motion_job_state_t state;
+    motion_fault_t fault;  // Set when the job fails: that of its first failed stop, at `slot`
+    uint32_t started_ms;   // Uptime when the job started moving, 0 while queued
+    uint32_t predicted_ms; // Predicted duration from started_ms until settled, from the servo model
+    uint32_t actual_ms;    // Measured duration, set once the job settles or fails
+} motion_job_info_t;
+
+// Called from the motion task whenever a job changes state or reaches a stop
+typedef void (*motion_job_cb_t)(const motion_job_info_t *job);
+
+// Configures the PWM of every tray's servo and starts their motion tasks.
+// Call after tray_init(). If a servo cannot be set up, returns the error
+// before any task has started.
+esp_err_t motion_init(void);
+
+// Queues a move without blocking. Returns ESP_ERR_NO_MEM when the queue is full.
+// job_id may be NULL if the caller does not need to track the job.
+esp_err_t motion_submit(motion_op_t op, int slot, uint32_t *job_id);
+
+// Planner estimate for a multi-slot program, from the current positions.
+// Figures are summed over the trays involved, except the duration: the
+// trays move in parallel, so it is that of the slowest one.
+typedef struct {
+    int count;                  // Distinct slots visited
+    uint8_t order[MAX_SLOTS];   // Planned visiting order, tray by tray
+    int travel_deg;             // Planned travel
+    int naive_travel_deg;       // Travel when visiting in the requested order
+    int reversals;              // Direction reversals of the planned order
+    int naive_reversals;
+    uint32_t predicted_ms;      // Predicted duration of the planned program
+} motion_plan_info_t;
+
+// Queues a motion program (MOTION_OP_FILL_SWEEP or MOTION_OP_DISPENSE_SWEEP)
+// visiting several slots, as one job per tray involved; job_ids needs room
+// for TRAY_MAX_TRAYS ids and *job_count receives how many were queued.
+// Duplicate slots are visited once. The visiting order is planned when a job
+// starts (see motion_plan.h), so it accounts for wherever earlier jobs left
+// the carousel. If a tray's queue is full, the jobs queued so far stand and
+// ESP_ERR_NO_MEM is returned.
+esp_err_t motion_submit_program(motion_op_t op, const int *slots, int count, uint32_t *job_ids, int *job_count);
+
+// Plans a program as if it started now, without queueing it.
+esp_err_t motion_estimate_program(motion_op_t op, const int *slots, int count, motion_plan_info_t *out);
+
+// Copies the current state of a job. Returns false if the id is unknown or
+// has already been evicted from the job history.
+bool motion_get_job(uint32_t job_id, motion_job_info_t *out);
+
+// Number of jobs waiting in the queues of all trays (not counting running ones)
+int motion_queue_depth(void);
+
+// Jobs accepted but not finished yet on one tray, and when the next of them
+// is expected to finish. Used by admission control to size Retry-After.
+typedef struct {
+    int pending;          // Queued plus running
+    uint32_t next_free_ms; // Predicted time until the running job settles, 0 if idle
+} motion_backlog_t;
+
+// Backlog of `tray`, or with tray -1 that of the busiest tray
+void motion_get_backlog(int tray, motion_backlog_t *out);
+
+// Looks for a queued or running single-slot job with the same op and slot
+// that has not yet completed its stop. Returns true and its id if found.
+bool motion_find_pending(motion_op_t op, int slot, uint32_t *job_id);
+
+// Registers a listener for job progress (one listener, set before jobs run)
+void motion_set_job_callback(motion_job_cb_t cb);
+
+const char *motion_op_name(motion_op_t op);
+const char *motion_state_name(motion_job_state_t state);
+const char *motion_fault_name(motion_fault_t fault);
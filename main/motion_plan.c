@@ -0,0 +1,58 @@
+#include <stdlib.h>
+#include "tray.h"
+#include "motion_plan.h"
+
+static int compare_slot_angle(const void *a, const void *b)
+{
+    return tray_slot_angle(*(const uint8_t *)a) - tray_slot_angle(*(const uint8_t *)b);
+}
+
+int motion_plan_order(int start_angle, uint8_t *slots, int count)
+{
+    if (count <= 0) return 0;
+
+    qsort(slots, count, sizeof(slots[0]), compare_slot_angle);
+
+    int low = tray_slot_angle(slots[0]);
+    int high = tray_slot_angle(slots[count - 1]);
+    if (start_angle >= 0 && abs(start_angle - high) < abs(start_angle - low)) {
+        // High end is nearer: sweep downwards
+        for (int i = 0; i < count / 2; i++) {
+            uint8_t tmp = slots[i];
+            slots[i] = slots[count - 1 - i];
+            slots[count - 1 - i] = tmp;
+        }
+    }
+    return motion_plan_travel(start_angle, slots, count);
+}
+
+int motion_plan_travel(int start_angle, const uint8_t *slots, int count)
+{
+    int travel = 0;
+    int angle = start_angle;
+
+    for (int i = 0; i < count; i++) {
+        int target = tray_slot_angle(slots[i]);
+        if (angle >= 0) travel += abs(target - angle);
+        angle = target;
+    }
+    return travel;
+}
+
+int motion_plan_reversals(int start_angle, const uint8_t *slots, int count)
+{
+    int reversals = 0;
+    int angle = start_angle;
+    int dir = 0;
+
+    for (int i = 0; i < count; i++) {
+        int target = tray_slot_angle(slots[i]);
+        if (angle >= 0 && target != angle) {
+            int step_dir = target > angle ? 1 : -1;
+            if (dir != 0 && step_dir != dir) reversals++;
+            dir = step_dir;
+        }
+        angle = target;
+    }
+    return reversals;
+}
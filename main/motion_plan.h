@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// Visit ordering for multi-slot motion programs on one tray. The carousel is
+// a line (0-180 degrees), so the shortest tour from the current angle visits
+// the nearer end of the span first and then sweeps to the other end: at most
+// one direction reversal, and no slot is passed twice. All slots passed in
+// must be on the same tray.
+
+// Reorders `slots` in place into the planned visiting order and returns the
+// planned travel in degrees. A negative start_angle (position unknown)
+// starts from the low end.
+int motion_plan_order(int start_angle, uint8_t *slots, int count);
+
+// Travel in degrees for visiting `slots` in the given order
+int motion_plan_travel(int start_angle, const uint8_t *slots, int count);
+
+// Number of direction reversals when visiting `slots` in the given order
+int motion_plan_reversals(int start_angle, const uint8_t *slots, int count);
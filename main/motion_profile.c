@@ -0,0 +1,83 @@
+#include <math.h>
+#include <stdlib.h>
+#include "motion_profile.h"
+
+const servo_model_t SERVO_MODEL_SG90 = {
+    .name = "SG90",
+    .vmax_dps = 300.0f,
+    .accel_dps2 = 1500.0f,
+    .settle_ms = 80,
+};
+
+const servo_model_t SERVO_MODEL_MG996R = {
+    .name = "MG996R",
+    .vmax_dps = 250.0f,
+    .accel_dps2 = 1200.0f,
+    .settle_ms = 100,
+};
+
+// Profile shape for a move: time spent accelerating, peak velocity reached
+// and time spent cruising at that velocity (all in seconds and degrees).
+typedef struct {
+    float t_accel;
+    float v_peak;
+    float t_cruise;
+} profile_shape_t;
+
+static profile_shape_t profile_shape(const servo_model_t *model, float distance)
+{
+    profile_shape_t shape;
+    float accel_dist = (model->vmax_dps * model->vmax_dps) / (2.0f * model->accel_dps2);
+
+    if (distance >= 2.0f * accel_dist) {
+        // Trapezoid: reaches vmax and cruises
+        shape.t_accel = model->vmax_dps / model->accel_dps2;
+        shape.v_peak = model->vmax_dps;
+        shape.t_cruise = (distance - 2.0f * accel_dist) / model->vmax_dps;
+    } else {
+        // Triangle: too short to reach vmax
+        shape.t_accel = sqrtf(distance / model->accel_dps2);
+        shape.v_peak = model->accel_dps2 * shape.t_accel;
+        shape.t_cruise = 0.0f;
+    }
+    return shape;
+}
+
+uint32_t motion_profile_travel_ms(const servo_model_t *model, int distance)
+{
+    distance = abs(distance);
+    if (distance == 0) return 0;
+
+    profile_shape_t shape = profile_shape(model, (float)distance);
+    return (uint32_t)ceilf((2.0f * shape.t_accel + shape.t_cruise) * 1000.0f);
+}
+
+uint32_t motion_profile_settle_ms(const servo_model_t *model, int distance)
+{
+    return motion_profile_travel_ms(model, distance) + model->settle_ms;
+}
+
+float motion_profile_position(const servo_model_t *model, int distance, uint32_t t_ms)
+{
+    float d = (float)abs(distance);
+    if (d == 0.0f) return 0.0f;
+
+    profile_shape_t shape = profile_shape(model, d);
+    float t = t_ms / 1000.0f;
+    float accel_dist = 0.5f * model->accel_dps2 * shape.t_accel * shape.t_accel;
+    float pos;
+
+    if (t <= shape.t_accel) {
+        pos = 0.5f * model->accel_dps2 * t * t;
+    } else if (t <= shape.t_accel + shape.t_cruise) {
+        pos = accel_dist + shape.v_peak * (t - shape.t_accel);
+    } else {
+        float t_left = 2.0f * shape.t_accel + shape.t_cruise - t;
+        if (t_left < 0.0f) t_left = 0.0f;
+        pos = d - 0.5f * model->accel_dps2 * t_left * t_left;
+    }
+
+    if (pos < 0.0f) pos = 0.0f;
+    if (pos > d) pos = d;
+    return pos;
+}
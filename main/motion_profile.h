@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Kinematic model of one servo type, as loaded by the carousel. The values
+// are deliberately below the datasheet no-load figures.
+typedef struct {
+    const char *name;
+    float vmax_dps;     // Maximum angular velocity (degrees/s)
+    float accel_dps2;   // Acceleration and deceleration (degrees/s^2)
+    uint32_t settle_ms; // Extra wait after the profile ends for the horn to stop ringing
+} servo_model_t;
+
+// SG90 micro servo (datasheet 0.1 s/60 degrees at 4.8 V)
+extern const servo_model_t SERVO_MODEL_SG90;
+// MG996R metal-gear servo (datasheet 0.17 s/60 degrees at 4.8 V)
+extern const servo_model_t SERVO_MODEL_MG996R;
+
+// Largest possible move, used when the starting angle is unknown (first move after boot)
+#define MOTION_PROFILE_FULL_RANGE 180
+
+// Travel time of a trapezoidal (or, for short moves, triangular) velocity
+// profile over `distance` degrees, without the settle margin.
+uint32_t motion_profile_travel_ms(const servo_model_t *model, int distance);
+
+// Travel time plus the settle margin: how long until the servo is at rest.
+uint32_t motion_profile_settle_ms(const servo_model_t *model, int distance);
+
+// Distance covered `t_ms` into the profile for a move of `distance` degrees,
+// clamped to [0, distance].
+float motion_profile_position(const servo_model_t *model, int distance, uint32_t t_ms);
@@ -0,0 +1,601 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_mac.h"
+#include "mqtt_client.h"
+#include "nvs.h"
+#include "cJSON.h"
+#include "ashumitra.h"
+#include "dedup.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "mqtt_bridge.h"
+#include "slot_state.h"
+#include "task_plan.h"
+#include "trace.h"
+#include "tray.h"
+
+#define MQTT_BRIDGE_TASK_STACK 4096
+#define MQTT_BRIDGE_RECONNECT_MS 5000
+#define MQTT_CMD_MAX_BODY      512
+#define MQTT_MIN_TIME          1577836800 // Event times before 2020 mean the clock is not set
+
+#define NVS_NAMESPACE "pill_disp"
+#define NVS_KEY_MQTT_URI "mqtt_uri"
+
+static const char *TAG = "ASHUMITRA_MQTT";
+
+static const char *ONLINE_MSG = "{\"online\":true}";
+static const char *OFFLINE_MSG = "{\"online\":false}";
+
+typedef enum {
+    BRIDGE_EVENT_DISPENSED = 0,
+    BRIDGE_EVENT_FAULT,
+} bridge_event_type_t;
+
+typedef struct {
+    uint8_t type;   // bridge_event_type_t
+    uint8_t slot;
+    uint8_t fault;  // motion_fault_t of a BRIDGE_EVENT_FAULT
+    uint32_t job;
+    uint32_t time;  // Unix time, 0 if the wall time was not known yet
+} bridge_event_t;
+
+static uint32_t s_boot_epoch = 0;
+static mqtt_bridge_cmd_fn_t s_cmd_fn = NULL;
+static TaskHandle_t s_task = NULL;
+static char s_device_id[13];   // Station MAC in hex
+static char s_topic_base[32];  // "ashumitra/<device id>"
+
+// Client lifecycle and the publishing side, taken by the bridge task and by
+// configuration changes. The client's own task never takes it.
+static SemaphoreHandle_t s_client_lock = NULL;
+static esp_mqtt_client_handle_t s_client = NULL;
+static char s_uri[MQTT_BRIDGE_URI_MAX];
+static bool s_network_up = false;
+static uint32_t s_state_sent_gen = 0; // Generation of the last state published, 0 before the first
+
+// Event queue, connection flags and counters
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static bridge_event_t s_events[MQTT_BRIDGE_EVENT_QUEUE];
+static int s_event_head = 0;
+static int s_event_count = 0;
+static bool s_resend_state = false; // Connected since the last state publish
+static mqtt_bridge_stats_t s_stats;
+
+// Only touched by the bridge task, under s_client_lock
+static char s_publish_buf[1280];
+
+static void build_topic(char *out, size_t size, const char *leaf)
+{
+    snprintf(out, size, "%s/%s", s_topic_base, leaf);
+}
+
+static void count_publish_error(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.publish_errors++;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+static bool is_connected(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    bool connected = s_stats.connected;
+    taskEXIT_CRITICAL(&s_lock);
+    return connected;
+}
+
+static void wake_task(void)
+{
+    if (s_task) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+// --- Commands ---
+static const char *parse_item(const cJSON *obj, bool dispense_ok, mqtt_cmd_item_t *item)
+{
+    const char *op = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "op"));
+    const cJSON *slot = cJSON_GetObjectItem(obj, "slot");
+    if (!op) return "missing op";
+    if (dispense_ok && strcmp(op, "dispense") == 0) {
+        item->op = MQTT_CMD_DISPENSE;
+    } else if (strcmp(op, "add") == 0) {
+        item->op = MQTT_CMD_ADD;
+    } else if (strcmp(op, "remove") == 0) {
+        item->op = MQTT_CMD_REMOVE;
+    } else {
+        return "unknown op";
+    }
+    if (!cJSON_IsNumber(slot) || slot->valueint < 0 || slot->valueint >= tray_slot_count()) {
+        return "invalid slot";
+    }
+    item->slot = slot->valueint;
+    return NULL;
+}
+
+// Replay cache key of a command: its op, and its slot unless it is a
+// schedule of several ops
+static dedup_cmd_t dedup_key(const mqtt_cmd_item_t *items, int count, int *slot)
+{
+    *slot = count == 1 ? items[0].slot : -1;
+    switch (items[0].op) {
+    case MQTT_CMD_DISPENSE: return DEDUP_CMD_DISPENSE;
+    case MQTT_CMD_REMOVE:   return DEDUP_CMD_REMOVE;
+    default:                return DEDUP_CMD_ADD;
+    }
+}
+
+// Parses and runs one command, then answers on cmd/result. A command with a
+// req ID is run once: the broker redelivers QoS 1 messages it saw no ack
+// for, and a redelivery gets the stored outcome back, as HTTP retries do.
+static void handle_command(esp_mqtt_client_handle_t client, const char *data, int len)
+{
+    char body[MQTT_CMD_MAX_BODY];
+    char req_id[DEDUP_ID_MAX + 1] = "";
+    mqtt_cmd_item_t items[MAX_SLOTS];
+    int count = 0;
+    uint32_t job_id = 0;
+    bool replayed = false;
+    const char *error = NULL;
+
+    cJSON *root = NULL;
+    if (len <= 0 || len >= (int)sizeof(body)) {
+        error = "command too large";
+    } else {
+        memcpy(body, data, len);
+        body[len] = '\0';
+        root = cJSON_Parse(body);
+        if (!cJSON_IsObject(root)) error = "malformed command";
+    }
+
+    if (!error) {
+        const char *req = cJSON_GetStringValue(cJSON_GetObjectItem(root, "req"));
+        if (req) {
+            snprintf(req_id, sizeof(req_id), "%s", req);
+            if (!dedup_id_valid(req)) error = "invalid req";
+        }
+        const char *op = cJSON_GetStringValue(cJSON_GetObjectItem(root, "op"));
+        if (op && strcmp(op, "schedule") == 0) {
+            const cJSON *ops = cJSON_GetObjectItem(root, "ops");
+            const cJSON *item;
+            if (!cJSON_IsArray(ops) || cJSON_GetArraySize(ops) == 0) {
+                error = "expected an ops array";
+            } else if (cJSON_GetArraySize(ops) > MAX_SLOTS) {
+                error = "too many ops";
+            } else {
+                cJSON_ArrayForEach(item, ops) {
+                    if (!error) error = parse_item(item, false, &items[count++]);
+                }
+            }
+        } else if (!error) {
+            error = parse_item(root, true, &items[count++]);
+        }
+    }
+    cJSON_Delete(root);
+
+    int dedup_slot = -1;
+    dedup_cmd_t dedup_cmd = error ? DEDUP_CMD_ADD : dedup_key(items, count, &dedup_slot);
+    if (!error && req_id[0] != '\0') {
+        dedup_outcome_t outcome;
+        switch (dedup_lookup(req_id, dedup_cmd, dedup_slot, &outcome)) {
+        case DEDUP_HIT:
+            replayed = true;
+            job_id = outcome.job_id;
+            break;
+        case DEDUP_CONFLICT:
+            error = "req already used for a different command";
+            break;
+        default:
+            break;
+        }
+    }
+    if (!error && !replayed) {
+        error = s_cmd_fn ? s_cmd_fn(items, count, &job_id) : "commands not supported";
+        if (!error && req_id[0] != '\0') {
+            dedup_outcome_t outcome = { .job_id = job_id };
+            snprintf(outcome.body, sizeof(outcome.body), "OK");
+            dedup_store(req_id, dedup_cmd, dedup_slot, &outcome);
+        }
+    }
+
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.commands++;
+    if (error) s_stats.command_errors++;
+    taskEXIT_CRITICAL(&s_lock);
+    if (error) {
+        ESP_LOGW(TAG, "Command %s refused: %s", req_id, error);
+    } else {
+        ESP_LOGI(TAG, "Command %s %s (job %" PRIu32 ")", req_id, replayed ? "replayed" : "done", job_id);
+    }
+
+    char topic[48];
+    char resp[128];
+    json_writer_t w;
+    json_writer_init(&w, resp, sizeof(resp), NULL, NULL);
+    json_obj_begin(&w);
+    json_kv_str(&w, "req", req_id);
+    json_kv_bool(&w, "ok", error == NULL);
+    if (error) {
+        json_kv_str(&w, "error", error);
+    } else if (job_id) {
+        json_kv_uint(&w, "job", job_id);
+    }
+    if (replayed) {
+        json_kv_bool(&w, "replayed", true);
+    }
+    json_obj_end(&w);
+    build_topic(topic, sizeof(topic), "cmd/result");
+    if (json_writer_finish(&w) != ESP_OK || esp_mqtt_client_publish(client, topic, resp, w.len, 1, 0) < 0) {
+        count_publish_error();
+    }
+}
+
+// Runs on the MQTT client task
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = event_data;
+    char topic[48];
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "Connected to the broker as %s", s_topic_base);
+        taskENTER_CRITICAL(&s_lock);
+        s_stats.connected = true;
+        s_stats.connects++;
+        s_resend_state = true; // The broker may have lost it, or it is from a previous boot
+        taskEXIT_CRITICAL(&s_lock);
+
+        build_topic(topic, sizeof(topic), "status");
+        if (esp_mqtt_client_publish(event->client, topic, ONLINE_MSG, 0, 1, 1) < 0) count_publish_error();
+        build_topic(topic, sizeof(topic), "cmd");
+        esp_mqtt_client_subscribe(event->client, topic, 1);
+        wake_task();
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        taskENTER_CRITICAL(&s_lock);
+        bool was_connected = s_stats.connected;
+        s_stats.connected = false;
+        taskEXIT_CRITICAL(&s_lock);
+        if (was_connected) {
+            ESP_LOGW(TAG, "Disconnected from the broker");
+        }
+        break;
+    case MQTT_EVENT_DATA:
+        build_topic(topic, sizeof(topic), "cmd");
+        if (event->topic_len == (int)strlen(topic) && memcmp(event->topic, topic, event->topic_len) == 0) {
+            // A command split over several DATA events is too large anyway
+            handle_command(event->client, event->data,
+                           event->data_len == event->total_data_len ? event->data_len : -1);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// --- Publishing ---
+static void publish_state_locked(void)
+{
+    slot_snapshot_t snap;
+    slot_state_read(&snap);
+
+    taskENTER_CRITICAL(&s_lock);
+    bool resend = s_resend_state;
+    s_resend_state = false;
+    taskEXIT_CRITICAL(&s_lock);
+    if (snap.generation == s_state_sent_gen && !resend) {
+        return; // Already published; the burst settled back on it
+    }
+
+    char epoch[12];
+    char topic[48];
+    snprintf(epoch, sizeof(epoch), "%08" PRIx32, s_boot_epoch);
+    json_writer_t w;
+    json_writer_init(&w, s_publish_buf, sizeof(s_publish_buf), NULL, NULL);
+    json_obj_begin(&w);
+    json_kv_str(&w, "epoch", epoch);
+    json_kv_uint(&w, "gen", snap.generation);
+    json_kv_uint(&w, "mask", slot_snapshot_mask(&snap));
+    json_key(&w, "slots");
+    json_arr_begin(&w);
+    for (int i = 0; i < tray_slot_count(); i++) {
+        if (snap.filled[i]) json_int(&w, i);
+    }
+    json_arr_end(&w);
+    json_obj_end(&w);
+
+    build_topic(topic, sizeof(topic), "state");
+    if (json_writer_finish(&w) != ESP_OK || esp_mqtt_client_publish(s_client, topic, s_publish_buf, w.len, 1, 1) < 0) {
+        count_publish_error();
+        taskENTER_CRITICAL(&s_lock);
+        s_resend_state = true;
+        taskEXIT_CRITICAL(&s_lock);
+        return;
+    }
+
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.state_published++;
+    if (s_state_sent_gen != 0 && snap.generation > s_state_sent_gen + 1) {
+        s_stats.state_coalesced += snap.generation - s_state_sent_gen - 1;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    s_state_sent_gen = snap.generation;
+}
+
+static void publish_events_locked(void)
+{
+    bridge_event_t events[MQTT_BRIDGE_EVENT_QUEUE];
+
+    taskENTER_CRITICAL(&s_lock);
+    int count = s_event_count;
+    for (int i = 0; i < count; i++) {
+        events[i] = s_events[(s_event_head + i) % MQTT_BRIDGE_EVENT_QUEUE];
+    }
+    s_event_head = 0;
+    s_event_count = 0;
+    taskEXIT_CRITICAL(&s_lock);
+    if (count == 0) return;
+
+    char topic[48];
+    json_writer_t w;
+    json_writer_init(&w, s_publish_buf, sizeof(s_publish_buf), NULL, NULL);
+    json_arr_begin(&w);
+    for (int i = 0; i < count; i++) {
+        json_obj_begin(&w);
+        json_kv_str(&w, "t", events[i].type == BRIDGE_EVENT_DISPENSED ? "dispensed" : "fault");
+        json_kv_uint(&w, "job", events[i].job);
+        json_kv_int(&w, "slot", events[i].slot);
+        if (events[i].type == BRIDGE_EVENT_FAULT) json_kv_str(&w, "reason", motion_fault_name(events[i].fault));
+        if (events[i].time) json_kv_uint(&w, "ts", events[i].time);
+        json_obj_end(&w);
+    }
+    json_arr_end(&w);
+
+    build_topic(topic, sizeof(topic), "event");
+    bool sent = json_writer_finish(&w) == ESP_OK &&
+                esp_mqtt_client_publish(s_client, topic, s_publish_buf, w.len, 1, 0) >= 0;
+    taskENTER_CRITICAL(&s_lock);
+    if (sent) {
+        s_stats.events_published += count;
+    } else {
+        s_stats.publish_errors++;
+        s_stats.events_dropped += count;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+static void mqtt_bridge_task(void *arg)
+{
+    for (;;) {
+        uint32_t wait_started_us = trace_task_wait();
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        trace_task_run(wait_started_us);
+        // Let the rest of a burst arrive; everything up to now goes out in one pass
+        vTaskDelay(pdMS_TO_TICKS(MQTT_BRIDGE_BATCH_MS));
+
+        xSemaphoreTake(s_client_lock, portMAX_DELAY);
+        if (s_client && is_connected()) {
+            publish_state_locked();
+            publish_events_locked();
+        }
+        xSemaphoreGive(s_client_lock);
+    }
+}
+
+// --- Client Lifecycle ---
+static void start_client_locked(void)
+{
+    if (s_client || s_uri[0] == '\0' || !s_network_up) return;
+
+    char client_id[32];
+    char will_topic[48];
+    snprintf(client_id, sizeof(client_id), "ashumitra-%s", s_device_id);
+    build_topic(will_topic, sizeof(will_topic), "status");
+    esp_mqtt_client_config_t config = {
+        .broker.address.uri = s_uri,
+        .credentials.client_id = client_id,
+        .session.last_will = {
+            .topic = will_topic,
+            .msg = OFFLINE_MSG,
+            .qos = 1,
+            .retain = 1,
+        },
+        .session.keepalive = MQTT_BRIDGE_KEEPALIVE_S,
+        .network.reconnect_timeout_ms = MQTT_BRIDGE_RECONNECT_MS,
+    };
+    s_client = esp_mqtt_client_init(&config);
+    if (!s_client) {
+        ESP_LOGE(TAG, "Invalid broker URI \"%s\"", s_uri);
+        return;
+    }
+    esp_mqtt_client_register_event(s_client, MQTT_EVENT_ANY, mqtt_event_handler, NULL);
+    esp_err_t err = esp_mqtt_client_start(s_client);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) starting the MQTT client", esp_err_to_name(err));
+        esp_mqtt_client_destroy(s_client);
+        s_client = NULL;
+        return;
+    }
+    ESP_LOGI(TAG, "Publishing to %s under %s", s_uri, s_topic_base);
+}
+
+static void stop_client_locked(void)
+{
+    if (!s_client) return;
+    if (is_connected()) {
+        // A clean disconnect does not fire the last will
+        char topic[48];
+        build_topic(topic, sizeof(topic), "status");
+        esp_mqtt_client_publish(s_client, topic, OFFLINE_MSG, 0, 1, 1);
+    }
+    esp_mqtt_client_stop(s_client);
+    esp_mqtt_client_destroy(s_client);
+    s_client = NULL;
+
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.connected = false;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+// --- Public API ---
+esp_err_t mqtt_bridge_init(uint32_t boot_epoch, mqtt_bridge_cmd_fn_t cmd_fn)
+{
+    s_boot_epoch = boot_epoch;
+    s_cmd_fn = cmd_fn;
+
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(s_device_id, sizeof(s_device_id), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    snprintf(s_topic_base, sizeof(s_topic_base), "ashumitra/%s", s_device_id);
+
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) == ESP_OK) {
+        size_t size = sizeof(s_uri);
+        if (nvs_get_str(nvs_handle, NVS_KEY_MQTT_URI, s_uri, &size) != ESP_OK) {
+            s_uri[0] = '\0';
+        }
+        nvs_close(nvs_handle);
+    }
+    s_stats.enabled = s_uri[0] != '\0';
+
+    s_client_lock = xSemaphoreCreateMutex();
+    if (!s_client_lock) {
+        ESP_LOGE(TAG, "Failed to create MQTT mutex!");
+        return ESP_ERR_NO_MEM;
+    }
+    // With persistence and history: dashboards can wait a moment
+    if (xTaskCreatePinnedToCore(mqtt_bridge_task, "mqtt_bridge", MQTT_BRIDGE_TASK_STACK, NULL, TASK_PLAN_STORAGE_PRIO, &s_task,
+                                TASK_PLAN_STORAGE_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create MQTT bridge task!");
+        return ESP_FAIL;
+    }
+    metrics_register_task(s_task, MQTT_BRIDGE_TASK_STACK);
+
+    if (s_stats.enabled) {
+        ESP_LOGI(TAG, "MQTT broker %s, device id %s", s_uri, s_device_id);
+    } else {
+        ESP_LOGI(TAG, "MQTT disabled (no broker configured), device id %s", s_device_id);
+    }
+    return ESP_OK;
+}
+
+void mqtt_bridge_start(void)
+{
+    if (!s_client_lock) return;
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    s_network_up = true;
+    start_client_locked();
+    xSemaphoreGive(s_client_lock);
+}
+
+esp_err_t mqtt_bridge_set_uri(const char *uri)
+{
+    if (!s_client_lock) return ESP_ERR_INVALID_STATE;
+    if (strlen(uri) >= sizeof(s_uri)) return ESP_ERR_INVALID_SIZE;
+    if (uri[0] != '\0' && strncmp(uri, "mqtt://", 7) != 0 && strncmp(uri, "mqtts://", 8) != 0 &&
+        strncmp(uri, "ws://", 5) != 0 && strncmp(uri, "wss://", 6) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        err = uri[0] != '\0' ? nvs_set_str(nvs_handle, NVS_KEY_MQTT_URI, uri) : nvs_erase_key(nvs_handle, NVS_KEY_MQTT_URI);
+        if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK; // Already disabled
+        if (err == ESP_OK) err = nvs_commit(nvs_handle);
+        nvs_close(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) saving the broker URI", esp_err_to_name(err));
+        return err;
+    }
+
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    stop_client_locked();
+    snprintf(s_uri, sizeof(s_uri), "%s", uri);
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.enabled = s_uri[0] != '\0';
+    s_event_count = 0; // Events from before the change would go to the wrong place
+    taskEXIT_CRITICAL(&s_lock);
+    start_client_locked();
+    xSemaphoreGive(s_client_lock);
+
+    ESP_LOGI(TAG, "MQTT %s%s", uri[0] ? "broker set to " : "disabled", uri);
+    return ESP_OK;
+}
+
+void mqtt_bridge_get_uri(char *out, size_t size)
+{
+    if (!s_client_lock) {
+        snprintf(out, size, "%s", "");
+        return;
+    }
+    xSemaphoreTake(s_client_lock, portMAX_DELAY);
+    snprintf(out, size, "%s", s_uri);
+    xSemaphoreGive(s_client_lock);
+}
+
+const char *mqtt_bridge_device_id(void)
+{
+    return s_device_id;
+}
+
+void mqtt_bridge_state_changed(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    bool connected = s_stats.connected;
+    taskEXIT_CRITICAL(&s_lock);
+    // While offline the change is picked up by the full publish on connect
+    if (connected) {
+        wake_task();
+    }
+}
+
+void mqtt_bridge_job_update(const motion_job_info_t *job)
+{
+    bridge_event_t event = { .slot = (uint8_t)job->slot, .job = job->id };
+    if ((job->op == MOTION_OP_DISPENSE || job->op == MOTION_OP_DISPENSE_SWEEP) &&
+        job->state == MOTION_JOB_MOVING && job->arrived) {
+        event.type = BRIDGE_EVENT_DISPENSED;
+    } else if (job->state == MOTION_JOB_FAILED) {
+        event.type = BRIDGE_EVENT_FAULT;
+        event.fault = (uint8_t)job->fault;
+    } else {
+        return;
+    }
+    time_t now = time(NULL);
+    event.time = now >= MQTT_MIN_TIME ? (uint32_t)now : 0;
+
+    taskENTER_CRITICAL(&s_lock);
+    bool queued = s_stats.enabled;
+    if (queued) {
+        if (s_event_count == MQTT_BRIDGE_EVENT_QUEUE) {
+            s_event_head = (s_event_head + 1) % MQTT_BRIDGE_EVENT_QUEUE; // Drop the oldest
+            s_event_count--;
+            s_stats.events_dropped++;
+        }
+        s_events[(s_event_head + s_event_count) % MQTT_BRIDGE_EVENT_QUEUE] = event;
+        s_event_count++;
+    }
+    bool connected = s_stats.connected;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (queued && connected) {
+        wake_task();
+    }
+}
+
+void mqtt_bridge_get_stats(mqtt_bridge_stats_t *out)
+{
+    taskENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    taskEXIT_CRITICAL(&s_lock);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "motion.h"
+
+// Optional MQTT publisher, so a facility dashboard can follow hundreds of
+// dispensers through one broker instead of polling each of them. Disabled
+// until a broker URI is configured (POST /mqtt, saved in NVS).
+//
+// Topics, under ashumitra/<device id> (the station MAC in hex):
+//   status      retained  {"online":true}, {"online":false} as the last will
+//   state       retained  {"epoch":"1a2b3c4d","gen":12,"mask":37,"slots":[0,2,5]}
+//   event                 [{"t":"dispensed","job":7,"slot":2,"ts":1700000000}, ...]
+//                         {"t":"fault","job":8,"slot":3,"reason":"jam"} (see motion_fault_name())
+//   cmd         (subscribed) {"op":"dispense","slot":2,"req":"abc"}
+//                         {"op":"schedule","ops":[{"op":"add","slot":0}],"req":"abc"}
+//                         ("add" and "remove" also work as one-op schedules)
+//   cmd/result            {"req":"abc","ok":true,"job":7} or {"req":"abc","ok":false,"error":"..."}
+//                         ("replayed":true when req was already carried out, see dedup.h)
+//
+// Publishing is batched: a change wakes the bridge task, which waits
+// MQTT_BRIDGE_BATCH_MS for more and then publishes the state once for the
+// whole burst, only if its (epoch, generation) differs from the last one
+// sent. Events are queued and go out together as one array.
+#define MQTT_BRIDGE_URI_MAX     128
+#define MQTT_BRIDGE_BATCH_MS    250
+#define MQTT_BRIDGE_EVENT_QUEUE 16  // Events held while offline; the oldest is dropped first
+#define MQTT_BRIDGE_KEEPALIVE_S 30
+
+typedef enum {
+    MQTT_CMD_DISPENSE = 0,
+    MQTT_CMD_ADD,
+    MQTT_CMD_REMOVE,
+} mqtt_cmd_op_t;
+
+typedef struct {
+    mqtt_cmd_op_t op;
+    int slot;
+} mqtt_cmd_item_t;
+
+// Carries out a command on the MQTT client task: one MQTT_CMD_DISPENSE, or
+// one or more MQTT_CMD_ADD / MQTT_CMD_REMOVE applied as one batch. Returns
+// NULL on success (with *job_id the motion job, 0 if none) or the reason
+// the command was refused. Must not block.
+typedef const char *(*mqtt_bridge_cmd_fn_t)(const mqtt_cmd_item_t *items, int count, uint32_t *job_id);
+
+typedef struct {
+    bool enabled;              // A broker URI is configured
+    bool connected;
+    uint32_t connects;
+    uint32_t state_published;  // Retained state messages sent
+    uint32_t state_coalesced;  // State generations folded into a later publish
+    uint32_t events_published; // Events sent (several per message when batched)
+    uint32_t events_dropped;   // Events lost while the queue was full
+    uint32_t commands;         // Commands received on the cmd topic
+    uint32_t command_errors;   // Commands refused or malformed
+    uint32_t publish_errors;
+} mqtt_bridge_stats_t;
+
+// Loads the broker URI from NVS and starts the bridge task. `boot_epoch`
+// goes into the state messages (same value as in the HTTP ETags) so a
+// subscriber can tell a reboot from a stale generation.
+esp_err_t mqtt_bridge_init(uint32_t boot_epoch, mqtt_bridge_cmd_fn_t cmd_fn);
+
+// Connects to the broker once the network is up (call on every network-up
+// event; the client reconnects on its own after the first start)
+void mqtt_bridge_start(void);
+
+// Saves a new broker URI ("" disables MQTT) and restarts the client
+esp_err_t mqtt_bridge_set_uri(const char *uri);
+
+// Copies the configured broker URI (empty when disabled)
+void mqtt_bridge_get_uri(char *out, size_t size);
+
+// Device id used in the topics
+const char *mqtt_bridge_device_id(void);
+
+// Call after every published slot-state change. Never blocks.
+void mqtt_bridge_state_changed(void);
+
+// Queues the dispense and fault events of a motion job update (chain it into
+// the motion job callback)
+void mqtt_bridge_job_update(const motion_job_info_t *job);
+
+void mqtt_bridge_get_stats(mqtt_bridge_stats_t *out);
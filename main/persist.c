@@ -0,0 +1,155 @@
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "persist.h"
+#include "task_plan.h"
+#include "trace.h"
+
+#define PERSIST_TASK_STACK 4096
+
+static const char *TAG = "ASHUMITRA_PERSIST";
+
+static persist_write_fn_t s_write_fn = NULL;
+static size_t s_record_size = 0;
+static TaskHandle_t s_persist_task = NULL;
+static SemaphoreHandle_t s_write_lock = NULL;  // Serializes the task and the shutdown flush
+
+// Dirty flag and counters, guarded by a spinlock so marking never blocks
+static portMUX_TYPE s_state_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_dirty = false;
+static uint32_t s_pending_marks = 0; // Marks folded into the next commit
+static persist_stats_t s_stats;
+
+// Writes the state if it is dirty. Caller must hold s_write_lock.
+static esp_err_t persist_write_locked(void)
+{
+    taskENTER_CRITICAL(&s_state_lock);
+    bool dirty = s_dirty;
+    uint32_t pending = s_pending_marks;
+    s_dirty = false; // Changes made during the write will mark it dirty again
+    s_pending_marks = 0;
+    taskEXIT_CRITICAL(&s_state_lock);
+
+    if (!dirty) return ESP_OK;
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = s_write_fn();
+    metrics_hist_observe(&metrics_nvs_commit, (uint32_t)(esp_timer_get_time() - start));
+
+    taskENTER_CRITICAL(&s_state_lock);
+    if (err == ESP_OK) {
+        s_stats.commits++;
+        s_stats.bytes_written += s_record_size;
+        if (pending > 1) s_stats.commits_avoided += pending - 1;
+    } else {
+        // Keep the change pending; the task retries it after PERSIST_RETRY_MS
+        s_stats.failures++;
+        s_dirty = true;
+        s_pending_marks += pending;
+    }
+    taskEXIT_CRITICAL(&s_state_lock);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Committed state (%" PRIu32 " changes in this commit)", pending);
+    } else {
+        ESP_LOGE(TAG, "Error (%s) committing state, will retry", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static void persist_task(void *arg)
+{
+    TickType_t idle_wait = portMAX_DELAY;
+
+    for (;;) {
+        // Sleep until the first change arrives, or until a failed write is due again
+        uint32_t wait_started_us = trace_task_wait();
+        bool changed = ulTaskNotifyTake(pdTRUE, idle_wait) != 0;
+        trace_task_run(wait_started_us);
+
+        if (changed) {
+            // Keep extending the window while changes keep arriving, up to the max delay
+            TickType_t first_change = xTaskGetTickCount();
+            for (;;) {
+                TickType_t elapsed = xTaskGetTickCount() - first_change;
+                if (elapsed >= pdMS_TO_TICKS(PERSIST_MAX_DELAY_MS)) break;
+                TickType_t wait = pdMS_TO_TICKS(PERSIST_MAX_DELAY_MS) - elapsed;
+                if (wait > pdMS_TO_TICKS(PERSIST_DEBOUNCE_MS)) wait = pdMS_TO_TICKS(PERSIST_DEBOUNCE_MS);
+                if (ulTaskNotifyTake(pdTRUE, wait) == 0) break; // Quiet for a full window
+            }
+        }
+
+        xSemaphoreTake(s_write_lock, portMAX_DELAY);
+        esp_err_t err = persist_write_locked();
+        xSemaphoreGive(s_write_lock);
+
+        // A failed write stays dirty; retry it even if no further change comes
+        idle_wait = err == ESP_OK ? portMAX_DELAY : pdMS_TO_TICKS(PERSIST_RETRY_MS);
+    }
+}
+
+// Runs from esp_restart() so a pending change is not lost on a software reset.
+// A brownout reset skips shutdown handlers (and flash writes would be unsafe
+// at that point anyway); PERSIST_MAX_DELAY_MS bounds what can be lost there.
+static void persist_shutdown_handler(void)
+{
+    if (s_write_lock && xSemaphoreTake(s_write_lock, pdMS_TO_TICKS(500)) == pdTRUE) {
+        persist_write_locked();
+        xSemaphoreGive(s_write_lock);
+    }
+}
+
+esp_err_t persist_init(persist_write_fn_t write_fn, size_t record_size)
+{
+    s_write_fn = write_fn;
+    s_record_size = record_size;
+
+    s_write_lock = xSemaphoreCreateMutex();
+    if (!s_write_lock) {
+        ESP_LOGE(TAG, "Failed to create persistence lock!");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreatePinnedToCore(persist_task, "persist", PERSIST_TASK_STACK, NULL, TASK_PLAN_STORAGE_PRIO, &s_persist_task,
+                                TASK_PLAN_STORAGE_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create persistence task!");
+        return ESP_FAIL;
+    }
+    metrics_register_task(s_persist_task, PERSIST_TASK_STACK);
+
+    esp_err_t err = esp_register_shutdown_handler(persist_shutdown_handler);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error (%s) registering shutdown flush", esp_err_to_name(err));
+    }
+    ESP_LOGI(TAG, "Write-behind persistence started (debounce %d ms, max delay %d ms)",
+             PERSIST_DEBOUNCE_MS, PERSIST_MAX_DELAY_MS);
+    return ESP_OK;
+}
+
+void persist_mark_dirty(void)
+{
+    taskENTER_CRITICAL(&s_state_lock);
+    s_dirty = true;
+    s_pending_marks++;
+    s_stats.marks++;
+    taskEXIT_CRITICAL(&s_state_lock);
+
+    if (s_persist_task) {
+        xTaskNotifyGive(s_persist_task);
+    }
+}
+
+void persist_get_stats(persist_stats_t *out)
+{
+    taskENTER_CRITICAL(&s_state_lock);
+    *out = s_stats;
+    out->dirty = s_dirty;
+    taskEXIT_CRITICAL(&s_state_lock);
+}
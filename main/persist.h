@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+// Quiet time after the last change before the state is committed. A burst of
+// edits (e.g. a caregiver filling a whole week) ends up as a single commit.
+#define PERSIST_DEBOUNCE_MS  1500
+// Upper bound on how long a change may stay unsaved while edits keep coming
+#define PERSIST_MAX_DELAY_MS 10000
+// Time before a failed commit is tried again
+#define PERSIST_RETRY_MS     5000
+
+// Callback that writes the current state to NVS and commits it
+typedef esp_err_t (*persist_write_fn_t)(void);
+
+typedef struct {
+    uint32_t marks;           // Number of persist_mark_dirty() calls
+    uint32_t commits;         // Successful NVS commits
+    uint32_t commits_avoided; // Changes that were folded into another commit
+    uint32_t failures;        // Failed write attempts (retried after PERSIST_RETRY_MS)
+    uint32_t bytes_written;   // Payload bytes handed to NVS
+    bool dirty;               // A change is waiting to be committed
+} persist_stats_t;
+
+// Starts the write-behind task and registers the shutdown flush.
+// record_size is the payload size of one write, used for the byte counter.
+esp_err_t persist_init(persist_write_fn_t write_fn, size_t record_size);
+
+// Records that the state changed. Never blocks and never touches flash.
+void persist_mark_dirty(void);
+
+void persist_get_stats(persist_stats_t *out);
@@ -0,0 +1,167 @@
+#include <stdatomic.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "power.h"
+
+static const char *TAG = "ASHUMITRA_POWER";
+
+static power_config_t s_config;
+static esp_pm_lock_handle_t s_active_lock = NULL; // Held while active: max clock, no light sleep
+static esp_timer_handle_t s_idle_timer = NULL;
+static SemaphoreHandle_t s_transition_lock = NULL; // Serializes idle/wake transitions
+
+// Read on every request, so kept lock-free
+static atomic_bool s_idle;
+static atomic_int s_holds;
+static atomic_int_fast64_t s_last_activity_us;
+
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static power_stats_t s_stats;
+static int64_t s_idle_since_us = 0;
+
+static void set_wifi_ps(wifi_ps_type_t type)
+{
+    // Fails harmlessly before Wi-Fi is started; wifi_mgr_start() starts it with power save off
+    esp_err_t err = esp_wifi_set_ps(type);
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, "Error (%s) setting Wi-Fi power save", esp_err_to_name(err));
+    }
+}
+
+// Arms the idle check for when the current quiet period would run out
+static void arm_idle_timer(uint32_t delay_ms)
+{
+    esp_timer_stop(s_idle_timer);
+    esp_timer_start_once(s_idle_timer, (uint64_t)delay_ms * 1000);
+}
+
+static void idle_timer_cb(void *arg)
+{
+    (void)arg;
+    xSemaphoreTake(s_transition_lock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    int64_t quiet_ms = (now - atomic_load(&s_last_activity_us)) / 1000;
+    if (atomic_load(&s_idle)) {
+        // Already idle, a late callback
+    } else if (atomic_load(&s_holds) > 0) {
+        arm_idle_timer(s_config.idle_ms); // power_release() restarts the countdown anyway
+    } else if (quiet_ms < s_config.idle_ms) {
+        arm_idle_timer(s_config.idle_ms - (uint32_t)quiet_ms);
+    } else {
+        set_wifi_ps(WIFI_PS_MAX_MODEM);
+        if (s_active_lock) esp_pm_lock_release(s_active_lock);
+        taskENTER_CRITICAL(&s_stats_lock);
+        atomic_store(&s_idle, true);
+        s_stats.idle_entries++;
+        s_idle_since_us = now;
+        taskEXIT_CRITICAL(&s_stats_lock);
+        ESP_LOGI(TAG, "Idle after %" PRIu32 " ms: modem sleep%s", (uint32_t)quiet_ms,
+                 s_active_lock ? (s_config.light_sleep ? ", DFS and light sleep" : " and DFS") : "");
+    }
+    xSemaphoreGive(s_transition_lock);
+}
+
+static void wake(void)
+{
+    xSemaphoreTake(s_transition_lock, portMAX_DELAY);
+    if (atomic_load(&s_idle)) {
+        int64_t start = esp_timer_get_time();
+        if (s_active_lock) esp_pm_lock_acquire(s_active_lock);
+        set_wifi_ps(WIFI_PS_NONE);
+        arm_idle_timer(s_config.idle_ms);
+
+        int64_t now = esp_timer_get_time();
+        taskENTER_CRITICAL(&s_stats_lock);
+        atomic_store(&s_idle, false);
+        s_stats.wakeups++;
+        s_stats.idle_us += now - s_idle_since_us;
+        taskEXIT_CRITICAL(&s_stats_lock);
+        ESP_LOGI(TAG, "Active (switched in %" PRIu32 " us)", (uint32_t)(now - start));
+    }
+    xSemaphoreGive(s_transition_lock);
+}
+
+void power_note_activity(void)
+{
+    atomic_store(&s_last_activity_us, esp_timer_get_time());
+    if (atomic_load(&s_idle)) {
+        wake();
+    }
+}
+
+void power_hold(void)
+{
+    atomic_fetch_add(&s_holds, 1);
+    power_note_activity();
+}
+
+void power_release(void)
+{
+    atomic_fetch_sub(&s_holds, 1);
+    power_note_activity(); // The quiet period starts when the last hold goes
+}
+
+esp_err_t power_init(const power_config_t *config)
+{
+    s_config = *config;
+    atomic_store(&s_last_activity_us, esp_timer_get_time());
+
+    s_transition_lock = xSemaphoreCreateMutex();
+    if (!s_transition_lock) {
+        ESP_LOGE(TAG, "Failed to create power mutex!");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // DFS and light sleep need CONFIG_PM_ENABLE (and tickless idle for light sleep)
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = config->max_freq_mhz,
+        .min_freq_mhz = config->min_freq_mhz,
+        .light_sleep_enable = config->light_sleep,
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err == ESP_OK) {
+        err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "active", &s_active_lock);
+    }
+    if (err == ESP_OK) {
+        esp_pm_lock_acquire(s_active_lock);
+    } else {
+        ESP_LOGW(TAG, "Error (%s) configuring power management, idle mode will only use modem sleep",
+                 esp_err_to_name(err));
+        s_active_lock = NULL;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = idle_timer_cb,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "power_idle",
+        .skip_unhandled_events = true,
+    };
+    err = esp_timer_create(&timer_args, &s_idle_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) creating idle timer!", esp_err_to_name(err));
+        return err;
+    }
+    arm_idle_timer(s_config.idle_ms);
+    ESP_LOGI(TAG, "Power management ready (idle after %" PRIu32 " ms, %d-%d MHz, light sleep %s)", s_config.idle_ms,
+             config->min_freq_mhz, config->max_freq_mhz, config->light_sleep ? "on" : "off");
+    return ESP_OK;
+}
+
+void power_get_stats(power_stats_t *out)
+{
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    out->idle = atomic_load(&s_idle);
+    if (out->idle) {
+        out->idle_us += now - s_idle_since_us;
+    }
+    taskEXIT_CRITICAL(&s_stats_lock);
+    out->holds = atomic_load(&s_holds);
+}
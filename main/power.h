@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Beacon intervals the station may sleep through in modem sleep. Frames for
+// an idle device wait at the AP until it listens again, so this bounds the
+// wake latency of the first request: about POWER_LISTEN_INTERVAL x 102.4 ms.
+#define POWER_LISTEN_INTERVAL 3
+
+// Idle policy. While active the CPU runs at max_freq_mhz and Wi-Fi power save
+// is off, so requests are served at full speed. After idle_ms without HTTP
+// requests or motion (and with the servo released) the device drops to
+// modem sleep, lets DFS lower the clock and, if enabled, light-sleeps
+// between Wi-Fi beacons and timer alarms.
+typedef struct {
+    uint32_t idle_ms;  // Quiet time before going idle
+    int max_freq_mhz;  // CPU clock while active
+    int min_freq_mhz;  // Lowest clock DFS may pick while idle
+    bool light_sleep;  // Automatic light sleep while idle
+} power_config_t;
+
+#define POWER_DEFAULT_CONFIG() {  \
+        .idle_ms      = 30000,    \
+        .max_freq_mhz = 160,      \
+        .min_freq_mhz = 40,       \
+        .light_sleep  = true,     \
+}
+
+typedef struct {
+    bool idle;             // Currently in the low-power mode
+    int holds;             // power_hold() calls not yet released
+    uint32_t idle_entries; // Transitions to idle
+    uint32_t wakeups;      // Transitions back to active
+    uint64_t idle_us;      // Time spent idle since boot
+} power_stats_t;
+
+// Configures power management and starts in the active mode. Call before
+// motion_init(). Without CONFIG_PM_ENABLE only the Wi-Fi part is managed.
+esp_err_t power_init(const power_config_t *config);
+
+// Marks activity (e.g. an HTTP request): wakes the device if it is idle and
+// restarts the idle countdown. Cheap while active.
+void power_note_activity(void);
+
+// Keeps the device active until the matching power_release(), e.g. while the
+// servo is driven (LEDC needs the APB clock and no light sleep).
+void power_hold(void);
+void power_release(void);
+
+void power_get_stats(power_stats_t *out);
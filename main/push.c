@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "json_writer.h"
+#include "push.h"
+
+static const char *TAG = "ASHUMITRA_PUSH";
+
+// One subscriber and its bounded send queue
+typedef struct {
+    int fd;                 // -1 when the entry is free
+    uint8_t head;           // Next message to send
+    uint8_t count;          // Messages waiting
+    bool overflowed;        // Messages were dropped; send a resync first
+    char msgs[PUSH_QUEUE_DEPTH][PUSH_MSG_MAX];
+} push_client_t;
+
+static httpd_handle_t s_server = NULL;
+static SemaphoreHandle_t s_push_lock = NULL;
+static push_client_t s_clients[PUSH_MAX_SUBSCRIBERS];
+static bool s_flush_pending = false;
+
+static const char *RESYNC_MSG = "{\"t\":\"resync\"}";
+
+// --- Subscriber Table ---
+static void remove_client_locked(int fd)
+{
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+        if (s_clients[i].fd == fd) {
+            s_clients[i].fd = -1;
+            s_clients[i].count = 0;
+            ESP_LOGI(TAG, "Subscriber on socket %d removed", fd);
+        }
+    }
+}
+
+static bool add_client(int fd)
+{
+    bool added = false;
+    xSemaphoreTake(s_push_lock, portMAX_DELAY);
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS && !added; i++) {
+        if (s_clients[i].fd == fd) {
+            added = true; // Already subscribed
+        }
+    }
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS && !added; i++) {
+        if (s_clients[i].fd < 0) {
+            s_clients[i].fd = fd;
+            s_clients[i].head = 0;
+            s_clients[i].count = 0;
+            s_clients[i].overflowed = false;
+            added = true;
+        }
+    }
+    xSemaphoreGive(s_push_lock);
+    return added;
+}
+
+// --- Sending ---
+static esp_err_t send_text(int fd, const char *msg)
+{
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .fragmented = false,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)msg,
+        .len = strlen(msg),
+    };
+    return httpd_ws_send_frame_async(s_server, fd, &frame);
+}
+
+// Runs on the httpd task (via httpd_queue_work) and drains every client queue
+static void push_flush_work(void *arg)
+{
+    char msg[PUSH_MSG_MAX];
+
+    xSemaphoreTake(s_push_lock, portMAX_DELAY);
+    s_flush_pending = false;
+    xSemaphoreGive(s_push_lock);
+
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+        for (;;) {
+            // Pop one message under the lock, send it without holding the lock
+            xSemaphoreTake(s_push_lock, portMAX_DELAY);
+            push_client_t *client = &s_clients[i];
+            int fd = client->fd;
+            bool have_msg = false;
+            if (fd >= 0 && client->overflowed) {
+                strcpy(msg, RESYNC_MSG);
+                client->overflowed = false;
+                have_msg = true;
+            } else if (fd >= 0 && client->count > 0) {
+                memcpy(msg, client->msgs[client->head], sizeof(msg));
+                client->head = (client->head + 1) % PUSH_QUEUE_DEPTH;
+                client->count--;
+                have_msg = true;
+            }
+            xSemaphoreGive(s_push_lock);
+
+            if (!have_msg) break;
+
+            if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET || send_text(fd, msg) != ESP_OK) {
+                ESP_LOGW(TAG, "Send to socket %d failed, dropping subscriber", fd);
+                xSemaphoreTake(s_push_lock, portMAX_DELAY);
+                remove_client_locked(fd);
+                xSemaphoreGive(s_push_lock);
+                break;
+            }
+        }
+    }
+}
+
+// Queues a message for every subscriber and schedules one flush on the httpd task
+static void push_broadcast(const char *msg)
+{
+    bool schedule = false;
+
+    if (!s_push_lock || !s_server) return;
+
+    xSemaphoreTake(s_push_lock, portMAX_DELAY);
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+        push_client_t *client = &s_clients[i];
+        if (client->fd < 0) continue;
+
+        if (client->count == PUSH_QUEUE_DEPTH) {
+            // Slow client: drop the oldest message, it will be told to resync
+            client->head = (client->head + 1) % PUSH_QUEUE_DEPTH;
+            client->count--;
+            client->overflowed = true;
+        }
+        int tail = (client->head + client->count) % PUSH_QUEUE_DEPTH;
+        snprintf(client->msgs[tail], PUSH_MSG_MAX, "%s", msg);
+        client->count++;
+        schedule = true;
+    }
+    if (schedule && !s_flush_pending) {
+        s_flush_pending = true;
+    } else {
+        schedule = false;
+    }
+    xSemaphoreGive(s_push_lock);
+
+    if (schedule && httpd_queue_work(s_server, push_flush_work, NULL) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to queue push flush");
+        xSemaphoreTake(s_push_lock, portMAX_DELAY);
+        s_flush_pending = false;
+        xSemaphoreGive(s_push_lock);
+    }
+}
+
+// Job update with every field at its longest
+#define PUSH_LONGEST_JOB_MSG "{\"t\":\"job\",\"id\":4294967295,\"op\":\"dispense_sweep\",\"tray\":3,\"slot\":31," \
+                             "\"st\":\"failed\",\"fault\":\"unknown\",\"done\":32,\"stops\":32}"
+_Static_assert(sizeof(PUSH_LONGEST_JOB_MSG) <= PUSH_MSG_MAX, "PUSH_MSG_MAX too small for a job update");
+
+// Broadcasts a message built with json_writer; one that did not fit
+// PUSH_MSG_MAX is dropped rather than sent truncated
+static void push_send_event(json_writer_t *w)
+{
+    if (json_writer_finish(w) != ESP_OK) {
+        ESP_LOGW(TAG, "Event does not fit %d bytes, not sent", PUSH_MSG_MAX);
+        return;
+    }
+    push_broadcast(w->buf);
+}
+
+// --- Public API ---
+esp_err_t push_init(httpd_handle_t server)
+{
+    if (!s_push_lock) {
+        s_push_lock = xSemaphoreCreateMutex();
+        if (!s_push_lock) {
+            ESP_LOGE(TAG, "Failed to create push mutex!");
+            return ESP_ERR_NO_MEM;
+        }
+        for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+            s_clients[i].fd = -1;
+        }
+    }
+    s_server = server;
+    return ESP_OK;
+}
+
+esp_err_t push_ws_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET) {
+        // Handshake done: register the socket as a subscriber
+        int fd = httpd_req_to_sockfd(req);
+        if (!add_client(fd)) {
+            ESP_LOGW(TAG, "Subscriber limit (%d) reached, rejecting socket %d", PUSH_MAX_SUBSCRIBERS, fd);
+            return ESP_FAIL; // Closes the connection
+        }
+        ESP_LOGI(TAG, "Subscriber on socket %d added (%d active)", fd, push_subscriber_count());
+        return ESP_OK;
+    }
+
+    // The channel is server-to-client only; read and discard client frames
+    uint8_t buf[32];
+    httpd_ws_frame_t frame = { .payload = NULL };
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) return err;
+    if (frame.len > 0 && frame.len <= sizeof(buf)) {
+        frame.payload = buf;
+        err = httpd_ws_recv_frame(req, &frame, frame.len);
+    } else if (frame.len > sizeof(buf)) {
+        return ESP_FAIL; // Nothing legitimate is that large
+    }
+    return err;
+}
+
+void push_on_close(httpd_handle_t hd, int sockfd)
+{
+    if (s_push_lock) {
+        xSemaphoreTake(s_push_lock, portMAX_DELAY);
+        remove_client_locked(sockfd);
+        xSemaphoreGive(s_push_lock);
+    }
+    close(sockfd); // A custom close_fn must close the socket itself
+}
+
+void push_slots_changed(uint32_t generation, uint32_t mask, uint32_t added, uint32_t removed)
+{
+    char msg[PUSH_MSG_MAX];
+    json_writer_t w;
+    json_writer_init(&w, msg, sizeof(msg), NULL, NULL);
+    json_obj_begin(&w);
+    json_kv_str(&w, "t", "slots");
+    json_kv_uint(&w, "gen", generation);
+    json_kv_uint(&w, "mask", mask);
+    json_kv_uint(&w, "add", added);
+    json_kv_uint(&w, "rem", removed);
+    json_obj_end(&w);
+    push_send_event(&w);
+}
+
+void push_job_update(const motion_job_info_t *job)
+{
+    char msg[PUSH_MSG_MAX];
+    json_writer_t w;
+    json_writer_init(&w, msg, sizeof(msg), NULL, NULL);
+    json_obj_begin(&w);
+    json_kv_str(&w, "t", "job");
+    json_kv_uint(&w, "id", job->id);
+    json_kv_str(&w, "op", motion_op_name(job->op));
+    json_kv_int(&w, "tray", job->tray);
+    json_kv_int(&w, "slot", job->slot);
+    json_kv_str(&w, "st", motion_state_name(job->state));
+    if (job->state == MOTION_JOB_FAILED) json_kv_str(&w, "fault", motion_fault_name(job->fault));
+    json_kv_int(&w, "done", job->stops_done);
+    json_kv_int(&w, "stops", job->stops);
+    json_obj_end(&w);
+    push_send_event(&w);
+
+    // One event per pill, as soon as the stop's drop wait is over
+    if ((job->op == MOTION_OP_DISPENSE || job->op == MOTION_OP_DISPENSE_SWEEP) &&
+        job->state == MOTION_JOB_MOVING && job->arrived) {
+        json_writer_init(&w, msg, sizeof(msg), NULL, NULL);
+        json_obj_begin(&w);
+        json_kv_str(&w, "t", "dispensed");
+        json_kv_uint(&w, "id", job->id);
+        json_kv_int(&w, "slot", job->slot);
+        json_obj_end(&w);
+        push_send_event(&w);
+    }
+}
+
+int push_subscriber_count(void)
+{
+    int count = 0;
+    if (!s_push_lock) return 0;
+    xSemaphoreTake(s_push_lock, portMAX_DELAY);
+    for (int i = 0; i < PUSH_MAX_SUBSCRIBERS; i++) {
+        if (s_clients[i].fd >= 0) count++;
+    }
+    xSemaphoreGive(s_push_lock);
+    return count;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "motion.h"
+
+// Maximum number of concurrent WebSocket subscribers. Each one holds an
+// httpd socket, so keep this well below max_open_sockets.
+#define PUSH_MAX_SUBSCRIBERS 4
+// Messages buffered per subscriber before the oldest is dropped and the
+// client is told to resync
+#define PUSH_QUEUE_DEPTH     8
+// Largest single message, including the terminating NUL. The longest is a
+// failed sweep's job update, 121 characters (see PUSH_LONGEST_JOB_MSG in
+// push.c); the rest leaves room for longer names.
+#define PUSH_MSG_MAX         160
+
+// Remembers the server handle used for queueing sends on the httpd task.
+esp_err_t push_init(httpd_handle_t server);
+
+// WebSocket handler for /ws (register with is_websocket = true)
+esp_err_t push_ws_handler(httpd_req_t *req);
+
+// httpd close_fn: drops the subscriber (if any) and closes the socket
+void push_on_close(httpd_handle_t hd, int sockfd);
+
+// Broadcasts a slot-state delta: the new generation and full mask, plus the
+// bits that were set and cleared by this change.
+void push_slots_changed(uint32_t generation, uint32_t mask, uint32_t added, uint32_t removed);
+
+// Broadcasts motion job progress; every completed dispense stop also
+// produces a "dispensed" event. Safe to call from any task.
+void push_job_update(const motion_job_info_t *job);
+
+// Number of currently connected subscribers
+int push_subscriber_count(void);
@@ -0,0 +1,141 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "slot_state.h"
+#include "tray.h"
+
+static const char *TAG = "ASHUMITRA_SLOTS";
+
+// The published snapshot is guarded by a sequence counter (seqlock): odd while
+// a publish is in progress, even otherwise. Readers copy the snapshot and
+// retry if the counter moved, so they never wait on a lock. The publish runs
+// in a critical section, so a reader on the same core can never observe it
+// half done and a reader on the other core spins for at most a few
+// microseconds.
+static slot_snapshot_t s_published;
+static atomic_uint_fast32_t s_seq = 0;
+static portMUX_TYPE s_publish_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Serializes writers (read-modify-write of the slots), never held across flash I/O
+static SemaphoreHandle_t s_writer_lock = NULL;
+
+static atomic_uint_fast32_t s_reads = 0;
+static atomic_uint_fast32_t s_read_retries = 0;
+static atomic_uint_fast32_t s_writes = 0;
+
+static void publish(const slot_snapshot_t *snap)
+{
+    volatile uint8_t *dst = (volatile uint8_t *)&s_published;
+    const uint8_t *src = (const uint8_t *)snap;
+
+    taskENTER_CRITICAL(&s_publish_lock);
+    atomic_fetch_add_explicit(&s_seq, 1, memory_order_relaxed); // Odd: publish in progress
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < sizeof(s_published); i++) {
+        dst[i] = src[i];
+    }
+    atomic_fetch_add_explicit(&s_seq, 1, memory_order_release); // Even: stable again
+    taskEXIT_CRITICAL(&s_publish_lock);
+}
+
+esp_err_t slot_state_init(const uint8_t *initial)
+{
+    slot_snapshot_t snap;
+
+    if (!s_writer_lock) {
+        s_writer_lock = xSemaphoreCreateMutex();
+        if (!s_writer_lock) {
+            ESP_LOGE(TAG, "Failed to create slot writer mutex!");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    memcpy(snap.filled, initial, sizeof(snap.filled));
+    snap.generation = 1;
+    publish(&snap);
+    return ESP_OK;
+}
+
+void slot_state_read(slot_snapshot_t *out)
+{
+    const volatile uint8_t *src = (const volatile uint8_t *)&s_published;
+    uint8_t *dst = (uint8_t *)out;
+
+    for (;;) {
+        uint_fast32_t seq = atomic_load_explicit(&s_seq, memory_order_acquire);
+        if ((seq & 1) == 0) {
+            for (size_t i = 0; i < sizeof(*out); i++) {
+                dst[i] = src[i];
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&s_seq, memory_order_relaxed) == seq) {
+                break;
+            }
+        }
+        atomic_fetch_add_explicit(&s_read_retries, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&s_reads, 1, memory_order_relaxed);
+}
+
+uint32_t slot_state_generation(void)
+{
+    slot_snapshot_t snap;
+    slot_state_read(&snap);
+    return snap.generation;
+}
+
+bool slot_state_is_filled(int slot)
+{
+    slot_snapshot_t snap;
+    if (slot < 0 || slot >= tray_slot_count()) return false;
+    slot_state_read(&snap);
+    return snap.filled[slot] == 1;
+}
+
+uint32_t slot_snapshot_mask(const slot_snapshot_t *snap)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        if (snap->filled[i] == 1) mask |= 1UL << i;
+    }
+    return mask;
+}
+
+void slot_state_write_begin(slot_snapshot_t *work)
+{
+    // Writers hold this for microseconds, so waiting forever is safe
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(s_writer_lock, portMAX_DELAY);
+    metrics_hist_observe(&metrics_writer_lock_wait, (uint32_t)(esp_timer_get_time() - start));
+    slot_state_read(work);
+}
+
+bool slot_state_write_end(slot_snapshot_t *work, bool commit)
+{
+    slot_snapshot_t current;
+    bool published = false;
+
+    slot_state_read(&current);
+    if (commit && memcmp(current.filled, work->filled, sizeof(current.filled)) != 0) {
+        work->generation = current.generation + 1;
+        publish(work);
+        atomic_fetch_add_explicit(&s_writes, 1, memory_order_relaxed);
+        published = true;
+    } else {
+        memcpy(work, &current, sizeof(*work)); // Report what is actually published
+    }
+    xSemaphoreGive(s_writer_lock);
+    return published;
+}
+
+void slot_state_get_stats(slot_state_stats_t *out)
+{
+    out->reads = atomic_load_explicit(&s_reads, memory_order_relaxed);
+    out->read_retries = atomic_load_explicit(&s_read_retries, memory_order_relaxed);
+    out->writes = atomic_load_explicit(&s_writes, memory_order_relaxed);
+}
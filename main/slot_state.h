@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "ashumitra.h"
+
+// One consistent view of the pill slots
+typedef struct {
+    uint8_t filled[MAX_SLOTS]; // 0 = empty, 1 = filled; only the first tray_slot_count() are used
+    uint32_t generation;       // Bumped on every published change
+} slot_snapshot_t;
+
+typedef struct {
+    uint32_t reads;        // Snapshots taken by readers
+    uint32_t read_retries; // Reads that overlapped a publish and were repeated
+    uint32_t writes;       // Published changes
+} slot_state_stats_t;
+
+// Publishes the initial state (generation 1, `initial` holds MAX_SLOTS
+// entries) and creates the writer lock.
+esp_err_t slot_state_init(const uint8_t *initial);
+
+// Copies the current snapshot. Lock-free: never blocks and never fails, at
+// worst it retries while a publish is in progress on the other core.
+void slot_state_read(slot_snapshot_t *out);
+
+// Current generation only, for cheap ETag checks
+uint32_t slot_state_generation(void);
+
+bool slot_state_is_filled(int slot);
+
+// Packs a snapshot into a bitmask, bit i set when slot i is filled
+uint32_t slot_snapshot_mask(const slot_snapshot_t *snap);
+
+// Writers: slot_state_write_begin() takes the writer lock and fills `work`
+// with the current state; slot_state_write_end() publishes it (when `commit`
+// is set and something changed), sets work->generation and releases the
+// lock. Returns true when a new generation was published. The lock is only
+// held between the two calls, never across flash I/O.
+void slot_state_write_begin(slot_snapshot_t *work);
+bool slot_state_write_end(slot_snapshot_t *work, bool commit);
+
+void slot_state_get_stats(slot_state_stats_t *out);
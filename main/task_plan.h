@@ -0,0 +1,54 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+// Core and priority of every task the firmware starts, in one place. Each
+// value can be changed in menuconfig ("Ashumitra task placement", see
+// Kconfig.projbuild); the defaults below apply where there is no sdkconfig
+// (the host simulator).
+//
+// On a dual-core ESP32 the Wi-Fi driver, lwIP, the event loop and the MQTT
+// client stay on core 0 (sdkconfig.defaults). The firmware's own tasks run
+// on core 1, so request bursts and flash commits never compete with the
+// radio, and the radio's interrupts never delay a servo step.
+//
+// Priorities on core 1, highest first:
+//   motion (one task per tray)  steps the servo ramp every 20 ms; above httpd
+//                               so a burst of requests cannot make it late
+//   httpd                       request handling
+//   persist, history, mqtt      write-behind flash commits and MQTT
+//                               publishing; never urgent
+//
+// A core of -1 leaves the task unpinned. On single-core chips every task is
+// created unpinned whatever the setting.
+
+#ifndef CONFIG_ASHUMITRA_MOTION_CORE
+#define CONFIG_ASHUMITRA_MOTION_CORE 1
+#endif
+#ifndef CONFIG_ASHUMITRA_MOTION_PRIO
+#define CONFIG_ASHUMITRA_MOTION_PRIO 7
+#endif
+#ifndef CONFIG_ASHUMITRA_HTTPD_CORE
+#define CONFIG_ASHUMITRA_HTTPD_CORE 1
+#endif
+#ifndef CONFIG_ASHUMITRA_HTTPD_PRIO
+#define CONFIG_ASHUMITRA_HTTPD_PRIO 5
+#endif
+#ifndef CONFIG_ASHUMITRA_STORAGE_CORE
+#define CONFIG_ASHUMITRA_STORAGE_CORE 1
+#endif
+#ifndef CONFIG_ASHUMITRA_STORAGE_PRIO
+#define CONFIG_ASHUMITRA_STORAGE_PRIO 3
+#endif
+
+// Core argument for xTaskCreatePinnedToCore()
+#define TASK_PLAN_CORE(core) \
+    (((core) < 0 || (core) >= portNUM_PROCESSORS) ? tskNO_AFFINITY : (BaseType_t)(core))
+
+#define TASK_PLAN_MOTION_CORE   TASK_PLAN_CORE(CONFIG_ASHUMITRA_MOTION_CORE)
+#define TASK_PLAN_MOTION_PRIO   CONFIG_ASHUMITRA_MOTION_PRIO
+#define TASK_PLAN_HTTPD_CORE    TASK_PLAN_CORE(CONFIG_ASHUMITRA_HTTPD_CORE)
+#define TASK_PLAN_HTTPD_PRIO    CONFIG_ASHUMITRA_HTTPD_PRIO
+// Persistence, history and the MQTT bridge
+#define TASK_PLAN_STORAGE_CORE  TASK_PLAN_CORE(CONFIG_ASHUMITRA_STORAGE_CORE)
+#define TASK_PLAN_STORAGE_PRIO  CONFIG_ASHUMITRA_STORAGE_PRIO
@@ -0,0 +1,110 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "trace.h"
+
+static const char *TAG = "ASHUMITRA_TRACE";
+
+static trace_event_t s_ring[TRACE_RING_LEN];
+static uint32_t s_next_seq = 0;   // Sequence number of the next event; slot is seq % TRACE_RING_LEN
+static atomic_bool s_active = false;
+static portMUX_TYPE s_trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void trace_start(void)
+{
+    taskENTER_CRITICAL(&s_trace_lock);
+    s_next_seq = 0;
+    taskEXIT_CRITICAL(&s_trace_lock);
+    atomic_store(&s_active, true);
+    ESP_LOGI(TAG, "Capture started (%d events)", TRACE_RING_LEN);
+}
+
+void trace_stop(void)
+{
+    atomic_store(&s_active, false);
+    ESP_LOGI(TAG, "Capture stopped");
+}
+
+void trace_get_status(trace_status_t *out)
+{
+    taskENTER_CRITICAL(&s_trace_lock);
+    out->active = atomic_load(&s_active);
+    out->recorded = s_next_seq;
+    out->next_seq = s_next_seq;
+    out->first_seq = s_next_seq > TRACE_RING_LEN ? s_next_seq - TRACE_RING_LEN : 0;
+    taskEXIT_CRITICAL(&s_trace_lock);
+}
+
+bool trace_get(uint32_t seq, trace_event_t *out)
+{
+    bool found = false;
+
+    taskENTER_CRITICAL(&s_trace_lock);
+    if (seq < s_next_seq && s_next_seq - seq <= TRACE_RING_LEN) {
+        *out = s_ring[seq % TRACE_RING_LEN];
+        found = true;
+    }
+    taskEXIT_CRITICAL(&s_trace_lock);
+    return found;
+}
+
+// Every recording function tests this before doing anything else, the clock
+// read included, so that while no capture runs a hook costs this one load
+static bool trace_active(void)
+{
+    return atomic_load_explicit(&s_active, memory_order_relaxed);
+}
+
+void trace_record_at(trace_type_t type, const char *name, uint32_t t_us, uint32_t value)
+{
+    if (!trace_active()) return;
+    if (!name) name = pcTaskGetName(NULL);
+
+    taskENTER_CRITICAL(&s_trace_lock);
+    s_ring[s_next_seq % TRACE_RING_LEN] = (trace_event_t) {
+        .t_us = t_us,
+        .value = value,
+        .name = name,
+        .type = type,
+        .core = (uint8_t)xPortGetCoreID(),
+    };
+    s_next_seq++;
+    taskEXIT_CRITICAL(&s_trace_lock);
+}
+
+void trace_record(trace_type_t type, const char *name, uint32_t value)
+{
+    if (!trace_active()) return;
+    trace_record_at(type, name, (uint32_t)esp_timer_get_time(), value);
+}
+
+uint32_t trace_task_wait(void)
+{
+    if (!trace_active()) return 0;
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+    trace_record_at(TRACE_TASK_WAIT, NULL, now_us, 0);
+    return now_us;
+}
+
+void trace_task_run(uint32_t wait_started_us)
+{
+    if (!trace_active()) return;
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+    // 0: the capture started during the wait, whose length is unknown
+    trace_record_at(TRACE_TASK_RUN, NULL, now_us, wait_started_us ? now_us - wait_started_us : 0);
+}
+
+const char *trace_type_name(trace_type_t type)
+{
+    switch (type) {
+        case TRACE_TASK_WAIT:  return "wait";
+        case TRACE_TASK_RUN:   return "run";
+        case TRACE_HANDLER:    return "handler";
+        case TRACE_SERVO_STEP: return "servo_step";
+        case TRACE_TYPE_COUNT: break;
+    }
+    return "unknown";
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+// Trace capture: a RAM ring buffer of timestamped scheduling and timing
+// events, started and dumped over HTTP (/trace). While no capture runs,
+// recording is a single flag test, so the call sites stay in release builds.
+//
+// The firmware's tasks record when they block and when they wake with work,
+// which is where they hand the core over; httpd records each handler run,
+// and the motion tasks record how late every servo ramp step was.
+
+#ifndef CONFIG_ASHUMITRA_TRACE_EVENTS
+#define CONFIG_ASHUMITRA_TRACE_EVENTS 512
+#endif
+#define TRACE_RING_LEN CONFIG_ASHUMITRA_TRACE_EVENTS
+
+typedef enum {
+    TRACE_TASK_WAIT = 0, // Task blocks waiting for work
+    TRACE_TASK_RUN,      // Task woke with work; value: microseconds it was blocked
+    TRACE_HANDLER,       // HTTP handler; name: URI, value: run time in microseconds
+    TRACE_SERVO_STEP,    // Servo ramp step; value: microseconds behind schedule
+    TRACE_TYPE_COUNT,
+} trace_type_t;
+
+typedef struct {
+    uint32_t t_us;       // esp_timer time, wraps after ~71 minutes
+    uint32_t value;
+    const char *name;    // Task name or URI; points at storage that outlives the capture
+    uint8_t type;        // trace_type_t
+    uint8_t core;        // Core the event was recorded on
+} trace_event_t;
+
+typedef struct {
+    bool active;
+    uint32_t recorded;   // Events since the capture started, including overwritten ones
+    uint32_t first_seq;  // Oldest event still in the ring
+    uint32_t next_seq;   // One past the newest event
+} trace_status_t;
+
+// Clears the ring and starts recording / stops recording (the ring is kept for dumping)
+void trace_start(void);
+void trace_stop(void);
+
+void trace_get_status(trace_status_t *out);
+
+// Copies the event with sequence number `seq`. False if it was overwritten or not recorded yet.
+bool trace_get(uint32_t seq, trace_event_t *out);
+
+// Records an event now; name NULL means the current task's name
+void trace_record(trace_type_t type, const char *name, uint32_t value);
+// Records an event that started at `t_us`
+void trace_record_at(trace_type_t type, const char *name, uint32_t t_us, uint32_t value);
+
+// Bracket a task's blocking wait for work: pass what trace_task_wait()
+// returned to trace_task_run() once the wait ends with work. Without a
+// capture running, trace_task_wait() returns 0 without reading the clock.
+uint32_t trace_task_wait(void);
+void trace_task_run(uint32_t wait_started_us);
+
+const char *trace_type_name(trace_type_t type);
@@ -0,0 +1,181 @@
+#include <string.h>
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "nvs.h"
+#include "tray.h"
+
+#define NVS_NAMESPACE "pill_disp"
+#define NVS_KEY_LAYOUT "tray_layout"
+
+static const char *TAG = "ASHUMITRA_TRAY";
+
+// Stock unit: one carousel on GPIO 2, Monday dose 1 .. Saturday dose 1
+static const tray_layout_t s_default_layout = {
+    .count = 1,
+    .doses_per_day = 2,
+    .tray = {
+        { .gpio = 2, .slots = 11, .angle = { 0, 17, 34, 52, 69, 86, 103, 121, 138, 155, 172 } },
+    },
+};
+
+static tray_layout_t s_layout;
+// Flattened per-slot lookups, built once at boot
+static int s_slot_count = 0;
+static int8_t s_slot_tray[MAX_SLOTS];
+static uint8_t s_slot_angle[MAX_SLOTS];
+static uint8_t s_first_slot[TRAY_MAX_TRAYS];
+
+bool tray_gpio_usable(int gpio)
+{
+    // GPIO 6-11 are wired to the SPI flash; driving them crashes the chip
+    return GPIO_IS_VALID_OUTPUT_GPIO(gpio) && (gpio < 6 || gpio > 11);
+}
+
+static bool layout_valid(const tray_layout_t *layout)
+{
+    int total = 0;
+
+    if (layout->count < 1 || layout->count > TRAY_MAX_TRAYS) return false;
+    if (layout->doses_per_day < 1 || layout->doses_per_day > TRAY_MAX_DOSES_PER_DAY) return false;
+    for (int t = 0; t < layout->count; t++) {
+        const tray_config_t *tray = &layout->tray[t];
+        if (tray->slots < 1 || !tray_gpio_usable(tray->gpio)) return false;
+        for (int other = 0; other < t; other++) {
+            if (layout->tray[other].gpio == tray->gpio) return false;
+        }
+        for (int i = 0; i < tray->slots && i < MAX_SLOTS; i++) {
+            if (tray->angle[i] > 180) return false;
+        }
+        total += tray->slots;
+    }
+    // Slot sets travel as 32-bit masks (ETags, push events, /get_filled_doses?format=mask),
+    // and slots past one week would wrap onto the days of earlier slots (double doses)
+    return total <= MAX_SLOTS && total <= 7 * layout->doses_per_day;
+}
+
+static void build_tables(void)
+{
+    s_slot_count = 0;
+    for (int t = 0; t < s_layout.count; t++) {
+        s_first_slot[t] = s_slot_count;
+        for (int i = 0; i < s_layout.tray[t].slots; i++) {
+            s_slot_tray[s_slot_count] = t;
+            s_slot_angle[s_slot_count] = s_layout.tray[t].angle[i];
+            s_slot_count++;
+        }
+    }
+}
+
+esp_err_t tray_init(void)
+{
+    s_layout = s_default_layout;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err == ESP_OK) {
+        tray_layout_t saved;
+        size_t size = sizeof(saved);
+        err = nvs_get_blob(nvs_handle, NVS_KEY_LAYOUT, &saved, &size);
+        nvs_close(nvs_handle);
+        if (err == ESP_OK && size == sizeof(saved) && layout_valid(&saved)) {
+            s_layout = saved;
+        } else if (err == ESP_OK) {
+            ESP_LOGW(TAG, "Saved tray layout is invalid, using the stock carousel");
+        }
+    }
+    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "No saved tray layout, using the stock carousel");
+    }
+
+    build_tables();
+    for (int t = 0; t < s_layout.count; t++) {
+        ESP_LOGI(TAG, "Tray %d: %d slots (%d..%d) on GPIO %d", t, s_layout.tray[t].slots, s_first_slot[t],
+                 s_first_slot[t] + s_layout.tray[t].slots - 1, s_layout.tray[t].gpio);
+    }
+    ESP_LOGI(TAG, "%d slots, %d doses per day", s_slot_count, s_layout.doses_per_day);
+    return ESP_OK;
+}
+
+bool tray_use_stock_layout(void)
+{
+    if (memcmp(&s_layout, &s_default_layout, sizeof(s_layout)) == 0) return false;
+    ESP_LOGW(TAG, "Falling back to the stock carousel for this boot");
+    s_layout = s_default_layout;
+    build_tables();
+    return true;
+}
+
+const tray_layout_t *tray_layout(void)
+{
+    return &s_layout;
+}
+
+int tray_count(void)
+{
+    return s_layout.count;
+}
+
+int tray_slot_count(void)
+{
+    return s_slot_count;
+}
+
+int tray_doses_per_day(void)
+{
+    return s_layout.doses_per_day;
+}
+
+int tray_of_slot(int slot)
+{
+    return (slot >= 0 && slot < s_slot_count) ? s_slot_tray[slot] : -1;
+}
+
+int tray_first_slot(int tray)
+{
+    return (tray >= 0 && tray < s_layout.count) ? s_first_slot[tray] : -1;
+}
+
+int tray_slot_angle(int slot)
+{
+    return (slot >= 0 && slot < s_slot_count) ? s_slot_angle[slot] : 0;
+}
+
+esp_err_t tray_save_layout(tray_layout_t *layout)
+{
+    if (layout->count < 1 || layout->count > TRAY_MAX_TRAYS) return ESP_ERR_INVALID_ARG;
+
+    // Trays given without angles get evenly spaced slots
+    for (int t = 0; t < layout->count; t++) {
+        tray_config_t *tray = &layout->tray[t];
+        bool has_angles = false;
+        for (int i = 0; i < MAX_SLOTS; i++) {
+            if (tray->angle[i] != 0) has_angles = true;
+        }
+        if (!has_angles && tray->slots > 1 && tray->slots <= MAX_SLOTS) {
+            for (int i = 0; i < tray->slots; i++) {
+                tray->angle[i] = (uint8_t)((i * TRAY_DEFAULT_SPAN_DEG + (tray->slots - 1) / 2) / (tray->slots - 1));
+            }
+        }
+    }
+    for (int t = layout->count; t < TRAY_MAX_TRAYS; t++) {
+        memset(&layout->tray[t], 0, sizeof(layout->tray[t]));
+    }
+    if (!layout_valid(layout)) return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(err));
+        return err;
+    }
+    err = nvs_set_blob(nvs_handle, NVS_KEY_LAYOUT, layout, sizeof(*layout));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) saving tray layout!", esp_err_to_name(err));
+    }
+    nvs_close(nvs_handle);
+    return err;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "ashumitra.h"
+
+// Carousels (trays) driven by their own servo and LEDC channel
+#define TRAY_MAX_TRAYS 4
+// Most doses per day the day/dose labels and default dose times cover
+#define TRAY_MAX_DOSES_PER_DAY 4
+// Angle range the slots of a generated layout are spread over
+#define TRAY_DEFAULT_SPAN_DEG 172
+
+// One carousel: its servo pin and the angle of each of its slots
+typedef struct {
+    uint8_t gpio;
+    uint8_t slots;
+    uint8_t angle[MAX_SLOTS];
+} tray_config_t;
+
+// Unit layout, saved in NVS. Slots are numbered across trays in order (tray
+// 0 holds slots 0..n0-1, tray 1 the next n1, ...) and map to days and doses
+// by that number alone: slot s is dose s % doses_per_day + 1 on day
+// s / doses_per_day, Monday first. The stock unit is one 11-slot tray with
+// two doses a day (Monday dose 1 .. Saturday dose 1); 7 days x 4 doses is
+// one 28-slot tray, or two 14-slot trays. A layout holds at most one week,
+// 7 x doses_per_day slots.
+typedef struct {
+    uint8_t count;          // Trays in use
+    uint8_t doses_per_day;
+    tray_config_t tray[TRAY_MAX_TRAYS];
+} tray_layout_t;
+
+// Loads the layout from NVS, falling back to the stock single carousel.
+// Call after nvs_init() and before anything sized by the slot count.
+esp_err_t tray_init(void);
+
+// Switches to the stock carousel when the servos of the loaded layout could
+// not be set up. Call before anything sized by the slot count. Returns false
+// if the stock layout was in use already.
+bool tray_use_stock_layout(void);
+
+// True if a servo can be driven from this pin: an output-capable GPIO that is
+// not one of the SPI flash pins (6-11)
+bool tray_gpio_usable(int gpio);
+
+// The layout in effect since boot. It never changes while running, so the
+// accessors below are plain table lookups.
+const tray_layout_t *tray_layout(void);
+int tray_count(void);
+int tray_slot_count(void);       // Slots on all trays together
+int tray_doses_per_day(void);
+int tray_of_slot(int slot);      // -1 for an invalid slot
+int tray_first_slot(int tray);
+int tray_slot_angle(int slot);   // Servo angle of a slot on its own tray
+
+// Checks a layout and saves it for the next boot. A layout with no angles
+// for a tray (all zero) gets its slots spread over TRAY_DEFAULT_SPAN_DEG.
+esp_err_t tray_save_layout(tray_layout_t *layout);
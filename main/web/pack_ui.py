@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Minify and gzip the web UI into a C source file for embedding.
+
+Usage: pack_ui.py <index.html> <out.c> <out.h>
+
+The minifier is deliberately conservative: it only removes comments and
+indentation, and keeps line breaks inside <script> so automatic semicolon
+insertion behaves exactly as in the source page.
+"""
+
+import gzip
+import hashlib
+import re
+import sys
+
+
+def strip_js_line_comment(line):
+    quote = None
+    i = 0
+    while i < len(line):
+        c = line[i]
+        if quote:
+            if c == '\\':
+                i += 2
+                continue
+            if c == quote:
+                quote = None
+        elif c in '\'"`':
+            quote = c
+        elif c == '/' and line.startswith('//', i):
+            return line[:i].rstrip()
+        i += 1
+    return line
+
+
+def minify_js(js):
+    out = []
+    for line in js.splitlines():
+        line = strip_js_line_comment(line.strip())
+        if line:
+            out.append(line)
+    return '\n'.join(out)
+
+
+def minify_css(css):
+    css = re.sub(r'/\*.*?\*/', '', css, flags=re.S)
+    css = re.sub(r'\s+', ' ', css)
+    css = re.sub(r'\s*([{};])\s*', r'\1', css)
+    css = re.sub(r'([:,])\s+', r'\1', css)
+    return css.replace(';}', '}').strip()
+
+
+def minify_html(html):
+    parts = re.split(r'(<script>.*?</script>|<style>.*?</style>)', html, flags=re.S)
+    out = []
+    for part in parts:
+        if part.startswith('<script>'):
+            out.append('<script>' + minify_js(part[8:-9]) + '</script>')
+        elif part.startswith('<style>'):
+            out.append('<style>' + minify_css(part[7:-8]) + '</style>')
+        else:
+            part = re.sub(r'<!--.*?-->', '', part, flags=re.S)
+            lines = [l.strip() for l in part.splitlines()]
+            out.append('\n'.join(l for l in lines if l))
+    return ''.join(out)
+
+
+def main():
+    src, out_c, out_h = sys.argv[1:4]
+    with open(src, encoding='utf-8') as f:
+        html = f.read()
+
+    minified = minify_html(html).encode('utf-8')
+    # mtime=0 keeps the output (and therefore the ETag) reproducible
+    packed = gzip.compress(minified, compresslevel=9, mtime=0)
+    etag = '"ui-' + hashlib.sha256(packed).hexdigest()[:16] + '"'
+
+    with open(out_h, 'w') as f:
+        f.write('// Generated by pack_ui.py from %s. Do not edit.\n' % src.split('/')[-1])
+        f.write('#pragma once\n\n#include <stddef.h>\n#include <stdint.h>\n\n')
+        f.write('#define WEB_UI_ETAG "%s"\n\n' % etag.replace('"', '\\"'))
+        f.write('extern const uint8_t web_ui_gz[];\n')
+        f.write('extern const size_t web_ui_gz_len;\n')
+
+    with open(out_c, 'w') as f:
+        f.write('// Generated by pack_ui.py (%d bytes raw, %d minified, %d gzipped). Do not edit.\n'
+                % (len(html.encode('utf-8')), len(minified), len(packed)))
+        f.write('#include "web_ui.h"\n\nconst uint8_t web_ui_gz[] = {\n')
+        for i in range(0, len(packed), 16):
+            f.write('    ' + ', '.join('0x%02x' % b for b in packed[i:i + 16]) + ',\n')
+        f.write('};\n\nconst size_t web_ui_gz_len = sizeof(web_ui_gz);\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,261 @@
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "wifi_mgr.h"
+
+#define NVS_NAMESPACE "pill_disp"
+#define NVS_KEY_WIFI_CACHE "wifi_cache"
+
+static const char *TAG = "ASHUMITRA_WIFI";
+
+// Last good connection, as saved in NVS. It only applies to the SSID it was
+// made with, so changing the credentials starts over with a scan.
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info;
+} wifi_cache_t;
+
+static wifi_mgr_config_t s_config;
+static wifi_mgr_up_cb_t s_on_up = NULL;
+static esp_netif_t *s_netif = NULL;
+static esp_timer_handle_t s_retry_timer = NULL;
+
+// Connection state, only touched from the event task
+static wifi_cache_t s_cache;    // As saved in NVS
+static wifi_cache_t s_current;  // Filled in as the link comes up
+static bool s_pinned = false;    // Joining the cached BSSID on the cached channel
+static bool s_static_ip = false; // Using the cached address until the link is up, DHCP client stopped
+static bool s_link_up = false;   // Associated since the last attempt
+
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_mgr_stats_t s_stats;
+
+// Copies a string into a fixed-size field of the driver config, which needs
+// no terminator when full (a 32-character SSID)
+static void copy_field(uint8_t *dst, size_t size, const char *src)
+{
+    memset(dst, 0, size);
+    memcpy(dst, src, strnlen(src, size));
+}
+
+static bool load_cache(void)
+{
+    nvs_handle_t nvs_handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) return false;
+    size_t size = sizeof(s_cache);
+    esp_err_t err = nvs_get_blob(nvs_handle, NVS_KEY_WIFI_CACHE, &s_cache, &size);
+    nvs_close(nvs_handle);
+
+    if (err != ESP_OK || size != sizeof(s_cache) || s_cache.channel == 0 ||
+        strncmp((const char *)s_cache.ssid, s_config.ssid, sizeof(s_cache.ssid)) != 0) {
+        memset(&s_cache, 0, sizeof(s_cache));
+        return false;
+    }
+    return true;
+}
+
+static void save_cache(void)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs_handle, NVS_KEY_WIFI_CACHE, &s_current, sizeof(s_current));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+    if (err == ESP_OK) {
+        s_cache = s_current;
+        ESP_LOGI(TAG, "Cached AP %02x:%02x:%02x:%02x:%02x:%02x on channel %d", s_cache.bssid[0], s_cache.bssid[1],
+                 s_cache.bssid[2], s_cache.bssid[3], s_cache.bssid[4], s_cache.bssid[5], s_cache.channel);
+    } else {
+        ESP_LOGW(TAG, "Error (%s) saving the connection cache", esp_err_to_name(err));
+    }
+}
+
+static void wifi_connect(void)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.attempts++;
+    taskEXIT_CRITICAL(&s_stats_lock);
+
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Error (%s) starting a connection attempt", esp_err_to_name(err));
+    }
+}
+
+static void retry_timer_cb(void *arg)
+{
+    (void)arg;
+    wifi_connect();
+}
+
+static void schedule_retry(void)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    uint32_t base = s_stats.backoff_ms;
+    s_stats.backoff_ms = base >= WIFI_MGR_BACKOFF_MAX_MS / 2 ? WIFI_MGR_BACKOFF_MAX_MS : base * 2;
+    taskEXIT_CRITICAL(&s_stats_lock);
+
+    uint32_t delay_ms = base / 2 + esp_random() % (base / 2 + 1);
+    ESP_LOGI(TAG, "Reconnecting in %" PRIu32 " ms", delay_ms);
+    esp_timer_start_once(s_retry_timer, (uint64_t)delay_ms * 1000);
+}
+
+// Stops using the cached AP and address: scan all channels and ask DHCP
+static void unpin(void)
+{
+    wifi_config_t wifi_config;
+    esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+    wifi_config.sta.bssid_set = false;
+    wifi_config.sta.channel = 0;
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    s_pinned = false;
+
+    if (s_static_ip) {
+        esp_netif_dhcpc_start(s_netif);
+        s_static_ip = false;
+    }
+}
+
+static void event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        const wifi_event_sta_connected_t *event = event_data;
+        memcpy(s_current.bssid, event->bssid, sizeof(s_current.bssid));
+        s_current.channel = event->channel;
+        s_link_up = true;
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        const wifi_event_sta_disconnected_t *event = event_data;
+        bool was_up = s_link_up;
+        s_link_up = false;
+
+        taskENTER_CRITICAL(&s_stats_lock);
+        s_stats.connected = false;
+        s_stats.disconnects++;
+        taskEXIT_CRITICAL(&s_stats_lock);
+        ESP_LOGW(TAG, "%s (reason %d)", was_up ? "Link lost" : "Connection attempt failed", event ? event->reason : 0);
+
+        if (s_pinned && !was_up) {
+            // The AP moved, changed channel or is gone: scan right away
+            ESP_LOGW(TAG, "Cached AP not reachable, falling back to a full scan");
+            unpin();
+            wifi_connect();
+            return;
+        }
+        schedule_retry();
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        const ip_event_got_ip_t *event = event_data;
+        uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        s_current.ip_info = event->ip_info;
+
+        taskENTER_CRITICAL(&s_stats_lock);
+        s_stats.connected = true;
+        s_stats.fast_connect = s_pinned;
+        s_stats.connects++;
+        s_stats.backoff_ms = WIFI_MGR_BACKOFF_MIN_MS;
+        s_stats.ip = event->ip_info.ip;
+        bool first = s_stats.first_ip_ms == 0;
+        if (first) s_stats.first_ip_ms = now_ms;
+        taskEXIT_CRITICAL(&s_stats_lock);
+
+        ESP_LOGI(TAG, "Got IP " IPSTR " %s%s", IP2STR(&event->ip_info.ip),
+                 s_pinned ? "via the cached AP" : "after a scan", s_static_ip ? " (cached address)" : "");
+        if (first) {
+            ESP_LOGI(TAG, "Network up %" PRIu32 " ms after power-on", now_ms);
+        }
+        if (memcmp(&s_current, &s_cache, sizeof(s_current)) != 0) {
+            save_cache(); // Only when something changed, so reconnects do not wear the flash
+        }
+        if (s_static_ip) {
+            // The cached address has no lease behind it: start DHCP now that
+            // the link is up. It asks for the same address again
+            // (CONFIG_LWIP_DHCP_RESTORE_LAST_IP) and this event comes back
+            // once the server has granted it, or handed out another one.
+            s_static_ip = false;
+            esp_err_t err = esp_netif_dhcpc_start(s_netif);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Error (%s) starting DHCP after the cached address", esp_err_to_name(err));
+            }
+        }
+        if (s_on_up) {
+            s_on_up();
+        }
+    }
+}
+
+esp_err_t wifi_mgr_start(const wifi_mgr_config_t *config, wifi_mgr_up_cb_t on_up)
+{
+    s_config = *config;
+    s_on_up = on_up;
+    s_stats.backoff_ms = WIFI_MGR_BACKOFF_MIN_MS;
+    copy_field(s_current.ssid, sizeof(s_current.ssid), config->ssid);
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    s_netif = esp_netif_create_default_wifi_sta();
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL, NULL));
+
+    const esp_timer_create_args_t timer_args = { .callback = retry_timer_cb, .name = "wifi_retry" };
+    esp_err_t err = esp_timer_create(&timer_args, &s_retry_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error (%s) creating the reconnect timer", esp_err_to_name(err));
+        return err;
+    }
+
+    wifi_config_t wifi_config = {
+        .sta = {
+            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
+            .listen_interval = config->listen_interval,
+        },
+    };
+    copy_field(wifi_config.sta.ssid, sizeof(wifi_config.sta.ssid), config->ssid);
+    copy_field(wifi_config.sta.password, sizeof(wifi_config.sta.password), config->password);
+    if (load_cache()) {
+        // Join the known AP directly instead of scanning every channel
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, s_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = s_cache.channel;
+        s_pinned = true;
+        if (config->cache_ip && s_cache.ip_info.ip.addr != 0) {
+            esp_netif_dhcpc_stop(s_netif);
+            esp_netif_set_ip_info(s_netif, &s_cache.ip_info);
+            s_static_ip = true;
+        }
+        ESP_LOGI(TAG, "Connecting to \"%s\" via the cached AP on channel %d%s", config->ssid, s_cache.channel,
+                 s_static_ip ? " with the cached address" : "");
+    } else {
+        ESP_LOGI(TAG, "Connecting to \"%s\" (no cached AP, scanning)", config->ssid);
+    }
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    // Full power until power.c finds the device idle; the driver defaults to modem sleep
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+    return ESP_OK;
+}
+
+void wifi_mgr_get_stats(wifi_mgr_stats_t *out)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
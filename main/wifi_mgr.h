@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_netif.h"
+
+// Station connection manager. Nothing waits for the network: wifi_mgr_start()
+// returns as soon as the driver is started, and the manager keeps the link up
+// from the system event task for as long as the device runs.
+//
+// The AP's BSSID and channel and the address the station got are cached in
+// NVS. The next boot connects to that AP on that channel directly (no scan)
+// and, with cache_ip, starts on the cached address instead of waiting for
+// DHCP. DHCP is restarted as soon as the link is up, so the address is leased
+// and renewed like any other (or replaced, if the server hands out another).
+// If the cached AP cannot be joined, the manager falls back to a full scan
+// with DHCP.
+
+// Reconnect delay after a failed attempt or a dropped link: doubles from the
+// minimum up to the maximum and is jittered (half fixed, half random) so a
+// room full of units does not hammer a rebooting AP in lockstep
+#define WIFI_MGR_BACKOFF_MIN_MS 250
+#define WIFI_MGR_BACKOFF_MAX_MS 60000
+
+typedef struct {
+    const char *ssid;
+    const char *password;
+    uint16_t listen_interval; // Beacons slept through in modem sleep (see power.h)
+    bool cache_ip;            // Start on the cached address until DHCP confirms it
+} wifi_mgr_config_t;
+
+// Called from the event task every time the station gets an address
+typedef void (*wifi_mgr_up_cb_t)(void);
+
+typedef struct {
+    bool connected;          // Associated and holding an address
+    bool fast_connect;       // Current (or last) connection used the cached AP
+    uint32_t attempts;       // esp_wifi_connect() calls
+    uint32_t connects;       // Addresses obtained
+    uint32_t disconnects;    // Links lost or attempts failed
+    uint32_t backoff_ms;     // Base of the next reconnect delay
+    uint32_t first_ip_ms;    // Time from power-on to the first address, 0 until then
+    esp_ip4_addr_t ip;
+} wifi_mgr_stats_t;
+
+// Creates the default event loop and station interface, loads the cache and
+// starts connecting. Call after nvs_init(); returns without waiting.
+esp_err_t wifi_mgr_start(const wifi_mgr_config_t *config, wifi_mgr_up_cb_t on_up);
+
+void wifi_mgr_get_stats(wifi_mgr_stats_t *out);